@@ -27,6 +27,7 @@
 #import "iScrobbler.h"
 #import "AudioStream.h"
 #import "AudioMetadataWriter.h"
+#import "AudioMetadataBatchWriter.h"
 #import "PreferencesController.h"
 #import "AppleRemote.h"
 #import "IntegerToDoubleRoundingValueTransformer.h"
@@ -116,19 +117,7 @@
 	[[AudioLibrary library] showWindow:self];
 	
 	// Restore the play queue
-	if([[NSUserDefaults standardUserDefaults] boolForKey:@"rememberPlayQueue"]) {
-		NSArray				*objectIDs		= [[NSUserDefaults standardUserDefaults] arrayForKey:@"savedPlayQueueStreams"];
-		NSMutableArray		*streams		= [NSMutableArray array];
-		AudioStream			*stream			= nil;
-		
-		for(NSNumber *objectID in objectIDs) {
-			stream = [[[CollectionManager manager] streamManager] streamForID:objectID];
-			if(nil != stream)
-				[streams addObject:stream];
-		}
-		
-		[[AudioLibrary library] addStreamsToPlayQueue:streams];
-	}
+	[[AudioLibrary library] restorePlayQueue];
 }
 
 - (void) applicationDidFinishLaunching:(NSNotification *)aNotification
@@ -194,6 +183,24 @@
     
 	// Check for and send crash reports
 	[SFBCrashReporter checkForNewCrashes];
+	
+	// Offer to finish or undo tag writes that were cut short
+	AudioMetadataBatchWriter *batchWriter = [AudioMetadataBatchWriter sharedBatchWriter];
+	if([batchWriter hasInterruptedBatch]) {
+		NSAlert *alert = [[NSAlert alloc] init];
+		[alert addButtonWithTitle:NSLocalizedStringFromTable(@"Finish Saving", @"Library", @"")];
+		[alert addButtonWithTitle:NSLocalizedStringFromTable(@"Revert Files", @"Library", @"")];
+		[alert addButtonWithTitle:NSLocalizedStringFromTable(@"Leave As Is", @"Library", @"")];
+		[alert setMessageText:NSLocalizedStringFromTable(@"Saving metadata was interrupted", @"Library", @"")];
+		[alert setInformativeText:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Metadata for %lu files wasn't saved when %@ last quit. The metadata can be saved now, or the files that were changed can be reverted to their previous metadata.", @"Library", @""), (unsigned long)[batchWriter interruptedFileCount], [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleName"]]];
+		[alert setAlertStyle:NSWarningAlertStyle];
+		
+		switch([alert runModal]) {
+			case NSAlertFirstButtonReturn:		[batchWriter resumeInterruptedBatch];		break;
+			case NSAlertSecondButtonReturn:		[batchWriter rollBackInterruptedBatch];		break;
+			default:							[batchWriter discardInterruptedBatch];		break;
+		}
+	}
 }
 
 - (void) applicationWillTerminate:(NSNotification *)aNotification
@@ -216,14 +223,17 @@
 	[_remoteControl stopListening:aNotification];
 	_remoteControl = nil;
 	
-	// Save the play queue
-	if([[NSUserDefaults standardUserDefaults] boolForKey:@"rememberPlayQueue"]) {
-		NSArray *objectIDs = [[AudioLibrary library] valueForKeyPath:[NSString stringWithFormat:@"%@.%@", PlayQueueKey, ObjectIDKey]];
-		[[NSUserDefaults standardUserDefaults] setObject:objectIDs forKey:@"savedPlayQueueStreams"];
-	}
+	// Save the play queue and the position within it
+	[[AudioLibrary library] savePlayQueue];
 	
 	// Save player state
 	[[AudioLibrary library] saveStateToDefaults];
+	
+	// Finish the tag writes in progress and the edits waiting to be written; the rest are resumed on the next launch
+	[AudioMetadataWriter writePendingMetadataAndSuspend];
+	
+	// Write out the library if it is held in memory
+	[[CollectionManager manager] flushDatabaseToDisk];
 }
 
 - (BOOL) applicationShouldTerminateAfterLastWindowClosed:(NSApplication *)theApplication
@@ -0,0 +1,206 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "AudioPipelineTrace.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <mach/mach_time.h>
+
+// The ring holds the most recent events; older ones are overwritten
+#define TRACE_RING_CAPACITY		(1 << 15)
+#define TRACE_RING_MASK			(TRACE_RING_CAPACITY - 1)
+
+// Threads beyond the first few share the last counter slot
+#define TRACE_THREAD_SLOTS		16
+
+typedef struct {
+	_Atomic uint64_t	sequence;		// One more than the event's position in the trace, or 0 while it is being written
+	AudioTraceEvent		event;
+} TraceSlot;
+
+// Each slot fills a cache line, so threads don't contend
+typedef struct {
+	_Atomic uint64_t	values			[AudioTraceCounterCount];
+} __attribute__((aligned(64))) TraceCounters;
+
+static TraceSlot			sRing				[TRACE_RING_CAPACITY];
+static _Atomic uint64_t		sNextSequence		= 0;
+
+static TraceCounters		sCounters			[TRACE_THREAD_SLOTS];
+static _Atomic uint32_t		sThreadsSeen		= 0;
+static __thread int32_t		sThreadSlot			= -1;
+
+static uint16_t
+threadSlot(void)
+{
+	if(-1 == sThreadSlot) {
+		uint32_t slot = atomic_fetch_add_explicit(&sThreadsSeen, 1, memory_order_relaxed);
+		sThreadSlot = (int32_t)(TRACE_THREAD_SLOTS > slot ? slot : TRACE_THREAD_SLOTS - 1);
+	}
+	
+	return (uint16_t)sThreadSlot;
+}
+
+uint64_t
+audioTraceTimestamp(void)
+{
+	return mach_absolute_time();
+}
+
+void
+audioTraceRecordEvent(uint16_t type, int64_t value, uint32_t detail)
+{
+	// Take the timestamp before reserving a slot, so the order of slots follows the order of timestamps as closely as possible
+	uint64_t	timestamp	= mach_absolute_time();
+	uint64_t	sequence	= atomic_fetch_add_explicit(&sNextSequence, 1, memory_order_relaxed);
+	TraceSlot	*slot		= &sRing[sequence & TRACE_RING_MASK];
+	
+	// Readers skip a slot whose sequence doesn't match before and after they copy it
+	atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	
+	slot->event.timestamp	= timestamp;
+	slot->event.value		= value;
+	slot->event.detail		= detail;
+	slot->event.type		= type;
+	slot->event.thread		= threadSlot();
+	
+	atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_release);
+}
+
+void
+audioTraceIncrementCounter(unsigned counter, uint64_t amount)
+{
+	if(AudioTraceCounterCount <= counter)
+		return;
+	
+	atomic_fetch_add_explicit(&sCounters[threadSlot()].values[counter], amount, memory_order_relaxed);
+}
+
+void
+audioTraceSliceScheduled(uint32_t sliceIndex, uint32_t frameCount)
+{
+	audioTraceIncrementCounter(AudioTraceCounterSlicesScheduled, 1);
+	audioTraceRecordEvent(AudioTraceEventSliceScheduled, frameCount, sliceIndex);
+}
+
+void
+audioTraceSliceCompleted(uint32_t sliceIndex, uint32_t frameCount, bool renderedLate, int64_t sampleTime)
+{
+	audioTraceIncrementCounter(AudioTraceCounterSlicesCompleted, 1);
+	audioTraceRecordEvent(AudioTraceEventSliceCompleted, frameCount, sliceIndex);
+	
+	if(renderedLate) {
+		audioTraceIncrementCounter(AudioTraceCounterLateRenders, 1);
+		audioTraceRecordEvent(AudioTraceEventLateRender, sampleTime, sliceIndex);
+	}
+}
+
+void
+audioTraceDecoderRead(uint32_t frameCount, uint64_t ticks)
+{
+	audioTraceIncrementCounter(AudioTraceCounterFramesDecoded, frameCount);
+	audioTraceIncrementCounter(AudioTraceCounterDecoderTicks, ticks);
+	audioTraceRecordEvent(AudioTraceEventDecoderRead, (int64_t)ticks, frameCount);
+}
+
+uint64_t
+audioTraceCounterValue(unsigned counter)
+{
+	uint64_t value = 0;
+	
+	if(AudioTraceCounterCount <= counter)
+		return 0;
+	
+	for(unsigned i = 0; i < TRACE_THREAD_SLOTS; ++i)
+		value += atomic_load_explicit(&sCounters[i].values[counter], memory_order_relaxed);
+	
+	return value;
+}
+
+bool
+audioTraceWriteToFile(const char *path)
+{
+	AudioTraceFileHeader		header;
+	mach_timebase_info_data_t	timebase;
+	
+	if(NULL == path) {
+		errno = EINVAL;
+		return false;
+	}
+	
+	AudioTraceEvent *events = calloc(TRACE_RING_CAPACITY, sizeof(AudioTraceEvent));
+	if(NULL == events)
+		return false;
+	
+	uint64_t	end			= atomic_load_explicit(&sNextSequence, memory_order_acquire);
+	uint64_t	start		= (TRACE_RING_CAPACITY < end ? end - TRACE_RING_CAPACITY : 0);
+	uint64_t	count		= 0;
+	
+	// Events being written, or overwritten while copying, are left out
+	for(uint64_t sequence = start; sequence < end; ++sequence) {
+		TraceSlot *slot = &sRing[sequence & TRACE_RING_MASK];
+		
+		if(sequence + 1 != atomic_load_explicit(&slot->sequence, memory_order_acquire))
+			continue;
+		
+		AudioTraceEvent event = slot->event;
+		atomic_thread_fence(memory_order_acquire);
+		
+		if(sequence + 1 != atomic_load_explicit(&slot->sequence, memory_order_relaxed))
+			continue;
+		
+		events[count++] = event;
+	}
+	
+	mach_timebase_info(&timebase);
+	
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, AUDIO_TRACE_FILE_MAGIC, sizeof(header.magic));
+	
+	header.version			= AUDIO_TRACE_FILE_VERSION;
+	header.eventSize		= sizeof(AudioTraceEvent);
+	header.timebaseNumer	= timebase.numer;
+	header.timebaseDenom	= timebase.denom;
+	header.eventCount		= count;
+	header.eventsDropped	= end - count;
+	
+	for(unsigned i = 0; i < AudioTraceCounterCount; ++i)
+		header.counters[i] = audioTraceCounterValue(i);
+	
+	FILE *file = fopen(path, "wb");
+	if(NULL == file) {
+		free(events);
+		return false;
+	}
+	
+	bool success = (1 == fwrite(&header, sizeof(header), 1, file) && count == fwrite(events, sizeof(AudioTraceEvent), (size_t)count, file));
+	
+	if(0 != fclose(file))
+		success = false;
+	
+	free(events);
+	
+	return success;
+}
@@ -0,0 +1,122 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef AUDIO_PIPELINE_TRACE_H
+#define AUDIO_PIPELINE_TRACE_H
+
+// ========================================
+// Always-on instrumentation for the decode/schedule/render pipeline
+// Recording an event or bumping a counter is lock-free and doesn't allocate,
+// so it is safe on the scheduling thread and in AudioUnit callbacks
+// This header is plain C so offline tools can read the dump format
+// ========================================
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================
+// Events
+// ========================================
+enum {
+	AudioTraceEventSliceScheduled		= 1,		// value: frames, detail: slice index
+	AudioTraceEventSliceCompleted		= 2,		// value: frames, detail: slice index
+	AudioTraceEventLateRender			= 3,		// value: sample time, detail: slice index
+	AudioTraceEventDecoderRead			= 4,		// value: duration in host ticks, detail: frames read
+	AudioTraceEventRegionStarted		= 5,		// value: decoder frame, detail: 0
+	AudioTraceEventRegionFinished		= 6,		// value: frames scheduled, detail: 0
+	AudioTraceEventSeek					= 7,		// value: requested frame, detail: 0
+	AudioTraceEventCPULoad				= 8			// value: AUGraph load in parts per million, detail: 0
+};
+
+typedef struct {
+	uint64_t		timestamp;		// Host ticks (mach_absolute_time)
+	int64_t			value;
+	uint32_t		detail;
+	uint16_t		type;
+	uint16_t		thread;			// The recording thread's counter slot
+} AudioTraceEvent;
+
+// ========================================
+// Counters, kept per thread and summed when read
+// ========================================
+enum {
+	AudioTraceCounterSlicesScheduled	= 0,
+	AudioTraceCounterSlicesCompleted,
+	AudioTraceCounterLateRenders,
+	AudioTraceCounterFramesDecoded,
+	AudioTraceCounterDecoderTicks,
+	AudioTraceCounterRegionsStarted,
+	AudioTraceCounterRegionsFinished,
+	AudioTraceCounterSeeks,
+	
+	AudioTraceCounterCount
+};
+
+// ========================================
+// Dump file layout: an AudioTraceFileHeader followed by eventCount AudioTraceEvents, oldest first
+// All fields are in the byte order of the machine that wrote the file
+// ========================================
+#define AUDIO_TRACE_FILE_MAGIC			"PLAYTRC1"
+#define AUDIO_TRACE_FILE_VERSION		1
+
+typedef struct {
+	char			magic			[8];
+	uint32_t		version;
+	uint32_t		eventSize;			// sizeof(AudioTraceEvent)
+	uint32_t		timebaseNumer;		// Host ticks * numer / denom = nanoseconds
+	uint32_t		timebaseDenom;
+	uint64_t		eventCount;
+	uint64_t		eventsDropped;		// Events overwritten before the dump
+	uint64_t		counters		[AudioTraceCounterCount];
+} AudioTraceFileHeader;
+
+#ifndef AUDIO_TRACE_FORMAT_ONLY
+
+// ========================================
+// Recording
+// ========================================
+uint64_t	audioTraceTimestamp(void);
+void		audioTraceRecordEvent(uint16_t type, int64_t value, uint32_t detail);
+void		audioTraceIncrementCounter(unsigned counter, uint64_t amount);
+
+// Records the event and bumps its counter
+void		audioTraceSliceScheduled(uint32_t sliceIndex, uint32_t frameCount);
+void		audioTraceSliceCompleted(uint32_t sliceIndex, uint32_t frameCount, bool renderedLate, int64_t sampleTime);
+void		audioTraceDecoderRead(uint32_t frameCount, uint64_t ticks);
+
+// ========================================
+// Reading
+// ========================================
+uint64_t	audioTraceCounterValue(unsigned counter);
+
+// Writes the counters and the events still in the ring; returns false and sets errno on failure
+bool		audioTraceWriteToFile(const char *path);
+
+#endif /* AUDIO_TRACE_FORMAT_ONLY */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AUDIO_PIPELINE_TRACE_H */
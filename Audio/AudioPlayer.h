@@ -81,6 +81,9 @@ enum {
 	float					_preAmplification;
 		
 	BOOL					_playing;
+	BOOL					_requestedNextStream;
+
+	NSOperationQueue		*_silenceQueue;
 
 	AudioLibrary			*_owner;
 	NSRunLoop				*_runLoop;
@@ -21,8 +21,14 @@
 #import "AudioPlayer.h"
 #import "AudioScheduler.h"
 #import "ScheduledAudioRegion.h"
+#import "ConvertingAudioDecoder.h"
 #import "AudioLibrary.h"
 #import "AudioStream.h"
+#import "CollectionManager.h"
+#import "AudioStreamManager.h"
+#import "SilenceUtilities.h"
+
+#include "AudioPipelineTrace.h"
 
 #include <CoreServices/CoreServices.h>
 #include <CoreAudio/CoreAudio.h>
@@ -127,10 +133,13 @@ NSString *const		AudioPlayerErrorDomain					= @"org.sbooth.Play.ErrorDomain.Audi
 - (void) setReplayGain:(float)replayGain;
 
 - (void) prepareToPlayStream:(AudioStream *)stream;
+- (void) setSilenceBoundariesForRegion:(ScheduledAudioRegion *)region stream:(AudioStream *)stream;
 - (NSNumber *) setReplayGainForStream:(AudioStream *)stream;
 
 - (void) setFormat:(AudioStreamBasicDescription)format;
 - (void) setChannelLayout:(AudioChannelLayout)channelLayout;
+
+- (void) writeAudioPipelineTrace;
 @end
 
 // ========================================
@@ -222,6 +231,9 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 		[_scheduler setAudioUnit:_generatorUnit];
 		[_scheduler setDelegate:self];
 		
+		_silenceQueue = [[NSOperationQueue alloc] init];
+		[_silenceQueue setMaxConcurrentOperationCount:1];
+		
 		// Set up a timer to update the UI 4 times per second
 		_timer = [NSTimer timerWithTimeInterval:0.25 target:self selector:@selector(uiTimerFireMethod:) userInfo:nil repeats:YES];
 		
@@ -347,8 +359,17 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 		}
 	}
 	
+	// Transitions between streams are configured whenever playback starts anew
+	[[self scheduler] setCrossfadeDuration:[[NSUserDefaults standardUserDefaults] doubleForKey:@"crossfadeDuration"]];
+	[[self scheduler] setSkipsSilenceBetweenRegions:[[NSUserDefaults standardUserDefaults] boolForKey:@"skipSilenceBetweenTracks"]];
+	
+	_requestedNextStream = NO;
+	
 	// Schedule the region for playback, and start scheduling audio slices
-	[[self scheduler] scheduleAudioRegion:[ScheduledAudioRegion scheduledAudioRegionWithDecoder:decoder]];
+	ScheduledAudioRegion *region = [ScheduledAudioRegion scheduledAudioRegionWithDecoder:decoder];
+	[self setSilenceBoundariesForRegion:region stream:stream];
+	
+	[[self scheduler] scheduleAudioRegion:region];
 	[[self scheduler] startScheduling];
 
 	[self prepareToPlayStream:stream];
@@ -376,12 +397,26 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	BOOL	formatsMatch			= (nextFormat.mSampleRate == format.mSampleRate && nextFormat.mChannelsPerFrame == format.mChannelsPerFrame);
 	BOOL	channelLayoutsMatch		= channelLayoutsAreEqual(&nextChannelLayout, &channelLayout);
 	
-	// The two files can be joined only if they have the same formats and channel layouts
-	if(NO == formatsMatch || NO == channelLayoutsMatch)
+	// Convert the next stream to the current format, so the two files can be joined without reconfiguring the AUGraph
+	// Only the sample rate and mono/stereo are converted, since other channel layouts can't be mapped reliably
+	if(NO == formatsMatch) {
+		if(2 < nextFormat.mChannelsPerFrame || 2 < format.mChannelsPerFrame)
+			return NO;
+		
+		ConvertingAudioDecoderQuality quality = [[NSUserDefaults standardUserDefaults] integerForKey:@"sampleRateConversionQuality"];
+		
+		decoder = [ConvertingAudioDecoder decoderWithDecoder:decoder format:format channelLayout:channelLayout quality:quality];
+		if(nil == decoder)
+			return NO;
+	}
+	// The two files can be joined only if they have the same channel layouts
+	else if(NO == channelLayoutsMatch)
 		return NO;
 
-	// The formats and channel layouts match, so schedule the region for playback
-	[[self scheduler] scheduleAudioRegion:[ScheduledAudioRegion scheduledAudioRegionWithDecoder:decoder]];
+	ScheduledAudioRegion *region = [ScheduledAudioRegion scheduledAudioRegionWithDecoder:decoder];
+	[self setSilenceBoundariesForRegion:region stream:stream];
+	
+	[[self scheduler] scheduleAudioRegion:region];
 
 	return YES;
 }
@@ -393,6 +428,8 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	[[self scheduler] stopScheduling];
 	[[self scheduler] clear];
 
+	_requestedNextStream = NO;
+
 	[self didChangeValueForKey:@"hasValidStream"];
 	
 	[self willChangeValueForKey:@"totalFrames"];
@@ -491,6 +528,8 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	
 	[self stopAUGraph];
 	[self setIsPlaying:NO];
+	
+	[self writeAudioPipelineTrace];
 }
 
 - (void) skipForward
@@ -632,6 +671,9 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 
 	BOOL resume = NO;
 
+	audioTraceIncrementCounter(AudioTraceCounterSeeks, 1);
+	audioTraceRecordEvent(AudioTraceEventSeek, currentFrame, 0);
+
 	[[self scheduler] stopScheduling];
 	[[self scheduler] reset];
 
@@ -709,7 +751,19 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	NSLog(@"-audioSchedulerFinishedSchedulingRegion: %@", region);
 #endif
 
-	// Request the next stream from the library, to keep playback going
+	// Request the next stream from the library, to keep playback going, unless it was requested ahead of a transition
+	if(_requestedNextStream)
+		_requestedNextStream = NO;
+	else
+		[_owner requestNextStream];
+}
+
+- (void) audioSchedulerApproachingEndOfRegion:(NSDictionary *)schedulerAndRegion
+{
+	NSParameterAssert(nil != schedulerAndRegion);
+	
+	// Request the next stream now so it can be crossfaded or have its leading silence skipped
+	_requestedNextStream = YES;
 	[_owner requestNextStream];
 }
 
@@ -728,8 +782,9 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	[self willChangeValueForKey:@"hasValidStream"];
 	[self didChangeValueForKey:@"hasValidStream"];	
 
+	// The region may not start at the beginning of the stream if it was faded in or its leading silence was skipped
 	[self willChangeValueForKey:@"currentFrame"];
-	[self setStartingFrame:0];
+	[self setStartingFrame:[region startingFrame]];
 	[self setPlayingFrame:0];
 	[self didChangeValueForKey:@"currentFrame"];
 	
@@ -1770,10 +1825,10 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	if(NO == [[self scheduler] isScheduling] || NO == [self isPlaying])
 		return;
 
-/*	Float32 averageCPULoad;
+	Float32 averageCPULoad;
 	OSStatus err = AUGraphGetCPULoad([self auGraph], &averageCPULoad);
 	if(noErr == err)
-		NSLog(@"Average CPU load = %f", averageCPULoad);*/
+		audioTraceRecordEvent(AudioTraceEventCPULoad, (int64_t)(averageCPULoad * 1000000), 0);
 	
 	// Determine the last sample that was rendered
 	AudioTimeStamp timeStamp = [[self scheduler] currentPlayTime];
@@ -2204,6 +2259,45 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	return nil;
 }
 
+- (void) setSilenceBoundariesForRegion:(ScheduledAudioRegion *)region stream:(AudioStream *)stream
+{
+	NSParameterAssert(nil != region);
+	NSParameterAssert(nil != stream);
+	
+	if(NO == [[NSUserDefaults standardUserDefaults] boolForKey:@"skipSilenceBetweenTracks"])
+		return;
+	
+	NSNumber		*objectID			= [stream valueForKey:ObjectIDKey];
+	Float64			sampleRate			= [[region decoder] format].mSampleRate;
+	NSTimeInterval	leadingSilence		= 0;
+	NSTimeInterval	trailingSilence		= 0;
+	
+	// The boundaries are stored in seconds, so they remain valid if the region's decoder converts the sample rate
+	if([[[CollectionManager manager] streamManager] getLeadingSilence:&leadingSilence trailingSilence:&trailingSilence forStreamID:objectID]) {
+		[region setLeadingSilenceFrames:(SInt64)(leadingSilence * sampleRate)];
+		[region setTrailingSilenceFrames:(SInt64)(trailingSilence * sampleRate)];
+		return;
+	}
+	
+	// Otherwise measure them in the background; they will be used if they are ready before the region is joined
+	id <AudioDecoderMethods> decoder = [stream decoder:nil];
+	if(nil == decoder)
+		return;
+	
+	[_silenceQueue addOperationWithBlock:^{
+		NSTimeInterval leading, trailing;
+		if(NO == calculateSilenceBoundaries(decoder, &leading, &trailing))
+			return;
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			[[[CollectionManager manager] streamManager] setLeadingSilence:leading trailingSilence:trailing forStreamID:objectID];
+			
+			[region setLeadingSilenceFrames:(SInt64)(leading * sampleRate)];
+			[region setTrailingSilenceFrames:(SInt64)(trailing * sampleRate)];
+		});
+	}];
+}
+
 - (void) setFormat:(AudioStreamBasicDescription)format
 {
 	_format = format;
@@ -2214,4 +2308,16 @@ myAudioDevicePropertyListenerProc( AudioDeviceID           inDevice,
 	_channelLayout = channelLayout;
 }
 
+- (void) writeAudioPipelineTrace
+{
+	NSString *tracePath = [[NSUserDefaults standardUserDefaults] stringForKey:@"audioPipelineTracePath"];
+	if(0 == [tracePath length])
+		return;
+	
+	// The ring is copied before writing, so recording can continue meanwhile
+	const char *path = [[tracePath stringByExpandingTildeInPath] fileSystemRepresentation];
+	if(NO == audioTraceWriteToFile(path))
+		NSLog(@"AudioPlayer error: Unable to write audio pipeline trace to %@: %s", tracePath, strerror(errno));
+}
+
 @end
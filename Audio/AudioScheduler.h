@@ -29,12 +29,18 @@
 extern NSString * const		AudioSchedulerObjectKey;			// AudioScheduler
 extern NSString * const		ScheduledAudioRegionObjectKey;		// ScheduledAudioRegion
 
-@class ScheduledAudioRegion;
+@class ScheduledAudioRegion, AudioSliceBufferPool;
 
 @interface AudioScheduler : NSObject
 {
 	NSUInteger				_numberSlices;
 	NSUInteger				_framesPerSlice;
+
+	NSUInteger				_slicesInFlight;			// How many slices may be scheduled at once, adjusted during playback
+	NSUInteger				_minimumSlicesInFlight;		// Derived from _minimumBufferMilliseconds for the region's sample rate
+	NSUInteger				_minimumBufferMilliseconds;
+	BOOL					_adaptsSlicesInFlight;
+	BOOL					_logsSliceAdjustments;
 	
 	AudioTimeStamp			_scheduledStartTime;
 
@@ -43,6 +49,13 @@ extern NSString * const		ScheduledAudioRegionObjectKey;		// ScheduledAudioRegion
 	ScheduledAudioRegion	*_regionBeingScheduled;
 	ScheduledAudioRegion	*_regionBeingRendered;
 
+	AudioSliceBufferPool	*_sliceBufferPool;
+
+	ScheduledAudioRegion	*_regionFadingIn;			// The next region, while it is mixed into the end of the current one
+	SInt64					_transitionStartFrame;		// The current region's frame where the crossfade starts
+	SInt64					_transitionEndFrame;		// The current region's frame where the crossfade (and region) ends
+	BOOL					_notifiedApproachingEnd;
+
 	semaphore_t				_semaphore;
 	
 	id						_delegate;
@@ -52,9 +65,28 @@ extern NSString * const		ScheduledAudioRegionObjectKey;		// ScheduledAudioRegion
 - (NSUInteger) numberOfSlicesInBuffer;
 - (NSUInteger) numberOfFramesPerSlice;
 
+// The slice buffers lent to scheduled regions
+- (AudioSliceBufferPool *) sliceBufferPool;
+
+// The number of slices kept scheduled ahead of the render position
+// This grows toward numberOfSlicesInBuffer when reads stall or slices render late,
+// and shrinks when decoding keeps up easily, so less audio is flushed and refilled on a seek
+// The depth learned is kept, as a duration, for later regions and for playback after a seek;
+// until a depth has been learned the full buffer is used
+- (NSUInteger) numberOfSlicesInFlight;
+
+// Slices the AudioUnit began rendering late (since the object was created)
+@property (atomic, readonly, assign) NSUInteger slicesRenderedLate;
+
 // The ScheduledSoundPlayer AudioUnit on which to schedule audio slices
 @property (atomic, readwrite, assign) AudioUnit audioUnit;
 
+// The length of the equal-power crossfade between consecutive regions, or 0 to join them back to back
+@property (atomic, readwrite, assign) NSTimeInterval crossfadeDuration;
+
+// YES to drop the regions' trailingSilenceFrames and leadingSilenceFrames where one region follows another
+@property (atomic, readwrite, assign) BOOL skipsSilenceBetweenRegions;
+
 // An optional delegate to receive notifications
 - (id) delegate;
 - (void) setDelegate:(id)delegate;
@@ -106,6 +138,10 @@ extern NSString * const		ScheduledAudioRegionObjectKey;		// ScheduledAudioRegion
 - (void) audioSchedulerStartedSchedulingRegion:(NSDictionary *)schedulerAndRegion;
 - (void) audioSchedulerFinishedSchedulingRegion:(NSDictionary *)schedulerAndRegion;
 
+// Sent a few seconds before the end of a region when crossfading or skipping silence,
+// so the next region is scheduled in time to be joined with it
+- (void) audioSchedulerApproachingEndOfRegion:(NSDictionary *)schedulerAndRegion;
+
 - (void) audioSchedulerStartedRenderingRegion:(NSDictionary *)schedulerAndRegion;
 - (void) audioSchedulerFinishedRenderingRegion:(NSDictionary *)schedulerAndRegion;
 @end
@@ -20,6 +20,10 @@
 
 #import "AudioScheduler.h"
 #import "ScheduledAudioRegion.h"
+#import "AudioSliceBufferPool.h"
+#include "AudioPipelineTrace.h"
+
+#include <mach/mach_time.h>
 
 // ========================================
 // Dictionary keys
@@ -32,6 +36,19 @@ NSString * const	ScheduledAudioRegionObjectKey		= @"org.sbooth.Play.ScheduledAud
 // ========================================
 NSString * const	AudioSchedulerRunLoopMode			= @"org.sbooth.Play.AudioScheduler.RunLoopMode";
 
+// How far ahead of a transition the delegate is asked for the next region
+#define TRANSITION_LOOKAHEAD_SECONDS	5
+
+// Adaptive buffering: the number of slices in flight is reconsidered after every window of slices
+#define ADAPTATION_WINDOW_SLICES		16
+// A read taking longer than this fraction of the audio it produced is a stall
+#define STALL_FRACTION					0.25
+// Reads consistently shorter than this fraction of the audio allow the depth to shrink
+#define IDLE_FRACTION					0.05
+#define QUIET_WINDOWS_BEFORE_SHRINKING	2
+// Each shrink gives up this fraction of the depth above the minimum (and at least one slice)
+#define SHRINK_FRACTION					0.25
+
 
 // ========================================
 // Private properties
@@ -46,6 +63,8 @@ NSString * const	AudioSchedulerRunLoopMode			= @"org.sbooth.Play.AudioScheduler.
 @property (atomic, readwrite, assign, getter=isScheduling, setter=scheduling:) BOOL scheduling;
 @property (atomic, readwrite, assign) BOOL keepScheduling;
 
+@property (atomic, readwrite, assign) NSUInteger slicesRenderedLate;
+
 @end
 
 // ========================================
@@ -61,6 +80,15 @@ NSString * const	AudioSchedulerRunLoopMode			= @"org.sbooth.Play.AudioScheduler.
 - (void) scheduledAdditionalFrames:(UInt32)frameCount;
 - (void) renderedAdditionalFrames:(UInt32)frameCount;
 
+- (SInt64) endingFrameForRegion:(ScheduledAudioRegion *)region followed:(BOOL)followed;
+- (void) skipLeadingSilenceInRegion:(ScheduledAudioRegion *)region;
+- (UInt32) readAudioInSlice:(NSUInteger)sliceIndex;
+- (void) mixRegionFadingInIntoSlice:(NSUInteger)sliceIndex startingFrame:(SInt64)startingFrame frameCount:(UInt32)frameCount;
+
+- (NSUInteger) slicesInFlightForRegion:(ScheduledAudioRegion *)region;
+- (void) resetSlicesInFlightForRegion:(ScheduledAudioRegion *)region;
+- (void) adaptSlicesInFlightAfterReadingFrames:(UInt32)frameCount sampleRate:(Float64)sampleRate duration:(uint64_t)duration;
+
 - (void) processSlicesInThread:(id)dummy;
 - (void) setThreadPolicy;
 @end
@@ -81,6 +109,12 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 		
 		[region lockSliceWithReference:slice];
 		
+		if(kScheduledAudioSliceFlag_BeganToRenderLate & slice->mFlags)
+			scheduler.slicesRenderedLate += 1;
+		
+		audioTraceSliceCompleted((uint32_t)(slice - [region sliceAtIndex:0]), slice->mNumberFrames,
+								 (kScheduledAudioSliceFlag_BeganToRenderLate & slice->mFlags), (int64_t)slice->mTimeStamp.mSampleTime);
+		
 #if DEBUG
 		if(kScheduledAudioSliceFlag_BeganToRenderLate & slice->mFlags)
 			NSLog(@"AudioScheduler error: kScheduledAudioSliceFlag_BeganToRenderLate (starting sample %"PRId64 ")", (SInt64)slice->mTimeStamp.mSampleTime);
@@ -125,6 +159,18 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 
 @implementation AudioScheduler {
 	AudioUnit				_audioUnit;
+	
+	// Measurements for the current adaptation window
+	NSUInteger				_slicesInWindow;
+	NSUInteger				_stallsInWindow;
+	double					_longestReadInWindow;		// As a fraction of the duration of the audio read
+	NSUInteger				_lateSlicesSeen;
+	NSUInteger				_quietWindows;
+	
+	// The learned depth, as a duration so it carries over to regions at other sample rates
+	double					_learnedBufferSeconds;
+	
+	mach_timebase_info_data_t	_timebase;
 }
 
 - (id) init
@@ -141,6 +187,18 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 		
 		_numberSlices		= [[NSUserDefaults standardUserDefaults] integerForKey:@"numberOfAudioSlicesInBuffer"];
 		_framesPerSlice		= [[NSUserDefaults standardUserDefaults] integerForKey:@"numberOfAudioFramesPerSlice"];
+		
+		// Start with the full buffer and let the depth shrink once decoding has proven it can keep up
+		_adaptsSlicesInFlight		= [[NSUserDefaults standardUserDefaults] boolForKey:@"adaptiveAudioBuffering"];
+		_logsSliceAdjustments		= [[NSUserDefaults standardUserDefaults] boolForKey:@"logAudioBufferAdjustments"];
+		_minimumBufferMilliseconds	= (NSUInteger)MAX(0, [[NSUserDefaults standardUserDefaults] integerForKey:@"minimumAudioBufferMilliseconds"]);
+		_minimumSlicesInFlight		= _numberSlices;
+		_slicesInFlight				= _numberSlices;
+		
+		mach_timebase_info(&_timebase);
+		
+		// Enough idle buffers for the current region and the next one
+		_sliceBufferPool	= [[AudioSliceBufferPool alloc] initWithMaximumCachedBuffers:2];
 	}
 	return self;
 }
@@ -161,6 +219,16 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	return _framesPerSlice;
 }
 
+- (AudioSliceBufferPool *) sliceBufferPool
+{
+	return _sliceBufferPool;
+}
+
+- (NSUInteger) numberOfSlicesInFlight
+{
+	return _slicesInFlight;
+}
+
 - (AudioUnit) audioUnit
 {
 	return _audioUnit;
@@ -214,7 +282,7 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	NSParameterAssert(nil != scheduledAudioRegion);
 	
 	// Setup the buffers inside the region we will be using
-	[scheduledAudioRegion allocateBuffersWithSliceCount:[self numberOfSlicesInBuffer] frameCount:[self numberOfFramesPerSlice]];
+	[scheduledAudioRegion borrowBuffersFromPool:[self sliceBufferPool] sliceCount:[self numberOfSlicesInBuffer] frameCount:[self numberOfFramesPerSlice]];
 	
 	@synchronized([self scheduledAudioRegions]) {
 		[[self scheduledAudioRegions] addObject:scheduledAudioRegion];
@@ -227,11 +295,13 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 {
 	NSParameterAssert(nil != scheduledAudioRegion);
 	
-	if([self regionBeingScheduled] == scheduledAudioRegion) {
+	if([self regionBeingScheduled] == scheduledAudioRegion || _regionFadingIn == scheduledAudioRegion) {
 		if (self.isScheduling)
 			NSLog(@"Cannot unschedule the current ScheduledAudioRegion while scheduling audio slices");
+		// This operation is thread safe as long as the scheduling thread isn't active
+		else if(_regionFadingIn == scheduledAudioRegion)
+			_regionFadingIn = nil;
 		else
-			// This operation is thread safe as long as the scheduling thread isn't active
 			_regionBeingScheduled = nil;
 		
 		return;
@@ -304,6 +374,22 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	if(nil != [self regionBeingRendered])
 		[[self regionBeingRendered] clearSliceBuffer];
 	
+	// Abandon any crossfade in progress; the next region is faded in again from its beginning
+	if(nil != _regionFadingIn) {
+		if([[_regionFadingIn decoder] supportsSeeking])
+			[[_regionFadingIn decoder] seekToFrame:0];
+		[_regionFadingIn clearSliceBuffer];
+		
+		@synchronized([self scheduledAudioRegions]) {
+			[[self scheduledAudioRegions] addObject:_regionFadingIn];
+		}
+		
+		_regionFadingIn = nil;
+	}
+	
+	// Playback after a seek resumes at the learned depth, with a fresh adaptation window
+	[self resetSlicesInFlightForRegion:[self regionBeingScheduled]];
+	
 	_scheduledStartTime.mFlags			= kAudioTimeStampSampleTimeValid;
 	_scheduledStartTime.mSampleTime		= 0;
 }
@@ -385,12 +471,207 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 	[[self regionBeingRendered] renderedAdditionalFrames:frameCount];
 }
 
+- (SInt64) endingFrameForRegion:(ScheduledAudioRegion *)region followed:(BOOL)followed
+{
+	SInt64 totalFrames = [[region decoder] totalFrames];
+	
+	// The last region plays until the decoder runs out, as do regions of unknown length
+	if(NO == followed || 0 >= totalFrames)
+		return INT64_MAX;
+	
+	if(self.skipsSilenceBetweenRegions && region.trailingSilenceFrames < totalFrames)
+		return totalFrames - region.trailingSilenceFrames;
+	
+	return totalFrames;
+}
+
+- (void) skipLeadingSilenceInRegion:(ScheduledAudioRegion *)region
+{
+	id <AudioDecoderMethods>	decoder		= [region decoder];
+	SInt64						frame		= region.leadingSilenceFrames;
+	
+	if(self.skipsSilenceBetweenRegions && 0 < frame && frame < [decoder totalFrames] && 0 == [decoder currentFrame] && [decoder supportsSeeking])
+		[decoder seekToFrame:frame];
+}
+
+- (UInt32) readAudioInSlice:(NSUInteger)sliceIndex
+{
+	ScheduledAudioRegion		*region				= [self regionBeingScheduled];
+	id <AudioDecoderMethods>	decoder				= [region decoder];
+	Float64						sampleRate			= [decoder format].mSampleRate;
+	SInt64						crossfadeFrames		= (SInt64)(self.crossfadeDuration * sampleRate);
+	SInt64						currentFrame		= [decoder currentFrame];
+	ScheduledAudioRegion		*nextRegion			= nil;
+	SInt64						endingFrame;
+	
+	if(0 >= crossfadeFrames && NO == self.skipsSilenceBetweenRegions && nil == _regionFadingIn)
+		return [region readAudioInSlice:sliceIndex];
+	
+	// Ask for the next region early enough that it can be joined to this one
+	if(NO == _notifiedApproachingEnd && [self endingFrameForRegion:region followed:YES] - currentFrame <= crossfadeFrames + (SInt64)(TRANSITION_LOOKAHEAD_SECONDS * sampleRate)) {
+		_notifiedApproachingEnd = YES;
+		
+		if(nil != [self delegate] && [[self delegate] respondsToSelector:@selector(audioSchedulerApproachingEndOfRegion:)])
+			[[self delegate] performSelectorOnMainThread:@selector(audioSchedulerApproachingEndOfRegion:)
+											  withObject:[NSDictionary dictionaryWithObjectsAndKeys:self, AudioSchedulerObjectKey, region, ScheduledAudioRegionObjectKey, nil]
+										   waitUntilDone:NO];
+	}
+	
+	if(nil != _regionFadingIn)
+		endingFrame = _transitionEndFrame;
+	else {
+		@synchronized([self scheduledAudioRegions]) {
+			nextRegion = [[self scheduledAudioRegions] lastObject];
+		}
+		endingFrame = [self endingFrameForRegion:region followed:(nil != nextRegion)];
+	}
+	
+	UInt32 frameCount = (UInt32)MAX(0, MIN((SInt64)[self numberOfFramesPerSlice], endingFrame - currentFrame));
+	
+	// Start decoding the next region once this slice reaches the crossfade
+	// The two regions must have the same number of channels to be mixed
+	if(nil != nextRegion && 0 < crossfadeFrames && currentFrame + frameCount > endingFrame - crossfadeFrames
+	   && [decoder format].mChannelsPerFrame == [[nextRegion decoder] format].mChannelsPerFrame) {
+		@synchronized([self scheduledAudioRegions]) {
+			[[self scheduledAudioRegions] removeObjectIdenticalTo:nextRegion];
+		}
+		
+		[self skipLeadingSilenceInRegion:nextRegion];
+		
+		_regionFadingIn				= nextRegion;
+		_transitionStartFrame		= MAX(currentFrame, endingFrame - crossfadeFrames);
+		_transitionEndFrame			= endingFrame;
+	}
+	
+	UInt32 framesRead = [region readAudioInSlice:sliceIndex frameCount:frameCount];
+	
+	if(nil != _regionFadingIn && 0 < framesRead)
+		[self mixRegionFadingInIntoSlice:sliceIndex startingFrame:currentFrame frameCount:framesRead];
+	
+	return framesRead;
+}
+
+- (void) mixRegionFadingInIntoSlice:(NSUInteger)sliceIndex startingFrame:(SInt64)startingFrame frameCount:(UInt32)frameCount
+{
+	SInt64 offset = MAX(0, _transitionStartFrame - startingFrame);
+	if(offset >= frameCount)
+		return;
+	
+	UInt32				mixFrameCount		= frameCount - (UInt32)offset;
+	AudioBufferList		*fadingOut			= [[self regionBeingScheduled] sliceAtIndex:sliceIndex]->mBufferList;
+	AudioBufferList		*fadingIn			= [_regionFadingIn sliceAtIndex:0]->mBufferList;
+	double				position			= startingFrame + offset - _transitionStartFrame;
+	double				length				= _transitionEndFrame - _transitionStartFrame;
+	UInt32				i, j;
+	
+	// The next region isn't scheduled yet, so its first slice is free to decode into
+	// Anything it can't provide is left as silence
+	[_regionFadingIn clearSlice:0];
+	[[_regionFadingIn decoder] readAudio:fadingIn frameCount:mixFrameCount];
+	
+	// Equal-power gains keep the perceived loudness constant across the transition
+	for(i = 0; i < mixFrameCount; ++i) {
+		double	angle		= M_PI_2 * (position + i + 0.5) / length;
+		float	gainOut		= (float)cos(angle);
+		float	gainIn		= (float)sin(angle);
+		
+		for(j = 0; j < fadingOut->mNumberBuffers; ++j) {
+			float *out = (float *)fadingOut->mBuffers[j].mData + offset;
+			out[i] = (gainOut * out[i]) + (gainIn * ((float *)fadingIn->mBuffers[j].mData)[i]);
+		}
+	}
+}
+
+- (NSUInteger) slicesInFlightForRegion:(ScheduledAudioRegion *)region
+{
+	NSUInteger slicesInFlight = 0;
+	
+	for(NSUInteger i = 0; i < [region numberOfSlicesInBuffer]; ++i) {
+		if(0 == (kScheduledAudioSliceFlag_Complete & [region sliceAtIndex:i]->mFlags))
+			++slicesInFlight;
+	}
+	
+	return slicesInFlight;
+}
+
+- (void) resetSlicesInFlightForRegion:(ScheduledAudioRegion *)region
+{
+	// The minimum is a duration, so it covers the same time at any sample rate
+	Float64 sampleRate = [[region decoder] format].mSampleRate;
+	if(0 < sampleRate && 0 < _framesPerSlice) {
+		NSUInteger minimumSlices = (NSUInteger)ceil(((_minimumBufferMilliseconds / 1000.0) * sampleRate) / _framesPerSlice);
+		_minimumSlicesInFlight = MIN(_numberSlices, MAX(2u, minimumSlices));
+	}
+	
+	// Start with the full buffer until a depth has been learned, then with the slices covering the same time
+	if(_adaptsSlicesInFlight && 0 < _learnedBufferSeconds && 0 < sampleRate && 0 < _framesPerSlice) {
+		NSUInteger learnedSlices = (NSUInteger)ceil((_learnedBufferSeconds * sampleRate) / _framesPerSlice);
+		_slicesInFlight = MIN(_numberSlices, MAX(_minimumSlicesInFlight, learnedSlices));
+	}
+	else
+		_slicesInFlight = _numberSlices;
+	
+	_lateSlicesSeen			= self.slicesRenderedLate;
+	_slicesInWindow			= 0;
+	_stallsInWindow			= 0;
+	_longestReadInWindow	= 0;
+	_quietWindows			= 0;
+}
+
+- (void) adaptSlicesInFlightAfterReadingFrames:(UInt32)frameCount sampleRate:(Float64)sampleRate duration:(uint64_t)duration
+{
+	if(NO == _adaptsSlicesInFlight || 0 >= sampleRate)
+		return;
+	
+	// Compare the time spent reading to the time the audio will take to play
+	double readFraction = ((duration * _timebase.numer) / (double)_timebase.denom) / ((frameCount / sampleRate) * NSEC_PER_SEC);
+	
+	if(STALL_FRACTION < readFraction)
+		++_stallsInWindow;
+	if(readFraction > _longestReadInWindow)
+		_longestReadInWindow = readFraction;
+	
+	if(ADAPTATION_WINDOW_SLICES > ++_slicesInWindow)
+		return;
+	
+	NSUInteger	slicesRenderedLate		= self.slicesRenderedLate;
+	NSUInteger	lateSlices				= slicesRenderedLate - _lateSlicesSeen;
+	NSUInteger	previousSlicesInFlight	= _slicesInFlight;
+	
+	// Grow quickly when the output starved or the source is slow, and shrink in proportion once it has been quiet
+	if(0 < lateSlices || 0 < _stallsInWindow) {
+		_slicesInFlight		= MIN(_numberSlices, _slicesInFlight + MAX(2, _slicesInFlight / 2));
+		_quietWindows		= 0;
+	}
+	else if(IDLE_FRACTION > _longestReadInWindow) {
+		if(QUIET_WINDOWS_BEFORE_SHRINKING <= ++_quietWindows && _slicesInFlight > _minimumSlicesInFlight) {
+			NSUInteger excess	= _slicesInFlight - _minimumSlicesInFlight;
+			_slicesInFlight		-= MAX(1u, (NSUInteger)(excess * SHRINK_FRACTION));
+			_quietWindows		= 0;
+		}
+	}
+	else
+		_quietWindows = 0;
+	
+	_learnedBufferSeconds = (_slicesInFlight * _framesPerSlice) / sampleRate;
+	
+	if(_logsSliceAdjustments && previousSlicesInFlight != _slicesInFlight)
+		NSLog(@"AudioScheduler: %lu -> %lu slices in flight (%lu late slices, %lu stalls, longest read %.1f%% of real time)",
+			  (unsigned long)previousSlicesInFlight, (unsigned long)_slicesInFlight, (unsigned long)lateSlices, (unsigned long)_stallsInWindow, 100 * _longestReadInWindow);
+	
+	_lateSlicesSeen			= slicesRenderedLate;
+	_slicesInWindow			= 0;
+	_stallsInWindow			= 0;
+	_longestReadInWindow	= 0;
+}
+
 - (void) processSlicesInThread
 {
 	mach_timespec_t			timeout				= { 2, 0 };
 	ScheduledAudioSlice		*slice				= NULL;
 	UInt32					frameCount			= 0;
 	BOOL					allFramesScheduled	= NO;
+	BOOL					regionFinished		= NO;
 	NSUInteger				i;
 	
 	// Make this a high-priority thread
@@ -406,15 +687,34 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 		// Grab the next ScheduledAudioRegion to work with
 		if(nil == [self regionBeingScheduled]) {
 
-			@synchronized([self scheduledAudioRegions]) {
-				[self setRegionBeingScheduled:[[self scheduledAudioRegions] lastObject]];
-				if(nil != [self regionBeingScheduled])
-					[[self scheduledAudioRegions] removeLastObject];
+			// A region that was faded in continues where the crossfade left off
+			if(nil != _regionFadingIn) {
+				[self setRegionBeingScheduled:_regionFadingIn];
+				_regionFadingIn = nil;
+			}
+			else {
+				@synchronized([self scheduledAudioRegions]) {
+					[self setRegionBeingScheduled:[[self scheduledAudioRegions] lastObject]];
+					if(nil != [self regionBeingScheduled])
+						[[self scheduledAudioRegions] removeLastObject];
+				}
+				
+				// Only skip silence where one region follows another
+				if(regionFinished && nil != [self regionBeingScheduled])
+					[self skipLeadingSilenceInRegion:[self regionBeingScheduled]];
 			}
 
 			// If a new region was found, notify the delegate
 			if(nil != [self regionBeingScheduled]) {
-				allFramesScheduled = NO;
+				allFramesScheduled			= NO;
+				regionFinished				= NO;
+				_notifiedApproachingEnd		= NO;
+				
+				[[self regionBeingScheduled] setStartingFrame:[[[self regionBeingScheduled] decoder] currentFrame]];
+				[self resetSlicesInFlightForRegion:[self regionBeingScheduled]];
+				
+				audioTraceIncrementCounter(AudioTraceCounterRegionsStarted, 1);
+				audioTraceRecordEvent(AudioTraceEventRegionStarted, [[self regionBeingScheduled] startingFrame], 0);
 
 				// Notify the delegate that the scheduling has been started for the current region
 				if(nil != [self delegate] && [[self delegate] respondsToSelector:@selector(audioSchedulerStartedSchedulingRegion:)])
@@ -427,23 +727,39 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 		// Inner scheduling loop, for processing an individual region
 		while(self.keepScheduling && nil != [self regionBeingScheduled] && NO == allFramesScheduled) {
 
+			NSUInteger slicesInFlight = [self slicesInFlightForRegion:[self regionBeingScheduled]];
+			
 			// Iterate through the slice buffer, scheduling audio as completed slices become available
 			for(i = 0; i < [[self regionBeingScheduled] numberOfSlicesInBuffer]; ++i) {
 				slice = [[self regionBeingScheduled] sliceAtIndex:i];
 
-				// If the slice is marked as complete, re-use it
-				if(kScheduledAudioSliceFlag_Complete & slice->mFlags) {
+				// If the slice is marked as complete, re-use it, unless enough audio is already scheduled
+				if(kScheduledAudioSliceFlag_Complete & slice->mFlags && slicesInFlight < _slicesInFlight) {
 					[self.regionBeingScheduled lockSlice:i];
 
 					// Prepare the slice
 					[[self regionBeingScheduled] clearSlice:i];
 					
 					// Read some data
-					frameCount = [[self regionBeingScheduled] readAudioInSlice:i];
+					Float64		sampleRate		= [[[self regionBeingScheduled] decoder] format].mSampleRate;
+					uint64_t	readStart		= mach_absolute_time();
+					
+					frameCount = [self readAudioInSlice:i];
+					
+					uint64_t	readDuration	= mach_absolute_time() - readStart;
+					
+					audioTraceDecoderRead(frameCount, readDuration);
+					
+					if(0 != frameCount)
+						[self adaptSlicesInFlightAfterReadingFrames:frameCount sampleRate:sampleRate duration:readDuration];
 					
 					// EOS?
 					if(0 == frameCount) {
-						allFramesScheduled = YES;
+						allFramesScheduled	= YES;
+						regionFinished		= YES;
+						
+						audioTraceIncrementCounter(AudioTraceCounterRegionsFinished, 1);
+						audioTraceRecordEvent(AudioTraceEventRegionFinished, [[self regionBeingScheduled] framesScheduled], 0);
 						
 						// Notify the delegate that the last frame of the current region has been scheduled
 						if(nil != [self delegate] && [[self delegate] respondsToSelector:@selector(audioSchedulerFinishedSchedulingRegion:)])
@@ -486,9 +802,12 @@ scheduledAudioSliceCompletionProc(void *userData, ScheduledAudioSlice *slice)
 					NSLog(@"AudioScheduler: Scheduling slice %"PRId32 " (%"PRId32 " frames) to start at sample %"PRId64 "", i, frameCount, (SInt64)slice->mTimeStamp.mSampleTime);
 #endif
 					
+					audioTraceSliceScheduled((uint32_t)i, frameCount);
+					
 					[self.regionBeingScheduled unlockSlice:i];
 
 					[self scheduledAdditionalFrames:frameCount];
+					++slicesInFlight;
 				}
 			}
 
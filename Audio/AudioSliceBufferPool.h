@@ -0,0 +1,88 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+#include <AudioToolbox/AudioToolbox.h>
+
+// ========================================
+// A set of ScheduledAudioSlices and their locks, for one ScheduledAudioRegion
+// The sample memory is page-aligned and faulted in when the set is created
+// ========================================
+@interface AudioSliceBuffer : NSObject
+{
+	@private
+	UInt32					_channelCount;
+	NSUInteger				_sliceCount;
+	NSUInteger				_framesPerSlice;
+	
+	ScheduledAudioSlice		*_slices;
+	NSArray					*_sliceLocks;
+	
+	void					*_samples;			// A single mapping backing every channel of every slice
+	size_t					_length;			// In bytes
+}
+
+- (UInt32) channelCount;
+- (NSUInteger) sliceCount;
+- (NSUInteger) framesPerSlice;
+
+- (ScheduledAudioSlice *) slices;
+- (NSArray<NSLock *> *) sliceLocks;
+
+// The sample memory, in bytes
+- (size_t) length;
+@end
+
+// ========================================
+// Slice buffers shared by the regions an AudioScheduler plays
+// Regions borrow a buffer when they are scheduled and return it when they are deallocated,
+// so after the first track transitions reuse memory instead of allocating it
+// A spare buffer is kept for the next region, and at most maximumCachedBuffers are kept idle
+// ========================================
+@interface AudioSliceBufferPool : NSObject
+{
+	@private
+	NSLock					*_lock;
+	NSMutableArray			*_cachedBuffers;		// Least recently returned first
+	NSUInteger				_maximumCachedBuffers;
+	
+	NSUInteger				_buffersInUse;
+	size_t					_bytesInUse;
+	size_t					_bytesCached;
+	size_t					_peakBytes;
+}
+
+- (id) initWithMaximumCachedBuffers:(NSUInteger)maximumCachedBuffers;
+
+// May be called from any thread
+- (AudioSliceBuffer *) sliceBufferWithChannelCount:(UInt32)channelCount sliceCount:(NSUInteger)sliceCount framesPerSlice:(NSUInteger)framesPerSlice;
+- (void) returnSliceBuffer:(AudioSliceBuffer *)sliceBuffer;
+
+// Releases the idle buffers
+- (void) removeCachedBuffers;
+
+// ========================================
+// Memory accounting
+- (size_t) bytesInUse;
+- (size_t) bytesCached;
+
+// The most memory held at once, in use and idle
+- (size_t) peakBytes;
+@end
@@ -0,0 +1,284 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioSliceBufferPool.h"
+
+#include <sys/mman.h>
+
+// ========================================
+// Private methods
+// ========================================
+@interface AudioSliceBuffer (Private)
+- (id) initWithChannelCount:(UInt32)channelCount sliceCount:(NSUInteger)sliceCount framesPerSlice:(NSUInteger)framesPerSlice;
+- (BOOL) matchesChannelCount:(UInt32)channelCount sliceCount:(NSUInteger)sliceCount framesPerSlice:(NSUInteger)framesPerSlice;
+- (void) prepareForReuse;
+@end
+
+@interface AudioSliceBufferPool (Private)
+- (void) noteBytesHeld;
+@end
+
+@implementation AudioSliceBuffer
+
+- (void) dealloc
+{
+	if(NULL != _slices) {
+		for(NSUInteger i = 0; i < _sliceCount; ++i)
+			free(_slices[i].mBufferList);
+		free(_slices);
+	}
+	
+	if(NULL != _samples)
+		munmap(_samples, _length);
+}
+
+- (UInt32)					channelCount			{ return _channelCount; }
+- (NSUInteger)				sliceCount				{ return _sliceCount; }
+- (NSUInteger)				framesPerSlice			{ return _framesPerSlice; }
+- (ScheduledAudioSlice *)	slices					{ return _slices; }
+- (NSArray *)				sliceLocks				{ return _sliceLocks; }
+- (size_t)					length					{ return _length; }
+
+@end
+
+@implementation AudioSliceBuffer (Private)
+
+- (id) initWithChannelCount:(UInt32)channelCount sliceCount:(NSUInteger)sliceCount framesPerSlice:(NSUInteger)framesPerSlice
+{
+	NSParameterAssert(0 < channelCount);
+	NSParameterAssert(0 < sliceCount);
+	NSParameterAssert(0 < framesPerSlice);
+	
+	if((self = [super init])) {
+		size_t pageSize = (size_t)getpagesize();
+		
+		_channelCount		= channelCount;
+		_sliceCount			= sliceCount;
+		_framesPerSlice		= framesPerSlice;
+		
+		// Each channel buffer starts on its own page
+		size_t bufferStride = ((framesPerSlice * sizeof(float)) + pageSize - 1) & ~(pageSize - 1);
+		
+		_length		= bufferStride * channelCount * sliceCount;
+		_samples	= mmap(NULL, _length, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+		if(MAP_FAILED == _samples) {
+			_samples = NULL;
+			return nil;
+		}
+		
+		// Fault in every page now, rather than while the scheduling thread fills the slices
+		for(size_t offset = 0; offset < _length; offset += pageSize)
+			((volatile char *)_samples)[offset] = 0;
+		
+		_slices = calloc(sliceCount, sizeof(ScheduledAudioSlice));
+		if(NULL == _slices)
+			return nil;
+		
+		NSMutableArray *sliceLocks = [NSMutableArray arrayWithCapacity:sliceCount];
+		
+		for(NSUInteger i = 0; i < sliceCount; ++i) {
+			_slices[i].mBufferList = calloc(sizeof(AudioBufferList) + (sizeof(AudioBuffer) * (channelCount - 1)), 1);
+			if(NULL == _slices[i].mBufferList)
+				return nil;
+			
+			_slices[i].mBufferList->mNumberBuffers = channelCount;
+			
+			for(UInt32 j = 0; j < channelCount; ++j) {
+				_slices[i].mBufferList->mBuffers[j].mData				= (char *)_samples + (bufferStride * ((i * channelCount) + j));
+				_slices[i].mBufferList->mBuffers[j].mNumberChannels	= 1;
+			}
+			
+			[sliceLocks addObject:[[NSLock alloc] init]];
+		}
+		
+		_sliceLocks = [sliceLocks copy];
+		
+		[self prepareForReuse];
+	}
+	return self;
+}
+
+- (BOOL) matchesChannelCount:(UInt32)channelCount sliceCount:(NSUInteger)sliceCount framesPerSlice:(NSUInteger)framesPerSlice
+{
+	return (_channelCount == channelCount && _sliceCount == sliceCount && _framesPerSlice == framesPerSlice);
+}
+
+// The samples aren't cleared, since AudioScheduler clears each slice before filling it
+- (void) prepareForReuse
+{
+	for(NSUInteger i = 0; i < _sliceCount; ++i) {
+		for(UInt32 j = 0; j < _channelCount; ++j)
+			_slices[i].mBufferList->mBuffers[j].mDataByteSize = (UInt32)(_framesPerSlice * sizeof(float));
+		
+		_slices[i].mNumberFrames			= 0;
+		_slices[i].mCompletionProc			= NULL;
+		_slices[i].mCompletionProcUserData	= NULL;
+		
+		// Set the complete flag so the scheduler knows this slice can be filled and scheduled
+		_slices[i].mFlags					= kScheduledAudioSliceFlag_Complete;
+	}
+}
+
+@end
+
+@implementation AudioSliceBufferPool
+
+- (id) init
+{
+	return [self initWithMaximumCachedBuffers:2];
+}
+
+- (id) initWithMaximumCachedBuffers:(NSUInteger)maximumCachedBuffers
+{
+	if((self = [super init])) {
+		_lock					= [[NSLock alloc] init];
+		_maximumCachedBuffers	= maximumCachedBuffers;
+		
+		// Sized so returning a buffer never grows the array
+		_cachedBuffers			= [[NSMutableArray alloc] initWithCapacity:maximumCachedBuffers + 1];
+	}
+	return self;
+}
+
+- (AudioSliceBuffer *) sliceBufferWithChannelCount:(UInt32)channelCount sliceCount:(NSUInteger)sliceCount framesPerSlice:(NSUInteger)framesPerSlice
+{
+	AudioSliceBuffer	*sliceBuffer	= nil;
+	AudioSliceBuffer	*spareBuffer	= nil;
+	
+	[_lock lock];
+	
+	for(AudioSliceBuffer *cachedBuffer in _cachedBuffers) {
+		if([cachedBuffer matchesChannelCount:channelCount sliceCount:sliceCount framesPerSlice:framesPerSlice]) {
+			sliceBuffer = cachedBuffer;
+			break;
+		}
+	}
+	
+	if(nil != sliceBuffer) {
+		[_cachedBuffers removeObjectIdenticalTo:sliceBuffer];
+		_bytesCached -= [sliceBuffer length];
+	}
+	
+	[_lock unlock];
+	
+	// The first region in a new format also allocates a spare for the region that follows it,
+	// so the transition between them doesn't allocate; after that the two buffers alternate
+	if(nil == sliceBuffer) {
+		sliceBuffer = [[AudioSliceBuffer alloc] initWithChannelCount:channelCount sliceCount:sliceCount framesPerSlice:framesPerSlice];
+		if(nil == sliceBuffer)
+			return nil;
+		
+		if(0 < _maximumCachedBuffers)
+			spareBuffer = [[AudioSliceBuffer alloc] initWithChannelCount:channelCount sliceCount:sliceCount framesPerSlice:framesPerSlice];
+	}
+	
+	[_lock lock];
+	
+	++_buffersInUse;
+	_bytesInUse += [sliceBuffer length];
+	
+	if(nil != spareBuffer) {
+		[_cachedBuffers addObject:spareBuffer];
+		_bytesCached += [spareBuffer length];
+	}
+	
+	[self noteBytesHeld];
+	
+	[_lock unlock];
+	
+	return sliceBuffer;
+}
+
+- (void) returnSliceBuffer:(AudioSliceBuffer *)sliceBuffer
+{
+	NSParameterAssert(nil != sliceBuffer);
+	
+	[sliceBuffer prepareForReuse];
+	
+	[_lock lock];
+	
+	--_buffersInUse;
+	_bytesInUse -= [sliceBuffer length];
+	
+	[_cachedBuffers addObject:sliceBuffer];
+	_bytesCached += [sliceBuffer length];
+	
+	// Drop the buffer that has been idle longest
+	if([_cachedBuffers count] > _maximumCachedBuffers) {
+		_bytesCached -= [[_cachedBuffers objectAtIndex:0] length];
+		[_cachedBuffers removeObjectAtIndex:0];
+	}
+	
+	[_lock unlock];
+}
+
+- (void) removeCachedBuffers
+{
+	[_lock lock];
+	[_cachedBuffers removeAllObjects];
+	_bytesCached = 0;
+	[_lock unlock];
+}
+
+- (size_t) bytesInUse
+{
+	[_lock lock];
+	size_t bytesInUse = _bytesInUse;
+	[_lock unlock];
+	
+	return bytesInUse;
+}
+
+- (size_t) bytesCached
+{
+	[_lock lock];
+	size_t bytesCached = _bytesCached;
+	[_lock unlock];
+	
+	return bytesCached;
+}
+
+- (size_t) peakBytes
+{
+	[_lock lock];
+	size_t peakBytes = _peakBytes;
+	[_lock unlock];
+	
+	return peakBytes;
+}
+
+@end
+
+@implementation AudioSliceBufferPool (Private)
+
+// Must be called with the lock held
+- (void) noteBytesHeld
+{
+	if(_bytesInUse + _bytesCached <= _peakBytes)
+		return;
+	
+	_peakBytes = _bytesInUse + _bytesCached;
+	
+#if DEBUG
+	NSLog(@"AudioSliceBufferPool: peak %.1f MB (%lu buffers in use, %lu idle)", _peakBytes / (1024.0 * 1024.0), (unsigned long)_buffersInUse, (unsigned long)[_cachedBuffers count]);
+#endif
+}
+
+@end
@@ -0,0 +1,77 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+#import "AudioDecoderMethods.h"
+
+// ========================================
+// Sample rate conversion quality
+// Longer filters cost more CPU but have less passband ripple and better
+// stopband attenuation
+// ========================================
+enum {
+	ConvertingAudioDecoderQualityLow			= 0,
+	ConvertingAudioDecoderQualityMedium			= 1,
+	ConvertingAudioDecoderQualityHigh			= 2
+};
+typedef NSUInteger ConvertingAudioDecoderQuality;
+
+// ========================================
+// Presents a decoder's audio at a different sample rate and number of channels,
+// so regions in different formats can be scheduled back to back
+// Sample rates are converted with a Kaiser-windowed sinc polyphase filter
+// Output is computed a block at a time: the outputs in a block that share a
+// phase form a decimating FIR over the input, computed with vDSP_desamp
+// ========================================
+@interface ConvertingAudioDecoder : NSObject <AudioDecoderMethods>
+{
+	@private
+	id <AudioDecoderMethods>		_decoder;
+	
+	AudioStreamBasicDescription		_format;
+	AudioChannelLayout				_channelLayout;
+	
+	UInt32							_interpolation;			// Output frames per conversion cycle
+	UInt32							_decimation;			// Input frames per conversion cycle
+	UInt32							_taps;					// Coefficients per phase
+	UInt32							_leadingTaps;			// Taps before the input frame nearest each output frame
+	float							*_filters;				// One filter per phase (_interpolation phases)
+	UInt32							_blockFrames;			// Output frames computed at once
+	float							*_phaseOutput;			// The outputs for one phase of a block
+	
+	AudioBufferList					*_inputBufferList;		// Audio from the decoder, in its format
+	float							**_history;				// Channel mapped input, in the output's channels
+	UInt32							_historyCapacity;
+	UInt32							_historyLength;
+	SInt64							_historyStart;			// The input frame at the start of _history
+	BOOL							_decoderAtEnd;
+	
+	SInt64							_totalFrames;
+	SInt64							_currentFrame;
+}
+
+// Returns nil if the conversion isn't supported
++ (id) decoderWithDecoder:(id <AudioDecoderMethods>)decoder format:(AudioStreamBasicDescription)format channelLayout:(AudioChannelLayout)channelLayout quality:(ConvertingAudioDecoderQuality)quality;
+- (id) initWithDecoder:(id <AudioDecoderMethods>)decoder format:(AudioStreamBasicDescription)format channelLayout:(AudioChannelLayout)channelLayout quality:(ConvertingAudioDecoderQuality)quality;
+
+// The decoder providing the audio
+- (id <AudioDecoderMethods>) decoder;
+
+@end
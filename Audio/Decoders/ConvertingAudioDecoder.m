@@ -0,0 +1,419 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "ConvertingAudioDecoder.h"
+
+#include <AudioToolbox/AudioFormat.h>
+#include <Accelerate/Accelerate.h>
+
+// The number of frames requested from the decoder at once
+#define INPUT_BUFFER_FRAMES			4096
+
+// Conversions needing more phases than this (unusual pairs of sample rates) aren't supported
+#define MAXIMUM_PHASES				2048
+
+// ========================================
+// Filter parameters for each quality
+// The cutoff is relative to the lower of the two Nyquist frequencies
+// ========================================
+static const struct {
+	UInt32		taps;
+	double		beta;
+	double		cutoff;
+} sQualities [] = {
+	{ 16,	6.0,	0.86 },
+	{ 32,	8.0,	0.92 },
+	{ 64,	10.0,	0.95 }
+};
+
+static UInt32
+greatestCommonDivisor(UInt32 a, UInt32 b)
+{
+	while(0 != b) {
+		UInt32 t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// The zeroth-order modified Bessel function of the first kind
+static double
+besselI0(double x)
+{
+	double sum = 1, term = 1;
+	for(unsigned k = 1; k < 64; ++k) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if(term < 1e-12 * sum)
+			break;
+	}
+	return sum;
+}
+
+@interface ConvertingAudioDecoder (Private)
+- (void) mapInputFrames:(UInt32)frameCount;
+- (void) appendSilence:(UInt32)frameCount;
+- (BOOL) fillHistoryFromFrame:(SInt64)firstFrame throughFrame:(SInt64)lastFrame;
+- (void) resetHistoryAtFrame:(SInt64)frame;
+@end
+
+@implementation ConvertingAudioDecoder
+
++ (id) decoderWithDecoder:(id <AudioDecoderMethods>)decoder format:(AudioStreamBasicDescription)format channelLayout:(AudioChannelLayout)channelLayout quality:(ConvertingAudioDecoderQuality)quality
+{
+	return [[ConvertingAudioDecoder alloc] initWithDecoder:decoder format:format channelLayout:channelLayout quality:quality];
+}
+
+- (id) initWithDecoder:(id <AudioDecoderMethods>)decoder format:(AudioStreamBasicDescription)format channelLayout:(AudioChannelLayout)channelLayout quality:(ConvertingAudioDecoderQuality)quality
+{
+	NSParameterAssert(nil != decoder);
+	
+	if((self = [super init])) {
+		AudioStreamBasicDescription		sourceFormat		= [decoder format];
+		UInt32							inputRate			= (UInt32)sourceFormat.mSampleRate;
+		UInt32							outputRate			= (UInt32)format.mSampleRate;
+		
+		// Only whole sample rates are supported
+		if(0 == inputRate || 0 == outputRate || inputRate != sourceFormat.mSampleRate || outputRate != format.mSampleRate)
+			return nil;
+		
+		if(0 == sourceFormat.mChannelsPerFrame || 0 == format.mChannelsPerFrame)
+			return nil;
+		
+		UInt32 divisor = greatestCommonDivisor(inputRate, outputRate);
+		
+		_interpolation		= outputRate / divisor;
+		_decimation			= inputRate / divisor;
+		
+		if(MAXIMUM_PHASES < _interpolation)
+			return nil;
+		
+		_decoder			= decoder;
+		
+		_format						= sourceFormat;
+		_format.mSampleRate			= format.mSampleRate;
+		_format.mChannelsPerFrame	= format.mChannelsPerFrame;
+		_channelLayout				= channelLayout;
+		
+		// Matching sample rates only need channel mapping, which a single tap does
+		if(1 == _interpolation && 1 == _decimation)
+			quality = NSNotFound;
+		else if(ConvertingAudioDecoderQualityHigh < quality)
+			quality = ConvertingAudioDecoderQualityMedium;
+		
+		_taps			= (NSNotFound == quality ? 1 : sQualities[quality].taps);
+		_leadingTaps	= (_taps - 1) / 2;
+		
+		_filters = calloc(_interpolation * _taps, sizeof(float));
+		if(NULL == _filters)
+			return nil;
+		
+		// Phase p of the filter is the windowed sinc centered p / _interpolation input frames
+		// before the input frame nearest the output frame
+		double	cutoff			= (NSNotFound == quality ? 1 : MIN(1, (double)_interpolation / _decimation) * sQualities[quality].cutoff);
+		double	beta			= (NSNotFound == quality ? 0 : sQualities[quality].beta);
+		double	halfWidth		= _taps / 2.0;
+		
+		for(UInt32 phase = 0; phase < _interpolation; ++phase) {
+			float	*filter		= _filters + (phase * _taps);
+			double	sum			= 0;
+			
+			for(UInt32 tap = 0; tap < _taps; ++tap) {
+				double	t			= (double)tap - _leadingTaps - ((double)phase / _interpolation);
+				double	x			= t / halfWidth;
+				double	window		= (1 >= fabs(x) ? besselI0(beta * sqrt(1 - (x * x))) / besselI0(beta) : 0);
+				double	sinc		= (1e-9 > fabs(t) ? 1 : sin(M_PI * cutoff * t) / (M_PI * cutoff * t));
+				
+				filter[tap]		= (float)(cutoff * sinc * window);
+				sum				+= filter[tap];
+			}
+			
+			// Normalize each phase for unity gain at DC
+			for(UInt32 tap = 0; tap < _taps; ++tap)
+				filter[tap] /= sum;
+		}
+		
+		// Allocate the input buffers
+		_inputBufferList = calloc(sizeof(AudioBufferList) + (sizeof(AudioBuffer) * (sourceFormat.mChannelsPerFrame - 1)), 1);
+		if(NULL == _inputBufferList)
+			return nil;
+		
+		_inputBufferList->mNumberBuffers = sourceFormat.mChannelsPerFrame;
+		
+		for(UInt32 i = 0; i < _inputBufferList->mNumberBuffers; ++i) {
+			_inputBufferList->mBuffers[i].mData = calloc(INPUT_BUFFER_FRAMES, sizeof(float));
+			if(NULL == _inputBufferList->mBuffers[i].mData)
+				return nil;
+			
+			_inputBufferList->mBuffers[i].mNumberChannels = 1;
+		}
+		
+		// Each block of output must fit in the history, so its input can span at most INPUT_BUFFER_FRAMES frames
+		_blockFrames		= (UInt32)((((UInt64)INPUT_BUFFER_FRAMES - 1) * _interpolation) / _decimation) + 1;
+		_phaseOutput		= calloc(_blockFrames, sizeof(float));
+		if(NULL == _phaseOutput)
+			return nil;
+		
+		_historyCapacity	= _taps + INPUT_BUFFER_FRAMES;
+		_history			= calloc(_format.mChannelsPerFrame, sizeof(float *));
+		if(NULL == _history)
+			return nil;
+		
+		for(UInt32 i = 0; i < _format.mChannelsPerFrame; ++i) {
+			_history[i] = calloc(_historyCapacity, sizeof(float));
+			if(NULL == _history[i])
+				return nil;
+		}
+		
+		_totalFrames = (([decoder totalFrames] * _interpolation) + _decimation - 1) / _decimation;
+		
+		[self resetHistoryAtFrame:[decoder currentFrame] - _leadingTaps];
+		_currentFrame = ([decoder currentFrame] * _interpolation) / _decimation;
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	free(_filters);
+	free(_phaseOutput);
+	
+	if(_inputBufferList) {
+		for(UInt32 i = 0; i < _inputBufferList->mNumberBuffers; ++i)
+			free(_inputBufferList->mBuffers[i].mData);
+		free(_inputBufferList);
+	}
+	
+	if(_history) {
+		for(UInt32 i = 0; i < _format.mChannelsPerFrame; ++i)
+			free(_history[i]);
+		free(_history);
+	}
+}
+
+- (id <AudioDecoderMethods>)		decoder					{ return _decoder; }
+
+- (AudioStreamBasicDescription)		format					{ return _format; }
+- (AudioChannelLayout)				channelLayout			{ return _channelLayout; }
+
+- (NSString *) formatDescription
+{
+	NSString	*description	= nil;
+	UInt32		specifierSize	= sizeof(description);
+	
+	OSStatus err = AudioFormatGetProperty(kAudioFormatProperty_FormatName, 
+										  sizeof(_format), 
+										  &_format, 
+										  &specifierSize, 
+										  &description);
+	if(noErr != err)
+		NSLog(@"AudioFormatGetProperty (kAudioFormatProperty_FormatName) failed: %ld", (long)err);
+	
+	return description;
+}
+
+- (NSString *) channelLayoutDescription
+{
+	NSString	*description	= nil;
+	UInt32		specifierSize	= sizeof(description);
+	
+	OSStatus err = AudioFormatGetProperty(kAudioFormatProperty_ChannelLayoutName, 
+										  sizeof(_channelLayout), 
+										  &_channelLayout, 
+										  &specifierSize, 
+										  &description);
+	if(noErr != err)
+		NSLog(@"AudioFormatGetProperty (kAudioFormatProperty_ChannelLayoutName) failed: %ld", (long)err);
+	
+	return description;
+}
+
+- (AudioStreamBasicDescription)		sourceFormat			{ return [_decoder sourceFormat]; }
+- (NSString *)						sourceFormatDescription	{ return [_decoder sourceFormatDescription]; }
+
+- (SInt64)			totalFrames								{ return _totalFrames; }
+- (SInt64)			currentFrame							{ return _currentFrame; }
+- (SInt64)			framesRemaining							{ return ([self totalFrames] - [self currentFrame]); }
+
+- (BOOL)			supportsSeeking							{ return [_decoder supportsSeeking]; }
+
+- (SInt64) seekToFrame:(SInt64)frame
+{
+	NSParameterAssert(0 <= frame && frame < [self totalFrames]);
+	
+	// Position the decoder far enough back to fill the filter for the first output frame
+	SInt64	inputFrame		= (frame * _decimation) / _interpolation;
+	SInt64	firstFrame		= MAX(0, inputFrame - (SInt64)_leadingTaps);
+	
+	if(-1 == [_decoder seekToFrame:firstFrame])
+		return -1;
+	
+	[self resetHistoryAtFrame:inputFrame - _leadingTaps];
+	_currentFrame = frame;
+	
+	return _currentFrame;
+}
+
+- (UInt32) readAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(NULL != bufferList);
+	NSParameterAssert(bufferList->mNumberBuffers == _format.mChannelsPerFrame);
+	NSParameterAssert(0 < frameCount);
+	
+	UInt32 framesWritten = 0;
+	
+	while(framesWritten < frameCount && _currentFrame < _totalFrames) {
+		UInt32	blockFrames		= (UInt32)MIN((SInt64)MIN(frameCount - framesWritten, _blockFrames), _totalFrames - _currentFrame);
+		SInt64	firstFrame		= ((_currentFrame * _decimation) / _interpolation) - _leadingTaps;
+		SInt64	lastFrame		= (((_currentFrame + blockFrames - 1) * _decimation) / _interpolation) - _leadingTaps + _taps - 1;
+		
+		if(NO == [self fillHistoryFromFrame:firstFrame throughFrame:lastFrame])
+			break;
+		
+		// The decoder may have ended early
+		if(_currentFrame >= _totalFrames)
+			break;
+		
+		blockFrames = (UInt32)MIN((SInt64)blockFrames, _totalFrames - _currentFrame);
+		
+		// Outputs _interpolation frames apart share a phase, and their input is _decimation frames apart
+		for(UInt32 frame = 0; frame < MIN(blockFrames, _interpolation); ++frame) {
+			SInt64			position	= (_currentFrame + frame) * _decimation;
+			const float		*filter		= _filters + ((position % _interpolation) * _taps);
+			UInt32			offset		= (UInt32)((position / _interpolation) - _leadingTaps - _historyStart);
+			UInt32			count		= (blockFrames - frame + _interpolation - 1) / _interpolation;
+			
+			for(UInt32 channel = 0; channel < bufferList->mNumberBuffers; ++channel) {
+				float *output = (float *)bufferList->mBuffers[channel].mData + framesWritten + frame;
+				
+				if(1 == _interpolation)
+					vDSP_desamp(_history[channel] + offset, _decimation, filter, output, count, _taps);
+				else {
+					vDSP_desamp(_history[channel] + offset, _decimation, filter, _phaseOutput, count, _taps);
+					cblas_scopy((int)count, _phaseOutput, 1, output, (int)_interpolation);
+				}
+			}
+		}
+		
+		framesWritten	+= blockFrames;
+		_currentFrame	+= blockFrames;
+	}
+	
+	for(UInt32 channel = 0; channel < bufferList->mNumberBuffers; ++channel) {
+		bufferList->mBuffers[channel].mNumberChannels	= 1;
+		bufferList->mBuffers[channel].mDataByteSize		= framesWritten * sizeof(float);
+	}
+	
+	return framesWritten;
+}
+
+@end
+
+@implementation ConvertingAudioDecoder (Private)
+
+- (void) mapInputFrames:(UInt32)frameCount
+{
+	UInt32	inputChannels		= _inputBufferList->mNumberBuffers;
+	UInt32	outputChannels		= _format.mChannelsPerFrame;
+	
+	for(UInt32 channel = 0; channel < outputChannels; ++channel) {
+		float			*output		= _history[channel] + _historyLength;
+		const float		*left		= _inputBufferList->mBuffers[0].mData;
+		
+		// Mono is copied to both front channels, and everything else is downmixed to mono from the front channels
+		if(1 == inputChannels && 2 > channel)
+			memcpy(output, left, frameCount * sizeof(float));
+		else if(1 == outputChannels && 1 < inputChannels) {
+			float half = 0.5f;
+			vDSP_vadd(left, 1, _inputBufferList->mBuffers[1].mData, 1, output, 1, frameCount);
+			vDSP_vsmul(output, 1, &half, output, 1, frameCount);
+		}
+		else if(channel < inputChannels)
+			memcpy(output, _inputBufferList->mBuffers[channel].mData, frameCount * sizeof(float));
+		else
+			memset(output, 0, frameCount * sizeof(float));
+	}
+	
+	_historyLength += frameCount;
+}
+
+- (void) appendSilence:(UInt32)frameCount
+{
+	for(UInt32 channel = 0; channel < _format.mChannelsPerFrame; ++channel)
+		memset(_history[channel] + _historyLength, 0, frameCount * sizeof(float));
+	
+	_historyLength += frameCount;
+}
+
+- (BOOL) fillHistoryFromFrame:(SInt64)firstFrame throughFrame:(SInt64)lastFrame
+{
+	while(_historyStart + _historyLength <= lastFrame) {
+		// Make room by discarding input that no longer contributes to the output
+		if(INPUT_BUFFER_FRAMES > _historyCapacity - _historyLength && firstFrame > _historyStart) {
+			UInt32 framesToDiscard = (UInt32)MIN(firstFrame - _historyStart, (SInt64)_historyLength);
+			
+			for(UInt32 channel = 0; channel < _format.mChannelsPerFrame; ++channel)
+				memmove(_history[channel], _history[channel] + framesToDiscard, (_historyLength - framesToDiscard) * sizeof(float));
+			
+			_historyStart	+= framesToDiscard;
+			_historyLength	-= framesToDiscard;
+		}
+		
+		UInt32 framesToRead = MIN(_historyCapacity - _historyLength, INPUT_BUFFER_FRAMES);
+		if(0 == framesToRead)
+			return NO;
+		
+		// After the decoder ends, silence flushes the filter
+		if(_decoderAtEnd) {
+			[self appendSilence:framesToRead];
+			continue;
+		}
+		
+		for(UInt32 i = 0; i < _inputBufferList->mNumberBuffers; ++i)
+			_inputBufferList->mBuffers[i].mDataByteSize = INPUT_BUFFER_FRAMES * sizeof(float);
+		
+		UInt32 framesRead = [_decoder readAudio:_inputBufferList frameCount:framesToRead];
+		if(0 == framesRead) {
+			SInt64 inputFrames = _historyStart + _historyLength;
+			
+			_decoderAtEnd	= YES;
+			_totalFrames	= MIN(_totalFrames, ((inputFrames * _interpolation) + _decimation - 1) / _decimation);
+			continue;
+		}
+		
+		[self mapInputFrames:framesRead];
+	}
+	
+	return YES;
+}
+
+- (void) resetHistoryAtFrame:(SInt64)frame
+{
+	_historyStart	= frame;
+	_historyLength	= 0;
+	_decoderAtEnd	= NO;
+	
+	// Frames before the start of the audio are silent
+	if(0 > frame)
+		[self appendSilence:(UInt32)-frame];
+}
+
+@end
@@ -0,0 +1,121 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+#include <CoreAudio/CoreAudioTypes.h>
+
+@class DecodedAudioChunk;
+
+// ========================================
+// Decoded (32-bit float non-interleaved) PCM for one chunk of a region of a file
+// Once the cache holds more than a threshold in memory, further chunks are memory
+// mapped from unlinked temporary files so the kernel can page them out
+// Once complete the audio is immutable and may be read from any thread
+// ========================================
+@interface DecodedAudio : NSObject
+{
+	@private
+	AudioStreamBasicDescription		_format;
+	UInt32							_frameCount;
+	
+	DecodedAudioChunk				*_chunk;			// Channel n starts at frame (n * _frameCount)
+}
+
+- (AudioStreamBasicDescription) format;
+- (UInt32) frameCount;
+
+// The size of the decoded audio, in bytes
+- (size_t) length;
+- (BOOL) isMapped;
+
+// Returns the number of frames copied to bufferList
+- (UInt32) readAudio:(AudioBufferList *)bufferList startingFrame:(UInt32)startingFrame frameCount:(UInt32)frameCount;
+
+// Only for filling the audio before it is added to the cache
+- (void) writeAudio:(const AudioBufferList *)bufferList startingFrame:(UInt32)startingFrame frameCount:(UInt32)frameCount;
+@end
+
+// ========================================
+// A bounded, least-recently-used cache of decoded audio, keyed by file identity
+// (device, inode, size and modification date) and frame range
+// Regions that are replayed (loops, repeated cue sheet tracks) are then
+// served without decoding
+// Regions are cached in fixed-size chunks, so regions of any length can be
+// cached and eviction frees memory a chunk at a time
+// Chunks are allocated ahead of time on a background queue, so filling the
+// cache never allocates on the decoding thread
+// The cache is disabled unless the "enableDecodedAudioCache" default is set;
+// "decodedAudioCacheSize" is its budget in megabytes
+// ========================================
+@interface DecodedAudioCache : NSObject
+{
+	@private
+	NSMutableDictionary		*_audio;				// Key -> DecodedAudio
+	NSMutableArray			*_recentlyUsedKeys;		// Least recently used first
+	
+	NSMutableArray			*_spareChunks;			// Preallocated DecodedAudioChunk, CHUNK_SIZE bytes each
+	NSMutableArray			*_spareMappedChunks;
+	BOOL					_refillingSpareChunks;
+	
+	size_t					_bytesResident;
+	size_t					_bytesMapped;
+	
+	NSUInteger				_hits;
+	NSUInteger				_misses;
+}
+
+// ========================================
+// The shared instance
++ (DecodedAudioCache *) sharedCache;
+
+// ========================================
+// Returns nil if the file can't be examined
++ (NSString *) keyForURL:(NSURL *)url startingFrame:(SInt64)startingFrame frameCount:(UInt32)frameCount;
+
+// The number of frames in each chunk of a region in format
++ (UInt32) framesPerChunkForFormat:(AudioStreamBasicDescription)format;
+
+// ========================================
+// Whether the "enableDecodedAudioCache" default is set
+- (BOOL) isEnabled;
+
+// ========================================
+// Returns nil (and counts a miss) if the chunk isn't cached or the cache is disabled
+- (DecodedAudio *) audioForKey:(NSString *)key chunk:(UInt32)chunk;
+
+// ========================================
+// Returns empty audio for one chunk to be filled and then passed to setAudio:forKey:chunk:,
+// or nil if the cache is disabled, the format isn't supported or no chunk is ready
+- (DecodedAudio *) audioBufferWithFormat:(AudioStreamBasicDescription)format frameCount:(UInt32)frameCount;
+- (void) setAudio:(DecodedAudio *)audio forKey:(NSString *)key chunk:(UInt32)chunk;
+
+- (void) removeAllAudio;
+
+// ========================================
+// Statistics
+- (NSUInteger) hits;
+- (NSUInteger) misses;
+- (double) hitRate;
+
+// Bytes of decoded audio in the cache, and how many of those are memory mapped
+- (size_t) bytesResident;
+- (size_t) bytesMapped;
+
+@end
@@ -0,0 +1,403 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "DecodedAudioCache.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The size of each chunk of cached audio, about 3 seconds of 44.1 kHz stereo
+#define CHUNK_SIZE					(1024 * 1024)
+
+// The number of chunks kept allocated for the decoding threads to fill
+#define SPARE_CHUNK_COUNT			4
+
+// The default budget, in megabytes, if none is set
+#define DEFAULT_CACHE_SIZE			256
+
+// Chunks beyond this many bytes of cached audio are memory mapped from temporary files
+#define MAPPING_THRESHOLD			(64 * 1024 * 1024)
+
+// ========================================
+// The memory for one chunk, either allocated or memory mapped
+// ========================================
+@interface DecodedAudioChunk : NSObject
+{
+	@private
+	void			*_bytes;
+	size_t			_length;
+	BOOL			_mapped;
+}
+
+// Every page is touched, so the decoding thread doesn't take the page faults
+- (id) initWithLength:(size_t)length mapped:(BOOL)mapped;
+
+- (void *) bytes;
+- (size_t) length;
+- (BOOL) isMapped;
+@end
+
+@interface DecodedAudio (Private)
+- (id) initWithFormat:(AudioStreamBasicDescription)format frameCount:(UInt32)frameCount chunk:(DecodedAudioChunk *)chunk;
+@end
+
+@interface DecodedAudioCache (Private)
+- (size_t) budget;
+- (void) evictAudioToFit:(size_t)length;
+- (void) removeAudioForKey:(NSString *)key;
+- (void) refillSpareChunks;
+@end
+
+@implementation DecodedAudioChunk
+
+- (id) initWithLength:(size_t)length mapped:(BOOL)mapped
+{
+	NSParameterAssert(0 < length);
+	
+	if((self = [super init])) {
+		_length		= length;
+		
+		if(NO == mapped) {
+			_bytes = malloc(_length);
+			if(NULL == _bytes)
+				return nil;
+		}
+		else {
+			// The file is unlinked immediately so it disappears with the mapping
+			char path [ PATH_MAX ];
+			snprintf(path, PATH_MAX, "%sPlay.DecodedAudio.XXXXXX", [NSTemporaryDirectory() fileSystemRepresentation]);
+			
+			int fd = mkstemp(path);
+			if(-1 == fd)
+				return nil;
+			
+			unlink(path);
+			
+			if(-1 == ftruncate(fd, (off_t)_length)) {
+				close(fd);
+				return nil;
+			}
+			
+			void *mapping = mmap(NULL, _length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			
+			if(MAP_FAILED == mapping)
+				return nil;
+			
+			_bytes		= mapping;
+			_mapped		= YES;
+		}
+		
+		memset(_bytes, 0, _length);
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	if(_mapped)
+		munmap(_bytes, _length);
+	else
+		free(_bytes);
+}
+
+- (void *)			bytes					{ return _bytes; }
+- (size_t)			length					{ return _length; }
+- (BOOL)			isMapped				{ return _mapped; }
+
+@end
+
+@implementation DecodedAudio
+
+- (id) initWithFormat:(AudioStreamBasicDescription)format frameCount:(UInt32)frameCount chunk:(DecodedAudioChunk *)chunk
+{
+	NSParameterAssert(0 < frameCount);
+	NSParameterAssert(nil != chunk);
+	NSParameterAssert((size_t)frameCount * format.mChannelsPerFrame * sizeof(float) <= [chunk length]);
+	
+	if((self = [super init])) {
+		_format			= format;
+		_frameCount		= frameCount;
+		_chunk			= chunk;
+	}
+	return self;
+}
+
+- (AudioStreamBasicDescription)		format					{ return _format; }
+- (UInt32)							frameCount				{ return _frameCount; }
+- (size_t)							length					{ return [_chunk length]; }
+- (BOOL)							isMapped				{ return [_chunk isMapped]; }
+
+- (UInt32) readAudio:(AudioBufferList *)bufferList startingFrame:(UInt32)startingFrame frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(NULL != bufferList);
+	NSParameterAssert(bufferList->mNumberBuffers == _format.mChannelsPerFrame);
+	
+	const float		*samples		= (const float *)[_chunk bytes];
+	UInt32			framesToCopy	= (startingFrame < _frameCount ? MIN(frameCount, _frameCount - startingFrame) : 0);
+	
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i) {
+		memcpy(bufferList->mBuffers[i].mData, samples + (i * _frameCount) + startingFrame, framesToCopy * sizeof(float));
+		bufferList->mBuffers[i].mDataByteSize = framesToCopy * sizeof(float);
+	}
+	
+	return framesToCopy;
+}
+
+- (void) writeAudio:(const AudioBufferList *)bufferList startingFrame:(UInt32)startingFrame frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(NULL != bufferList);
+	NSParameterAssert(bufferList->mNumberBuffers == _format.mChannelsPerFrame);
+	NSParameterAssert(startingFrame + frameCount <= _frameCount);
+	
+	float *samples = (float *)[_chunk bytes];
+	
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
+		memcpy(samples + (i * _frameCount) + startingFrame, bufferList->mBuffers[i].mData, frameCount * sizeof(float));
+}
+
+@end
+
+@implementation DecodedAudioCache
+
++ (DecodedAudioCache *) sharedCache
+{
+	static DecodedAudioCache *sharedCache = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sharedCache = [[self alloc] init];
+	});
+	return sharedCache;
+}
+
++ (NSString *) keyForURL:(NSURL *)url startingFrame:(SInt64)startingFrame frameCount:(UInt32)frameCount
+{
+	NSParameterAssert(nil != url);
+	
+	struct stat sb;
+	if(NO == [url isFileURL] || -1 == stat([[url path] fileSystemRepresentation], &sb))
+		return nil;
+	
+	// The modification date and size change whenever the file is rewritten
+	return [NSString stringWithFormat:@"%llu:%llu:%lld:%ld.%09ld:%lld:%u", 
+		(unsigned long long)sb.st_dev, (unsigned long long)sb.st_ino, (long long)sb.st_size, 
+		(long)sb.st_mtimespec.tv_sec, (long)sb.st_mtimespec.tv_nsec, startingFrame, frameCount];
+}
+
++ (UInt32) framesPerChunkForFormat:(AudioStreamBasicDescription)format
+{
+	return (UInt32)(CHUNK_SIZE / (MAX(1u, format.mChannelsPerFrame) * sizeof(float)));
+}
+
+- (id) init
+{
+	if((self = [super init])) {
+		_audio				= [[NSMutableDictionary alloc] init];
+		_recentlyUsedKeys	= [[NSMutableArray alloc] init];
+		_spareChunks		= [[NSMutableArray alloc] init];
+		_spareMappedChunks	= [[NSMutableArray alloc] init];
+	}
+	return self;
+}
+
+- (BOOL) isEnabled
+{
+	return [[NSUserDefaults standardUserDefaults] boolForKey:@"enableDecodedAudioCache"];
+}
+
+- (DecodedAudio *) audioForKey:(NSString *)key chunk:(UInt32)chunk
+{
+	NSParameterAssert(nil != key);
+	
+	if(NO == [self isEnabled])
+		return nil;
+	
+	NSString *chunkKey = [NSString stringWithFormat:@"%@#%u", key, chunk];
+	
+	@synchronized(self) {
+		DecodedAudio *audio = [_audio objectForKey:chunkKey];
+		
+		if(nil == audio) {
+			++_misses;
+			return nil;
+		}
+		
+		++_hits;
+		
+		[_recentlyUsedKeys removeObject:chunkKey];
+		[_recentlyUsedKeys addObject:chunkKey];
+		
+		return audio;
+	}
+}
+
+- (DecodedAudio *) audioBufferWithFormat:(AudioStreamBasicDescription)format frameCount:(UInt32)frameCount
+{
+	if(NO == [self isEnabled])
+		return nil;
+	
+	// Only the canonical (non-interleaved float) format is supported
+	if(kAudioFormatLinearPCM != format.mFormatID || !(kAudioFormatFlagIsFloat & format.mFormatFlags) || !(kAudioFormatFlagIsNonInterleaved & format.mFormatFlags) || 32 != format.mBitsPerChannel)
+		return nil;
+	
+	if(0 == frameCount || [[self class] framesPerChunkForFormat:format] < frameCount)
+		return nil;
+	
+	DecodedAudioChunk *chunk = nil;
+	@synchronized(self) {
+		// Use a mapped chunk once the cache holds enough in memory, but take whichever kind is ready
+		NSMutableArray *preferred	= (MAPPING_THRESHOLD <= _bytesResident - _bytesMapped ? _spareMappedChunks : _spareChunks);
+		NSMutableArray *other		= (preferred == _spareChunks ? _spareMappedChunks : _spareChunks);
+		
+		chunk = [preferred lastObject];
+		if(nil != chunk)
+			[preferred removeLastObject];
+		else {
+			chunk = [other lastObject];
+			if(nil != chunk)
+				[other removeLastObject];
+		}
+		
+		[self refillSpareChunks];
+	}
+	
+	// If no chunk is ready this one simply isn't cached
+	if(nil == chunk)
+		return nil;
+	
+	return [[DecodedAudio alloc] initWithFormat:format frameCount:frameCount chunk:chunk];
+}
+
+- (void) setAudio:(DecodedAudio *)audio forKey:(NSString *)key chunk:(UInt32)chunk
+{
+	NSParameterAssert(nil != audio);
+	NSParameterAssert(nil != key);
+	
+	NSString *chunkKey = [NSString stringWithFormat:@"%@#%u", key, chunk];
+	
+	@synchronized(self) {
+		[self removeAudioForKey:chunkKey];
+		[self evictAudioToFit:[audio length]];
+		
+		[_audio setObject:audio forKey:chunkKey];
+		[_recentlyUsedKeys addObject:chunkKey];
+		
+		_bytesResident += [audio length];
+		if([audio isMapped])
+			_bytesMapped += [audio length];
+	}
+}
+
+- (void) removeAllAudio
+{
+	@synchronized(self) {
+		[_audio removeAllObjects];
+		[_recentlyUsedKeys removeAllObjects];
+		[_spareChunks removeAllObjects];
+		[_spareMappedChunks removeAllObjects];
+		
+		_bytesResident	= 0;
+		_bytesMapped	= 0;
+	}
+}
+
+- (NSUInteger)		hits						{ @synchronized(self) { return _hits; } }
+- (NSUInteger)		misses						{ @synchronized(self) { return _misses; } }
+- (size_t)			bytesResident				{ @synchronized(self) { return _bytesResident; } }
+- (size_t)			bytesMapped					{ @synchronized(self) { return _bytesMapped; } }
+
+- (double) hitRate
+{
+	@synchronized(self) {
+		NSUInteger lookups = _hits + _misses;
+		return (0 == lookups ? 0 : (double)_hits / lookups);
+	}
+}
+
+@end
+
+@implementation DecodedAudioCache (Private)
+
+- (size_t) budget
+{
+	NSInteger megabytes = [[NSUserDefaults standardUserDefaults] integerForKey:@"decodedAudioCacheSize"];
+	return (size_t)(0 < megabytes ? megabytes : DEFAULT_CACHE_SIZE) * 1024 * 1024;
+}
+
+- (void) evictAudioToFit:(size_t)length
+{
+	size_t budget = [self budget];
+	
+	// Audio still being played is retained by its decoder, so eviction only drops the cache's reference
+	while(0 != [_recentlyUsedKeys count] && budget < _bytesResident + length)
+		[self removeAudioForKey:[_recentlyUsedKeys objectAtIndex:0]];
+}
+
+- (void) removeAudioForKey:(NSString *)key
+{
+	DecodedAudio *audio = [_audio objectForKey:key];
+	if(nil == audio)
+		return;
+	
+	_bytesResident -= [audio length];
+	if([audio isMapped])
+		_bytesMapped -= [audio length];
+	
+	[_audio removeObjectForKey:key];
+	[_recentlyUsedKeys removeObject:key];
+}
+
+// Called with the lock held
+// Chunks are kept ready of the kind the cache will use next
+- (void) refillSpareChunks
+{
+	if(_refillingSpareChunks || SPARE_CHUNK_COUNT <= [_spareChunks count] + [_spareMappedChunks count])
+		return;
+	
+	_refillingSpareChunks = YES;
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+		for(;;) {
+			BOOL mapped = NO;
+			@synchronized(self) {
+				if(SPARE_CHUNK_COUNT <= [_spareChunks count] + [_spareMappedChunks count]) {
+					_refillingSpareChunks = NO;
+					return;
+				}
+				
+				mapped = (MAPPING_THRESHOLD <= _bytesResident - _bytesMapped + (CHUNK_SIZE * [_spareChunks count]));
+			}
+			
+			DecodedAudioChunk *chunk = [[DecodedAudioChunk alloc] initWithLength:CHUNK_SIZE mapped:mapped];
+			
+			@synchronized(self) {
+				if(nil == chunk) {
+					_refillingSpareChunks = NO;
+					return;
+				}
+				
+				[(mapped ? _spareMappedChunks : _spareChunks) addObject:chunk];
+			}
+		}
+	});
+}
+
+@end
@@ -21,9 +21,11 @@
 #import <Cocoa/Cocoa.h>
 #import "AudioDecoderMethods.h"
 
-@class AudioDecoder;
+@class AudioDecoder, DecodedAudio;
 
 // A wrapper around an AudioDecoder
+// When the DecodedAudioCache is enabled, the region is cached a chunk at a time
+// as it is decoded so later passes (loops, or replaying the region) don't decode
 @interface LoopableRegionDecoder : NSObject <AudioDecoderMethods>
 {
 	AudioDecoder	*_decoder;
@@ -35,6 +37,12 @@
 	UInt32			_framesReadInCurrentLoop;
 	SInt64			_totalFramesRead;
 	NSUInteger		_completedLoops;
+	
+	NSString		*_cacheKey;					// Identifies this region in the DecodedAudioCache
+	UInt32			_framesPerChunk;
+	UInt32			_chunk;						// The chunk being read, or NO_CHUNK
+	DecodedAudio	*_cachedAudio;				// The decoded chunk, if cached
+	DecodedAudio	*_pendingAudio;				// The chunk as it is decoded, for the cache
 }
 
 + (id) decoderWithURL:(NSURL *)URL startingFrame:(SInt64)startingFrame error:(NSError **)error;
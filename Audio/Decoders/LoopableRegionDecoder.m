@@ -20,9 +20,17 @@
 
 #import "LoopableRegionDecoder.h"
 #import "AudioDecoder.h"
+#import "DecodedAudioCache.h"
+
+// No chunk is being read
+#define NO_CHUNK		UINT32_MAX
 
 @interface LoopableRegionDecoder (Private)
 - (AudioDecoder *) decoder;
+- (NSString *) cacheKey;
+- (void) beginChunk:(UInt32)chunk;
+- (void) endChunk;
+- (UInt32) readChunkAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount;
 @end
 
 @implementation LoopableRegionDecoder
@@ -123,7 +131,10 @@
 {
 	NSParameterAssert(0 <= startingFrame);
 	
-	_startingFrame = startingFrame;
+	_startingFrame	= startingFrame;
+	_cacheKey		= nil;
+	
+	[self endChunk];
 }
 
 - (UInt32)			frameCount							{ return _frameCount; }
@@ -132,7 +143,10 @@
 {
 	NSParameterAssert(0 < frameCount);
 	
-	_frameCount = frameCount;
+	_frameCount		= frameCount;
+	_cacheKey		= nil;
+	
+	[self endChunk];
 }
 
 #pragma mark Decoding
@@ -151,7 +165,7 @@
 	_framesReadInCurrentLoop	=     (UInt32) frame % [self frameCount];
 	_totalFramesRead			= frame;
 	
-	[[self decoder] seekToFrame:[self startingFrame] + _framesReadInCurrentLoop];
+	[self endChunk];
 	
 	return [self currentFrame];
 }
@@ -164,34 +178,42 @@
 	if([self loopCount] < [self completedLoops])
 		return 0;
 	
-	UInt32	framesRemaining		= (UInt32)([self startingFrame] + [self frameCount] - [[self decoder] currentFrame]);
-	UInt32	framesToRead		= (frameCount < framesRemaining ? frameCount : framesRemaining);
-	UInt32	framesRead			= 0;
+	// Fill the request across chunk boundaries, but stop at the end of the pass
+	AudioBuffer			viewBuffers [bufferList->mNumberBuffers + 1];
+	AudioBufferList		*view				= (AudioBufferList *)viewBuffers;
+	NSUInteger			completedLoops		= [self completedLoops];
+	UInt32				framesRead			= 0;
 	
-	if(0 < framesToRead)
-		framesRead = [[self decoder] readAudio:bufferList frameCount:framesToRead];
-	
-	_framesReadInCurrentLoop	+= framesRead;
-	_totalFramesRead			+= framesRead;
+	view->mNumberBuffers = bufferList->mNumberBuffers;
 	
-	if([self frameCount] == _framesReadInCurrentLoop || (0 == framesRead && 0 != framesToRead)) {
-		++_completedLoops;
-		_framesReadInCurrentLoop = 0;
+	while(framesRead < frameCount && completedLoops == [self completedLoops]) {
+		for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i) {
+			view->mBuffers[i].mNumberChannels	= bufferList->mBuffers[i].mNumberChannels;
+			view->mBuffers[i].mData				= (float *)bufferList->mBuffers[i].mData + framesRead;
+			view->mBuffers[i].mDataByteSize		= (frameCount - framesRead) * sizeof(float);
+		}
 		
-		if([self loopCount] > [self completedLoops])
-			[[self decoder] seekToFrame:[self startingFrame]];
+		UInt32 chunkFramesRead = [self readChunkAudio:view frameCount:(frameCount - framesRead)];
+		if(0 == chunkFramesRead)
+			break;
+		
+		framesRead += chunkFramesRead;
 	}
 	
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers; ++i)
+		bufferList->mBuffers[i].mDataByteSize = framesRead * sizeof(float);
+	
 	return framesRead;	
 }
 
 - (void) reset
 {
-	[[self decoder] seekToFrame:[self startingFrame]];
-	
+	// The decoder is positioned when the first chunk is read, so cached regions are never decoded
 	_framesReadInCurrentLoop	= 0;
 	_totalFramesRead			= 0;
 	_completedLoops				= 0;
+	
+	[self endChunk];
 }
 
 #pragma mark AudioDecoder pass-throughs
@@ -214,4 +236,88 @@
 @implementation LoopableRegionDecoder (Private)
 - (AudioDecoder *)	decoder									{ return _decoder; }
 
+- (NSString *) cacheKey
+{
+	// Don't stat the file when nothing will be cached
+	if(nil == _cacheKey && [[DecodedAudioCache sharedCache] isEnabled])
+		_cacheKey = [DecodedAudioCache keyForURL:[[self decoder] URL] startingFrame:[self startingFrame] frameCount:[self frameCount]];
+	return _cacheKey;
+}
+
+- (void) beginChunk:(UInt32)chunk
+{
+	_chunk				= chunk;
+	_pendingAudio		= nil;
+	_cachedAudio		= (nil != [self cacheKey] ? [[DecodedAudioCache sharedCache] audioForKey:[self cacheKey] chunk:chunk] : nil);
+	
+	if(nil != _cachedAudio)
+		return;
+	
+	SInt64 frame = [self startingFrame] + _framesReadInCurrentLoop;
+	if([[self decoder] currentFrame] != frame)
+		[[self decoder] seekToFrame:frame];
+	
+	// Decoded audio is only cached if reading starts at the beginning of the chunk
+	if(nil != [self cacheKey] && chunk * _framesPerChunk == _framesReadInCurrentLoop) {
+		UInt32 chunkFrames	= MIN(_framesPerChunk, [self frameCount] - (chunk * _framesPerChunk));
+		_pendingAudio		= [[DecodedAudioCache sharedCache] audioBufferWithFormat:[self format] frameCount:chunkFrames];
+	}
+}
+
+- (void) endChunk
+{
+	_chunk				= NO_CHUNK;
+	_cachedAudio		= nil;
+	_pendingAudio		= nil;
+}
+
+- (UInt32) readChunkAudio:(AudioBufferList *)bufferList frameCount:(UInt32)frameCount
+{
+	if(0 == _framesPerChunk)
+		_framesPerChunk = [DecodedAudioCache framesPerChunkForFormat:[self format]];
+	
+	UInt32 chunk = _framesReadInCurrentLoop / _framesPerChunk;
+	if(chunk != _chunk)
+		[self beginChunk:chunk];
+	
+	UInt32	chunkStart			= chunk * _framesPerChunk;
+	UInt32	chunkFrames			= MIN(_framesPerChunk, [self frameCount] - chunkStart);
+	UInt32	offset				= _framesReadInCurrentLoop - chunkStart;
+	UInt32	framesToRead		= MIN(frameCount, chunkFrames - offset);
+	UInt32	framesRead			= 0;
+	
+	if(nil != _cachedAudio)
+		framesRead = [_cachedAudio readAudio:bufferList startingFrame:offset frameCount:framesToRead];
+	else {
+		UInt32 framesRemaining	= (UInt32)([self startingFrame] + [self frameCount] - [[self decoder] currentFrame]);
+		framesToRead			= MIN(framesToRead, framesRemaining);
+		
+		if(0 < framesToRead)
+			framesRead = [[self decoder] readAudio:bufferList frameCount:framesToRead];
+		
+		if(nil != _pendingAudio && 0 < framesRead)
+			[_pendingAudio writeAudio:bufferList startingFrame:offset frameCount:framesRead];
+	}
+	
+	_framesReadInCurrentLoop	+= framesRead;
+	_totalFramesRead			+= framesRead;
+	
+	// Only a complete chunk is worth caching
+	if(chunkStart + chunkFrames == _framesReadInCurrentLoop) {
+		if(nil != _pendingAudio)
+			[[DecodedAudioCache sharedCache] setAudio:_pendingAudio forKey:[self cacheKey] chunk:chunk];
+		
+		[self endChunk];
+	}
+	
+	if([self frameCount] == _framesReadInCurrentLoop || (0 == framesRead && 0 != framesToRead)) {
+		++_completedLoops;
+		_framesReadInCurrentLoop	= 0;
+		
+		[self endChunk];
+	}
+	
+	return framesRead;
+}
+
 @end
@@ -26,9 +26,12 @@
 @interface WavPackDecoder : AudioDecoder
 {
     WavpackContext		*_wpc;
+	FILE				*_file;				// Non-NULL when _wpc was opened partway through the file
 	
 	SInt64				_totalFrames;
 	SInt64				_currentFrame;
+	
+	NSData				*_seekTable;		// WavPackSeekPoint entries, ordered by frame
 }
 
 @end
@@ -20,9 +20,124 @@
 
 #import "WavPackDecoder.h"
 #import "AudioStream.h"
+#import "CollectionManager.h"
+#import "AudioStreamManager.h"
+
+#include <sys/stat.h>
+
+// ========================================
+// Seeking in WavPack searches the file for the block containing the target
+// sample, which is slow in large cue sheet images
+// A seek table maps frames to the file offsets of the blocks containing them, with an
+// entry for the block containing each track in the image plus one every SEEK_TABLE_INTERVAL
+// seconds; it is built once in the background and stored in the database
+// ========================================
+#define SEEK_TABLE_INTERVAL			5
+#define WAVPACK_HEADER_SIZE			32
+#define SKIP_BUFFER_FRAMES			4096
+
+typedef struct {
+	SInt64		frame;		// The first frame in the block
+	SInt64		offset;		// The file offset of the block's header
+} WavPackSeekPoint;
+
+static NSOperationQueue		*sSeekTableQueue		= nil;
+static NSMutableSet			*sPendingSeekTables		= nil;
+
+// ========================================
+// Stream reader callbacks, for opening files at an arbitrary block
+static int32_t		readBytes(void *id, void *data, int32_t bcount)			{ return (int32_t)fread(data, 1, bcount, (FILE *)id); }
+static uint32_t		getPosition(void *id)									{ return (uint32_t)ftello((FILE *)id); }
+static int			setPositionAbsolute(void *id, uint32_t pos)				{ return fseeko((FILE *)id, pos, SEEK_SET); }
+static int			setPositionRelative(void *id, int32_t delta, int mode)	{ return fseeko((FILE *)id, delta, mode); }
+static int			pushBackByte(void *id, int c)							{ return ungetc(c, (FILE *)id); }
+static int			canSeek(void *id)										{ return 1; }
+static int32_t		writeBytes(void *id, void *data, int32_t bcount)		{ return (int32_t)fwrite(data, 1, bcount, (FILE *)id); }
+
+static uint32_t
+getLength(void *id)
+{
+	struct stat sb;
+	return (-1 == fstat(fileno((FILE *)id), &sb) ? 0 : (uint32_t)sb.st_size);
+}
+
+static WavpackStreamReader sStreamReader = {
+	readBytes, getPosition, setPositionAbsolute, setPositionRelative, pushBackByte, getLength, canSeek, writeBytes
+};
+
+// ========================================
+// Scan the block headers, recording the block containing each starting frame and
+// one block per interval
+static NSData *
+buildSeekTable(NSString *path, NSArray *startingFrames, SInt64 interval)
+{
+	FILE *file = fopen([path fileSystemRepresentation], "r");
+	if(NULL == file)
+		return nil;
+	
+	NSMutableData		*seekTable		= [NSMutableData data];
+	NSUInteger			nextStart		= 0;
+	SInt64				nextInterval	= 0;
+	off_t				offset			= 0;
+	uint8_t				header			[ WAVPACK_HEADER_SIZE ];
+	
+	for(;;) {
+		if(-1 == fseeko(file, offset, SEEK_SET) || WAVPACK_HEADER_SIZE != fread(header, 1, WAVPACK_HEADER_SIZE, file))
+			break;
+		
+		// Trailing tags (or anything else) end the scan
+		if(memcmp(header, "wvpk", 4))
+			break;
+		
+		uint32_t	blockSize		= OSReadLittleInt32(header, 4);
+		uint32_t	blockIndex		= OSReadLittleInt32(header, 16);
+		uint32_t	blockSamples	= OSReadLittleInt32(header, 20);
+		uint32_t	flags			= OSReadLittleInt32(header, 24);
+		
+		// Multichannel audio is stored as several blocks per frame, and only the first may be used to start decoding
+		if(0 != blockSamples && (INITIAL_BLOCK & flags)) {
+			BOOL record = (blockIndex >= nextInterval);
+			
+			while(nextStart < [startingFrames count] && [[startingFrames objectAtIndex:nextStart] longLongValue] < blockIndex + blockSamples) {
+				if([[startingFrames objectAtIndex:nextStart] longLongValue] >= blockIndex)
+					record = YES;
+				++nextStart;
+			}
+			
+			if(record) {
+				WavPackSeekPoint point = { blockIndex, offset };
+				[seekTable appendBytes:&point length:sizeof(point)];
+				nextInterval = blockIndex + interval;
+			}
+		}
+		
+		offset += 8 + blockSize;
+	}
+	
+	fclose(file);
+	
+	return (0 != [seekTable length] ? seekTable : nil);
+}
+
+@interface WavPackDecoder (Private)
+- (void) loadSeekTable;
+- (const WavPackSeekPoint *) seekPointForFrame:(SInt64)frame;
+- (BOOL) openAtSeekPoint:(const WavPackSeekPoint *)point;
+- (BOOL) skipFrames:(SInt64)frameCount;
+@end
 
 @implementation WavPackDecoder
 
++ (void) initialize
+{
+	if([WavPackDecoder class] == self) {
+		sSeekTableQueue = [[NSOperationQueue alloc] init];
+		[sSeekTableQueue setMaxConcurrentOperationCount:1];
+		
+		sPendingSeekTables = [[NSMutableSet alloc] init];
+	}
+}
+
 - (id) initWithURL:(NSURL *)url error:(NSError **)error
 {
 	NSParameterAssert(nil != url);
@@ -69,6 +184,8 @@
 			case 1:		_channelLayout.mChannelLayoutTag = kAudioChannelLayoutTag_Mono;				break;
 			case 2:		_channelLayout.mChannelLayoutTag = kAudioChannelLayoutTag_Stereo;			break;
 		}
+		
+		[self loadSeekTable];
 	}
 	return self;
 }
@@ -77,6 +194,8 @@
 {
 	if(_wpc)
 		WavpackCloseFile(_wpc);
+	if(_file)
+		fclose(_file);
 }
 
 - (SInt64)			totalFrames							{ return _totalFrames; }
@@ -88,6 +207,18 @@
 {
 	NSParameterAssert(0 <= frame && frame < [self totalFrames]);
 	
+	// With a seek table, positioning is a single file seek plus decoding part of one interval
+	const WavPackSeekPoint *point = [self seekPointForFrame:frame];
+	if(NULL != point) {
+		// Decoding forward is cheaper than reopening if the current position is past the seek point
+		if(point->frame <= _currentFrame && _currentFrame <= frame) {
+			if([self skipFrames:frame - _currentFrame])
+				return _currentFrame;
+		}
+		else if([self openAtSeekPoint:point] && [self skipFrames:frame - _currentFrame])
+			return _currentFrame;
+	}
+	
 	int result = WavpackSeekSample(_wpc, (uint32_t)frame);
 	if(result)
 		_currentFrame = frame;
@@ -160,3 +291,127 @@
 }
 
 @end
+
+@implementation WavPackDecoder (Private)
+
+- (void) loadSeekTable
+{
+	// The database may only be used from the main thread, and correction files would need their own table
+	if(NO == [NSThread isMainThread] || [[NSFileManager defaultManager] fileExistsAtPath:[[[self URL] path] stringByAppendingString:@"c"]])
+		return;
+	
+	struct stat sb;
+	if(-1 == stat([[[self URL] path] fileSystemRepresentation], &sb))
+		return;
+	
+	AudioStreamManager		*streamManager			= [[CollectionManager manager] streamManager];
+	NSURL					*url					= [self URL];
+	SInt64					fileSize				= sb.st_size;
+	NSTimeInterval			modificationDate		= sb.st_mtimespec.tv_sec + (sb.st_mtimespec.tv_nsec / (double)NSEC_PER_SEC);
+	
+	_seekTable = [streamManager seekTableForURL:url fileSize:fileSize modificationDate:modificationDate];
+	if(nil != _seekTable)
+		return;
+	
+	// Only images containing cue sheet tracks need a table
+	NSArray *startingFrames = [streamManager startingFramesForURL:url];
+	if(0 == [startingFrames count] || [sPendingSeekTables containsObject:url])
+		return;
+	
+	[sPendingSeekTables addObject:url];
+	
+	SInt64 interval = (SInt64)(SEEK_TABLE_INTERVAL * [self format].mSampleRate);
+	[sSeekTableQueue addOperationWithBlock:^{
+		NSData *seekTable = buildSeekTable([url path], startingFrames, interval);
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if(nil != seekTable)
+				[[[CollectionManager manager] streamManager] setSeekTable:seekTable forURL:url fileSize:fileSize modificationDate:modificationDate];
+			[sPendingSeekTables removeObject:url];
+		});
+	}];
+}
+
+- (const WavPackSeekPoint *) seekPointForFrame:(SInt64)frame
+{
+	if(nil == _seekTable)
+		return NULL;
+	
+	const WavPackSeekPoint	*points		= [_seekTable bytes];
+	NSUInteger				count		= [_seekTable length] / sizeof(WavPackSeekPoint);
+	NSUInteger				low			= 0;
+	NSUInteger				high		= count;
+	
+	// Find the last point at or before frame
+	while(low < high) {
+		NSUInteger middle = low + (high - low) / 2;
+		if(points[middle].frame <= frame)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	
+	return (0 == low ? NULL : points + (low - 1));
+}
+
+- (BOOL) openAtSeekPoint:(const WavPackSeekPoint *)point
+{
+	NSParameterAssert(NULL != point);
+	
+	FILE *file = fopen([[[self URL] path] fileSystemRepresentation], "r");
+	if(NULL == file)
+		return NO;
+	
+	if(-1 == fseeko(file, point->offset, SEEK_SET)) {
+		fclose(file);
+		return NO;
+	}
+	
+	// WavPack blocks are self-contained, so decoding may begin at any initial block
+	char errorBuf [80];
+	WavpackContext *wpc = WavpackOpenFileInputEx(&sStreamReader, file, NULL, errorBuf, OPEN_NORMALIZE, 0);
+	if(NULL == wpc || (SInt64)WavpackGetSampleIndex(wpc) != point->frame) {
+		if(wpc)
+			WavpackCloseFile(wpc);
+		fclose(file);
+		return NO;
+	}
+	
+	if(_wpc)
+		WavpackCloseFile(_wpc);
+	if(_file)
+		fclose(_file);
+	
+	_wpc			= wpc;
+	_file			= file;
+	_currentFrame	= point->frame;
+	
+	return YES;
+}
+
+- (BOOL) skipFrames:(SInt64)frameCount
+{
+	NSParameterAssert(0 <= frameCount);
+	
+	if(0 == frameCount)
+		return YES;
+	
+	int32_t *buffer = calloc(SKIP_BUFFER_FRAMES * _format.mChannelsPerFrame, sizeof(int32_t));
+	if(NULL == buffer)
+		return NO;
+	
+	while(0 < frameCount) {
+		uint32_t samplesRead = WavpackUnpackSamples(_wpc, buffer, (uint32_t)MIN(frameCount, SKIP_BUFFER_FRAMES));
+		if(0 == samplesRead)
+			break;
+		
+		_currentFrame	+= samplesRead;
+		frameCount		-= samplesRead;
+	}
+	
+	free(buffer);
+	
+	return (0 == frameCount);
+}
+
+@end
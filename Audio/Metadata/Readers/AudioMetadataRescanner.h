@@ -0,0 +1,63 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+// ========================================
+// Rescans the metadata of many streams at once
+// Files are parsed on a single pool of worker threads, one per processor,
+// and files whose size, modification date and inode match the values
+// recorded at the previous scan are skipped.  The parsed metadata is applied
+// on the main thread in batches, each batch in a single transaction
+// ========================================
+@interface AudioMetadataRescanner : NSObject
+{
+	@private
+	NSOperationQueue		*_readerQueue;			// Shared by all file formats so the total number of readers is bounded
+	NSMutableArray			*_pendingResults;		// Parsed metadata not yet written to the database
+	NSMutableDictionary		*_formatStatistics;		// Parse cost for each file format
+	
+	NSUInteger				_outstandingFiles;		// Files queued but not yet processed
+	NSUInteger				_skippedFiles;			// Files that were unchanged since the last scan
+	NSUInteger				_failedFiles;			// Files whose metadata couldn't be read
+	NSUInteger				_finishedFiles;			// Files processed since the statistics were last logged
+	
+	NSUInteger				_generation;			// Incremented on cancel so stale results are dropped
+	BOOL					_flushScheduled;
+}
+
+// ========================================
+// The shared instance
++ (AudioMetadataRescanner *) sharedRescanner;
+
+// ========================================
+// Rescanning (must be called from the main thread)
+- (void) rescanMetadataForStreams:(NSArray *)streams;
+- (void) rescanMetadataForStreams:(NSArray *)streams skipUnchangedFiles:(BOOL)skipUnchangedFiles;
+
+- (void) cancel;
+- (BOOL) isRescanning;
+
+// ========================================
+// Per-format parse cost (NSDictionary of file count, bytes and seconds keyed by path extension)
+- (NSDictionary *) formatStatistics;
+- (void) resetFormatStatistics;
+
+@end
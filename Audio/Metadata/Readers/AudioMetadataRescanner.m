@@ -0,0 +1,336 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioMetadataRescanner.h"
+#import "AudioMetadataReader.h"
+#import "AudioStream.h"
+#import "CollectionManager.h"
+#import "UtilityFunctions.h"
+
+// Number of parsed files whose metadata is written in a single transaction
+#define RESCAN_BATCH_SIZE		250
+
+// ========================================
+// Keys for the per-format statistics
+// ========================================
+static NSString * const		RescanFileCountKey			= @"fileCount";
+static NSString * const		RescanByteCountKey			= @"byteCount";
+static NSString * const		RescanParseTimeKey			= @"parseTime";
+
+static NSString * const		RescanStreamKey				= @"stream";
+static NSString * const		RescanMetadataKey			= @"metadata";
+static NSString * const		RescanFileStampKey			= @"fileStamp";
+
+// ========================================
+// Returns YES if the file on disk is the same one seen at the previous scan
+static BOOL
+fileStampIsUnchanged(NSDictionary *storedStamp, NSDictionary *currentStamp)
+{
+	if(nil == storedStamp || nil == currentStamp)
+		return NO;
+	
+	NSNumber	*storedSize		= [storedStamp objectForKey:FileSizeKey];
+	NSDate		*storedDate		= [storedStamp objectForKey:FileModificationDateKey];
+	NSNumber	*storedInode	= [storedStamp objectForKey:FileInodeKey];
+	
+	if(nil == storedSize || nil == storedDate || nil == storedInode)
+		return NO;
+	
+	// Dates round-trip through the database as doubles, so allow for a little slop
+	return ([storedSize isEqualToNumber:[currentStamp objectForKey:FileSizeKey]] 
+			&& [storedInode isEqualToNumber:[currentStamp objectForKey:FileInodeKey]]
+			&& 0.000001 > fabs([storedDate timeIntervalSinceDate:[currentStamp objectForKey:FileModificationDateKey]]));
+}
+
+@interface AudioMetadataRescanner (Private)
+- (void) readMetadataForStream:(AudioStream *)stream URL:(NSURL *)url storedFileStamp:(NSDictionary *)storedStamp skipUnchangedFile:(BOOL)skipUnchangedFile generation:(NSUInteger)generation;
+- (void) finishFile:(NSDictionary *)result generation:(NSUInteger)generation;
+- (void) recordParseOfFormat:(NSString *)format byteCount:(unsigned long long)byteCount parseTime:(NSTimeInterval)parseTime;
+
+- (void) flushPendingResults;
+- (void) logFormatStatistics;
+@end
+
+// ========================================
+// The singleton instance
+// ========================================
+static AudioMetadataRescanner *sharedRescannerInstance = nil;
+
+@implementation AudioMetadataRescanner
+
++ (AudioMetadataRescanner *) sharedRescanner
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedRescannerInstance = [[self alloc] init];
+    });
+    return sharedRescannerInstance;
+}
+
+- (id) init
+{
+	if((self = [super init])) {
+		_readerQueue		= [[NSOperationQueue alloc] init];
+		[_readerQueue setMaxConcurrentOperationCount:[[NSProcessInfo processInfo] activeProcessorCount]];
+		
+		_pendingResults		= [[NSMutableArray alloc] init];
+		_formatStatistics	= [[NSMutableDictionary alloc] init];
+	}
+	return self;
+}
+
+- (void) rescanMetadataForStreams:(NSArray *)streams
+{
+	[self rescanMetadataForStreams:streams skipUnchangedFiles:YES];
+}
+
+- (void) rescanMetadataForStreams:(NSArray *)streams skipUnchangedFiles:(BOOL)skipUnchangedFiles
+{
+	NSParameterAssert(nil != streams);
+	NSAssert([NSThread isMainThread], @"Rescans must be started from the main thread");
+	
+	NSUInteger		generation		= 0;
+	NSURL			*url			= nil;
+	NSDictionary	*storedStamp	= nil;
+	
+	@synchronized(_pendingResults) {
+		_outstandingFiles	+= [streams count];
+		generation			= _generation;
+	}
+	
+	for(AudioStream *stream in streams) {
+		// Resolving the URL may update the stream's bookmark, so it has to happen here and not on a worker thread
+		url			= [stream currentStreamURL];
+		storedStamp	= [NSDictionary dictionaryWithObjectsAndKeys:
+			[stream valueForKey:FileSizeKey], FileSizeKey,
+			[stream valueForKey:FileModificationDateKey], FileModificationDateKey,
+			[stream valueForKey:FileInodeKey], FileInodeKey,
+			nil];
+		
+		[_readerQueue addOperationWithBlock:^{
+			[self readMetadataForStream:stream URL:url storedFileStamp:storedStamp skipUnchangedFile:skipUnchangedFiles generation:generation];
+		}];
+	}
+}
+
+- (void) cancel
+{
+	@synchronized(_pendingResults) {
+		++_generation;
+		
+		[_readerQueue cancelAllOperations];
+		
+		[_pendingResults removeAllObjects];
+		_outstandingFiles = 0;
+	}
+}
+
+- (BOOL) isRescanning
+{
+	@synchronized(_pendingResults) {
+		return (0 != _outstandingFiles || 0 != [_pendingResults count]);
+	}
+}
+
+- (NSDictionary *) formatStatistics
+{
+	@synchronized(_formatStatistics) {
+		NSMutableDictionary *statistics = [NSMutableDictionary dictionary];
+		
+		for(NSString *format in _formatStatistics)
+			[statistics setObject:[[_formatStatistics objectForKey:format] copy] forKey:format];
+		
+		return statistics;
+	}
+}
+
+- (void) resetFormatStatistics
+{
+	@synchronized(_formatStatistics) {
+		[_formatStatistics removeAllObjects];
+	}
+}
+
+@end
+
+@implementation AudioMetadataRescanner (Private)
+
+// Called on a worker thread
+- (void) readMetadataForStream:(AudioStream *)stream URL:(NSURL *)url storedFileStamp:(NSDictionary *)storedStamp skipUnchangedFile:(BOOL)skipUnchangedFile generation:(NSUInteger)generation
+{
+	NSDictionary *currentStamp = getFileStampForURL(url);
+	
+	// Missing files and files that haven't changed since the last scan are skipped
+	if(nil == currentStamp || (skipUnchangedFile && fileStampIsUnchanged(storedStamp, currentStamp))) {
+		@synchronized(_pendingResults) {
+			if(nil == currentStamp)
+				++_failedFiles;
+			else
+				++_skippedFiles;
+		}
+		
+		[self finishFile:nil generation:generation];
+		return;
+	}
+	
+	NSError					*error				= nil;
+	AudioMetadataReader		*metadataReader		= [AudioMetadataReader metadataReaderForURL:url error:&error];
+	NSDate					*startTime			= [NSDate date];
+	
+	if(nil == metadataReader || NO == [metadataReader readMetadata:&error]) {
+		@synchronized(_pendingResults) {
+			++_failedFiles;
+		}
+		
+		[self finishFile:nil generation:generation];
+		return;
+	}
+	
+	[self recordParseOfFormat:[[url pathExtension] lowercaseString]
+					byteCount:[[currentStamp objectForKey:FileSizeKey] unsignedLongLongValue]
+					parseTime:-[startTime timeIntervalSinceNow]];
+	
+	NSDictionary *result = [NSDictionary dictionaryWithObjectsAndKeys:
+		stream, RescanStreamKey,
+		[metadataReader metadata], RescanMetadataKey,
+		currentStamp, RescanFileStampKey,
+		nil];
+
+	[self finishFile:result generation:generation];
+}
+
+// Called on a worker thread
+- (void) finishFile:(NSDictionary *)result generation:(NSUInteger)generation
+{
+	BOOL flush = NO;
+	
+	@synchronized(_pendingResults) {
+		// Results from a canceled rescan are dropped
+		if(generation != _generation)
+			return;
+		
+		if(nil != result)
+			[_pendingResults addObject:result];
+		
+		--_outstandingFiles;
+		++_finishedFiles;
+		
+		if(NO == _flushScheduled && (RESCAN_BATCH_SIZE <= [_pendingResults count] || 0 == _outstandingFiles)) {
+			_flushScheduled = YES;
+			flush = YES;
+		}
+	}
+	
+	if(flush)
+		[self performSelectorOnMainThread:@selector(flushPendingResults) withObject:nil waitUntilDone:NO];
+}
+
+- (void) recordParseOfFormat:(NSString *)format byteCount:(unsigned long long)byteCount parseTime:(NSTimeInterval)parseTime
+{
+	@synchronized(_formatStatistics) {
+		NSMutableDictionary *statistics = [_formatStatistics objectForKey:format];
+		
+		if(nil == statistics) {
+			statistics = [NSMutableDictionary dictionary];
+			[_formatStatistics setObject:statistics forKey:format];
+		}
+		
+		[statistics setObject:[NSNumber numberWithUnsignedInteger:[[statistics objectForKey:RescanFileCountKey] unsignedIntegerValue] + 1] forKey:RescanFileCountKey];
+		[statistics setObject:[NSNumber numberWithUnsignedLongLong:[[statistics objectForKey:RescanByteCountKey] unsignedLongLongValue] + byteCount] forKey:RescanByteCountKey];
+		[statistics setObject:[NSNumber numberWithDouble:[[statistics objectForKey:RescanParseTimeKey] doubleValue] + parseTime] forKey:RescanParseTimeKey];
+	}
+}
+
+- (void) flushPendingResults
+{
+	NSArray		*results		= nil;
+	BOOL		finished		= NO;
+	
+	@synchronized(_pendingResults) {
+		results				= [_pendingResults copy];
+		finished			= (0 == _outstandingFiles);
+		_flushScheduled		= NO;
+		
+		[_pendingResults removeAllObjects];
+	}
+	
+	if(0 != [results count]) {
+		// Join an update that is already in progress (for example the metadata editing sheet)
+		BOOL ownsUpdate = (NO == [[CollectionManager manager] updateInProgress]);
+		
+		if(ownsUpdate)
+			[[CollectionManager manager] beginUpdate];
+		
+		for(NSDictionary *result in results) {
+			AudioStream		*stream			= [result objectForKey:RescanStreamKey];
+			NSDictionary	*metadata		= [result objectForKey:RescanMetadataKey];
+			NSDictionary	*fileStamp		= [result objectForKey:RescanFileStampKey];
+			
+			// Empty old metadata
+			[stream clearMetadata:self];
+			
+			for(NSString *key in metadata)
+				[stream setValue:[metadata valueForKey:key] forKey:key];
+			
+			for(NSString *key in fileStamp)
+				[stream setValue:[fileStamp valueForKey:key] forKey:key];
+		}
+		
+		if(ownsUpdate)
+			[[CollectionManager manager] finishUpdate];
+	}
+	
+	if(finished)
+		[self logFormatStatistics];
+}
+
+- (void) logFormatStatistics
+{
+	NSDictionary	*statistics		= [self formatStatistics];
+	NSUInteger		skippedFiles	= 0;
+	NSUInteger		failedFiles		= 0;
+	NSUInteger		finishedFiles	= 0;
+	
+	@synchronized(_pendingResults) {
+		skippedFiles	= _skippedFiles;
+		failedFiles		= _failedFiles;
+		finishedFiles	= _finishedFiles;
+		_skippedFiles	= 0;
+		_failedFiles	= 0;
+		_finishedFiles	= 0;
+	}
+	
+	// Single files are rescanned each time a stream starts playing, which isn't worth logging
+	if(1 >= finishedFiles || NO == [[NSUserDefaults standardUserDefaults] boolForKey:@"logMetadataRescanStatistics"])
+		return;
+	
+	NSLog(@"Metadata rescan finished (%lu unchanged, %lu unreadable)", (unsigned long)skippedFiles, (unsigned long)failedFiles);
+	
+	for(NSString *format in [[statistics allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+		NSDictionary		*formatStatistics	= [statistics objectForKey:format];
+		NSUInteger			fileCount			= [[formatStatistics objectForKey:RescanFileCountKey] unsignedIntegerValue];
+		unsigned long long	byteCount			= [[formatStatistics objectForKey:RescanByteCountKey] unsignedLongLongValue];
+		double				parseTime			= [[formatStatistics objectForKey:RescanParseTimeKey] doubleValue];
+		
+		NSLog(@"  %@: %lu files, %.1f MB, %f seconds (%f ms per file)", format, (unsigned long)fileCount, byteCount / (1024.0 * 1024.0), parseTime, (0 != fileCount ? 1000.0 * parseTime / fileCount : 0.0));
+	}
+}
+
+@end
@@ -20,8 +20,13 @@
 
 #import "AudioMetadataReader.h"
 
+#include <FLAC/format.h>
+
 @interface FLACMetadataReader : AudioMetadataReader
 {
 }
 
+// Adds the metadata contained in a single metadata block
++ (void) addMetadataFromBlock:(const FLAC__StreamMetadata *)block toDictionary:(NSMutableDictionary *)metadataDictionary;
+
 @end
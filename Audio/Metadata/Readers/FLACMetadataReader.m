@@ -24,18 +24,114 @@
 
 @implementation FLACMetadataReader
 
++ (void) addMetadataFromBlock:(const FLAC__StreamMetadata *)block toDictionary:(NSMutableDictionary *)metadataDictionary
+{
+	unsigned						i;
+	char							*fieldName			= NULL;
+	char							*fieldValue			= NULL;
+	NSString						*key, *value;
+
+	switch(block->type) {					
+		case FLAC__METADATA_TYPE_VORBIS_COMMENT:				
+			for(i = 0; i < block->data.vorbis_comment.num_comments; ++i) {
+				
+				// Let FLAC parse the comment for us
+				if(NO == FLAC__metadata_object_vorbiscomment_entry_to_name_value_pair(block->data.vorbis_comment.comments[i], &fieldName, &fieldValue)) {
+					// Ignore malformed comments
+					continue;
+				}
+				
+				key		= [[NSString alloc] initWithBytesNoCopy:fieldName length:strlen(fieldName) encoding:NSASCIIStringEncoding freeWhenDone:YES];
+				value	= [[NSString alloc] initWithBytesNoCopy:fieldValue length:strlen(fieldValue) encoding:NSUTF8StringEncoding freeWhenDone:YES];
+			
+				if(NSOrderedSame == [key caseInsensitiveCompare:@"ALBUM"])
+					[metadataDictionary setValue:value forKey:MetadataAlbumTitleKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"ARTIST"])
+					[metadataDictionary setValue:value forKey:MetadataArtistKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"ALBUMARTIST"])
+					[metadataDictionary setValue:value forKey:MetadataAlbumArtistKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"COMPOSER"])
+					[metadataDictionary setValue:value forKey:MetadataComposerKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"GENRE"])
+					[metadataDictionary setValue:value forKey:MetadataGenreKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"DATE"])
+					[metadataDictionary setValue:value forKey:MetadataDateKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"DESCRIPTION"])
+					[metadataDictionary setValue:value forKey:MetadataCommentKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"TITLE"])
+					[metadataDictionary setValue:value forKey:MetadataTitleKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"TRACKNUMBER"])
+					[metadataDictionary setValue:[NSNumber numberWithUnsignedInteger:(NSUInteger)[value integerValue]] forKey:MetadataTrackNumberKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"TRACKTOTAL"])
+					[metadataDictionary setValue:[NSNumber numberWithUnsignedInteger:(NSUInteger)[value integerValue]] forKey:MetadataTrackTotalKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"COMPILATION"])
+					[metadataDictionary setValue:[NSNumber numberWithBool:(BOOL)[value integerValue]] forKey:MetadataCompilationKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"DISCNUMBER"])
+					[metadataDictionary setValue:[NSNumber numberWithUnsignedInteger:(NSUInteger)[value integerValue]] forKey:MetadataDiscNumberKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"DISCTOTAL"])
+					[metadataDictionary setValue:[NSNumber numberWithUnsignedInteger:(NSUInteger)[value integerValue]] forKey:MetadataDiscTotalKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"ISRC"])
+					[metadataDictionary setValue:value forKey:MetadataISRCKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"MCN"])
+					[metadataDictionary setValue:value forKey:MetadataMCNKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"BPM"])
+					[metadataDictionary setValue:[NSNumber numberWithUnsignedInteger:(NSUInteger)[value integerValue]] forKey:MetadataBPMKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"REPLAYGAIN_REFERENCE_LOUDNESS"]) {
+					NSScanner	*scanner		= [NSScanner scannerWithString:value];						
+					double		doubleValue		= 0.0;
+					
+					if([scanner scanDouble:&doubleValue]) {
+						[metadataDictionary setValue:[NSNumber numberWithDouble:doubleValue] forKey:ReplayGainReferenceLoudnessKey];
+					}						
+				}
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"REPLAYGAIN_TRACK_GAIN"]) {
+					NSScanner	*scanner		= [NSScanner scannerWithString:value];						
+					double		doubleValue		= 0.0;
+					
+					if([scanner scanDouble:&doubleValue])
+						[metadataDictionary setValue:[NSNumber numberWithDouble:doubleValue] forKey:ReplayGainTrackGainKey];
+				}
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"REPLAYGAIN_TRACK_PEAK"]) {
+					[metadataDictionary setValue:[NSNumber numberWithDouble:[value doubleValue]] forKey:ReplayGainTrackPeakKey];
+				}
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"REPLAYGAIN_ALBUM_GAIN"]) {
+					NSScanner	*scanner		= [NSScanner scannerWithString:value];						
+					double		doubleValue		= 0.0;
+					
+					if([scanner scanDouble:&doubleValue])
+						[metadataDictionary setValue:[NSNumber numberWithDouble:doubleValue] forKey:ReplayGainAlbumGainKey];
+				}
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"REPLAYGAIN_ALBUM_PEAK"])
+					[metadataDictionary setValue:[NSNumber numberWithDouble:[value doubleValue]] forKey:ReplayGainAlbumPeakKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"MUSICDNS_PUID"])
+					[metadataDictionary setValue:value forKey:MetadataMusicDNSPUIDKey];
+				else if(NSOrderedSame == [key caseInsensitiveCompare:@"MUSICBRAINZ_ID"])
+					[metadataDictionary setValue:value forKey:MetadataMusicBrainzIDKey];
+
+				fieldName	= NULL;
+				fieldValue	= NULL;
+			}
+			break;
+			
+		// Pictures are extracted separately by AlbumArtworkCache
+		case FLAC__METADATA_TYPE_PICTURE:						break;
+		case FLAC__METADATA_TYPE_STREAMINFO:					break;
+		case FLAC__METADATA_TYPE_PADDING:						break;
+		case FLAC__METADATA_TYPE_APPLICATION:					break;
+		case FLAC__METADATA_TYPE_SEEKTABLE:						break;
+		case FLAC__METADATA_TYPE_CUESHEET:						break;
+		case FLAC__METADATA_TYPE_UNDEFINED:						break;
+		default:												break;
+	}
+}
+
 - (BOOL) readMetadata:(NSError **)error
 {
 	NSString						*path				= [_url path];
 	FLAC__Metadata_Chain			*chain				= NULL;
 	FLAC__Metadata_Iterator			*iterator			= NULL;
 	FLAC__StreamMetadata			*block				= NULL;
-	unsigned						i;
-	char							*fieldName			= NULL;
-	char							*fieldValue			= NULL;
 	NSMutableDictionary				*metadataDictionary;
-	NSString						*key, *value;
-	NSImage							*picture;
 				
 	chain							= FLAC__metadata_chain_new();
 	
@@ -90,103 +186,7 @@
 			break;
 		}
 		
-		switch(block->type) {					
-			case FLAC__METADATA_TYPE_VORBIS_COMMENT:				
-				for(i = 0; i < block->data.vorbis_comment.num_comments; ++i) {
-					
-					// Let FLAC parse the comment for us
-					if(NO == FLAC__metadata_object_vorbiscomment_entry_to_name_value_pair(block->data.vorbis_comment.comments[i], &fieldName, &fieldValue)) {
-						// Ignore malformed comments
-						continue;
-					}
-					
-					key		= [[NSString alloc] initWithBytesNoCopy:fieldName length:strlen(fieldName) encoding:NSASCIIStringEncoding freeWhenDone:YES];
-					value	= [[NSString alloc] initWithBytesNoCopy:fieldValue length:strlen(fieldValue) encoding:NSUTF8StringEncoding freeWhenDone:YES];
-				
-					if(NSOrderedSame == [key caseInsensitiveCompare:@"ALBUM"])
-						[metadataDictionary setValue:value forKey:MetadataAlbumTitleKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"ARTIST"])
-						[metadataDictionary setValue:value forKey:MetadataArtistKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"ALBUMARTIST"])
-						[metadataDictionary setValue:value forKey:MetadataAlbumArtistKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"COMPOSER"])
-						[metadataDictionary setValue:value forKey:MetadataComposerKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"GENRE"])
-						[metadataDictionary setValue:value forKey:MetadataGenreKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"DATE"])
-						[metadataDictionary setValue:value forKey:MetadataDateKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"DESCRIPTION"])
-						[metadataDictionary setValue:value forKey:MetadataCommentKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"TITLE"])
-						[metadataDictionary setValue:value forKey:MetadataTitleKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"TRACKNUMBER"])
-						[metadataDictionary setValue:[NSNumber numberWithUnsignedInteger:(NSUInteger)[value integerValue]] forKey:MetadataTrackNumberKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"TRACKTOTAL"])
-						[metadataDictionary setValue:[NSNumber numberWithUnsignedInteger:(NSUInteger)[value integerValue]] forKey:MetadataTrackTotalKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"COMPILATION"])
-						[metadataDictionary setValue:[NSNumber numberWithBool:(BOOL)[value integerValue]] forKey:MetadataCompilationKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"DISCNUMBER"])
-						[metadataDictionary setValue:[NSNumber numberWithUnsignedInteger:(NSUInteger)[value integerValue]] forKey:MetadataDiscNumberKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"DISCTOTAL"])
-						[metadataDictionary setValue:[NSNumber numberWithUnsignedInteger:(NSUInteger)[value integerValue]] forKey:MetadataDiscTotalKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"ISRC"])
-						[metadataDictionary setValue:value forKey:MetadataISRCKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"MCN"])
-						[metadataDictionary setValue:value forKey:MetadataMCNKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"BPM"])
-						[metadataDictionary setValue:[NSNumber numberWithUnsignedInteger:(NSUInteger)[value integerValue]] forKey:MetadataBPMKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"REPLAYGAIN_REFERENCE_LOUDNESS"]) {
-						NSScanner	*scanner		= [NSScanner scannerWithString:value];						
-						double		doubleValue		= 0.0;
-						
-						if([scanner scanDouble:&doubleValue]) {
-							[metadataDictionary setValue:[NSNumber numberWithDouble:doubleValue] forKey:ReplayGainReferenceLoudnessKey];
-						}						
-					}
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"REPLAYGAIN_TRACK_GAIN"]) {
-						NSScanner	*scanner		= [NSScanner scannerWithString:value];						
-						double		doubleValue		= 0.0;
-						
-						if([scanner scanDouble:&doubleValue])
-							[metadataDictionary setValue:[NSNumber numberWithDouble:doubleValue] forKey:ReplayGainTrackGainKey];
-					}
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"REPLAYGAIN_TRACK_PEAK"]) {
-						[metadataDictionary setValue:[NSNumber numberWithDouble:[value doubleValue]] forKey:ReplayGainTrackPeakKey];
-					}
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"REPLAYGAIN_ALBUM_GAIN"]) {
-						NSScanner	*scanner		= [NSScanner scannerWithString:value];						
-						double		doubleValue		= 0.0;
-						
-						if([scanner scanDouble:&doubleValue])
-							[metadataDictionary setValue:[NSNumber numberWithDouble:doubleValue] forKey:ReplayGainAlbumGainKey];
-					}
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"REPLAYGAIN_ALBUM_PEAK"])
-						[metadataDictionary setValue:[NSNumber numberWithDouble:[value doubleValue]] forKey:ReplayGainAlbumPeakKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"MUSICDNS_PUID"])
-						[metadataDictionary setValue:value forKey:MetadataMusicDNSPUIDKey];
-					else if(NSOrderedSame == [key caseInsensitiveCompare:@"MUSICBRAINZ_ID"])
-						[metadataDictionary setValue:value forKey:MetadataMusicBrainzIDKey];
-
-					fieldName	= NULL;
-					fieldValue	= NULL;
-				}
-				break;
-				
-			case FLAC__METADATA_TYPE_PICTURE:
-				picture = [[NSImage alloc] initWithData:[NSData dataWithBytes:block->data.picture.data length:block->data.picture.data_length]];
-				if(nil != picture) {
-					[metadataDictionary setValue:[picture TIFFRepresentation] forKey:@"albumArt"];
-				}
-				break;
-				
-			case FLAC__METADATA_TYPE_STREAMINFO:					break;
-			case FLAC__METADATA_TYPE_PADDING:						break;
-			case FLAC__METADATA_TYPE_APPLICATION:					break;
-			case FLAC__METADATA_TYPE_SEEKTABLE:						break;
-			case FLAC__METADATA_TYPE_CUESHEET:						break;
-			case FLAC__METADATA_TYPE_UNDEFINED:						break;
-			default:												break;
-		}
+		[[self class] addMetadataFromBlock:block toDictionary:metadataDictionary];
 	} while(FLAC__metadata_iterator_next(iterator));
 	
 	FLAC__metadata_iterator_delete(iterator);
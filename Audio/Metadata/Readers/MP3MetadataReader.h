@@ -25,3 +25,11 @@
 }
 
 @end
+
+#ifdef __cplusplus
+#include <taglib/mpegfile.h>
+
+// Reads the tags from an already open file
+// foundReplayGain is set if the tags contained ReplayGain information
+NSMutableDictionary * metadataFromMPEGFile(TagLib::MPEG::File& f, BOOL *foundReplayGain);
+#endif
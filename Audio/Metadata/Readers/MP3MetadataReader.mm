@@ -58,36 +58,18 @@
 - (BOOL) scanForXingAndLAMEHeaders:(NSMutableDictionary *)metadataDictionary;
 @end
 
-@implementation MP3MetadataReader
-
-- (BOOL) readMetadata:(NSError **)error
+NSMutableDictionary *
+metadataFromMPEGFile(TagLib::MPEG::File& f, BOOL *foundReplayGain)
 {
-	NSMutableDictionary						*metadataDictionary;
-	NSString								*path				= [_url path];
-	TagLib::MPEG::File						f					([path fileSystemRepresentation], false);
+	NSCParameterAssert(NULL != foundReplayGain);
+	
+	NSMutableDictionary						*metadataDictionary	= [NSMutableDictionary dictionary];
 	TagLib::String							s;
 	NSString								*trackString, *trackNum, *totalTracks;
 	NSString								*discString, *discNum, *totalDiscs;
 	NSRange									range;
-	BOOL									foundReplayGain		= NO;
-	
-	if(NO == f.isValid()) {
-		if(nil != error) {
-			NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
-			
-			[errorDictionary setObject:[NSString stringWithFormat:NSLocalizedStringFromTable(@"The file \"%@\" is not a valid MPEG file.", @"Errors", @""), [[NSFileManager defaultManager] displayNameAtPath:path]] forKey:NSLocalizedDescriptionKey];
-			[errorDictionary setObject:NSLocalizedStringFromTable(@"Not an MPEG file", @"Errors", @"") forKey:NSLocalizedFailureReasonErrorKey];
-			[errorDictionary setObject:NSLocalizedStringFromTable(@"The file's extension may not match the file's type.", @"Errors", @"") forKey:NSLocalizedRecoverySuggestionErrorKey];						
-			
-			*error = [NSError errorWithDomain:AudioMetadataReaderErrorDomain 
-										 code:AudioMetadataReaderFileFormatNotRecognizedError 
-									 userInfo:errorDictionary];
-		}
-	
-		return NO;
-	}
 	
-	metadataDictionary = [NSMutableDictionary dictionary];
+	*foundReplayGain = NO;
 
 	// Album title
 	s = f.tag()->album();
@@ -213,7 +195,7 @@
 			if([scanner scanDouble:&doubleValue]) {
 				[metadataDictionary setValue:[NSNumber numberWithDouble:doubleValue] forKey:ReplayGainTrackGainKey];
 				[metadataDictionary setValue:[NSNumber numberWithDouble:89.0] forKey:ReplayGainReferenceLoudnessKey];
-				foundReplayGain = YES;
+				*foundReplayGain = YES;
 			}
 		}
 		
@@ -234,7 +216,7 @@
 			if([scanner scanDouble:&doubleValue]) {
 				[metadataDictionary setValue:[NSNumber numberWithDouble:doubleValue] forKey:ReplayGainAlbumGainKey];
 				[metadataDictionary setValue:[NSNumber numberWithDouble:89.0] forKey:ReplayGainReferenceLoudnessKey];
-				foundReplayGain = YES;
+				*foundReplayGain = YES;
 			}
 		}
 		
@@ -246,7 +228,7 @@
 		}
 
 		// If nothing found check for RVA2 frame
-		if(NO == foundReplayGain) {
+		if(NO == *foundReplayGain) {
 			frameList = id3v2tag->frameListMap()["RVA2"];
 			
 			TagLib::ID3v2::FrameList::Iterator frameIterator;
@@ -268,7 +250,7 @@
 					
 					if(0 != volumeAdjustment) {
 						[metadataDictionary setValue:[NSNumber numberWithFloat:volumeAdjustment] forKey:ReplayGainTrackGainKey];
-						foundReplayGain = YES;
+						*foundReplayGain = YES;
 					}
 				}
 				else if(TagLib::String("album", TagLib::String::Latin1) == relativeVolume->identification()) {
@@ -284,7 +266,7 @@
 					
 					if(0 != volumeAdjustment) {
 						[metadataDictionary setValue:[NSNumber numberWithFloat:volumeAdjustment] forKey:ReplayGainAlbumGainKey];
-						foundReplayGain = YES;
+						*foundReplayGain = YES;
 					}
 				}
 				// Fall back to track gain if identification is not specified
@@ -301,14 +283,44 @@
 					
 					if(0 != volumeAdjustment) {
 						[metadataDictionary setValue:[NSNumber numberWithFloat:volumeAdjustment] forKey:ReplayGainTrackGainKey];
-						foundReplayGain = YES;
+						*foundReplayGain = YES;
 					}
 				}
 			}			
 		}	
 	}
+
+	return metadataDictionary;
+}
+
+@implementation MP3MetadataReader
+
+- (BOOL) readMetadata:(NSError **)error
+{
+	NSMutableDictionary						*metadataDictionary;
+	NSString								*path				= [_url path];
+	TagLib::MPEG::File						f					([path fileSystemRepresentation], false);
+	BOOL									foundReplayGain		= NO;
+	
+	if(NO == f.isValid()) {
+		if(nil != error) {
+			NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
+			
+			[errorDictionary setObject:[NSString stringWithFormat:NSLocalizedStringFromTable(@"The file \"%@\" is not a valid MPEG file.", @"Errors", @""), [[NSFileManager defaultManager] displayNameAtPath:path]] forKey:NSLocalizedDescriptionKey];
+			[errorDictionary setObject:NSLocalizedStringFromTable(@"Not an MPEG file", @"Errors", @"") forKey:NSLocalizedFailureReasonErrorKey];
+			[errorDictionary setObject:NSLocalizedStringFromTable(@"The file's extension may not match the file's type.", @"Errors", @"") forKey:NSLocalizedRecoverySuggestionErrorKey];						
+			
+			*error = [NSError errorWithDomain:AudioMetadataReaderErrorDomain 
+										 code:AudioMetadataReaderFileFormatNotRecognizedError 
+									 userInfo:errorDictionary];
+		}
+	
+		return NO;
+	}
+	
+	metadataDictionary = metadataFromMPEGFile(f, &foundReplayGain);
 	
-	// If still nothing, scan for LAME header
+	// If nothing was found in the tags, scan for LAME header
 	if(NO == foundReplayGain)
 		[self scanForXingAndLAMEHeaders:metadataDictionary];
 
@@ -0,0 +1,98 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+// ========================================
+// Notifications
+// ========================================
+// Posted on the main thread after each file is written
+// userInfo contains the file's URL, the batch counts and an NSError if the write failed
+extern NSString * const		AudioMetadataBatchWriterDidWriteFileNotification;
+
+extern NSString * const		AudioMetadataBatchWriterURLKey;
+extern NSString * const		AudioMetadataBatchWriterErrorKey;
+extern NSString * const		AudioMetadataBatchWriterCompletedFilesKey;
+extern NSString * const		AudioMetadataBatchWriterTotalFilesKey;
+
+// ========================================
+// Writes the metadata of many streams at once
+// Files are written on a pool of worker threads, with one queue per volume
+// limited to metadataWritesPerVolume concurrent writes so a slow disk isn't
+// thrashed and fast disks are kept busy.  Writes to the same file are serialized.
+// Every batch is recorded in a journal in the Application Support folder
+// along with the tags each file had before it was written, so a batch
+// interrupted by a crash or by quitting can be finished or rolled back on the next launch
+// ========================================
+@interface AudioMetadataBatchWriter : NSObject
+{
+	@private
+	NSMutableDictionary		*_volumeQueues;			// NSOperationQueue for each volume
+	NSMutableDictionary		*_lastOperations;		// Most recent write queued for each URL
+	
+	NSMutableArray			*_journalEntries;		// URL and new metadata of every file in the batch
+	int						_journalFD;				// Append-only log of started and finished writes
+	NSArray					*_interruptedEntries;	// Entries from a journal left behind by the previous launch
+	
+	NSUInteger				_outstandingFiles;		// Files queued but not yet written
+	NSUInteger				_completedFiles;		// Files written (or failed) in this batch
+	NSUInteger				_failedFiles;			// Files whose metadata couldn't be written
+	NSUInteger				_rewrittenFiles;		// Files whose audio data had to be moved
+	SInt64					_bytesWritten;			// Bytes written by writers that report them
+	NSDate					*_startTime;
+	
+	NSUInteger				_generation;			// Incremented on cancel so queued writes are skipped
+	BOOL					_keepsJournal;			// Set when quitting so skipped writes can be resumed
+}
+
+// ========================================
+// The shared instance
++ (AudioMetadataBatchWriter *) sharedBatchWriter;
+
+// ========================================
+// Writing (must be called from the main thread)
+// Streams added while a batch is running join it
+- (void) writeMetadataForStreams:(NSArray *)streams;
+
+// Writes already in progress are finished, queued writes are dropped
+- (void) cancel;
+- (BOOL) isWriting;
+
+// Blocks until every queued write is finished
+- (void) waitUntilFinished;
+
+// For quitting: finishes the writes in progress and those for the given streams,
+// and leaves the rest of the queued writes in the journal to be resumed on the next launch
+- (void) suspendAfterWritingMetadataForStreams:(NSArray *)streams;
+
+// ========================================
+// Recovery of a batch left unfinished by the previous launch (must be called from the main thread)
+// A new batch replaces the journal on disk, but the interrupted files are remembered until resolved
+- (BOOL) hasInterruptedBatch;
+- (NSUInteger) interruptedFileCount;
+
+// Writes the new metadata to the files that weren't finished
+- (void) resumeInterruptedBatch;
+// Restores the original metadata of the files that were written and rescans them
+- (void) rollBackInterruptedBatch;
+// Leaves the files as they are
+- (void) discardInterruptedBatch;
+
+@end
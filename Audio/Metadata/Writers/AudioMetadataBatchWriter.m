@@ -0,0 +1,643 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioMetadataBatchWriter.h"
+#import "AudioMetadataWriter.h"
+#import "AudioMetadataReader.h"
+#import "AudioMetadataRescanner.h"
+#import "AudioStream.h"
+#import "AudioStreamManager.h"
+#import "CollectionManager.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <libkern/OSByteOrder.h>
+
+// ========================================
+// Notifications
+// ========================================
+NSString * const	AudioMetadataBatchWriterDidWriteFileNotification	= @"org.sbooth.Play.AudioMetadataBatchWriter.DidWriteFileNotification";
+
+NSString * const	AudioMetadataBatchWriterURLKey						= @"url";
+NSString * const	AudioMetadataBatchWriterErrorKey					= @"error";
+NSString * const	AudioMetadataBatchWriterCompletedFilesKey			= @"completedFiles";
+NSString * const	AudioMetadataBatchWriterTotalFilesKey				= @"totalFiles";
+
+// ========================================
+// Journal file names, in the Application Support folder
+// ========================================
+static NSString * const		JournalEntriesFileName		= @"Metadata Journal.plist";
+static NSString * const		JournalLogFileName			= @"Metadata Journal.log";
+
+// ========================================
+// Keys for journal entries and log records
+// ========================================
+static NSString * const		JournalURLKey				= @"url";
+static NSString * const		JournalMetadataKey			= @"metadata";
+static NSString * const		JournalOriginalMetadataKey	= @"originalMetadata";
+static NSString * const		JournalFinishedKey			= @"finished";
+static NSString * const		JournalIndexKey				= @"index";
+static NSString * const		JournalEventKey				= @"event";
+
+static NSString * const		JournalStartedEvent			= @"started";
+static NSString * const		JournalFinishedEvent		= @"finished";
+
+// ========================================
+// The keys the metadata writers understand
+static NSArray *
+writableMetadataKeys(void)
+{
+	static NSArray			*keys		= nil;
+	static dispatch_once_t	onceToken;
+	
+	dispatch_once(&onceToken, ^{
+		keys = [NSArray arrayWithObjects:
+			MetadataTitleKey, MetadataAlbumTitleKey, MetadataArtistKey, MetadataAlbumArtistKey,
+			MetadataGenreKey, MetadataComposerKey, MetadataDateKey, MetadataCompilationKey,
+			MetadataTrackNumberKey, MetadataTrackTotalKey, MetadataDiscNumberKey, MetadataDiscTotalKey,
+			MetadataCommentKey, MetadataISRCKey, MetadataMCNKey, MetadataBPMKey,
+			MetadataMusicDNSPUIDKey, MetadataMusicBrainzIDKey,
+			ReplayGainReferenceLoudnessKey, ReplayGainTrackGainKey, ReplayGainTrackPeakKey,
+			ReplayGainAlbumGainKey, ReplayGainAlbumPeakKey,
+			nil];
+	});
+	
+	return keys;
+}
+
+// ========================================
+// Copies the writable metadata of a stream or reader so it can be used off the main thread
+// and stored in the journal.  Missing values are omitted, which the writers treat as empty
+static NSDictionary *
+writableMetadata(id object)
+{
+	NSMutableDictionary *metadata = [NSMutableDictionary dictionary];
+	
+	for(NSString *key in writableMetadataKeys()) {
+		id value = [object valueForKey:key];
+		if(nil != value)
+			[metadata setObject:value forKey:key];
+	}
+	
+	return metadata;
+}
+
+static NSString *
+journalPath(NSString *fileName)
+{
+	NSArray *paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES);
+	if(0 == [paths count])
+		return nil;
+	
+	NSString *applicationName = [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleName"];
+	
+	return [[[paths objectAtIndex:0] stringByAppendingPathComponent:applicationName] stringByAppendingPathComponent:fileName];
+}
+
+static void
+removeJournalFiles(void)
+{
+	[[NSFileManager defaultManager] removeItemAtPath:journalPath(JournalEntriesFileName) error:nil];
+	[[NSFileManager defaultManager] removeItemAtPath:journalPath(JournalLogFileName) error:nil];
+}
+
+@interface AudioMetadataBatchWriter (Private)
+- (NSOperationQueue *) writerQueueForURL:(NSURL *)url;
+
+- (NSArray *) entriesForStreams:(NSArray *)streams;
+- (void) writeEntries:(NSArray *)entries;
+- (void) writeMetadata:(NSDictionary *)metadata toURL:(NSURL *)url journalIndex:(NSUInteger)journalIndex generation:(NSUInteger)generation;
+- (void) finishWriteToURL:(NSURL *)url metadataWriter:(AudioMetadataWriter *)metadataWriter error:(NSError *)error canceled:(BOOL)canceled;
+- (void) finishBatch;
+- (void) postProgress:(NSDictionary *)progress;
+
+- (BOOL) openJournal;
+- (void) closeJournal;
+- (void) appendJournalRecord:(NSDictionary *)record synchronize:(BOOL)synchronize;
+- (void) loadInterruptedBatch;
+@end
+
+// ========================================
+// The singleton instance
+// ========================================
+static AudioMetadataBatchWriter *sharedBatchWriterInstance = nil;
+
+@implementation AudioMetadataBatchWriter
+
++ (AudioMetadataBatchWriter *) sharedBatchWriter
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedBatchWriterInstance = [[self alloc] init];
+    });
+    return sharedBatchWriterInstance;
+}
+
+- (id) init
+{
+	if((self = [super init])) {
+		_volumeQueues		= [[NSMutableDictionary alloc] init];
+		_lastOperations		= [[NSMutableDictionary alloc] init];
+		_journalEntries		= [[NSMutableArray alloc] init];
+		_journalFD			= -1;
+		_bytesWritten		= 0;
+		
+		// Read the journal before a new batch replaces it
+		[self loadInterruptedBatch];
+	}
+	return self;
+}
+
+- (void) writeMetadataForStreams:(NSArray *)streams
+{
+	NSParameterAssert(nil != streams);
+	NSAssert([NSThread isMainThread], @"Metadata writes must be started from the main thread");
+	
+	[self writeEntries:[self entriesForStreams:streams]];
+}
+
+- (void) cancel
+{
+	@synchronized(_journalEntries) {
+		++_generation;
+	}
+}
+
+- (BOOL) isWriting
+{
+	@synchronized(_journalEntries) {
+		return (0 != _outstandingFiles);
+	}
+}
+
+- (void) waitUntilFinished
+{
+	NSAssert([NSThread isMainThread], @"Metadata writes must be waited on from the main thread");
+	
+	for(NSOperationQueue *queue in [_volumeQueues allValues])
+		[queue waitUntilAllOperationsAreFinished];
+}
+
+- (void) suspendAfterWritingMetadataForStreams:(NSArray *)streams
+{
+	NSAssert([NSThread isMainThread], @"Metadata writes must be suspended from the main thread");
+	
+	NSArray *entries = [self entriesForStreams:(nil != streams ? streams : [NSArray array])];
+	
+	// The streams' writes take the new generation so they aren't skipped, and are queued under the same lock
+	// so they join the suspended batch instead of starting a new journal over the one being kept
+	@synchronized(_journalEntries) {
+		_keepsJournal = YES;
+		++_generation;
+		
+		[self writeEntries:entries];
+	}
+	
+	// The skipped writes drain at once, leaving only those already started to wait for
+	[self waitUntilFinished];
+}
+
+- (BOOL) hasInterruptedBatch
+{
+	return (0 != [self interruptedFileCount]);
+}
+
+- (NSUInteger) interruptedFileCount
+{
+	NSUInteger count = 0;
+	
+	for(NSDictionary *entry in _interruptedEntries) {
+		if(NO == [[entry objectForKey:JournalFinishedKey] boolValue])
+			++count;
+	}
+	
+	return count;
+}
+
+- (void) resumeInterruptedBatch
+{
+	NSMutableArray *entries = [NSMutableArray array];
+	
+	for(NSDictionary *entry in _interruptedEntries) {
+		if(NO == [[entry objectForKey:JournalFinishedKey] boolValue])
+			[entries addObject:entry];
+	}
+	
+	[self discardInterruptedBatch];
+	[self writeEntries:entries];
+}
+
+- (void) rollBackInterruptedBatch
+{
+	NSMutableArray		*entries			= [NSMutableArray array];
+	NSMutableArray		*unwrittenStreams	= [NSMutableArray array];
+	AudioStreamManager	*streamManager		= [[CollectionManager manager] streamManager];
+	
+	[[CollectionManager manager] beginUpdate];
+	
+	for(NSDictionary *entry in _interruptedEntries) {
+		NSURL			*url				= [entry objectForKey:JournalURLKey];
+		NSDictionary	*originalMetadata	= [entry objectForKey:JournalOriginalMetadataKey];
+		AudioStream		*stream				= [streamManager streamForURL:url];
+		
+		// Files without recorded tags were never written (or couldn't be read), so rescanning them puts the library back
+		if(nil == originalMetadata) {
+			if(nil != stream)
+				[unwrittenStreams addObject:stream];
+			continue;
+		}
+		
+		[entries addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+			url, JournalURLKey,
+			originalMetadata, JournalMetadataKey,
+			nil]];
+		
+		for(NSString *key in writableMetadataKeys())
+			[stream setValue:[originalMetadata objectForKey:key] forKey:key];
+	}
+	
+	[[CollectionManager manager] finishUpdate];
+	
+	[self discardInterruptedBatch];
+	[self writeEntries:entries];
+	
+	if(0 != [unwrittenStreams count])
+		[[AudioMetadataRescanner sharedRescanner] rescanMetadataForStreams:unwrittenStreams skipUnchangedFiles:NO];
+}
+
+- (void) discardInterruptedBatch
+{
+	_interruptedEntries = nil;
+	
+	@synchronized(_journalEntries) {
+		// A batch started since launch owns the journal files now
+		if(-1 == _journalFD)
+			removeJournalFiles();
+	}
+}
+
+@end
+
+@implementation AudioMetadataBatchWriter (Private)
+
+- (NSOperationQueue *) writerQueueForURL:(NSURL *)url
+{
+	id volume = nil;
+	if(NO == [url getResourceValue:&volume forKey:NSURLVolumeIdentifierKey error:nil] || nil == volume)
+		volume = [NSNull null];
+	
+	NSOperationQueue *queue = [_volumeQueues objectForKey:volume];
+	
+	if(nil == queue) {
+		NSInteger maxConcurrentWrites = [[NSUserDefaults standardUserDefaults] integerForKey:@"metadataWritesPerVolume"];
+		
+		queue = [[NSOperationQueue alloc] init];
+		[queue setMaxConcurrentOperationCount:MAX(1, maxConcurrentWrites)];
+		[_volumeQueues setObject:queue forKey:volume];
+	}
+	
+	return queue;
+}
+
+// Called on the main thread
+// Called on the main thread
+- (NSArray *) entriesForStreams:(NSArray *)streams
+{
+	NSMutableArray *entries = [NSMutableArray array];
+	
+	for(AudioStream *stream in streams) {
+		// FIXME: Save album-only metadata to original file?
+		if([stream isPartOfCueSheet])
+			continue;
+		
+		// Resolving the URL may update the stream's bookmark, so it has to happen here and not on a worker thread
+		NSURL *url = [stream currentStreamURL];
+		if(nil == url)
+			continue;
+		
+		[entries addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+			url, JournalURLKey,
+			writableMetadata(stream), JournalMetadataKey,
+			nil]];
+	}
+	
+	return entries;
+}
+
+- (void) writeEntries:(NSArray *)entries
+{
+	if(0 == [entries count])
+		return;
+	
+	NSMutableArray		*operations		= [NSMutableArray arrayWithCapacity:[entries count]];
+	NSMutableArray		*queues			= [NSMutableArray arrayWithCapacity:[entries count]];
+	
+	// Looking up the volume touches the disk, so do it before taking the lock the workers use
+	for(NSDictionary *entry in entries)
+		[queues addObject:[self writerQueueForURL:[entry objectForKey:JournalURLKey]]];
+	
+	@synchronized(_journalEntries) {
+		NSUInteger	journalIndex	= [_journalEntries count];
+		NSUInteger	generation		= _generation;
+		
+		if(0 == _outstandingFiles)
+			_startTime = [NSDate date];
+		
+		_outstandingFiles += [entries count];
+		
+		[_journalEntries addObjectsFromArray:entries];
+		
+		// The writes still happen without a journal, they just can't be recovered
+		if(NO == [self openJournal])
+			NSLog(@"AudioMetadataBatchWriter: Unable to write the journal, an interrupted batch won't be recoverable");
+		
+		for(NSDictionary *entry in entries) {
+			NSURL				*url			= [entry objectForKey:JournalURLKey];
+			NSDictionary		*metadata		= [entry objectForKey:JournalMetadataKey];
+			NSUInteger			index			= journalIndex++;
+			
+			NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
+				[self writeMetadata:metadata toURL:url journalIndex:index generation:generation];
+			}];
+			
+			// Two writers must never have the same file open
+			NSOperation *previousOperation = [_lastOperations objectForKey:url];
+			if(nil != previousOperation)
+				[operation addDependency:previousOperation];
+			
+			[_lastOperations setObject:operation forKey:url];
+			[operations addObject:operation];
+		}
+	}
+	
+	for(NSUInteger i = 0; i < [operations count]; ++i)
+		[[queues objectAtIndex:i] addOperation:[operations objectAtIndex:i]];
+}
+
+// Called on a worker thread
+- (void) writeMetadata:(NSDictionary *)metadata toURL:(NSURL *)url journalIndex:(NSUInteger)journalIndex generation:(NSUInteger)generation
+{
+	BOOL canceled = NO;
+	
+	@synchronized(_journalEntries) {
+		canceled = (generation != _generation);
+	}
+	
+	if(canceled) {
+		[self finishWriteToURL:url metadataWriter:nil error:nil canceled:YES];
+		return;
+	}
+	
+	NSError					*error				= nil;
+	NSNumber				*index				= [NSNumber numberWithUnsignedInteger:journalIndex];
+	NSMutableDictionary		*record				= [NSMutableDictionary dictionaryWithObjectsAndKeys:
+		index, JournalIndexKey,
+		JournalStartedEvent, JournalEventKey,
+		nil];
+	
+	// Save the tags the file has now so the write can be rolled back
+	AudioMetadataReader *metadataReader = [AudioMetadataReader metadataReaderForURL:url error:&error];
+	if(nil != metadataReader && [metadataReader readMetadata:&error])
+		[record setObject:writableMetadata([metadataReader metadata]) forKey:JournalOriginalMetadataKey];
+	
+	// The start of a write has to be on disk before the file is modified
+	[self appendJournalRecord:record synchronize:YES];
+	
+	error = nil;
+	AudioMetadataWriter *metadataWriter = [AudioMetadataWriter metadataWriterForURL:url error:&error];
+	if(nil != metadataWriter && NO == [metadataWriter writeMetadata:metadata error:&error])
+		metadataWriter = nil;
+	
+	// A lost finish record only means the file is written again on resume
+	[self appendJournalRecord:[NSDictionary dictionaryWithObjectsAndKeys:index, JournalIndexKey, JournalFinishedEvent, JournalEventKey, nil] synchronize:NO];
+	
+	[self finishWriteToURL:url metadataWriter:metadataWriter error:error canceled:NO];
+}
+
+// Called on a worker thread
+- (void) finishWriteToURL:(NSURL *)url metadataWriter:(AudioMetadataWriter *)metadataWriter error:(NSError *)error canceled:(BOOL)canceled
+{
+	NSMutableDictionary *progress = nil;
+	
+	if(NO == canceled) {
+		if(nil == metadataWriter)
+			NSLog(@"AudioMetadataBatchWriter: Unable to write metadata to %@ (%@)", [url path], [error localizedDescription]);
+#if DEBUG
+		else
+			NSLog(@"AudioMetadataBatchWriter: %@: %lld bytes%@", [[url path] lastPathComponent], [metadataWriter bytesWritten], ([metadataWriter rewroteFile] ? @" (file rewritten)" : @""));
+#endif
+	}
+	
+	@synchronized(_journalEntries) {
+		--_outstandingFiles;
+		
+		if(NO == canceled) {
+			++_completedFiles;
+			
+			if(nil == metadataWriter)
+				++_failedFiles;
+			else {
+				if([metadataWriter rewroteFile])
+					++_rewrittenFiles;
+				
+				if(0 <= [metadataWriter bytesWritten])
+					_bytesWritten += [metadataWriter bytesWritten];
+			}
+			
+			progress = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+				url, AudioMetadataBatchWriterURLKey,
+				[NSNumber numberWithUnsignedInteger:_completedFiles], AudioMetadataBatchWriterCompletedFilesKey,
+				[NSNumber numberWithUnsignedInteger:_completedFiles + _outstandingFiles], AudioMetadataBatchWriterTotalFilesKey,
+				nil];
+			
+			if(nil == metadataWriter && nil != error)
+				[progress setObject:error forKey:AudioMetadataBatchWriterErrorKey];
+		}
+		
+		if(0 == _outstandingFiles)
+			[self finishBatch];
+	}
+	
+	if(nil != progress)
+		[self performSelectorOnMainThread:@selector(postProgress:) withObject:progress waitUntilDone:NO];
+}
+
+// Called with the lock held
+- (void) finishBatch
+{
+	if(0 != _completedFiles)
+		NSLog(@"AudioMetadataBatchWriter: Wrote metadata to %lu files (%lu failed, %lu rewritten) in %.2f seconds, %lld bytes in files reporting their writes", 
+			  (unsigned long)(_completedFiles - _failedFiles), (unsigned long)_failedFiles, (unsigned long)_rewrittenFiles, -[_startTime timeIntervalSinceNow], _bytesWritten);
+	
+	[self closeJournal];
+	[_lastOperations removeAllObjects];
+	
+	_completedFiles		= 0;
+	_failedFiles		= 0;
+	_rewrittenFiles		= 0;
+	_bytesWritten		= 0;
+	_startTime			= nil;
+}
+
+- (void) postProgress:(NSDictionary *)progress
+{
+	[[NSNotificationCenter defaultCenter] postNotificationName:AudioMetadataBatchWriterDidWriteFileNotification object:self userInfo:progress];
+}
+
+// ========================================
+// The journal is a property list of the entries in the batch, rewritten atomically as entries are added,
+// and a log of length-prefixed binary property lists recording when each write started
+// (with the file's original tags) and finished
+// Called with the lock held
+- (BOOL) openJournal
+{
+	NSMutableArray *storedEntries = [NSMutableArray arrayWithCapacity:[_journalEntries count]];
+	
+	for(NSDictionary *entry in _journalEntries)
+		[storedEntries addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+			[[entry objectForKey:JournalURLKey] absoluteString], JournalURLKey,
+			[entry objectForKey:JournalMetadataKey], JournalMetadataKey,
+			nil]];
+	
+	NSString	*entriesPath	= journalPath(JournalEntriesFileName);
+	NSData		*data			= [NSPropertyListSerialization dataWithPropertyList:storedEntries format:NSPropertyListBinaryFormat_v1_0 options:0 error:nil];
+	
+	if(nil == entriesPath || nil == data || NO == [data writeToFile:entriesPath atomically:YES])
+		return NO;
+	
+	// A new batch starts with an empty log
+	if(-1 == _journalFD)
+		_journalFD = open([journalPath(JournalLogFileName) fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	
+	return (-1 != _journalFD);
+}
+
+// Called with the lock held
+- (void) closeJournal
+{
+	if(-1 != _journalFD) {
+		close(_journalFD);
+		_journalFD = -1;
+	}
+	
+	[_journalEntries removeAllObjects];
+	
+	// Files without a finished record are offered for resuming on the next launch
+	if(NO == _keepsJournal)
+		removeJournalFiles();
+}
+
+- (void) appendJournalRecord:(NSDictionary *)record synchronize:(BOOL)synchronize
+{
+	NSData *data = [NSPropertyListSerialization dataWithPropertyList:record format:NSPropertyListBinaryFormat_v1_0 options:0 error:nil];
+	if(nil == data)
+		return;
+	
+	uint32_t		length		= OSSwapHostToBigInt32((uint32_t)[data length]);
+	NSMutableData	*buffer		= [NSMutableData dataWithBytes:&length length:sizeof(length)];
+	int				fd			= -1;
+	
+	[buffer appendData:data];
+	
+	@synchronized(_journalEntries) {
+		fd = _journalFD;
+		
+		if(-1 != fd && (ssize_t)[buffer length] != write(fd, [buffer bytes], [buffer length]))
+			NSLog(@"AudioMetadataBatchWriter: Unable to write to the journal (%s)", strerror(errno));
+	}
+	
+	// The journal stays open while this file's write is outstanding, so it is safe to sync outside the lock
+	// fsync protects against the application crashing; F_FULLFSYNC for every file would serialize
+	// the whole batch on the drive's cache
+	if(synchronize && -1 != fd)
+		fsync(fd);
+}
+
+- (void) loadInterruptedBatch
+{
+	NSData *entriesData = [NSData dataWithContentsOfFile:journalPath(JournalEntriesFileName)];
+	if(nil == entriesData)
+		return;
+	
+	NSArray *storedEntries = [NSPropertyListSerialization propertyListWithData:entriesData options:NSPropertyListImmutable format:NULL error:nil];
+	if(NO == [storedEntries isKindOfClass:[NSArray class]]) {
+		removeJournalFiles();
+		return;
+	}
+	
+	NSData					*logData			= [NSData dataWithContentsOfFile:journalPath(JournalLogFileName)];
+	const uint8_t			*bytes				= [logData bytes];
+	NSUInteger				offset				= 0;
+	NSMutableDictionary		*originalMetadata	= [NSMutableDictionary dictionary];
+	NSMutableIndexSet		*finishedIndexes	= [NSMutableIndexSet indexSet];
+	
+	// A record cut short by the crash ends the log
+	while(offset + sizeof(uint32_t) <= [logData length]) {
+		uint32_t length = OSReadBigInt32(bytes, offset);
+		offset += sizeof(uint32_t);
+		
+		if(offset + length > [logData length])
+			break;
+		
+		NSDictionary *record = [NSPropertyListSerialization propertyListWithData:[logData subdataWithRange:NSMakeRange(offset, length)] options:NSPropertyListImmutable format:NULL error:nil];
+		offset += length;
+		
+		if(NO == [record isKindOfClass:[NSDictionary class]])
+			break;
+		
+		NSNumber *index = [record objectForKey:JournalIndexKey];
+		
+		if([[record objectForKey:JournalEventKey] isEqualToString:JournalFinishedEvent])
+			[finishedIndexes addIndex:[index unsignedIntegerValue]];
+		else if(nil != [record objectForKey:JournalOriginalMetadataKey])
+			[originalMetadata setObject:[record objectForKey:JournalOriginalMetadataKey] forKey:index];
+	}
+	
+	NSMutableArray *entries = [NSMutableArray arrayWithCapacity:[storedEntries count]];
+	
+	for(NSUInteger i = 0; i < [storedEntries count]; ++i) {
+		NSDictionary	*storedEntry	= [storedEntries objectAtIndex:i];
+		NSURL			*url			= [NSURL URLWithString:[storedEntry objectForKey:JournalURLKey]];
+		NSDictionary	*metadata		= [storedEntry objectForKey:JournalMetadataKey];
+		
+		if(nil == url || nil == metadata)
+			continue;
+		
+		NSMutableDictionary *entry = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+			url, JournalURLKey,
+			metadata, JournalMetadataKey,
+			[NSNumber numberWithBool:[finishedIndexes containsIndex:i]], JournalFinishedKey,
+			nil];
+		
+		NSDictionary *original = [originalMetadata objectForKey:[NSNumber numberWithUnsignedInteger:i]];
+		if(nil != original)
+			[entry setObject:original forKey:JournalOriginalMetadataKey];
+		
+		[entries addObject:entry];
+	}
+	
+	_interruptedEntries = entries;
+	
+	// Nothing to do if the application quit after the last write but before the journal was removed
+	if(NO == [self hasInterruptedBatch])
+		[self discardInterruptedBatch];
+}
+
+@end
@@ -31,13 +31,33 @@ enum {
 	AudioMetadataWriterInputOutputError					= 2
 };
 
+@class AudioStream;
+
 @interface AudioMetadataWriter : NSObject
 {
 	NSURL							*_url;
+	
+	SInt64							_bytesWritten;		// Set by writers that can account for their writes, otherwise -1
+	BOOL							_rewroteFile;		// YES if the audio data had to move to make room for the tags
 }
 
 + (AudioMetadataWriter *)			metadataWriterForURL:(NSURL *)url error:(NSError **)error;
 
+// ========================================
+// Edits to a stream that arrive within a second of each other are written to its file together
+// The writes are handed to the AudioMetadataBatchWriter; at termination writes still pending
+// should be flushed with writePendingMetadataAndSuspend, which also suspends the batch writer
++ (void)							scheduleMetadataWriteForStream:(AudioStream *)stream;
++ (void)							writePendingMetadata;
++ (void)							writePendingMetadataAndSuspend;
+
 - (BOOL)							writeMetadata:(id)metadata error:(NSError **)error;
 
+// ========================================
+// The cost of the last write
+// Writers that have to move the audio data reserve metadataPaddingSize bytes of padding
+// so subsequent edits can be written in place
+- (SInt64)							bytesWritten;
+- (BOOL)							rewroteFile;
+
 @end
@@ -30,13 +30,27 @@
 #import "AIFFMetadataWriter.h"
 #import "WAVEMetadataWriter.h"
 
+#import "AudioMetadataBatchWriter.h"
 #import "AudioStream.h"
 #import "UtilityFunctions.h"
 
+// Delay before writing scheduled metadata, so bursts of edits to a file are written together
+#define METADATA_WRITE_DELAY		1.0
+
 NSString *const AudioMetadataWriterErrorDomain = @"org.sbooth.Play.ErrorDomain.AudioMetadataWriter";
 
+// Streams waiting to be written, keyed by URL so each file is written once
+static NSMutableDictionary *pendingStreams = nil;
+
 @implementation AudioMetadataWriter
 
+- (id) init
+{
+	if((self = [super init]))
+		_bytesWritten = -1;
+	return self;
+}
+
 + (AudioMetadataWriter *) metadataWriterForURL:(NSURL *)url error:(NSError **)error
 {
 	NSParameterAssert(nil != url);
@@ -144,6 +158,47 @@ NSString *const AudioMetadataWriterErrorDomain = @"org.sbooth.Play.ErrorDomain.A
 	return result;
 }
 
++ (void) scheduleMetadataWriteForStream:(AudioStream *)stream
+{
+	NSParameterAssert(nil != stream);
+	
+	if(nil == pendingStreams)
+		pendingStreams = [[NSMutableDictionary alloc] init];
+	
+	// The values are read when the write happens, so later edits are picked up as well
+	[pendingStreams setObject:stream forKey:[stream currentStreamURL]];
+	
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(writePendingMetadata) object:nil];
+	[self performSelector:@selector(writePendingMetadata) withObject:nil afterDelay:METADATA_WRITE_DELAY];
+}
+
++ (void) writePendingMetadata
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(writePendingMetadata) object:nil];
+	
+	if(0 == [pendingStreams count])
+		return;
+	
+	NSArray *streams = [pendingStreams allValues];
+	[pendingStreams removeAllObjects];
+	
+	[[AudioMetadataBatchWriter sharedBatchWriter] writeMetadataForStreams:streams];
+}
+
++ (void) writePendingMetadataAndSuspend
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(writePendingMetadata) object:nil];
+	
+	NSArray *streams = [pendingStreams allValues];
+	[pendingStreams removeAllObjects];
+	
+	// Queued separately, the edits would be skipped along with the rest of the batch
+	[[AudioMetadataBatchWriter sharedBatchWriter] suspendAfterWritingMetadataForStreams:streams];
+}
+
 - (BOOL)			writeMetadata:(id)metadata error:(NSError **)error			{ return NO; }
 
+- (SInt64)			bytesWritten												{ return _bytesWritten; }
+- (BOOL)			rewroteFile													{ return _rewroteFile; }
+
 @end
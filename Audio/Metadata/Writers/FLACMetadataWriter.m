@@ -44,6 +44,65 @@ setVorbisComment(FLAC__StreamMetadata		*block,
 	}
 }
 
+// Makes sure the chain ends with at least paddingSize bytes of padding
+static BOOL
+reservePadding(FLAC__Metadata_Chain		*chain,
+			   unsigned					paddingSize)
+{
+	NSCParameterAssert(NULL != chain);
+	
+	FLAC__Metadata_Iterator *iterator = FLAC__metadata_iterator_new();
+	NSCAssert(NULL != iterator, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	FLAC__metadata_iterator_init(iterator, chain);
+	while(FLAC__metadata_iterator_next(iterator))
+		;
+	
+	FLAC__bool result = YES;
+	
+	// FLAC__metadata_chain_sort_padding() has merged any padding into the last block
+	if(FLAC__METADATA_TYPE_PADDING == FLAC__metadata_iterator_get_block_type(iterator)) {
+		FLAC__StreamMetadata *padding = FLAC__metadata_iterator_get_block(iterator);
+		if(padding->length < paddingSize)
+			padding->length = paddingSize;
+	}
+	else {
+		FLAC__StreamMetadata *padding = FLAC__metadata_object_new(FLAC__METADATA_TYPE_PADDING);
+		NSCAssert(NULL != padding, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+		
+		padding->length = paddingSize;
+		
+		result = FLAC__metadata_iterator_insert_block_after(iterator, padding);
+		if(NO == result)
+			FLAC__metadata_object_delete(padding);
+	}
+	
+	FLAC__metadata_iterator_delete(iterator);
+	
+	return result;
+}
+
+// Returns the size of the metadata blocks, including their headers
+static SInt64
+metadataLength(FLAC__Metadata_Chain *chain)
+{
+	NSCParameterAssert(NULL != chain);
+	
+	FLAC__Metadata_Iterator *iterator = FLAC__metadata_iterator_new();
+	NSCAssert(NULL != iterator, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	SInt64 length = 0;
+	
+	FLAC__metadata_iterator_init(iterator, chain);
+	do {
+		length += FLAC__STREAM_METADATA_HEADER_LENGTH + FLAC__metadata_iterator_get_block(iterator)->length;
+	} while(FLAC__metadata_iterator_next(iterator));
+	
+	FLAC__metadata_iterator_delete(iterator);
+	
+	return length;
+}
+
 @implementation FLACMetadataWriter
 
 - (BOOL) writeMetadata:(id)metadata error:(NSError **)error
@@ -213,6 +272,12 @@ setVorbisComment(FLAC__StreamMetadata		*block,
 	setVorbisComment(block, @"MUSICDNS_PUID", [metadata valueForKey:MetadataMusicDNSPUIDKey]);
 	setVorbisComment(block, @"MUSICBRAINZ_ID", [metadata valueForKey:MetadataMusicBrainzIDKey]);
 
+	// If the comments no longer fit in the existing padding the whole file is rewritten,
+	// so leave enough room that the next edit won't need to do the same
+	BOOL rewriteFile = FLAC__metadata_chain_check_if_tempfile_needed(chain, YES);
+	if(rewriteFile)
+		reservePadding(chain, (unsigned)[[NSUserDefaults standardUserDefaults] integerForKey:@"metadataPaddingSize"]);
+
 	// Write the new metadata to the file
 	result = FLAC__metadata_chain_write(chain, YES, NO);
 	if(NO == result) {
@@ -235,6 +300,9 @@ setVorbisComment(FLAC__StreamMetadata		*block,
 		return NO;
 	}
 
+	_rewroteFile	= rewriteFile;
+	_bytesWritten	= (rewriteFile ? (SInt64)[[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileSize] : metadataLength(chain));
+
 	FLAC__metadata_chain_delete(chain);
 	FLAC__metadata_iterator_delete(iterator);
 
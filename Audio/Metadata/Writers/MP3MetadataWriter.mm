@@ -31,6 +31,8 @@
 #include <taglib/attachedpictureframe.h>
 #include <taglib/relativevolumeframe.h>
 #include <taglib/id3v2tag.h>
+#include <taglib/id3v2header.h>
+#include <taglib/id3v2synchdata.h>
 
 @implementation MP3MetadataWriter
 
@@ -294,7 +296,51 @@
 		f.ID3v2Tag()->addFrame(pictureFrame);
 	}*/
 	
-	result = f.save();
+	// TagLib moves the audio whenever the ID3v2 tag outgrows its padding, and then only leaves 1 KB.
+	// A tag at the start of the file is written here instead, so the size of the write is known up
+	// front and a rewrite leaves metadataPaddingSize bytes for later edits
+	f.seek(0);
+	
+	TagLib::ByteVector	fileHeader			= f.readBlock(TagLib::ID3v2::Header::size());
+	TagLib::uint		originalTagSize		= 0;
+	bool				writeTagHere		= false;
+	
+	if(fileHeader.startsWith(TagLib::ID3v2::Header::fileIdentifier())) {
+		TagLib::ID3v2::Header header(fileHeader);
+		originalTagSize		= header.completeTagSize();
+		writeTagHere		= (false == header.footerPresent());
+	}
+	// Files without a tag get one at the start; one found elsewhere in the file is left to TagLib
+	else
+		writeTagHere = (0 == f.ID3v2Tag()->header()->tagSize());
+	
+	if(writeTagHere) {
+		// The tags at the end of the file go first, since inserting at the start invalidates TagLib's offsets
+		result = f.save(TagLib::MPEG::File::ID3v1 | TagLib::MPEG::File::APE, false);
+		
+		if(result && (false == f.ID3v2Tag()->isEmpty() || 0 != originalTagSize)) {
+			// If the frames fit, render() pads the tag to its original size
+			TagLib::ByteVector tagData = f.ID3v2Tag()->render();
+			
+			_rewroteFile = (tagData.size() != originalTagSize);
+			
+			if(_rewroteFile) {
+				tagData.resize(tagData.size() + (TagLib::uint)[[NSUserDefaults standardUserDefaults] integerForKey:@"metadataPaddingSize"], 0);
+				
+				// The tag size is the synchsafe integer at offset 6 of the header
+				TagLib::ByteVector tagSize = TagLib::ID3v2::SynchData::fromUInt(tagData.size() - TagLib::ID3v2::Header::size());
+				for(TagLib::uint i = 0; i < tagSize.size(); ++i)
+					tagData[6 + i] = tagSize[i];
+			}
+			
+			f.insert(tagData, 0, originalTagSize);
+			
+			_bytesWritten = (_rewroteFile ? f.length() : tagData.size());
+		}
+	}
+	else
+		result = f.save();
+	
 	if(NO == result) {
 		if(nil != error) {
 			NSMutableDictionary		*errorDictionary	= [NSMutableDictionary dictionary];
@@ -0,0 +1,46 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+// ========================================
+// Reads the properties, metadata and embedded cue sheet of a file together
+// Formats with a dedicated probe open and parse the file only once; all other
+// formats fall back on the individual properties and metadata readers
+// ========================================
+@interface AudioFileProbe : NSObject
+{
+	NSURL							*_url;
+	NSDictionary					*_properties;
+	NSDictionary					*_metadata;
+	BOOL							_hasAlbumArt;
+}
+
++ (AudioFileProbe *)				probeForURL:(NSURL *)url error:(NSError **)error;
+
+- (BOOL)							probeFile:(NSError **)error;
+
+- (NSDictionary *)					properties;
+- (NSDictionary *)					metadata;
+- (NSDictionary *)					cueSheet;
+
+- (BOOL)							hasAlbumArt;
+
+@end
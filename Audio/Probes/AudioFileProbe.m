@@ -0,0 +1,80 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioFileProbe.h"
+#import "FLACFileProbe.h"
+#import "MPEGFileProbe.h"
+
+#import "AudioPropertiesReader.h"
+#import "AudioMetadataReader.h"
+#import "AudioStream.h"
+
+@implementation AudioFileProbe
+
++ (AudioFileProbe *) probeForURL:(NSURL *)url error:(NSError **)error
+{
+	NSParameterAssert(nil != url);
+	NSParameterAssert([url isFileURL]);
+	
+	AudioFileProbe				*result				= nil;
+	NSString					*pathExtension		= [[[url path] pathExtension] lowercaseString];
+	
+	if([pathExtension isEqualToString:@"flac"])
+		result = [[FLACFileProbe alloc] init];
+	else if([pathExtension isEqualToString:@"mp3"])
+		result = [[MPEGFileProbe alloc] init];
+	// Unsupported formats are reported by the properties reader
+	else
+		result = [[AudioFileProbe alloc] init];
+	
+	[result setValue:url forKey:StreamURLKey];
+	
+	return result;
+}
+
+- (BOOL) probeFile:(NSError **)error
+{
+	AudioPropertiesReader *propertiesReader = [AudioPropertiesReader propertiesReaderForURL:_url error:error];
+	if(nil == propertiesReader)
+		return NO;
+	
+	if(NO == [propertiesReader readProperties:error])
+		return NO;
+
+	AudioMetadataReader *metadataReader = [AudioMetadataReader metadataReaderForURL:_url error:error];
+	if(nil == metadataReader)
+		return NO;
+	
+	if(NO == [metadataReader readMetadata:error])
+		return NO;
+	
+	[self setValue:[propertiesReader properties] forKey:@"properties"];
+	[self setValue:[metadataReader metadata] forKey:@"metadata"];
+	
+	return YES;
+}
+
+- (NSDictionary *)	properties					{ return _properties; }
+- (NSDictionary *)	metadata					{ return _metadata; }
+- (NSDictionary *)	cueSheet					{ return [_properties valueForKey:AudioPropertiesCueSheetKey]; }
+
+- (BOOL)			hasAlbumArt					{ return _hasAlbumArt; }
+
+@end
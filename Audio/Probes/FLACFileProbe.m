@@ -0,0 +1,93 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "FLACFileProbe.h"
+#import "FLACPropertiesReader.h"
+#import "FLACMetadataReader.h"
+#include <FLAC/metadata.h>
+
+@implementation FLACFileProbe
+
+- (BOOL) probeFile:(NSError **)error
+{
+	NSString					*path		= [_url path];
+	FLAC__Metadata_Chain		*chain		= NULL;
+	FLAC__Metadata_Iterator		*iterator	= NULL;
+	FLAC__StreamMetadata		*block		= NULL;
+	
+	chain = FLAC__metadata_chain_new();
+	NSAssert(NULL != chain, @"Unable to allocate memory.");
+	
+	// The properties, cue sheet and metadata all come from the same metadata chain
+	if(NO == FLAC__metadata_chain_read(chain, [path fileSystemRepresentation])) {
+		if(nil != error) {
+			NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
+			
+			[errorDictionary setObject:[NSString stringWithFormat:NSLocalizedStringFromTable(@"The file \"%@\" is not a valid FLAC file.", @"Errors", @""), [[NSFileManager defaultManager] displayNameAtPath:path]] forKey:NSLocalizedDescriptionKey];
+			[errorDictionary setObject:NSLocalizedStringFromTable(@"Not a FLAC file", @"Errors", @"") forKey:NSLocalizedFailureReasonErrorKey];
+			
+			if(FLAC__METADATA_CHAIN_STATUS_BAD_METADATA == FLAC__metadata_chain_status(chain))
+				[errorDictionary setObject:NSLocalizedStringFromTable(@"The file contains bad metadata.", @"Errors", @"") forKey:NSLocalizedRecoverySuggestionErrorKey];
+			else
+				[errorDictionary setObject:NSLocalizedStringFromTable(@"The file's extension may not match the file's type.", @"Errors", @"") forKey:NSLocalizedRecoverySuggestionErrorKey];
+			
+			*error = [NSError errorWithDomain:AudioPropertiesReaderErrorDomain 
+										 code:AudioPropertiesReaderFileFormatNotRecognizedError 
+									 userInfo:errorDictionary];
+		}
+		
+		FLAC__metadata_chain_delete(chain);
+		
+		return NO;
+	}
+	
+	iterator = FLAC__metadata_iterator_new();
+	NSAssert(NULL != iterator, @"Unable to allocate memory.");
+	
+	FLAC__metadata_iterator_init(iterator, chain);
+	
+	NSMutableDictionary		*propertiesDictionary	= [NSMutableDictionary dictionary];
+	NSMutableDictionary		*metadataDictionary		= [NSMutableDictionary dictionary];
+	
+	do {
+		block = FLAC__metadata_iterator_get_block(iterator);
+		
+		if(NULL == block)
+			break;
+		
+		[FLACPropertiesReader addPropertiesFromBlock:block toDictionary:propertiesDictionary];
+
+		// Only note the presence of album art, decoding the image is expensive
+		if(FLAC__METADATA_TYPE_PICTURE == block->type)
+			_hasAlbumArt = YES;
+		else
+			[FLACMetadataReader addMetadataFromBlock:block toDictionary:metadataDictionary];
+	} while(FLAC__metadata_iterator_next(iterator));
+	
+	FLAC__metadata_iterator_delete(iterator);
+	FLAC__metadata_chain_delete(chain);
+	
+	[self setValue:propertiesDictionary forKey:@"properties"];
+	[self setValue:metadataDictionary forKey:@"metadata"];
+	
+	return YES;
+}
+
+@end
@@ -0,0 +1,283 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "MPEGFileProbe.h"
+#import "MP3MetadataReader.h"
+#import "AudioMetadataReader.h"
+#import "AudioStream.h"
+
+#include <taglib/mpegfile.h>
+#include <taglib/id3v2tag.h>
+
+#include <mad/mad.h>
+
+#define INPUT_BUFFER_SIZE	(5 * 8192)
+#define LAME_HEADER_SIZE	((8 * 5) + 4 + 4 + 8 + 32 + 16 + 16 + 4 + 4 + 8 + 12 + 12 + 8 + 8 + 2 + 3 + 11 + 32 + 32 + 32)
+
+// Xing header flags, see MPEGPropertiesReader.m
+#define FRAMES_FLAG     0x0001
+#define BYTES_FLAG      0x0002
+#define TOC_FLAG        0x0004
+#define VBR_SCALE_FLAG  0x0008
+
+// ========================================
+// Decodes the first frames of the file, which are read through the already open TagLib file
+// Fills in the stream properties and, if requested, the ReplayGain values from the LAME header
+static BOOL
+readFirstFrames(TagLib::MPEG::File& f, NSMutableDictionary *propertiesDictionary, NSMutableDictionary *metadataDictionary, BOOL readReplayGain)
+{
+	long firstFrameOffset = f.firstFrameOffset();
+	if(0 > firstFrameOffset)
+		return NO;
+	
+	f.seek(firstFrameOffset);
+	TagLib::ByteVector block = f.readBlock(INPUT_BUFFER_SIZE);
+	if(0 == block.size())
+		return NO;
+	
+	// MAD_BUFFER_GUARD zeroes are required to decode the last frame in the buffer
+	unsigned char		inputBuffer		[INPUT_BUFFER_SIZE + MAD_BUFFER_GUARD];
+	
+	memcpy(inputBuffer, block.data(), block.size());
+	memset(inputBuffer + block.size(), 0, MAD_BUFFER_GUARD);
+	
+	struct mad_stream	stream;
+	struct mad_frame	frame;
+	uint32_t			framesDecoded	= 0;
+	BOOL				foundTotalFrames	= NO;
+	
+	mad_stream_init(&stream);
+	mad_frame_init(&frame);
+	
+	mad_stream_buffer(&stream, inputBuffer, block.size() + MAD_BUFFER_GUARD);
+	
+	for(;;) {
+		if(-1 == mad_frame_decode(&frame, &stream)) {
+			if(MAD_RECOVERABLE(stream.error))
+				continue;
+			
+			// The buffer is large enough to hold the first two frames
+#if DEBUG
+			NSLog(@"Unrecoverable frame level error (%s)", mad_stream_errorstr(&stream));
+#endif
+			break;
+		}
+		
+		++framesDecoded;
+		
+		// The first frame contains the stream properties and possibly the Xing and LAME headers
+		// Reference http://www.codeproject.com/audio/MPEGAudioInfo.asp
+		if(1 == framesDecoded) {
+			[propertiesDictionary setValue:NSLocalizedStringFromTable(@"MPEG-1 Audio", @"Formats", @"") forKey:PropertiesFileTypeKey];		
+			switch(frame.header.layer) {
+				case 1:
+					[propertiesDictionary setValue:NSLocalizedStringFromTable(@"Layer I", @"Formats", @"") forKey:PropertiesDataFormatKey];
+					[propertiesDictionary setValue:NSLocalizedStringFromTable(@"MP1", @"Formats", @"") forKey:PropertiesFormatDescriptionKey];
+					break;
+				case 2:
+					[propertiesDictionary setValue:NSLocalizedStringFromTable(@"Layer II", @"Formats", @"") forKey:PropertiesDataFormatKey];
+					[propertiesDictionary setValue:NSLocalizedStringFromTable(@"MP2", @"Formats", @"") forKey:PropertiesFormatDescriptionKey];
+					break;
+				case 3:
+					[propertiesDictionary setValue:NSLocalizedStringFromTable(@"Layer III", @"Formats", @"") forKey:PropertiesDataFormatKey];
+					[propertiesDictionary setValue:NSLocalizedStringFromTable(@"MP3", @"Formats", @"") forKey:PropertiesFormatDescriptionKey];
+					break;
+			}
+			
+			[propertiesDictionary setValue:[NSNumber numberWithUnsignedInt:frame.header.samplerate] forKey:PropertiesSampleRateKey];
+			[propertiesDictionary setValue:[NSNumber numberWithInt:MAD_NCHANNELS(&frame.header)] forKey:PropertiesChannelsPerFrameKey];
+			[propertiesDictionary setValue:[NSNumber numberWithUnsignedLong:frame.header.bitrate] forKey:PropertiesBitrateKey];
+			
+			unsigned samplesPerMPEGFrame		= 32 * MAD_NSBSAMPLES(&frame.header);
+			unsigned ancillaryBitsRemaining		= stream.anc_bitlen;
+			
+			if(32 > ancillaryBitsRemaining)
+				continue;
+			
+			uint32_t magic = mad_bit_read(&stream.anc_ptr, 32);
+			ancillaryBitsRemaining -= 32;
+			
+			if('Xing' != magic && 'Info' != magic)
+				continue;
+			
+			if(32 > ancillaryBitsRemaining)
+				continue;
+			
+			uint32_t flags = mad_bit_read(&stream.anc_ptr, 32);
+			ancillaryBitsRemaining -= 32;
+			
+			// 4 byte value containing total frames
+			if(FRAMES_FLAG & flags) {
+				if(32 > ancillaryBitsRemaining)
+					continue;
+				
+				uint32_t frames = mad_bit_read(&stream.anc_ptr, 32);
+				ancillaryBitsRemaining -= 32;
+				
+				// Our concept of a frame is the same as CoreAudio's- one sample across all channels
+				[propertiesDictionary setValue:[NSNumber numberWithUnsignedLong:frames * samplesPerMPEGFrame] forKey:PropertiesTotalFramesKey];
+				foundTotalFrames = YES;
+			}
+			
+			// 4 byte value containing total bytes
+			if(BYTES_FLAG & flags) {
+				if(32 > ancillaryBitsRemaining)
+					continue;
+				
+				/*uint32_t bytes =*/ mad_bit_read(&stream.anc_ptr, 32);
+				ancillaryBitsRemaining -= 32;
+			}
+			
+			// 100 bytes containing TOC information
+			if(TOC_FLAG & flags) {
+				if(8 * 100 > ancillaryBitsRemaining)
+					continue;
+				
+				unsigned i;
+				for(i = 0; i < 100; ++i)
+					/*xingTOC[i] =*/ mad_bit_read(&stream.anc_ptr, 8);
+				
+				ancillaryBitsRemaining -= (8 * 100);
+			}
+			
+			// 4 byte value indicating encoded vbr scale
+			if(VBR_SCALE_FLAG & flags) {
+				if(32 > ancillaryBitsRemaining)
+					continue;
+				
+				/*uint32_t vbrScale =*/ mad_bit_read(&stream.anc_ptr, 32);
+				ancillaryBitsRemaining -= 32;
+			}
+			
+			// Look for the LAME header next
+			// http://gabriel.mp3-tech.org/mp3infotag.html				
+			if(readReplayGain && 32 + LAME_HEADER_SIZE <= ancillaryBitsRemaining && 'LAME' == mad_bit_read(&stream.anc_ptr, 32)) {
+				unsigned i;
+				for(i = 0; i < 5; ++i)
+					/*versionString[i] =*/ mad_bit_read(&stream.anc_ptr, 8);
+				
+				/*uint8_t infoTagRevision =*/ mad_bit_read(&stream.anc_ptr, 4);
+				/*uint8_t vbrMethod =*/ mad_bit_read(&stream.anc_ptr, 4);
+				
+				/*uint8_t lowpassFilterValue =*/ mad_bit_read(&stream.anc_ptr, 8);
+				
+				float peakSignalAmplitude = mad_bit_read(&stream.anc_ptr, 32);
+				if(0 != peakSignalAmplitude)
+					[metadataDictionary setValue:[NSNumber numberWithFloat:peakSignalAmplitude] forKey:ReplayGainTrackPeakKey];
+				
+				uint16_t radioReplayGain = mad_bit_read(&stream.anc_ptr, 16);
+				if(0 != radioReplayGain) {
+					BOOL		negative		= 0 != (radioReplayGain & 0x0200);
+					uint16_t	adjustment		= radioReplayGain & 0x01FF;		
+					double		replayGainDB	= (negative ? -1 : 1) * (adjustment / 10.0);
+					
+					[metadataDictionary setValue:[NSNumber numberWithDouble:replayGainDB] forKey:ReplayGainTrackGainKey];
+					[metadataDictionary setValue:[NSNumber numberWithDouble:89.0] forKey:ReplayGainReferenceLoudnessKey];
+				}
+				
+				uint16_t audiophileReplayGain = mad_bit_read(&stream.anc_ptr, 16);
+				if(0 != audiophileReplayGain) {
+					BOOL		negative		= 0 != (audiophileReplayGain & 0x0200);
+					uint16_t	adjustment		= audiophileReplayGain & 0x01FF;		
+					double		replayGainDB	= (negative ? -1 : 1) * (adjustment / 10.0);
+					
+					[metadataDictionary setValue:[NSNumber numberWithDouble:replayGainDB] forKey:ReplayGainAlbumGainKey];
+					[metadataDictionary setValue:[NSNumber numberWithDouble:89.0] forKey:ReplayGainReferenceLoudnessKey];
+				}
+				
+				// The remainder of the LAME header is unused
+			}
+			
+			// With a frame count from the Xing header there is no need to look at the second frame
+			if(foundTotalFrames)
+				break;
+		}
+		else {
+			// Just estimate the number of frames based on the file's size
+			unsigned totalFrames = frame.header.samplerate * ((f.length() - firstFrameOffset) / (frame.header.bitrate / 8.0f));
+			
+			[propertiesDictionary setValue:[NSNumber numberWithUnsignedLong:totalFrames] forKey:PropertiesTotalFramesKey];
+			
+			break;
+		}
+	}
+	
+	// Clean up
+	mad_frame_finish(&frame);
+	mad_stream_finish(&stream);
+	
+	return (0 != framesDecoded);
+}
+
+@implementation MPEGFileProbe
+
+- (BOOL) probeFile:(NSError **)error
+{
+	NSString							*path				= [_url path];
+	TagLib::MPEG::File					f					([path fileSystemRepresentation], false);
+	BOOL								foundReplayGain		= NO;
+	
+	if(NO == f.isValid()) {
+		if(nil != error) {
+			NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
+			
+			[errorDictionary setObject:[NSString stringWithFormat:NSLocalizedStringFromTable(@"The file \"%@\" is not a valid MPEG file.", @"Errors", @""), [[NSFileManager defaultManager] displayNameAtPath:path]] forKey:NSLocalizedDescriptionKey];
+			[errorDictionary setObject:NSLocalizedStringFromTable(@"Not an MPEG file", @"Errors", @"") forKey:NSLocalizedFailureReasonErrorKey];
+			[errorDictionary setObject:NSLocalizedStringFromTable(@"The file's extension may not match the file's type.", @"Errors", @"") forKey:NSLocalizedRecoverySuggestionErrorKey];						
+			
+			*error = [NSError errorWithDomain:AudioMetadataReaderErrorDomain 
+										 code:AudioMetadataReaderFileFormatNotRecognizedError 
+									 userInfo:errorDictionary];
+		}
+		
+		return NO;
+	}
+	
+	NSMutableDictionary		*propertiesDictionary	= [NSMutableDictionary dictionary];
+	NSMutableDictionary		*metadataDictionary		= metadataFromMPEGFile(f, &foundReplayGain);
+	
+	// The tags take precedence over the LAME header for ReplayGain
+	if(NO == readFirstFrames(f, propertiesDictionary, metadataDictionary, NO == foundReplayGain)) {
+		if(nil != error) {
+			NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
+			
+			[errorDictionary setObject:[NSString stringWithFormat:NSLocalizedStringFromTable(@"The file \"%@\" is not a valid MPEG file.", @"Errors", @""), [[NSFileManager defaultManager] displayNameAtPath:path]] forKey:NSLocalizedDescriptionKey];
+			[errorDictionary setObject:NSLocalizedStringFromTable(@"Not an MPEG file", @"Errors", @"") forKey:NSLocalizedFailureReasonErrorKey];
+			[errorDictionary setObject:NSLocalizedStringFromTable(@"The file's extension may not match the file's type.", @"Errors", @"") forKey:NSLocalizedRecoverySuggestionErrorKey];						
+			
+			*error = [NSError errorWithDomain:AudioMetadataReaderErrorDomain 
+										 code:AudioMetadataReaderFileFormatNotRecognizedError 
+									 userInfo:errorDictionary];
+		}
+		
+		return NO;
+	}
+	
+	TagLib::ID3v2::Tag *id3v2tag = f.ID3v2Tag();
+	if(NULL != id3v2tag && NO == id3v2tag->frameListMap()["APIC"].isEmpty())
+		_hasAlbumArt = YES;
+	
+	[self setValue:propertiesDictionary forKey:@"properties"];
+	[self setValue:metadataDictionary forKey:@"metadata"];
+	
+	return YES;
+}
+
+@end
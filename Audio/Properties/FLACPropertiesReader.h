@@ -20,8 +20,13 @@
 
 #import "AudioPropertiesReader.h"
 
+#include <FLAC/format.h>
+
 @interface FLACPropertiesReader : AudioPropertiesReader
 {
 }
 
+// Adds the properties contained in a single metadata block
++ (void) addPropertiesFromBlock:(const FLAC__StreamMetadata *)block toDictionary:(NSMutableDictionary *)propertiesDictionary;
+
 @end
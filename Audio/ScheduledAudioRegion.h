@@ -23,6 +23,8 @@
 
 #import "AudioDecoderMethods.h"
 
+@class AudioSliceBuffer, AudioSliceBufferPool;
+
 // A class encapsulating an AudioDecoder and the buffers and associated internal state that 
 // AudioScheduler needs to use a decoder
 @interface ScheduledAudioRegion : NSObject
@@ -36,6 +38,9 @@
 
 	NSUInteger					_numberSlices;
 	NSUInteger					_framesPerSlice;
+
+	AudioSliceBufferPool		*_sliceBufferPool;
+	AudioSliceBuffer			*_pooledSliceBuffer;	// Returned to _sliceBufferPool when the region is deallocated
 }
 
 + (ScheduledAudioRegion *) scheduledAudioRegionWithDecoder:(id <AudioDecoderMethods>)decoder;
@@ -54,10 +59,19 @@
 @property (atomic, readonly, assign) SInt64 framesScheduled;
 @property (atomic, readonly, assign) SInt64 framesRendered;
 
+// The decoder's frame when the first slice of this region was read
+// This is non-zero if leading silence was skipped or the region was faded in over the previous one
+@property (atomic, readwrite, assign) SInt64 startingFrame;
+
+// Silence at the edges of the decoder's audio, which AudioScheduler may skip when joining regions
+@property (atomic, readwrite, assign) SInt64 leadingSilenceFrames;
+@property (atomic, readwrite, assign) SInt64 trailingSilenceFrames;
+
 - (NSUInteger) numberOfSlicesInBuffer;
 - (NSUInteger) numberOfFramesPerSlice;
 
 - (void) allocateBuffersWithSliceCount:(NSUInteger)sliceCount frameCount:(NSUInteger)frameCount;
+- (void) borrowBuffersFromPool:(AudioSliceBufferPool *)pool sliceCount:(NSUInteger)sliceCount frameCount:(NSUInteger)frameCount;
 - (void) clearSliceBuffer;
 - (void) clearSlice:(NSUInteger)sliceIndex;
 
@@ -65,6 +79,7 @@
 - (void) clearFramesRendered;
 
 - (UInt32) readAudioInSlice:(NSUInteger)sliceIndex;
+- (UInt32) readAudioInSlice:(NSUInteger)sliceIndex frameCount:(UInt32)frameCount;
 
 - (ScheduledAudioSlice *) buffer;
 - (ScheduledAudioSlice *) sliceAtIndex:(NSUInteger)sliceIndex;
@@ -20,6 +20,7 @@
 
 #import "ScheduledAudioRegion.h"
 #import "AudioDecoder.h"
+#import "AudioSliceBufferPool.h"
 
 void allocate_slice_for_asbd(const AudioStreamBasicDescription *asbd, ScheduledAudioSlice *slice, NSUInteger numberOfFramesPerSlice);
 void deallocate_slice(ScheduledAudioSlice *slice);
@@ -145,6 +146,8 @@ clear_slice_buffer(ScheduledAudioSlice *sliceBuffer, NSArray<NSLock *> *sliceLoc
 @property (atomic, readwrite, assign) SInt64 framesScheduled;
 @property (atomic, readwrite, assign) SInt64 framesRendered;
 
+- (void) returnPooledBuffers;
+
 @end
 
 @implementation ScheduledAudioRegion
@@ -189,7 +192,10 @@ clear_slice_buffer(ScheduledAudioSlice *sliceBuffer, NSArray<NSLock *> *sliceLoc
 
 - (void) dealloc
 {
-	deallocate_slice_buffer(&_sliceBuffer, _sliceLocks, [self numberOfSlicesInBuffer]);
+	if(nil != _pooledSliceBuffer)
+		[_sliceBufferPool returnSliceBuffer:_pooledSliceBuffer];
+	else if(NULL != _sliceBuffer)
+		deallocate_slice_buffer(&_sliceBuffer, _sliceLocks, [self numberOfSlicesInBuffer]);
 }
 
 #pragma mark Properties
@@ -233,11 +239,15 @@ clear_slice_buffer(ScheduledAudioSlice *sliceBuffer, NSArray<NSLock *> *sliceLoc
 	NSParameterAssert(0 < sliceCount);
 	NSParameterAssert(0 < frameCount);
 	
+	[self returnPooledBuffers];
+	
+	if(NULL != _sliceBuffer)
+		deallocate_slice_buffer(&_sliceBuffer, _sliceLocks, [self numberOfSlicesInBuffer]);
+
 	_numberSlices		= sliceCount;
 	_framesPerSlice		= frameCount;
 	
 	// Allocate the buffers for the AudioScheduler to use
-	deallocate_slice_buffer(&_sliceBuffer, _sliceLocks, [self numberOfSlicesInBuffer]);
 	AudioStreamBasicDescription format = [[self decoder] format];
 	_sliceBuffer = allocate_slice_buffer_for_asbd(&format, [self numberOfSlicesInBuffer], [self numberOfFramesPerSlice]);
 	
@@ -248,6 +258,47 @@ clear_slice_buffer(ScheduledAudioSlice *sliceBuffer, NSArray<NSLock *> *sliceLoc
 	_sliceLocks = [sliceLocks copy];
 }
 
+- (void) borrowBuffersFromPool:(AudioSliceBufferPool *)pool sliceCount:(NSUInteger)sliceCount frameCount:(NSUInteger)frameCount
+{
+	NSParameterAssert(nil != pool);
+	NSParameterAssert(0 < sliceCount);
+	NSParameterAssert(0 < frameCount);
+	
+	[self returnPooledBuffers];
+	
+	if(NULL != _sliceBuffer)
+		deallocate_slice_buffer(&_sliceBuffer, _sliceLocks, [self numberOfSlicesInBuffer]);
+	
+	AudioSliceBuffer *sliceBuffer = [pool sliceBufferWithChannelCount:[[self decoder] format].mChannelsPerFrame sliceCount:sliceCount framesPerSlice:frameCount];
+	
+	// Fall back to private buffers if the pool couldn't provide any
+	if(nil == sliceBuffer) {
+		[self allocateBuffersWithSliceCount:sliceCount frameCount:frameCount];
+		return;
+	}
+	
+	_numberSlices			= sliceCount;
+	_framesPerSlice			= frameCount;
+	
+	_sliceBufferPool		= pool;
+	_pooledSliceBuffer		= sliceBuffer;
+	_sliceBuffer			= [sliceBuffer slices];
+	_sliceLocks				= [sliceBuffer sliceLocks];
+}
+
+- (void) returnPooledBuffers
+{
+	if(nil == _pooledSliceBuffer)
+		return;
+	
+	[_sliceBufferPool returnSliceBuffer:_pooledSliceBuffer];
+	
+	_sliceBufferPool		= nil;
+	_pooledSliceBuffer		= nil;
+	_sliceBuffer			= NULL;
+	_sliceLocks				= nil;
+}
+
 - (void) lockSlice:(NSUInteger)sliceIndex;
 {
 	NSParameterAssert(sliceIndex < [self numberOfSlicesInBuffer]);
@@ -298,10 +349,17 @@ clear_slice_buffer(ScheduledAudioSlice *sliceBuffer, NSArray<NSLock *> *sliceLoc
 - (void)			clearFramesRendered						{ self.framesRendered = 0; }
 
 - (UInt32) readAudioInSlice:(NSUInteger)sliceIndex
+{
+	return [self readAudioInSlice:sliceIndex frameCount:(UInt32)[self numberOfFramesPerSlice]];
+}
+
+- (UInt32) readAudioInSlice:(NSUInteger)sliceIndex frameCount:(UInt32)frameCount
 {
 	NSParameterAssert(sliceIndex < [self numberOfSlicesInBuffer]);
+	NSParameterAssert(frameCount <= [self numberOfFramesPerSlice]);
 	
-	UInt32 framesRead = [[self decoder] readAudio:_sliceBuffer[sliceIndex].mBufferList frameCount:[self numberOfFramesPerSlice]];
+	// Reading zero frames ends the region early
+	UInt32 framesRead = (0 < frameCount ? [[self decoder] readAudio:_sliceBuffer[sliceIndex].mBufferList frameCount:frameCount] : 0);
 	
 	if(0 == framesRead)
 		_atEnd = YES;
@@ -26,6 +26,7 @@
 @class AudioStreamTableView, AudioStreamArrayController;
 @class BrowserOutlineView, BrowserTreeController;
 @class BrowserNode;
+@class ShuffleEngine;
 
 // ========================================
 // Notification Names
@@ -111,6 +112,11 @@ extern NSString * const		PlayQueueKey;
 	NSMutableArray			*_playQueue;	
 	NSUInteger				_playbackIndex;
 	NSUInteger				_nextPlaybackIndex;
+	ShuffleEngine			*_shuffleEngine;			// Order for random playback, kept in step with the play queue
+	
+	NSUInteger				_resumePlaybackIndex;		// Saved position to start from when play is pressed
+	SInt64					_resumeFrame;
+	BOOL					_playQueueSaveScheduled;
 	
 	BOOL					_sentNextStreamRequest;
 	
@@ -276,6 +282,10 @@ extern NSString * const		PlayQueueKey;
 - (void)		saveStateToDefaults;
 - (void)		restoreStateFromDefaults;
 
+// The play queue is saved to the database shortly after each change
+- (void)		savePlayQueue;
+- (void)		restorePlayQueue;
+
 // ========================================
 // Undo/redo support
 - (NSUndoManager *) undoManager;
@@ -52,7 +52,10 @@
 
 #import "AudioPropertiesReader.h"
 #import "AudioMetadataReader.h"
+#import "AudioFileProbe.h"
+#import "AlbumArtworkCache.h"
 #import "AudioMetadataWriter.h"
+#import "AudioMetadataRescanner.h"
 
 #import "PlaylistInformationSheet.h"
 #import "SmartPlaylistInformationSheet.h"
@@ -86,6 +89,7 @@
 
 #import "UtilityFunctions.h"
 #import "CueSheetParser.h"
+#import "ShuffleEngine.h"
 
 #import "IconFamily.h"
 #import "ImageAndTextCell.h"
@@ -150,6 +154,18 @@ NSString * const	PlayQueueKey								= @"playQueue";
 #define PLAY_QUEUE_TABLE_COLUMNS_MENU_ITEM_INDEX	5
 #define STREAM_TABLE_COLUMNS_MENU_ITEM_INDEX		6
 
+// Delay before saving the play queue, so bursts of changes are written together
+#define PLAY_QUEUE_SAVE_DELAY						1.0
+
+// Values for the randomTrackWeighting default, used when adding random tracks from the library
+enum {
+	RandomTrackWeightingNone						= 0,
+	RandomTrackWeightingRating						= 1,
+	RandomTrackWeightingPlayCount					= 2
+};
+
+static void *PlayQueueObservationContext = &PlayQueueObservationContext;
+
 // ========================================
 // Callback Methods (for sheets, etc.)
 // ========================================
@@ -164,6 +180,8 @@ NSString * const	PlayQueueKey								= @"playQueue";
 @interface AudioLibrary (Private)
 - (void) scrollNowPlayingToVisible;
 
+- (void) schedulePlayQueueSave;
+
 - (void) setPlayButtonEnabled:(BOOL)playButtonEnabled;
 
 - (NSUInteger) playbackIndex;
@@ -213,6 +231,8 @@ NSString * const	PlayQueueKey								= @"playQueue";
 
 - (void) playbackDidComplete:(NSNotification *)aNotification;
 
+- (void) albumArtworkCacheDidCacheArtwork:(NSNotification *)aNotification;
+
 @end
 
 @implementation AudioLibrary
@@ -236,6 +256,7 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	// Setup stream table column defaults
 	NSDictionary *streamTableVisibleColumnsDictionary = [NSDictionary dictionaryWithObjectsAndKeys:
 		[NSNumber numberWithBool:NO], @"fileAvailable",
+		[NSNumber numberWithBool:NO], @"artwork",
 		[NSNumber numberWithBool:NO], @"id",
 		[NSNumber numberWithBool:YES], @"title",
 		[NSNumber numberWithBool:YES], @"albumTitle",
@@ -262,6 +283,7 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	
 	NSDictionary *streamTableColumnSizesDictionary = [NSDictionary dictionaryWithObjectsAndKeys:
 		[NSNumber numberWithFloat:26], @"fileAvailable",
+		[NSNumber numberWithFloat:20], @"artwork",
 		[NSNumber numberWithFloat:72], @"id",
 		[NSNumber numberWithFloat:192], @"title",
 		[NSNumber numberWithFloat:128], @"albumTitle",
@@ -414,7 +436,10 @@ NSString * const	PlayQueueKey								= @"playQueue";
 				return nil;
 			}
 			
-			if(NO == [[CollectionManager manager] connectToDatabase:databasePath error:&error]) {
+			// The hybrid mode runs queries against an in-memory copy of the library and saves it periodically
+			BOOL inMemory = [[NSUserDefaults standardUserDefaults] boolForKey:@"useHybridInMemoryDatabase"];
+			
+			if(NO == [[CollectionManager manager] connectToDatabase:databasePath inMemory:inMemory error:&error]) {
 				if(nil != error)
 					[[NSApplication sharedApplication] presentError:error];
 				
@@ -422,9 +447,13 @@ NSString * const	PlayQueueKey								= @"playQueue";
 			}
 		}
 		
-		_playQueue			= [[NSMutableArray alloc] init];
-		_playbackIndex		= NSNotFound;
-		_nextPlaybackIndex	= NSNotFound;
+		_playQueue				= [[NSMutableArray alloc] init];
+		_playbackIndex			= NSNotFound;
+		_nextPlaybackIndex		= NSNotFound;
+		_resumePlaybackIndex	= NSNotFound;
+		_shuffleEngine			= [[ShuffleEngine alloc] init];
+		
+		[self addObserver:self forKeyPath:PlayQueueKey options:0 context:PlayQueueObservationContext];
 		
 		[[NSNotificationCenter defaultCenter] addObserver:self 
 												 selector:@selector(streamAdded:) 
@@ -460,6 +489,11 @@ NSString * const	PlayQueueKey								= @"playQueue";
 												 selector:@selector(playbackDidComplete:) 
 													 name:AudioStreamPlaybackDidCompleteNotification
 												   object:nil];		
+		
+		[[NSNotificationCenter defaultCenter] addObserver:self 
+												 selector:@selector(albumArtworkCacheDidCacheArtwork:) 
+													 name:AlbumArtworkCacheDidCacheArtworkNotification
+												   object:nil];
 	}
 	return self;
 }
@@ -467,6 +501,7 @@ NSString * const	PlayQueueKey								= @"playQueue";
 - (void) dealloc
 {
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	[self removeObserver:self forKeyPath:PlayQueueKey context:PlayQueueObservationContext];
 
 	[[CollectionManager manager] disconnectFromDatabase:nil];
 
@@ -807,43 +842,49 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	if([[filename pathExtension] isEqualToString:@"cue"])
 		return [self addStreamsFromExternalCueSheet:filename];
 	
-	// Read the properties to determine if the file contains an embedded cuesheet
-	AudioPropertiesReader *propertiesReader = [AudioPropertiesReader propertiesReaderForURL:[NSURL fileURLWithPath:filename] error:&error];
-	if(nil == propertiesReader)
+	NSURL *url = [NSURL fileURLWithPath:filename];
+	
+	// If the file is already in the library as a single stream, there is no need to open it
+	AudioStream *stream = [[[CollectionManager manager] streamManager] streamForURL:url];
+	if(nil != stream)
+		return YES;
+	
+	// Read the properties, metadata and any embedded cuesheet in a single pass
+	AudioFileProbe *probe = [AudioFileProbe probeForURL:url error:&error];
+	if(nil == probe)
 		return NO;
 	
-	BOOL result = [propertiesReader readProperties:&error];
+	BOOL result = [probe probeFile:&error];
 	if(NO == result)
 		return NO;
 	
+	// Record the file's state so unchanged files can be skipped when rescanning
+	NSDictionary *fileStamp = getFileStampForURL(url);
+	
+	// Artwork is scaled and cached in the background, never stored with the stream
+	if([probe hasAlbumArt])
+		[[AlbumArtworkCache sharedCache] cacheArtworkForURL:url];
+	
 	// If the file contains an embedded cuesheet, treat each cue sheet entry as a separate stream in the library
-	NSDictionary *cueSheet = [propertiesReader cueSheet];
+	NSDictionary *cueSheet = [probe cueSheet];
 	if(nil != cueSheet) {
-		// Read the metadata for the file as a whole
-		AudioMetadataReader *metadataReader	= [AudioMetadataReader metadataReaderForURL:[NSURL fileURLWithPath:filename] error:&error];
-		if(nil == metadataReader)
-			return NO;
-		
-		result = [metadataReader readMetadata:&error];
-		if(NO == result)
-			return NO;
-
 		// Iterate through each track in the cue sheet, adding it to the library if required
 		for(NSDictionary *cueSheetTrack in [cueSheet valueForKey:AudioPropertiesCueSheetTracksKey]) {
 			// If the stream already exists in the library, skip it
-			AudioStream *stream = [[[CollectionManager manager] streamManager] streamForURL:[NSURL fileURLWithPath:filename] 
-																			  startingFrame:[cueSheetTrack valueForKey:StreamStartingFrameKey] 
-																				 frameCount:[cueSheetTrack valueForKey:StreamFrameCountKey]];
+			stream = [[[CollectionManager manager] streamManager] streamForURL:url 
+																  startingFrame:[cueSheetTrack valueForKey:StreamStartingFrameKey] 
+																	 frameCount:[cueSheetTrack valueForKey:StreamFrameCountKey]];
 			if(nil != stream)
 				continue;
 
 			// Create a dictionary containing all applicable keys for this stream
-			NSMutableDictionary *values = [NSMutableDictionary dictionaryWithDictionary:[propertiesReader properties]];
+			NSMutableDictionary *values = [NSMutableDictionary dictionaryWithDictionary:[probe properties]];
 			[values addEntriesFromDictionary:cueSheetTrack];
-			[values addEntriesFromDictionary:[metadataReader metadata]];
+			[values addEntriesFromDictionary:[probe metadata]];
+			[values addEntriesFromDictionary:fileStamp];
 			
 			// Insert the object in the database
-			stream = [AudioStream insertStreamForURL:[NSURL fileURLWithPath:filename] withInitialValues:values];
+			stream = [AudioStream insertStreamForURL:url withInitialValues:values];
 			
 			// Add the stream to the selected playlist
 			if(nil != stream && [_browserController selectedNodeIsPlaylist])
@@ -853,25 +894,12 @@ NSString * const	PlayQueueKey								= @"playQueue";
 		return YES;
 	}
 	else {
-		// If the stream already exists in the library, do nothing
-		AudioStream *stream = [[[CollectionManager manager] streamManager] streamForURL:[NSURL fileURLWithPath:filename]];
-		if(nil != stream)
-			return YES;
-
-		// Read the metadata
-		AudioMetadataReader *metadataReader	= [AudioMetadataReader metadataReaderForURL:[NSURL fileURLWithPath:filename] error:&error];
-		if(nil == metadataReader)
-			return NO;
-		
-		result = [metadataReader readMetadata:&error];
-		if(NO == result)
-			return NO;
-		
-		NSMutableDictionary *values = [NSMutableDictionary dictionaryWithDictionary:[propertiesReader properties]];
-		[values addEntriesFromDictionary:[metadataReader metadata]];
+		NSMutableDictionary *values = [NSMutableDictionary dictionaryWithDictionary:[probe properties]];
+		[values addEntriesFromDictionary:[probe metadata]];
+		[values addEntriesFromDictionary:fileStamp];
 		
 		// Insert the object in the database
-		stream = [AudioStream insertStreamForURL:[NSURL fileURLWithPath:filename] withInitialValues:values];
+		stream = [AudioStream insertStreamForURL:url withInitialValues:values];
 		
 		// Add the stream to the selected playlist
 		if(nil != stream && [_browserController selectedNodeIsPlaylist])
@@ -1134,17 +1162,24 @@ NSString * const	PlayQueueKey								= @"playQueue";
 		return;
 	
 	if(NO == [[self player] hasValidStream]) {
-		if(0 != [self countOfPlayQueue]) {
-			NSUInteger playIndex = ([self randomPlayback] ? (NSUInteger)(genrand_real2() * [self countOfPlayQueue]) : 0);			
+		// Pick up where playback left off when the queue was saved
+		if(NSNotFound != _resumePlaybackIndex && _resumePlaybackIndex < [self countOfPlayQueue]) {
+			SInt64 resumeFrame = _resumeFrame;
+			
+			[self playStreamAtIndex:_resumePlaybackIndex];
+			
+			if(0 < resumeFrame && resumeFrame < [[self player] totalFrames])
+				[[self player] setCurrentFrame:resumeFrame];
+		}
+		else if(0 != [self countOfPlayQueue]) {
+			NSUInteger playIndex = ([self randomPlayback] ? [_shuffleEngine nextIndexAfterIndex:NSNotFound] : 0);
 			[self playStreamAtIndex:playIndex];
 		}
 		else if([self randomPlayback]) {
 			NSArray		*streams			= (1 < [[_streamController selectedObjects] count] ? [_streamController selectedObjects] : [_streamController arrangedObjects]);
-			double		randomNumber		= genrand_real2();
-			NSUInteger	randomIndex			= (NSUInteger)(randomNumber * [streams count]);
 			
 			[self setPlayQueueFromArray:streams];
-			[self playStreamAtIndex:randomIndex];
+			[self playStreamAtIndex:[_shuffleEngine nextIndexAfterIndex:NSNotFound]];
 		}
 		else {
 			[_streamTable addToPlayQueue:sender];
@@ -1177,10 +1212,14 @@ NSString * const	PlayQueueKey								= @"playQueue";
 			[[NSNotificationCenter defaultCenter] postNotificationName:AudioStreamPlaybackDidResumeNotification 
 																object:self
 															  userInfo:[NSDictionary dictionaryWithObject:[self nowPlaying] forKey:AudioStreamObjectKey]];
-		else
+		else {
 			[[NSNotificationCenter defaultCenter] postNotificationName:AudioStreamPlaybackDidPauseNotification
 																object:self
 															  userInfo:[NSDictionary dictionaryWithObject:[self nowPlaying] forKey:AudioStreamObjectKey]];
+			
+			// Remember the position
+			[self schedulePlayQueueSave];
+		}
 	}
 	
 	[self updatePlayButtonState];
@@ -1193,6 +1232,9 @@ NSString * const	PlayQueueKey								= @"playQueue";
 		return;
 	}
 
+	// Remember where playback stopped
+	[self savePlayQueue];
+
 	AudioStream *stream = [self nowPlaying];
 
 	[self setPlaybackIndex:NSNotFound];
@@ -1269,13 +1311,9 @@ NSString * const	PlayQueueKey								= @"playQueue";
 		[self updatePlayButtonState];
 	}
 	else if([self randomPlayback]) {
-		double			randomNumber;
-		NSUInteger		randomIndex;
-		
-		randomNumber	= genrand_real2();
-		randomIndex		= (NSUInteger)(randomNumber * [streams count]);
-		
-		[self playStreamAtIndex:randomIndex];
+		// If the next stream was already drawn for gapless playback, drawing again would skip it for this pass
+		streamIndex = [self nextPlaybackIndex];
+		[self playStreamAtIndex:(streamIndex < [streams count] ? streamIndex : [_shuffleEngine nextIndexAfterIndex:[self playbackIndex]])];
 	}
 	else if([self loopPlayback]) {
 		streamIndex = [self playbackIndex];
@@ -1311,13 +1349,13 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	if(nil == stream || 0 == [streams count])
 		[self setPlaybackIndex:NSNotFound];
 	else if([self randomPlayback]) {
-		double			randomNumber;
-		NSUInteger		randomIndex;
+		// Step back through the shuffled order, or pick something new at the start of it
+		NSUInteger previousIndex = [_shuffleEngine indexDrawnBeforeIndex:[self playbackIndex]];
 		
-		randomNumber	= genrand_real2();
-		randomIndex		= (NSUInteger)(randomNumber * [streams count]);
+		if(NSNotFound == previousIndex)
+			previousIndex = [_shuffleEngine nextIndexAfterIndex:[self playbackIndex]];
 		
-		[self playStreamAtIndex:randomIndex];
+		[self playStreamAtIndex:previousIndex];
 	}
 	else if([self loopPlayback]) {
 		streamIndex = [self playbackIndex];		
@@ -1339,6 +1377,8 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	
 	AudioStream *currentStream = [self nowPlaying];
 	
+	_resumePlaybackIndex = NSNotFound;
+	
 	[[self player] stop];
 	
 	if(nil != currentStream) {
@@ -1361,6 +1401,7 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	
 	[_playQueueTable setNeedsDisplayInRect:[_playQueueTable rectOfRow:[self playbackIndex]]];
 	
+	[_shuffleEngine markIndexAsDrawn:thisIndex];
 	[self setPlaybackIndex:thisIndex];
 	[self setNextPlaybackIndex:NSNotFound];
 	
@@ -1379,18 +1420,16 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	
 	[self updatePlayQueueHistory];
 	
-	// Rescan metadata, if desired
-	if([[NSUserDefaults standardUserDefaults] boolForKey:@"rescanMetadataBeforePlayback"]) {
-		[[CollectionManager manager] beginUpdate];
-		[stream rescanMetadata:self];
-		[[CollectionManager manager] finishUpdate];
-	}
-	
 	[stream setIsPlaying:YES];
 	[self scrollNowPlayingToVisible];
 		
 	[[self player] play];
 	
+	// Rescan metadata, if desired
+	// This happens in the background once playback has started, and only if the file changed since it was last read
+	if([[NSUserDefaults standardUserDefaults] boolForKey:@"rescanMetadataBeforePlayback"])
+		[[AudioMetadataRescanner sharedRescanner] rescanMetadataForStreams:[NSArray arrayWithObject:stream]];
+	
 	[[NSNotificationCenter defaultCenter] postNotificationName:AudioStreamPlaybackDidStartNotification 
 														object:self 
 													  userInfo:[NSDictionary dictionaryWithObject:stream forKey:AudioStreamObjectKey]];
@@ -1477,9 +1516,11 @@ NSString * const	PlayQueueKey								= @"playQueue";
 {
 	NSParameterAssert(nil != streams);
 	
-	[self willChangeValueForKey:PlayQueueKey];
+	NSIndexSet *indexes = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange([self countOfPlayQueue], [streams count])];
+	
+	[self willChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:PlayQueueKey];
 	[_playQueue addObjectsFromArray:streams];
-	[self didChangeValueForKey:PlayQueueKey];
+	[self didChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:PlayQueueKey];
 	
 	[self updatePlayButtonState];
 }
@@ -1503,9 +1544,9 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	NSParameterAssert(nil != indexes);
 	NSParameterAssert([streams count] == [indexes count]);
 		
-	[self willChangeValueForKey:PlayQueueKey];
+	[self willChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:PlayQueueKey];
 	[_playQueue insertObjects:streams atIndexes:indexes];
-	[self didChangeValueForKey:PlayQueueKey];
+	[self didChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:PlayQueueKey];
 	
 	[self updatePlayButtonState];
 }
@@ -1524,24 +1565,26 @@ NSString * const	PlayQueueKey								= @"playQueue";
 
 - (IBAction) scramblePlayQueue:(id)sender
 {
-	NSUInteger	i;
-	double		randomNumber;
-	NSUInteger	randomIndex;
+	NSUInteger	count		= [self countOfPlayQueue];
+	NSUInteger	*indexes	= malloc(count * sizeof(NSUInteger));
+	NSUInteger	shuffled	= 0;
+	
+	if(NULL == indexes)
+		return;
+	
+	// Fisher-Yates over every position except the one playing, which stays put
+	for(NSUInteger i = 0; i < count; ++i)
+		if([self playbackIndex] != i)
+			indexes[shuffled++] = i;
 	
 	[self willChangeValueForKey:PlayQueueKey];
-	for(i = 0; i < [self countOfPlayQueue]; ++i) {
-		
-		if([self playbackIndex] == i)
-			continue;
-		
-		do {
-			randomNumber	= genrand_real2();
-			randomIndex		= (NSUInteger)(randomNumber * [self countOfPlayQueue]);
-		} while(randomIndex == [self playbackIndex]);
-		
-		[_playQueue exchangeObjectAtIndex:i withObjectAtIndex:randomIndex];
+	while(1 < shuffled) {
+		NSUInteger randomIndex = randomIndexLessThan(shuffled--);
+		[_playQueue exchangeObjectAtIndex:indexes[shuffled] withObjectAtIndex:indexes[randomIndex]];
 	}
 	[self didChangeValueForKey:PlayQueueKey];
+	
+	free(indexes);
 }
 
 - (IBAction) prunePlayQueue:(id)sender
@@ -1661,6 +1704,82 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	[[self player] restoreStateFromDefaults];
 }
 
+- (void) savePlayQueue
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(savePlayQueue) object:nil];
+	_playQueueSaveScheduled = NO;
+	
+	if(NO == [[NSUserDefaults standardUserDefaults] boolForKey:@"rememberPlayQueue"])
+		return;
+	
+	// Streams added to the library a moment ago have no ID until their rows are written
+	[[CollectionManager manager] waitForBackgroundWrites];
+	
+	[[[CollectionManager manager] streamManager] setPlayQueueStreamIDs:[_playQueue valueForKey:ObjectIDKey]];
+	
+	// Without a stream the last saved position is kept, so stopping doesn't lose it
+	if(NSNotFound != [self playbackIndex] && [[self player] hasValidStream]) {
+		[[NSUserDefaults standardUserDefaults] setInteger:(NSInteger)[self playbackIndex] forKey:@"savedPlayQueueIndex"];
+		[[NSUserDefaults standardUserDefaults] setObject:[NSNumber numberWithLongLong:[[self player] currentFrame]] forKey:@"savedPlayQueueFrame"];
+	}
+}
+
+- (void) restorePlayQueue
+{
+	if(NO == [[NSUserDefaults standardUserDefaults] boolForKey:@"rememberPlayQueue"])
+		return;
+	
+	// Earlier versions saved the queue in the defaults when quitting
+	NSArray *objectIDs = [[NSUserDefaults standardUserDefaults] arrayForKey:@"savedPlayQueueStreams"];
+	if(nil != objectIDs) {
+		[[[CollectionManager manager] streamManager] setPlayQueueStreamIDs:objectIDs];
+		[[NSUserDefaults standardUserDefaults] removeObjectForKey:@"savedPlayQueueStreams"];
+	}
+	
+	// Adding the streams resets the saved position, so read it first
+	NSInteger	savedIndex		= [[NSUserDefaults standardUserDefaults] integerForKey:@"savedPlayQueueIndex"];
+	SInt64		savedFrame		= [[[NSUserDefaults standardUserDefaults] objectForKey:@"savedPlayQueueFrame"] longLongValue];
+	
+	[self addStreamsToPlayQueue:[[[CollectionManager manager] streamManager] playQueueStreams]];
+	
+	if(0 <= savedIndex && (NSUInteger)savedIndex < [self countOfPlayQueue]) {
+		_resumePlaybackIndex	= savedIndex;
+		_resumeFrame			= savedFrame;
+		
+		[[NSUserDefaults standardUserDefaults] setInteger:savedIndex forKey:@"savedPlayQueueIndex"];
+	}
+}
+
+- (void) observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
+{
+	if(PlayQueueObservationContext != context) {
+		[super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+		return;
+	}
+	
+	// Keep the random playback order in step with the queue
+	NSKeyValueChange	kind		= [[change objectForKey:NSKeyValueChangeKindKey] unsignedIntegerValue];
+	NSIndexSet			*indexes	= [change objectForKey:NSKeyValueChangeIndexesKey];
+	
+	if(NSKeyValueChangeInsertion == kind)
+		[_shuffleEngine insertIndexes:indexes];
+	else if(NSKeyValueChangeRemoval == kind)
+		[_shuffleEngine removeIndexes:indexes];
+	
+	if(NSKeyValueChangeSetting == kind || [_shuffleEngine count] != [self countOfPlayQueue]) {
+		[_shuffleEngine resetWithCount:[self countOfPlayQueue]];
+		[_shuffleEngine markIndexAsDrawn:[self playbackIndex]];
+	}
+	
+	// The saved position no longer applies once the queue is edited
+	_resumePlaybackIndex = NSNotFound;
+	
+	if(NSNotFound == [self playbackIndex])
+		[[NSUserDefaults standardUserDefaults] setInteger:-1 forKey:@"savedPlayQueueIndex"];
+	
+	[self schedulePlayQueueSave];
+}
+
 @end
 
 @implementation AudioLibrary (NSTableViewDelegateMethods)
@@ -1677,7 +1796,11 @@ NSString * const	PlayQueueKey								= @"playQueue";
 
 - (void) tableView:(NSTableView *)tableView willDisplayCell:(id)cell forTableColumn:(NSTableColumn *)aTableColumn row:(NSInteger)rowIndex
 {
-	if(tableView == _playQueueTable) {
+	if(tableView == _streamTable && [[aTableColumn identifier] isEqual:@"artwork"]) {
+		AudioStream *stream = [[_streamController arrangedObjects] objectAtIndex:rowIndex];
+		[cell setObjectValue:[[AlbumArtworkCache sharedCache] artworkForStream:stream size:AlbumArtworkSmallSize]];
+	}
+	else if(tableView == _playQueueTable) {
 		NSDictionary *infoForBinding = [tableView infoForBinding:NSContentBinding];
 		
 		if(nil != infoForBinding) {
@@ -2120,25 +2243,11 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	if(nil == stream || 0 == [streams count] || [self stopPlayingAfterCurrentTrack])
 		[self setNextPlaybackIndex:NSNotFound];
 	else if([self randomPlayback]) {
-		double		randomNumber;
-		NSUInteger	randomIndex;
-		
-		if([[NSUserDefaults standardUserDefaults] boolForKey:@"removeStreamsFromPlayQueueWhenFinished"]) {
-			if(1 == [streams count])
-				randomIndex = NSNotFound;
-			else {
-				do {
-					randomNumber	= genrand_real2();
-					randomIndex		= (NSUInteger)(randomNumber * [streams count]);
-				} while(randomIndex == [self playbackIndex]);
-			}
-		}
-		else {
-			randomNumber	= genrand_real2();
-			randomIndex		= (NSUInteger)(randomNumber * [streams count]);
-		}
-		
-		[self setNextPlaybackIndex:randomIndex];
+		// The current stream is about to be removed, so it can't follow itself
+		if(1 == [streams count] && [[NSUserDefaults standardUserDefaults] boolForKey:@"removeStreamsFromPlayQueueWhenFinished"])
+			[self setNextPlaybackIndex:NSNotFound];
+		else
+			[self setNextPlaybackIndex:[_shuffleEngine nextIndexAfterIndex:[self playbackIndex]]];
 	}
 	else if([self loopPlayback]) {
 		streamIndex = [self playbackIndex];		
@@ -2186,6 +2295,15 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	[_playQueueTable scrollRowToVisible:[self playbackIndex]];
 }
 
+- (void) schedulePlayQueueSave
+{
+	if(_playQueueSaveScheduled || NO == [[NSUserDefaults standardUserDefaults] boolForKey:@"rememberPlayQueue"])
+		return;
+	
+	_playQueueSaveScheduled = YES;
+	[self performSelector:@selector(savePlayQueue) withObject:nil afterDelay:PLAY_QUEUE_SAVE_DELAY];
+}
+
 - (void)		setPlayButtonEnabled:(BOOL)playButtonEnabled		{ _playButtonEnabled = playButtonEnabled; }
 
 - (NSUInteger)	playbackIndex										{ return _playbackIndex; }
@@ -2204,6 +2322,9 @@ NSString * const	PlayQueueKey								= @"playQueue";
 		[_playQueueTable setHighlightedRow:-1];
 
 	[_playQueueTable setNeedsDisplayInRect:[_playQueueTable rectOfRow:oldPlaybackIndex]];
+	
+	if(oldPlaybackIndex != _playbackIndex)
+		[self schedulePlayQueueSave];
 }
 
 - (NSUInteger)	nextPlaybackIndex									{ return _nextPlaybackIndex; }
@@ -2220,19 +2341,38 @@ NSString * const	PlayQueueKey								= @"playQueue";
 - (void) addRandomTracksFromLibraryToPlayQueue:(NSUInteger)count
 {
 	NSArray			*streams		= [[[CollectionManager manager] streamManager] streams];
-	double			randomNumber;
-	NSUInteger		randomIndex;
-	NSUInteger		i;
+	NSUInteger		streamCount		= [streams count];
+	NSInteger		weighting		= [[NSUserDefaults standardUserDefaults] integerForKey:@"randomTrackWeighting"];
+	NSArray			*indexes		= nil;
 	
-	[self willChangeValueForKey:PlayQueueKey];
-	for(i = 0; i < count; ++i) {
-		randomNumber	= genrand_real2();
-		randomIndex		= (NSUInteger)(randomNumber * [streams count]);
-		[_playQueue addObject:[streams objectAtIndex:randomIndex]];
+	if(0 == streamCount)
+		return;
+	
+	// Tracks are chosen without replacement, optionally favoring highly rated or often played ones
+	if(RandomTrackWeightingRating == weighting || RandomTrackWeightingPlayCount == weighting) {
+		NSString	*key		= (RandomTrackWeightingRating == weighting ? StatisticsRatingKey : StatisticsPlayCountKey);
+		double		*weights	= malloc(streamCount * sizeof(double));
+		
+		if(NULL == weights)
+			return;
+		
+		// Unrated and unplayed tracks still get a chance
+		for(NSUInteger i = 0; i < streamCount; ++i)
+			weights[i] = 1 + [[[streams objectAtIndex:i] valueForKey:key] doubleValue];
+		
+		WeightedIndexSampler *sampler = [[WeightedIndexSampler alloc] initWithWeights:weights count:streamCount];
+		free(weights);
+		
+		indexes = [sampler indexesWithoutReplacement:count];
 	}
-	[self didChangeValueForKey:PlayQueueKey];
+	else
+		indexes = randomIndexesWithoutReplacement(streamCount, count);
 	
-	[self updatePlayButtonState];
+	NSMutableArray *randomStreams = [NSMutableArray arrayWithCapacity:[indexes count]];
+	for(NSNumber *index in indexes)
+		[randomStreams addObject:[streams objectAtIndex:[index unsignedIntegerValue]]];
+	
+	[self addStreamsToPlayQueue:randomStreams];
 }
 
 - (BOOL) addStreamsFromExternalCueSheet:(NSString *)filename
@@ -2270,12 +2410,15 @@ NSString * const	PlayQueueKey								= @"playQueue";
 		NSUInteger playQueueHistorySize	= [[NSUserDefaults standardUserDefaults] integerForKey:@"playQueueHistorySize"];
 		NSUInteger thisIndex					= [self playbackIndex];
 		
-		[self willChangeValueForKey:PlayQueueKey];
-		while(thisIndex > playQueueHistorySize) {
-			[_playQueue removeObjectAtIndex:0];
-			--thisIndex;
+		if(thisIndex > playQueueHistorySize) {
+			NSIndexSet *indexes = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, thisIndex - playQueueHistorySize)];
+			
+			[self willChange:NSKeyValueChangeRemoval valuesAtIndexes:indexes forKey:PlayQueueKey];
+			[_playQueue removeObjectsAtIndexes:indexes];
+			[self didChange:NSKeyValueChangeRemoval valuesAtIndexes:indexes forKey:PlayQueueKey];
+			
+			thisIndex = playQueueHistorySize;
 		}
-		[self didChangeValueForKey:PlayQueueKey];
 
 		[self setPlaybackIndex:thisIndex];
 	}
@@ -2456,6 +2599,18 @@ NSString * const	PlayQueueKey								= @"playQueue";
 	[[[_streamTable tableColumnWithIdentifier:@"bpm"] dataCell] setFormatter:numberFormatter];
 	[[[_streamTable tableColumnWithIdentifier:@"bitrate"] dataCell] setFormatter:numberFormatter];
 	
+	// The artwork column isn't bound; its images come from the artwork cache as rows are drawn
+	NSTableColumn	*artworkColumn		= [[NSTableColumn alloc] initWithIdentifier:@"artwork"];
+	NSImageCell		*artworkCell		= [[NSImageCell alloc] init];
+	
+	[artworkCell setImageScaling:NSImageScaleProportionallyDown];
+	[artworkColumn setDataCell:artworkCell];
+	[artworkColumn setEditable:NO];
+	[artworkColumn setWidth:20];
+	[[artworkColumn headerCell] setStringValue:NSLocalizedStringFromTable(@"Artwork", @"Library", @"")];
+	
+	[_streamTable addTableColumn:artworkColumn];
+	
 
 	[[_streamTable headerView] setMenu:_streamTableHeaderContextMenu];
 	
@@ -2761,22 +2916,31 @@ NSString * const	PlayQueueKey								= @"playQueue";
 - (void) streamRemoved:(NSNotification *)aNotification
 {
 	AudioStream				*stream			= [[aNotification userInfo] objectForKey:AudioStreamObjectKey];
-
-	[self willChangeValueForKey:PlayQueueKey];
-	[_playQueue removeObject:stream];
-	[self didChangeValueForKey:PlayQueueKey];
+	NSIndexSet				*indexes		= [_playQueue indexesOfObjectsPassingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) {
+		return [obj isEqual:stream];
+	}];
+	
+	if(0 != [indexes count]) {
+		[self willChange:NSKeyValueChangeRemoval valuesAtIndexes:indexes forKey:PlayQueueKey];
+		[_playQueue removeObjectsAtIndexes:indexes];
+		[self didChange:NSKeyValueChangeRemoval valuesAtIndexes:indexes forKey:PlayQueueKey];
+	}
 
 	[self updatePlayButtonState];
 }
 
 - (void) streamsRemoved:(NSNotification *)aNotification
 {
-	[self willChangeValueForKey:PlayQueueKey];
-	
-	for(AudioStream *stream in [[aNotification userInfo] objectForKey:AudioStreamsObjectKey])
-		[_playQueue removeObject:stream];
+	NSSet		*streams	= [NSSet setWithArray:[[aNotification userInfo] objectForKey:AudioStreamsObjectKey]];
+	NSIndexSet	*indexes	= [_playQueue indexesOfObjectsPassingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) {
+		return [streams containsObject:obj];
+	}];
 	
-	[self didChangeValueForKey:PlayQueueKey];
+	if(0 != [indexes count]) {
+		[self willChange:NSKeyValueChangeRemoval valuesAtIndexes:indexes forKey:PlayQueueKey];
+		[_playQueue removeObjectsAtIndexes:indexes];
+		[self didChange:NSKeyValueChangeRemoval valuesAtIndexes:indexes forKey:PlayQueueKey];
+	}
 
 	[self updatePlayButtonState];
 }
@@ -2803,6 +2967,12 @@ NSString * const	PlayQueueKey								= @"playQueue";
 
 }
 
+- (void) albumArtworkCacheDidCacheArtwork:(NSNotification *)aNotification
+{
+	if(-1 != [_streamTable columnWithIdentifier:@"artwork"])
+		[_streamTable setNeedsDisplay:YES];
+}
+
 @end
 
 @implementation AudioLibrary (ScriptingAdditions)
@@ -32,6 +32,12 @@ extern NSString * const		iTunesPboardType;
 @interface AudioStreamArrayController : NSArrayController
 {
 	IBOutlet BrowserTreeController	*_browserController;
+	
+	NSArray							*_sortDescriptorsBeforeSearch;		// Full-text results are ranked unless the sort changes during the search
+
+	NSArray							*_searchedContent;					// The content the search index was built from
+	NSUInteger						_searchedContentCount;
+	NSDictionary					*_searchedContentByID;				// Object IDs mapped to the content's objects with that ID
 }
 
 @end
@@ -20,6 +20,7 @@
 
 #import "AudioStreamArrayController.h"
 #import "CollectionManager.h"
+#import "AudioStreamManager.h"
 #import "AudioStream.h"
 #import "AudioLibrary.h"
 #import "BrowserTreeController.h"
@@ -32,6 +33,25 @@ NSString * const AudioStreamPboardType					= @"org.sbooth.Play.AudioStream.Pboar
 NSString * const AudioStreamTableMovedRowsPboardType	= @"org.sbooth.Play.AudioLibrary.AudioStreamTable.MovedRowsPboardType";
 NSString * const iTunesPboardType						= @"CorePasteboardFlavorType 0x6974756E";
 
+// ========================================
+// The key used by the search field's "All" predicate
+// Predicates on this key are answered by the full-text index instead of KVC
+// ========================================
+static NSString * const		FullTextSearchKey			= @"fullTextSearch";
+
+// ========================================
+// The "All" predicate used before the full-text index existed
+// The index only matches whole words and word prefixes, so when it finds nothing
+// in the displayed streams the search falls back to substring matching
+// Both search the same columns as the stream_search table
+// ========================================
+static NSString * const		SubstringSearchFormat		= @"title contains[cd] %@ or artist contains[cd] %@ or albumTitle contains[cd] %@ or albumArtist contains[cd] %@ or composer contains[cd] %@ or genre contains[cd] %@ or comment contains[cd] %@ or date contains[cd] %@";
+
+// ========================================
+// Searches slower than this are logged
+// ========================================
+#define SEARCH_TIME_BUDGET				0.010
+
 @interface AudioLibrary (Private)
 - (NSUInteger) playbackIndex;
 - (void) setPlaybackIndex:(NSUInteger)playbackIndex;
@@ -41,10 +61,77 @@ NSString * const iTunesPboardType						= @"CorePasteboardFlavorType 0x6974756E";
 - (void) moveObjectsInArrangedObjectsFromIndexes:(NSIndexSet *)indexSet toIndex:(NSUInteger)insertIndex;
 - (NSIndexSet *) indexSetForRows:(NSArray *)rows;
 - (NSInteger) rowsAboveRow:(NSInteger)row inIndexSet:(NSIndexSet *)indexSet;
+- (NSString *) fullTextSearchString;
+- (NSDictionary *) contentByIDForObjects:(NSArray *)objects;
 @end
 
 @implementation AudioStreamArrayController
 
+- (void) setFilterPredicate:(NSPredicate *)filterPredicate
+{
+	BOOL searchWasActive = (nil != [self fullTextSearchString]);
+	
+	[super setFilterPredicate:filterPredicate];
+	
+	BOOL searchIsActive = (nil != [self fullTextSearchString]);
+	
+	// Remember the sort in effect when the search began, so a column clicked during the search can be told apart
+	if(searchIsActive && NO == searchWasActive)
+		_sortDescriptorsBeforeSearch = [self sortDescriptors];
+	else if(NO == searchIsActive)
+		_sortDescriptorsBeforeSearch = nil;
+}
+
+- (void) setContent:(id)content
+{
+	_searchedContent		= nil;
+	_searchedContentByID	= nil;
+	
+	[super setContent:content];
+}
+
+- (NSArray *) arrangeObjects:(NSArray *)objects
+{
+	NSString *searchString = [self fullTextSearchString];
+	if(nil == searchString)
+		return [super arrangeObjects:objects];
+	
+	NSDate *startTime = [NSDate date];
+	
+	// The full-text index covers the whole library, so keep only the stream IDs in this view, in order of relevance
+	NSArray				*streamIDs		= [[[CollectionManager manager] streamManager] streamIDsMatchingSearch:searchString];
+	NSDictionary		*contentByID	= [self contentByIDForObjects:objects];
+	NSMutableArray		*matches		= [NSMutableArray array];
+	BOOL				ranked			= YES;
+	
+	for(NSNumber *objectID in streamIDs) {
+		NSArray *streams = [contentByID objectForKey:objectID];
+		if(nil != streams)
+			[matches addObjectsFromArray:streams];
+	}
+	
+	if(0 == [matches count]) {
+		NSArray *arguments = @[searchString, searchString, searchString, searchString, searchString, searchString, searchString, searchString];
+		[matches addObjectsFromArray:[objects filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:SubstringSearchFormat argumentArray:arguments]]];
+		ranked = NO;
+	}
+	
+	// Keep the relevance order unless the user has sorted by a column since the search began
+	NSArray *sortDescriptors = [self sortDescriptors];
+	if(0 != [sortDescriptors count] && (NO == ranked || NO == [sortDescriptors isEqualToArray:_sortDescriptorsBeforeSearch]))
+		[matches sortUsingDescriptors:sortDescriptors];
+	
+	NSTimeInterval elapsed = -[startTime timeIntervalSinceNow];
+#if DEBUG
+	NSLog(@"Searched %lu streams for \"%@\" in %f seconds (%lu matches)", (unsigned long)[objects count], searchString, elapsed, (unsigned long)[matches count]);
+#else
+	if(SEARCH_TIME_BUDGET < elapsed)
+		NSLog(@"Searching %lu streams for \"%@\" took %f seconds", (unsigned long)[objects count], searchString, elapsed);
+#endif
+	
+	return matches;
+}
+
 - (BOOL) tableView:(NSTableView *)tableView writeRowsWithIndexes:(NSIndexSet *)rowIndexes toPasteboard:(NSPasteboard *)pboard
 {
 	NSArray				*objects		= [[self arrangedObjects] objectsAtIndexes:rowIndexes];
@@ -214,6 +301,51 @@ NSString * const iTunesPboardType						= @"CorePasteboardFlavorType 0x6974756E";
 	return indexSet;
 }
 
+- (NSString *) fullTextSearchString
+{
+	NSPredicate *predicate = [self filterPredicate];
+	if(NO == [predicate isKindOfClass:[NSComparisonPredicate class]])
+		return nil;
+	
+	NSExpression *lhs = [(NSComparisonPredicate *)predicate leftExpression];
+	NSExpression *rhs = [(NSComparisonPredicate *)predicate rightExpression];
+	
+	if(NSKeyPathExpressionType != [lhs expressionType] || NO == [[lhs keyPath] isEqualToString:FullTextSearchKey])
+		return nil;
+	if(NSConstantValueExpressionType != [rhs expressionType] || NO == [[rhs constantValue] isKindOfClass:[NSString class]])
+		return nil;
+	
+	return [rhs constantValue];
+}
+
+- (NSDictionary *) contentByIDForObjects:(NSArray *)objects
+{
+	// Rebuilt only when the content changes, not for each keystroke
+	if(objects == _searchedContent && [objects count] == _searchedContentCount && nil != _searchedContentByID)
+		return _searchedContentByID;
+	
+	NSMutableDictionary *contentByID = [NSMutableDictionary dictionaryWithCapacity:[objects count]];
+	
+	// Playlists may contain the same stream more than once
+	for(id object in objects) {
+		NSNumber *objectID = [object valueForKey:ObjectIDKey];
+		if(nil == objectID)
+			continue;
+		
+		NSMutableArray *streams = [contentByID objectForKey:objectID];
+		if(nil == streams)
+			[contentByID setObject:[NSMutableArray arrayWithObject:object] forKey:objectID];
+		else
+			[streams addObject:object];
+	}
+	
+	_searchedContent		= objects;
+	_searchedContentCount	= [objects count];
+	_searchedContentByID	= contentByID;
+	
+	return contentByID;
+}
+
 - (NSInteger) rowsAboveRow:(NSInteger)row inIndexSet:(NSIndexSet *)indexSet
 {
 	NSInteger				i				= 0;
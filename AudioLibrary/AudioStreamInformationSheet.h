@@ -42,6 +42,8 @@
 	IBOutlet NSTextField	*_trackPeakTextField;
 	IBOutlet NSTextField	*_albumGainTextField;
 	IBOutlet NSTextField	*_albumPeakTextField;
+	
+	IBOutlet NSImageView	*_artworkImageView;
 }
 
 - (NSWindow *)			sheet;
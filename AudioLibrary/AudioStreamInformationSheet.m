@@ -19,6 +19,15 @@
  */
 
 #import "AudioStreamInformationSheet.h"
+#import "AudioStream.h"
+#import "AlbumArtworkCache.h"
+
+static void *SelectionObservationContext = &SelectionObservationContext;
+
+@interface AudioStreamInformationSheet (Private)
+- (void) updateArtwork;
+- (void) albumArtworkCacheDidCacheArtwork:(NSNotification *)aNotification;
+@end
 
 @implementation AudioStreamInformationSheet
 
@@ -98,6 +107,28 @@
 	
 	[_trackPeakTextField setFormatter:peakFormatter];
 	[_albumPeakTextField setFormatter:peakFormatter];
+	
+	// Artwork comes from the artwork cache, which may still be extracting it
+	[_streamController addObserver:self forKeyPath:@"selectionIndexes" options:0 context:SelectionObservationContext];
+	
+	[[NSNotificationCenter defaultCenter] addObserver:self 
+											 selector:@selector(albumArtworkCacheDidCacheArtwork:) 
+												 name:AlbumArtworkCacheDidCacheArtworkNotification
+											   object:nil];
+}
+
+- (void) dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	[_streamController removeObserver:self forKeyPath:@"selectionIndexes" context:SelectionObservationContext];
+}
+
+- (void) observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
+{
+	if(SelectionObservationContext == context)
+		[self updateArtwork];
+	else
+		[super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
 }
 
 - (NSWindow *) sheet
@@ -139,3 +170,26 @@
 }*/
 
 @end
+
+@implementation AudioStreamInformationSheet (Private)
+
+- (void) updateArtwork
+{
+	NSURL	*url		= [[[_streamController selectedObjects] lastObject] valueForKey:StreamURLKey];
+	NSImage	*artwork	= nil;
+	
+	if(nil != url)
+		artwork = [[AlbumArtworkCache sharedCache] artworkForURL:url size:AlbumArtworkLargeSize];
+	
+	[_artworkImageView setImage:artwork];
+}
+
+- (void) albumArtworkCacheDidCacheArtwork:(NSNotification *)aNotification
+{
+	NSURL *url = [[[_streamController selectedObjects] lastObject] valueForKey:StreamURLKey];
+	
+	if([url isEqual:[[aNotification userInfo] objectForKey:StreamURLKey]])
+		[self updateArtwork];
+}
+
+@end
@@ -51,6 +51,7 @@ extern NSString * const		iTunesPboardType;
 - (IBAction)	clearReplayGain:(id)sender;
 
 - (IBAction)	determinePUIDs:(id)sender;
+- (IBAction)	selectDuplicates:(id)sender;
 
 - (IBAction)	lookupTrackInMusicBrainz:(id)sender;
 - (IBAction)	searchMusicBrainzForMatchingTracks:(id)sender;
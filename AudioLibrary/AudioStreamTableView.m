@@ -24,6 +24,8 @@
 #import "Playlist.h"
 #import "AudioLibrary.h"
 #import "AudioDecoder.h"
+#import "AudioMetadataRescanner.h"
+#import "AudioMetadataBatchWriter.h"
 
 #import "AudioStreamInformationSheet.h"
 #import "AudioMetadataEditingSheet.h"
@@ -40,6 +42,9 @@
 #import "CancelableProgressSheet.h"
 
 #import "PUIDUtilities.h"
+#import "AudioFingerprintUtilities.h"
+#import "AudioPipelineBenchmark.h"
+#import "DatabaseBenchmark.h"
 #import "MusicBrainzUtilities.h"
 
 #import "CTBadge.h"
@@ -76,6 +81,13 @@ dumpASBD(const AudioStreamBasicDescription *asbd)
 - (void) showMusicBrainzSearchSheetDidEnd:(NSWindow *)sheet returnCode:(NSInteger)returnCode contextInfo:(void *)contextInfo;
 - (void) performReplayGainCalculationForStreams:(NSArray *)streams calculateAlbumGain:(BOOL)calculateAlbumGain;
 - (void) performPUIDCalculationForStreams:(NSArray *)streams;
+- (void) performDuplicateDetectionForStreams:(NSArray *)streams;
+- (void) performMetadataWriteForStreams:(NSArray *)streams;
+#if DEBUG
+- (IBAction) benchmarkAudioPipeline:(id)sender;
+- (void) performAudioPipelineBenchmarkForStreams:(NSArray *)streams;
+- (IBAction) benchmarkDatabase:(id)sender;
+#endif
 @end
 
 @implementation AudioStreamTableView
@@ -85,6 +97,13 @@ dumpASBD(const AudioStreamBasicDescription *asbd)
 	[self registerForDraggedTypes:[NSArray arrayWithObjects:AudioStreamTableMovedRowsPboardType, AudioStreamPboardType, NSFilenamesPboardType, NSURLPboardType, iTunesPboardType, nil]];
 	NSFormatter *formatter = [[SecondsFormatter alloc] init];
 	[[[self tableColumnWithIdentifier:@"duration"] dataCell] setFormatter:formatter];
+
+#if DEBUG
+	// Developer aid, not shown in release builds
+	[[self menu] addItem:[NSMenuItem separatorItem]];
+	[[self menu] addItemWithTitle:@"Benchmark Audio Pipeline" action:@selector(benchmarkAudioPipeline:) keyEquivalent:@""];
+	[[self menu] addItemWithTitle:@"Benchmark Database" action:@selector(benchmarkDatabase:) keyEquivalent:@""];
+#endif
 }
 
 - (BOOL) validateMenuItem:(NSMenuItem *)menuItem
@@ -128,6 +147,14 @@ dumpASBD(const AudioStreamBasicDescription *asbd)
 			[menuItem setTitle:NSLocalizedStringFromTable(@"Determine PUIDs...", @"Menus", @"")];
 		return ((0 != selectedObjectsCount) && canConnectToMusicDNS());
 	}
+	else if([menuItem action] == @selector(selectDuplicates:))
+		return (1 < [[_streamController arrangedObjects] count]);
+#if DEBUG
+	else if([menuItem action] == @selector(benchmarkAudioPipeline:))
+		return (0 != selectedObjectsCount);
+	else if([menuItem action] == @selector(benchmarkDatabase:))
+		return YES;
+#endif
 	else if([menuItem action] == @selector(lookupTrackInMusicBrainz:))
 		return ((1 == selectedObjectsCount) && nil != [[_streamController selection] valueForKey:MetadataMusicDNSPUIDKey] && canConnectToMusicBrainz());
 	else if([menuItem action] == @selector(searchMusicBrainzForMatchingTracks:))
@@ -469,9 +496,7 @@ dumpASBD(const AudioStreamBasicDescription *asbd)
 		return;
 	}
 	
-	[[CollectionManager manager] beginUpdate];
-	[[_streamController selectedObjects] makeObjectsPerformSelector:@selector(rescanMetadata:) withObject:sender];
-	[[CollectionManager manager] finishUpdate];
+	[[AudioMetadataRescanner sharedRescanner] rescanMetadataForStreams:[_streamController selectedObjects]];
 }
 
 - (IBAction) saveMetadata:(id)sender
@@ -481,7 +506,11 @@ dumpASBD(const AudioStreamBasicDescription *asbd)
 		return;
 	}
 	
-	[[_streamController selectedObjects] makeObjectsPerformSelector:@selector(saveMetadata:) withObject:sender];
+	// Single streams go through the usual delayed write so further edits are picked up
+	if(1 == [[_streamController selectedObjects] count])
+		[[[_streamController selectedObjects] lastObject] saveMetadata:sender];
+	else
+		[self performMetadataWriteForStreams:[[_streamController selectedObjects] copy]];
 }
 
 - (IBAction) clearMetadata:(id)sender
@@ -567,6 +596,17 @@ dumpASBD(const AudioStreamBasicDescription *asbd)
 	[self performPUIDCalculationForStreams:streams];
 }
 
+- (IBAction) selectDuplicates:(id)sender
+{
+	if(2 > [[_streamController arrangedObjects] count]) {
+		NSBeep();
+		return;
+	}
+	
+	NSArray *streams = [[_streamController arrangedObjects] copy];
+	[self performDuplicateDetectionForStreams:streams];
+}
+
 - (IBAction) lookupTrackInMusicBrainz:(id)sender
 {
 	if(1 != [[_streamController selectedObjects] count] || nil == [[_streamController selection] valueForKey:MetadataMusicDNSPUIDKey]) {
@@ -1371,4 +1411,161 @@ bail:
 	[[progressSheet sheet] close];
 }
 
+- (void) performDuplicateDetectionForStreams:(NSArray *)streams
+{
+	CancelableProgressSheet *progressSheet = [[CancelableProgressSheet alloc] init];
+	[progressSheet setLegend:NSLocalizedStringFromTable(@"Finding duplicates...", @"Library", @"")];
+	
+	[[NSApplication sharedApplication] beginSheet:[progressSheet sheet]
+								   modalForWindow:[self window]
+									modalDelegate:nil
+								   didEndSelector:nil
+									  contextInfo:nil];
+	
+	NSModalSession modalSession = [[NSApplication sharedApplication] beginModalSessionForWindow:[progressSheet sheet]];
+	
+	// Only streams without a stored fingerprint are decoded
+	[progressSheet startProgressIndicator:self];
+	[[CollectionManager manager] beginUpdate];
+	calculateAudioFingerprints(streams, modalSession);
+	[[CollectionManager manager] finishUpdate];
+	
+	NSArray *duplicates = findDuplicateStreams();
+	[progressSheet stopProgressIndicator:self];
+	
+	[NSApp endModalSession:modalSession];
+	
+	[NSApp endSheet:[progressSheet sheet]];
+	[[progressSheet sheet] close];
+	
+	// Select every stream in the list that has a duplicate
+	NSMutableSet *duplicateIDs = [NSMutableSet set];
+	for(NSArray *group in duplicates)
+		[duplicateIDs addObjectsFromArray:group];
+	
+	NSMutableIndexSet	*indexes			= [NSMutableIndexSet indexSet];
+	NSArray				*arrangedObjects	= [_streamController arrangedObjects];
+	
+	for(NSUInteger i = 0; i < [arrangedObjects count]; ++i) {
+		if([duplicateIDs containsObject:[[arrangedObjects objectAtIndex:i] valueForKey:ObjectIDKey]])
+			[indexes addIndex:i];
+	}
+	
+	if(0 == [indexes count]) {
+		NSBeep();
+		return;
+	}
+	
+	[_streamController setSelectionIndexes:indexes];
+	[self scrollRowToVisible:[indexes firstIndex]];
+}
+
+- (void) performMetadataWriteForStreams:(NSArray *)streams
+{
+	CancelableProgressSheet *progressSheet = [[CancelableProgressSheet alloc] init];
+	[progressSheet setLegend:NSLocalizedStringFromTable(@"Saving metadata...", @"Library", @"")];
+	
+	[[NSApplication sharedApplication] beginSheet:[progressSheet sheet]
+								   modalForWindow:[self window]
+									modalDelegate:nil
+								   didEndSelector:nil
+									  contextInfo:nil];
+	
+	NSModalSession modalSession = [[NSApplication sharedApplication] beginModalSessionForWindow:[progressSheet sheet]];
+	
+	// The files are written on worker threads, which report each finished file
+	AudioMetadataBatchWriter *batchWriter = [AudioMetadataBatchWriter sharedBatchWriter];
+	
+	id observer = [[NSNotificationCenter defaultCenter] addObserverForName:AudioMetadataBatchWriterDidWriteFileNotification object:batchWriter queue:nil usingBlock:^(NSNotification *note) {
+		[progressSheet setLegend:[NSString stringWithFormat:NSLocalizedStringFromTable(@"Saving metadata (%@ of %@)...", @"Library", @""), 
+								  [[note userInfo] objectForKey:AudioMetadataBatchWriterCompletedFilesKey], 
+								  [[note userInfo] objectForKey:AudioMetadataBatchWriterTotalFilesKey]]];
+	}];
+	
+	[progressSheet startProgressIndicator:self];
+	[batchWriter writeMetadataForStreams:streams];
+	
+	while([batchWriter isWriting]) {
+		// Files already being written are finished on cancel
+		if(NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession]) {
+			[batchWriter cancel];
+			[progressSheet setLegend:NSLocalizedStringFromTable(@"Canceling...", @"Library", @"")];
+		}
+		
+		usleep(10000);
+	}
+	
+	[progressSheet stopProgressIndicator:self];
+	
+	[[NSNotificationCenter defaultCenter] removeObserver:observer];
+	
+	[NSApp endModalSession:modalSession];
+	
+	[NSApp endSheet:[progressSheet sheet]];
+	[[progressSheet sheet] close];
+}
+
+#if DEBUG
+- (IBAction) benchmarkAudioPipeline:(id)sender
+{
+	if(0 == [[_streamController selectedObjects] count]) {
+		NSBeep();
+		return;
+	}
+	
+	NSArray *streams = [[_streamController selectedObjects] copy];
+	[self performAudioPipelineBenchmarkForStreams:streams];
+}
+
+- (void) performAudioPipelineBenchmarkForStreams:(NSArray *)streams
+{
+	CancelableProgressSheet *progressSheet = [[CancelableProgressSheet alloc] init];
+	[progressSheet setLegend:@"Benchmarking audio pipeline..."];
+	
+	[[NSApplication sharedApplication] beginSheet:[progressSheet sheet]
+								   modalForWindow:[self window]
+									modalDelegate:nil
+								   didEndSelector:nil
+									  contextInfo:nil];
+	
+	NSModalSession modalSession = [[NSApplication sharedApplication] beginModalSessionForWindow:[progressSheet sheet]];
+	
+	// The results are logged
+	[progressSheet startProgressIndicator:self];
+	benchmarkAudioPipeline(streams, modalSession);
+	[progressSheet stopProgressIndicator:self];
+	
+	[NSApp endModalSession:modalSession];
+	
+	[NSApp endSheet:[progressSheet sheet]];
+	[[progressSheet sheet] close];
+}
+
+- (IBAction) benchmarkDatabase:(id)sender
+{
+	CancelableProgressSheet *progressSheet = [[CancelableProgressSheet alloc] init];
+	[progressSheet setLegend:@"Benchmarking database..."];
+	
+	[[NSApplication sharedApplication] beginSheet:[progressSheet sheet]
+								   modalForWindow:[self window]
+									modalDelegate:nil
+								   didEndSelector:nil
+									  contextInfo:nil];
+	
+	NSModalSession modalSession = [[NSApplication sharedApplication] beginModalSessionForWindow:[progressSheet sheet]];
+	
+	// The results are logged
+	[progressSheet startProgressIndicator:self];
+	benchmarkDatabaseConcurrency(modalSession);
+	benchmarkDatabaseLoading(modalSession);
+	benchmarkLibraryImport(modalSession);
+	[progressSheet stopProgressIndicator:self];
+	
+	[NSApp endModalSession:modalSession];
+	
+	[NSApp endSheet:[progressSheet sheet]];
+	[[progressSheet sheet] close];
+}
+#endif
+
 @end
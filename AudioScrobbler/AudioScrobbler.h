@@ -22,12 +22,12 @@
 
 #import <mach/mach.h>
 
-@class AudioStream;
+@class AudioStream, AudioScrobblerSpool;
 
 @interface AudioScrobbler : NSObject
 {
 	NSString			*_pluginID;
-	NSMutableArray		*_queue;
+	AudioScrobblerSpool	*_spool;
 
 	BOOL				_audioScrobblerThreadCompleted;
 	BOOL				_keepProcessingAudioScrobblerCommands;
@@ -21,6 +21,7 @@
 #import "AudioScrobbler.h"
 
 #import "AudioScrobblerClient.h"
+#import "AudioScrobblerSpool.h"
 #import "AudioStream.h"
 
 // ========================================
@@ -28,6 +29,17 @@
 // ========================================
 NSString * const	AudioScrobblerRunLoopMode			= @"org.sbooth.Play.AudioScrobbler.RunLoopMode";
 
+// The maximum number of spooled commands sent before waiting for their responses
+#define AUDIOSCROBBLER_BATCH_SIZE			16
+
+// Reconnection attempts back off exponentially, in seconds
+#define AUDIOSCROBBLER_MINIMUM_BACKOFF		1
+#define AUDIOSCROBBLER_MAXIMUM_BACKOFF		300
+
+// Commands describe what is playing now, so there is no point sending them late
+#define AUDIOSCROBBLER_COMMAND_LIFETIME		60
+#define AUDIOSCROBBLER_MAXIMUM_SPOOL_SIZE	(64 * 1024)
+
 // ========================================
 // Helpers
 // ========================================
@@ -41,12 +53,22 @@ escapeForLastFM(NSString *string)
 							   options:NSLiteralSearch 
 								 range:NSMakeRange(0, [result length])];
 	
+	// Commands are terminated by newlines
+	[result replaceOccurrencesOfString:@"\r" 
+							withString:@" " 
+							   options:NSLiteralSearch 
+								 range:NSMakeRange(0, [result length])];
+	[result replaceOccurrencesOfString:@"\n" 
+							withString:@" " 
+							   options:NSLiteralSearch 
+								 range:NSMakeRange(0, [result length])];
+	
 	return (nil == result ? @"" : result);
 }
 
 @interface AudioScrobbler (Private)
 
-- (NSMutableArray *)	queue;
+- (AudioScrobblerSpool *)	spool;
 - (NSString *)			pluginID;
 
 - (void)				sendCommand:(NSString *)command;
@@ -59,6 +81,7 @@ escapeForLastFM(NSString *string)
 
 - (semaphore_t)			semaphore;
 
+- (BOOL)				submitPendingCommands:(AudioScrobblerClient *)client port:(in_port_t *)port;
 - (void)				processAudioScrobblerCommands:(AudioScrobbler *)myself;
 
 @end
@@ -139,12 +162,26 @@ escapeForLastFM(NSString *string)
 
 @implementation AudioScrobbler (Private)
 
-- (NSMutableArray *) queue
+- (AudioScrobblerSpool *) spool
 {
-	if(nil == _queue)
-		_queue = [[NSMutableArray alloc] init];
+	@synchronized(self) {
+		if(nil == _spool) {
+			NSArray *paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES);
+			NSAssert(nil != paths, NSLocalizedStringFromTable(@"Unable to locate the \"Application Support\" folder.", @"Errors", @""));
+			
+			NSString *applicationName			= [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleName"];
+			NSString *applicationSupportFolder	= [[paths objectAtIndex:0] stringByAppendingPathComponent:applicationName];
+			
+			if(NO == [[NSFileManager defaultManager] fileExistsAtPath:applicationSupportFolder])
+				[[NSFileManager defaultManager] createDirectoryAtPath:applicationSupportFolder withIntermediateDirectories:YES attributes:nil error:nil];
+			
+			_spool = [[AudioScrobblerSpool alloc] initWithPath:[applicationSupportFolder stringByAppendingPathComponent:@"AudioScrobbler.spool"] 
+													maximumAge:AUDIOSCROBBLER_COMMAND_LIFETIME 
+												   maximumSize:AUDIOSCROBBLER_MAXIMUM_SPOOL_SIZE];
+		}
+	}
 	
-	return _queue;
+	return _spool;
 }
 
 - (NSString *) pluginID
@@ -152,11 +189,10 @@ escapeForLastFM(NSString *string)
 	return _pluginID;
 }
 
+// Called on the main thread, so the spool is flushed to disk by the scrobbler thread
 - (void) sendCommand:(NSString *)command
 {
-	@synchronized([self queue]) {
-		[[self queue] addObject:command];
-	}
+	[[self spool] appendCommand:command];
 	semaphore_signal([self semaphore]);
 }
 
@@ -185,66 +221,92 @@ escapeForLastFM(NSString *string)
 	return _semaphore;
 }
 
+// Sends a batch of spooled commands over the persistent connection, reconnecting if necessary
+// Commands are only removed from the spool once the client has responded to them
+// Returns NO if no progress could be made
+- (BOOL) submitPendingCommands:(AudioScrobblerClient *)client port:(in_port_t *)port
+{
+	NSParameterAssert(nil != client);
+	NSParameterAssert(NULL != port);
+	
+	uint64_t		sequenceNumber	= 0;
+	NSArray			*commands		= [[self spool] pendingCommands:AUDIOSCROBBLER_BATCH_SIZE firstSequenceNumber:&sequenceNumber];
+	NSString		*response		= nil;
+	NSUInteger		acknowledged	= 0;
+	
+	if(0 == [commands count])
+		return YES;
+	
+	@try {
+		if(NO == [client isConnected]) {
+			if(NO == [client connectToHost:@"localhost" port:*port])
+				return NO;
+			
+			*port = [client connectedPort];
+		}
+		
+		// Pipeline the batch, then collect the responses in order
+		if([client send:[commands componentsJoinedByString:@""]]) {
+			for(acknowledged = 0; acknowledged < [commands count]; ++acknowledged) {
+				response = [client receive];
+				if(nil == response)
+					break;
+				
+				// The command was processed, even if the client didn't like it; resending won't help
+				if(2 > [response length] || NSOrderedSame != [response compare:@"OK" options:NSLiteralSearch range:NSMakeRange(0,2)])
+					NSLog(@"AudioScrobbler error: %@", response);
+			}
+		}
+	}
+	
+	@catch(NSException *exception) {
+//		NSLog(@"Exception: %@",exception);
+	}
+	
+	// The spool may have dropped commands from the front of this batch to make room while it was sent
+	[[self spool] acknowledgeCommandsBeforeSequenceNumber:sequenceNumber + acknowledged];
+	
+	// Responses that never arrived mean the connection was lost; the unacknowledged commands will be resent
+	if(acknowledged < [commands count])
+		[client shutdown];
+	
+	return (0 != acknowledged);
+}
+
 - (void) processAudioScrobblerCommands:(AudioScrobbler *)myself
 {
 	@autoreleasepool {
 		AudioScrobblerClient	*client				= [[AudioScrobblerClient alloc] init];
 		mach_timespec_t			timeout				= { 5, 0 };
-		NSEnumerator			*enumerator			= nil;
-		NSString				*command			= nil;
-		NSString				*response			= nil;
+		unsigned int			backoff				= 0;
 		in_port_t				port				= 33367;
 		
 		while([myself keepProcessingAudioScrobblerCommands]) {
-
-			// Get the first command to be sent
-			@synchronized([myself queue]) {
-				enumerator	= [[myself queue] objectEnumerator];
-				command		= [enumerator nextObject];
-			
-				[[myself queue] removeObjectIdenticalTo:command];
-			}
-
-			if(nil != command) {
-				@try {
-					if([client connectToHost:@"localhost" port:port]) {
-						port = [client connectedPort];
-						[client send:command];
-						
-						response = [client receive];
-						if(2 > [response length] || NSOrderedSame != [response compare:@"OK" options:NSLiteralSearch range:NSMakeRange(0,2)])
-							NSLog(@"AudioScrobbler error: %@", response);
-						
-						[client shutdown];
-					}
-				}
+			@autoreleasepool {
+				[[myself spool] synchronize];
+				
+				if([myself submitPendingCommands:client port:&port])
+					backoff = 0;
+				else
+					backoff = (0 == backoff ? AUDIOSCROBBLER_MINIMUM_BACKOFF : MIN(2 * backoff, AUDIOSCROBBLER_MAXIMUM_BACKOFF));
 				
-				@catch(NSException *exception) {
-					[client shutdown];
-//				NSLog(@"Exception: %@",exception);
+				// Keep draining a backlog without waiting
+				if(0 == backoff && 0 != [[myself spool] count])
 					continue;
-				}
+				
+				timeout.tv_sec = (0 == backoff ? 5 : backoff);
 			}
-					
+			
+			// A new command also ends the wait and triggers a reconnection attempt
 			semaphore_timedwait([myself semaphore], timeout);
 		}
 		
-		// Send a final stop command to cleanup
-		@try {
-			if([client connectToHost:@"localhost" port:port]) {
-				[client send:[NSString stringWithFormat:@"STOP c=%@\n", [myself pluginID]]];
-				
-				response = [client receive];
-				if(2 > [response length] || NSOrderedSame != [response compare:@"OK" options:NSLiteralSearch range:NSMakeRange(0,2)])
-					NSLog(@"AudioScrobbler error: %@", response);
-				
-				[client shutdown];
-			}
-		}
+		// Send a final stop command to cleanup; anything that can't be sent stays spooled for the next launch
+		[[myself spool] appendCommand:[NSString stringWithFormat:@"STOP c=%@\n", [myself pluginID]]];
+		[[myself spool] synchronize];
+		[myself submitPendingCommands:client port:&port];
 		
-		@catch(NSException *exception) {
-			[client shutdown];
-		}
+		[client shutdown];
 		
 		[myself setAudioScrobblerThreadCompleted:YES];
 	}
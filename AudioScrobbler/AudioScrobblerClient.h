@@ -24,9 +24,10 @@
 
 @interface AudioScrobblerClient : NSObject
 {
-	int			_socket;
-	BOOL		_doPortStepping;
-	in_port_t	_port;
+	int				_socket;
+	BOOL			_doPortStepping;
+	in_port_t		_port;
+	NSMutableData	*_receiveBuffer;	// Bytes received but not yet returned by -receive
 }
 
 - (BOOL)		connectToHost:(NSString *)hostname port:(in_port_t)port;
@@ -34,7 +35,9 @@
 - (BOOL)		isConnected;
 - (in_port_t)	connectedPort;
 
-- (void)		send:(NSString *)data;
+// The connection is kept alive between commands, and several commands may be
+// sent before their responses are read; -receive returns one response line
+- (BOOL)		send:(NSString *)data;
 - (NSString *)	receive;
 
 - (void)		shutdown;
@@ -29,6 +29,7 @@
 
 #define kBufferSize		1024
 #define	kPortsToStep	5
+#define kReceiveTimeout	5
 
 static in_addr_t 
 addressForHost(NSString *hostname)
@@ -64,6 +65,7 @@ addressForHost(NSString *hostname)
 	if((self = [super init])) {
 		_socket				= -1;
 		_doPortStepping		= YES;
+		_receiveBuffer		= [[NSMutableData alloc] init];
 	}
 	return self;
 }
@@ -90,7 +92,7 @@ addressForHost(NSString *hostname)
 	return _port;
 }
 
-- (void) send:(NSString *)data
+- (BOOL) send:(NSString *)data
 {	
 	const char		*utf8data		= [data UTF8String];
 	size_t			len				= strlen(utf8data);	
@@ -100,48 +102,59 @@ addressForHost(NSString *hostname)
 
 	if(NO == [self isConnected]) {
 		NSLog(@"AudioScrobblerClient error: Can't send data, client not connected");
-		return;
+		return NO;
 	}
 	
-	while(totalBytesSent < bytesToSend && -1 != bytesSent) {
+	while(totalBytesSent < bytesToSend) {
 		bytesSent = send(_socket, utf8data + totalBytesSent, bytesToSend - totalBytesSent, 0);
 		
-		if(-1 == bytesSent || 0 == bytesSent)
+		if(-1 == bytesSent && EINTR == errno)
+			continue;
+		
+		if(-1 == bytesSent || 0 == bytesSent) {
 			NSLog(@"AudioScrobblerClient error: Unable to send data through socket: %s", strerror(errno));
+			return NO;
+		}
 		
 		totalBytesSent += bytesSent;
 	}
+	
+	return YES;
 }
 
 - (NSString *) receive
 {
 	char		buffer			[ kBufferSize ];
-	size_t		readSize		= kBufferSize - 1;
 	ssize_t		bytesRead		= 0;
-	BOOL		keepGoing		= YES;
-	NSString	*result			= nil;
+	NSRange		newline;
 
 	if(NO == [self isConnected]) {
 		NSLog(@"AudioScrobblerClient error: Can't receive data, client not connected");
 		return nil;
 	}
 	
-	do {
-		bytesRead = recv(_socket, buffer, readSize, 0);
-		if(-1 == bytesRead || 0 == bytesRead) {
-			NSLog(@"AudioScrobblerClient error: Unable to receive data through socket: %s", strerror(errno));
+	// Responses to pipelined commands may arrive together, so split on newlines
+	for(;;) {
+		newline = [_receiveBuffer rangeOfData:[NSData dataWithBytes:"\n" length:1] options:0 range:NSMakeRange(0, [_receiveBuffer length])];
+		if(NSNotFound != newline.location)
 			break;
+		
+		bytesRead = recv(_socket, buffer, kBufferSize, 0);
+		
+		if(-1 == bytesRead && EINTR == errno)
+			continue;
+		
+		if(-1 == bytesRead || 0 == bytesRead) {
+			if(-1 == bytesRead)
+				NSLog(@"AudioScrobblerClient error: Unable to receive data through socket: %s", strerror(errno));
+			return nil;
 		}
-			
-		if('\n' == buffer[bytesRead - 1]) {			
-			--bytesRead;
-			keepGoing = NO;
-		}
-
-		buffer[bytesRead]	= '\0';
-		result				= [[NSString alloc] initWithUTF8String:buffer];
 		
-	} while(keepGoing);
+		[_receiveBuffer appendBytes:buffer length:bytesRead];
+	}
+	
+	NSString *result = [[NSString alloc] initWithBytes:[_receiveBuffer bytes] length:newline.location encoding:NSUTF8StringEncoding];
+	[_receiveBuffer replaceBytesInRange:NSMakeRange(0, NSMaxRange(newline)) withBytes:NULL length:0];
 	
 	return result;
 }
@@ -162,8 +175,10 @@ addressForHost(NSString *hostname)
 
 	for(;;) {
 		bytesRead = recv(_socket, buffer, kBufferSize, 0);
-		if(-1 == bytesRead)
+		if(-1 == bytesRead) {
 			NSLog(@"AudioScrobblerClient error: Waiting for shutdown confirmation failed: %s", strerror(errno));
+			break;
+		}
 		
 		if(0 != bytesRead) {
 			NSString *received = [[NSString alloc] initWithBytes:buffer length:bytesRead encoding:NSUTF8StringEncoding];
@@ -179,6 +194,8 @@ addressForHost(NSString *hostname)
 	
 	_socket		= -1;
 	_port		= 0;
+	
+	[_receiveBuffer setLength:0];
 }
 
 @end
@@ -190,6 +207,8 @@ addressForHost(NSString *hostname)
 	NSParameterAssert(INADDR_NONE != remoteAddress);
 	
 	struct sockaddr_in		socketAddress;
+	struct timeval			timeout			= { kReceiveTimeout, 0 };
+	int						on				= 1;
 	int						result;
 
 	_socket = socket(AF_INET, SOCK_STREAM, 0);
@@ -197,6 +216,12 @@ addressForHost(NSString *hostname)
 		NSLog(@"Unable to create socket (%s)", strerror(errno));
 		return NO;
 	}
+	
+	// The connection is long-lived: detect a vanished peer, don't raise SIGPIPE writing to it
+	// and don't block forever waiting for a response
+	setsockopt(_socket, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+	setsockopt(_socket, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
 	_port							= port;
 	socketAddress.sin_family		= AF_INET;
@@ -0,0 +1,63 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+// ========================================
+// Append-only, on-disk queue of commands for the Last.fm client
+// Commands remain in the spool until they are acknowledged, so a backlog
+// survives a crash or quit and is submitted on the next launch
+// Every command describes what is playing right now, so each one is stamped
+// when it is spooled and discarded unsent once it is older than maximumAge
+// ========================================
+@interface AudioScrobblerSpool : NSObject
+{
+	@private
+	int					_fd;				// The spool file
+	off_t				_head;				// File offset of the first unacknowledged command
+	off_t				_tail;				// File offset of the end of the last command
+	NSMutableArray		*_commands;			// Unacknowledged commands (with their timestamps), oldest first
+	uint64_t			_firstSequenceNumber;	// Sequence number of the first unacknowledged command
+	
+	NSTimeInterval		_maximumAge;
+	off_t				_maximumSize;
+	BOOL				_needsSynchronize;
+}
+
+- (id) initWithPath:(NSString *)path maximumAge:(NSTimeInterval)maximumAge maximumSize:(off_t)maximumSize;
+
+// Commands are newline-terminated lines; the append is written but not flushed to disk
+// The oldest commands are dropped if the spool would grow beyond maximumSize
+- (BOOL) appendCommand:(NSString *)command;
+
+// Flushes appended commands to disk; this may block, so avoid calling it on the main thread
+- (BOOL) synchronize;
+
+- (NSUInteger) count;
+
+// Returns up to maxCount of the oldest unacknowledged commands, after discarding any that have expired
+// Commands are numbered consecutively as they are spooled; sequenceNumber receives the first one's number
+- (NSArray *) pendingCommands:(NSUInteger)maxCount firstSequenceNumber:(uint64_t *)sequenceNumber;
+
+// Removes the commands numbered below sequenceNumber from the spool
+// Commands dropped to make room while a batch was in flight are not counted twice
+- (void) acknowledgeCommandsBeforeSequenceNumber:(uint64_t)sequenceNumber;
+
+@end
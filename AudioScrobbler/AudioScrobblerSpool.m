@@ -0,0 +1,352 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioScrobblerSpool.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// ========================================
+// The spool file begins with the offset of the first unacknowledged command,
+// followed by the commands, one per line, each prefixed with the time (in
+// seconds since 1970) it was spooled and a space
+// ========================================
+#define SPOOL_HEADER_SIZE		((off_t)sizeof(uint64_t))
+
+static BOOL
+writeAll(int fd, const void *buffer, size_t length)
+{
+	const char *bytes = buffer;
+	
+	while(0 < length) {
+		ssize_t bytesWritten = write(fd, bytes, length);
+		if(-1 == bytesWritten) {
+			if(EINTR == errno)
+				continue;
+			return NO;
+		}
+		
+		bytes	+= bytesWritten;
+		length	-= (size_t)bytesWritten;
+	}
+	
+	return YES;
+}
+
+// Splits a spooled line into its timestamp and command; returns nil for lines without a timestamp
+static NSString *
+commandFromLine(NSString *line, NSTimeInterval *timestamp)
+{
+	NSRange separator = [line rangeOfString:@" " options:NSLiteralSearch];
+	if(NSNotFound == separator.location || 0 == separator.location)
+		return nil;
+	
+	NSString *stamp = [line substringToIndex:separator.location];
+	if(NSNotFound != [stamp rangeOfCharacterFromSet:[[NSCharacterSet decimalDigitCharacterSet] invertedSet]].location)
+		return nil;
+	
+	if(NULL != timestamp)
+		*timestamp = [stamp doubleValue];
+	
+	return [line substringFromIndex:NSMaxRange(separator)];
+}
+
+static inline off_t
+lengthOfLine(NSString *line)
+{
+	return (off_t)[line lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+}
+
+@interface AudioScrobblerSpool (Private)
+- (BOOL) writeHead;
+- (BOOL) rewriteCommands;
+- (BOOL) loadCommands;
+- (void) discardExpiredCommands;
+- (void) removeCommands:(NSUInteger)count;
+@end
+
+@implementation AudioScrobblerSpool
+
+- (id) initWithPath:(NSString *)path maximumAge:(NSTimeInterval)maximumAge maximumSize:(off_t)maximumSize
+{
+	NSParameterAssert(nil != path);
+	NSParameterAssert(SPOOL_HEADER_SIZE < maximumSize);
+	
+	if((self = [super init])) {
+		_maximumAge		= maximumAge;
+		_maximumSize	= maximumSize;
+		_commands		= [[NSMutableArray alloc] init];
+		_fd				= open([path fileSystemRepresentation], O_RDWR | O_CREAT, 0644);
+		
+		if(-1 == _fd) {
+			NSLog(@"AudioScrobblerSpool: Unable to open \"%@\" (%s)", path, strerror(errno));
+			return nil;
+		}
+		
+		if(NO == [self loadCommands]) {
+			NSLog(@"AudioScrobblerSpool: Unable to read \"%@\" (%s)", path, strerror(errno));
+			close(_fd), _fd = -1;
+			return nil;
+		}
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	if(-1 != _fd)
+		close(_fd), _fd = -1;
+}
+
+- (BOOL) appendCommand:(NSString *)command
+{
+	NSParameterAssert(nil != command);
+	
+	// Commands are delimited by newlines, so one must terminate each command
+	if(NO == [command hasSuffix:@"\n"])
+		command = [command stringByAppendingString:@"\n"];
+	
+	NSString	*line	= [NSString stringWithFormat:@"%.0f %@", floor([[NSDate date] timeIntervalSince1970]), command];
+	NSData		*data	= [line dataUsingEncoding:NSUTF8StringEncoding];
+	
+	@synchronized(self) {
+		// Make room by reclaiming acknowledged commands, then by dropping the oldest ones
+		if(_maximumSize < _tail + (off_t)[data length]) {
+			off_t pendingSize = _tail - _head;
+			while(0 != [_commands count] && _maximumSize < SPOOL_HEADER_SIZE + pendingSize + (off_t)[data length]) {
+				pendingSize -= lengthOfLine([_commands objectAtIndex:0]);
+				[_commands removeObjectAtIndex:0];
+				++_firstSequenceNumber;
+			}
+			
+			if(_maximumSize < SPOOL_HEADER_SIZE + (off_t)[data length]) {
+				NSLog(@"AudioScrobblerSpool: Command too large to spool");
+				return NO;
+			}
+			
+			if(NO == [self rewriteCommands]) {
+				NSLog(@"AudioScrobblerSpool: Unable to compact spool (%s)", strerror(errno));
+				return NO;
+			}
+		}
+		
+		if(-1 == lseek(_fd, _tail, SEEK_SET) || NO == writeAll(_fd, [data bytes], [data length])) {
+			NSLog(@"AudioScrobblerSpool: Unable to append command (%s)", strerror(errno));
+			return NO;
+		}
+		
+		_tail				+= (off_t)[data length];
+		_needsSynchronize	= YES;
+		
+		[_commands addObject:line];
+	}
+	
+	return YES;
+}
+
+- (BOOL) synchronize
+{
+	@synchronized(self) {
+		if(NO == _needsSynchronize)
+			return YES;
+		
+		if(-1 == fsync(_fd)) {
+			NSLog(@"AudioScrobblerSpool: Unable to flush spool (%s)", strerror(errno));
+			return NO;
+		}
+		
+		_needsSynchronize = NO;
+	}
+	
+	return YES;
+}
+
+- (NSUInteger) count
+{
+	@synchronized(self) {
+		return [_commands count];
+	}
+}
+
+- (NSArray *) pendingCommands:(NSUInteger)maxCount firstSequenceNumber:(uint64_t *)sequenceNumber
+{
+	NSParameterAssert(NULL != sequenceNumber);
+	
+	@synchronized(self) {
+		[self discardExpiredCommands];
+		
+		*sequenceNumber = _firstSequenceNumber;
+		
+		NSArray			*lines		= [_commands subarrayWithRange:NSMakeRange(0, MIN(maxCount, [_commands count]))];
+		NSMutableArray	*commands	= [NSMutableArray arrayWithCapacity:[lines count]];
+		
+		for(NSString *line in lines)
+			[commands addObject:commandFromLine(line, NULL)];
+		
+		return commands;
+	}
+}
+
+- (void) acknowledgeCommandsBeforeSequenceNumber:(uint64_t)sequenceNumber
+{
+	@synchronized(self) {
+		// Some of the commands may have been dropped since they were handed out
+		if(sequenceNumber <= _firstSequenceNumber)
+			return;
+		
+		[self removeCommands:(NSUInteger)MIN(sequenceNumber - _firstSequenceNumber, (uint64_t)[_commands count])];
+	}
+}
+
+@end
+
+@implementation AudioScrobblerSpool (Private)
+
+- (void) removeCommands:(NSUInteger)count
+{
+	NSParameterAssert(count <= [_commands count]);
+	
+	if(0 == count)
+		return;
+	
+	NSUInteger i;
+	for(i = 0; i < count; ++i)
+		_head += lengthOfLine([_commands objectAtIndex:i]);
+	
+	[_commands removeObjectsInRange:NSMakeRange(0, count)];
+	_firstSequenceNumber += count;
+	
+	// Reclaim the space once everything has been acknowledged
+	if(0 == [_commands count]) {
+		_head = _tail = SPOOL_HEADER_SIZE;
+		if(-1 == ftruncate(_fd, SPOOL_HEADER_SIZE))
+			NSLog(@"AudioScrobblerSpool: Unable to truncate spool (%s)", strerror(errno));
+	}
+	
+	// The head is not synced; after a crash a few acknowledged commands may be sent again
+	if(NO == [self writeHead])
+		NSLog(@"AudioScrobblerSpool: Unable to update spool head (%s)", strerror(errno));
+}
+
+- (BOOL) writeHead
+{
+	uint64_t head = (uint64_t)_head;
+	return (sizeof(head) == pwrite(_fd, &head, sizeof(head), 0));
+}
+
+// Replaces the contents of the spool with _commands, so the head stays on a command boundary
+- (BOOL) rewriteCommands
+{
+	_head = _tail = SPOOL_HEADER_SIZE;
+	if(-1 == ftruncate(_fd, SPOOL_HEADER_SIZE) || NO == [self writeHead] || -1 == lseek(_fd, 0, SEEK_END))
+		return NO;
+	
+	for(NSString *line in _commands) {
+		NSData *lineData = [line dataUsingEncoding:NSUTF8StringEncoding];
+		if(NO == writeAll(_fd, [lineData bytes], [lineData length]))
+			return NO;
+		
+		_tail += (off_t)[lineData length];
+	}
+	
+	_needsSynchronize = YES;
+	
+	return YES;
+}
+
+- (BOOL) loadCommands
+{
+	struct stat		sb;
+	uint64_t		head		= 0;
+	
+	if(-1 == fstat(_fd, &sb))
+		return NO;
+	
+	// A new (or damaged) spool starts out empty
+	if(SPOOL_HEADER_SIZE > sb.st_size || sizeof(head) != pread(_fd, &head, sizeof(head), 0) || SPOOL_HEADER_SIZE > (off_t)head || sb.st_size < (off_t)head) {
+		_head = _tail = SPOOL_HEADER_SIZE;
+		return (-1 != ftruncate(_fd, SPOOL_HEADER_SIZE) && [self writeHead]);
+	}
+	
+	_head = (off_t)head;
+	_tail = sb.st_size;
+	
+	size_t			length		= (size_t)(sb.st_size - _head);
+	NSMutableData	*data		= [NSMutableData dataWithLength:length];
+	
+	if(0 != length && (ssize_t)length != pread(_fd, [data mutableBytes], length, _head))
+		return NO;
+	
+	const char		*bytes		= [data bytes];
+	size_t			lineStart	= 0;
+	NSUInteger		skipped		= 0;
+	size_t			i;
+	
+	for(i = 0; i < length; ++i) {
+		if('\n' != bytes[i])
+			continue;
+		
+		NSString *line = [[NSString alloc] initWithBytes:bytes + lineStart length:i + 1 - lineStart encoding:NSUTF8StringEncoding];
+		if(nil != line && nil != commandFromLine(line, NULL))
+			[_commands addObject:line];
+		else
+			++skipped;
+		
+		lineStart = i + 1;
+	}
+	
+	// Discard a partial command left by an interrupted append
+	if(lineStart != length) {
+		_tail = _head + (off_t)lineStart;
+		if(-1 == ftruncate(_fd, _tail))
+			return NO;
+	}
+	
+	// Commands left over from a previous launch have probably expired
+	[self discardExpiredCommands];
+	
+	if(0 == skipped)
+		return YES;
+	
+	NSLog(@"AudioScrobblerSpool: Discarding %ld undecodable commands", (long)skipped);
+	
+	return ([self rewriteCommands] && -1 != fsync(_fd));
+}
+
+// Commands are spooled in order, so the expired ones are at the front
+- (void) discardExpiredCommands
+{
+	NSTimeInterval	oldest		= [[NSDate date] timeIntervalSince1970] - _maximumAge;
+	NSTimeInterval	timestamp	= 0;
+	NSUInteger		count		= 0;
+	
+	while(count < [_commands count]) {
+		commandFromLine([_commands objectAtIndex:count], &timestamp);
+		if(timestamp >= oldest)
+			break;
+		++count;
+	}
+	
+	if(0 != count)
+		[self removeCommands:count];
+}
+
+@end
@@ -72,6 +72,10 @@ extern NSString * const		PropertiesSampleRateKey;
 extern NSString * const		PropertiesTotalFramesKey;
 extern NSString * const		PropertiesBitrateKey;
 
+extern NSString * const		FileSizeKey;
+extern NSString * const		FileModificationDateKey;
+extern NSString * const		FileInodeKey;
+
 @interface AudioStream : DatabaseObject
 {
 	BOOL _playing;
@@ -75,6 +75,10 @@ NSString * const	PropertiesSampleRateKey					= @"sampleRate";
 NSString * const	PropertiesTotalFramesKey				= @"totalFrames";
 NSString * const	PropertiesBitrateKey					= @"bitrate";
 
+NSString * const	FileSizeKey								= @"fileSize";
+NSString * const	FileModificationDateKey					= @"fileModificationDate";
+NSString * const	FileInodeKey							= @"fileInode";
+
 // ========================================
 // KVC key names
 // ========================================
@@ -330,23 +334,7 @@ NSString * const	IsPlayingKey							= @"isPlaying";
 	if([self isPartOfCueSheet])
 		return;
 	
-	NSError					*error				= nil;
-	AudioMetadataWriter		*metadataWriter		= [AudioMetadataWriter metadataWriterForURL:[self currentStreamURL] error:&error];
-	
-	if(nil == metadataWriter) {
-/*		if(nil != error)
-			[[AudioLibrary library] presentError:error];
-		*/
-		return;
-	}
-	
-	BOOL result = [metadataWriter writeMetadata:self error:&error];
-	if(NO == result) {
-/*		if(nil != error)
-			[[AudioLibrary library] presentError:error];
-		*/
-		return;
-	}	
+	[AudioMetadataWriter scheduleMetadataWriteForStream:self];
 }
 
 - (IBAction) refreshPath:(id)sender
@@ -523,6 +511,10 @@ NSString * const	IsPlayingKey							= @"isPlaying";
 			PropertiesSampleRateKey,
 			PropertiesTotalFramesKey,
 			PropertiesBitrateKey,
+
+			FileSizeKey,
+			FileModificationDateKey,
+			FileInodeKey,
 			
 			nil];
 	}	
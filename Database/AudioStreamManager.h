@@ -39,6 +39,7 @@
 	
 	NSMapTable 				*_registeredStreams;	// Registered streams
 	NSMutableArray			*_cachedStreams;		// Current state of all streams from the database
+	NSMutableDictionary		*_pendingStreams;		// Streams queued for insertion but not yet written, keyed by URL
 	
 	NSMutableSet			*_insertedStreams;		// Streams inserted during a transaction
 	NSMutableSet			*_updatedStreams;		// Streams updated during a transaction
@@ -47,6 +48,8 @@
 	BOOL					_updating;				// Indicates if a transaction is in progress
 	
 	NSArray					*_streamKeys;			// AudioStream (aggregate) keys this object supports
+	
+	NSArray					*_savedPlayQueueIDs;	// Stream IDs currently stored in the play_queue table, if known
 }
 
 // ========================================
@@ -65,6 +68,12 @@
 
 - (NSArray *) streamsContainedByURL:(NSURL *)url;
 
+// Full-text search over title, artist, album, album artist, composer, genre and comment
+// Returns the IDs of the matching streams, best matches first
+- (NSArray *) streamIDsMatchingSearch:(NSString *)searchString;
+
+// With a background writer connection inserts and updates are queued for it; an inserted
+// stream gets its ID and joins the library once its row is written
 - (BOOL) insertStream:(AudioStream *)stream;
 - (void) saveStream:(AudioStream *)stream;
 - (void) deleteStream:(AudioStream *)stream;
@@ -92,6 +101,33 @@
 
 @interface AudioStreamManager (PlaylistMethods)
 - (NSArray *) streamsForPlaylist:(Playlist *)playlist;
+- (NSArray *) streamIDsForPlaylist:(Playlist *)playlist;
+@end
+
+@interface AudioStreamManager (FingerprintMethods)
+- (NSArray *) streamIDsWithoutFingerprints;
+- (NSData *) fingerprintForStreamID:(NSNumber *)objectID;
+- (void) setFingerprint:(NSData *)fingerprint signature:(NSData *)signature forStreamID:(NSNumber *)objectID;
+- (void) enumerateFingerprintSignaturesUsingBlock:(void (^)(NSInteger streamID, const void *signature, NSUInteger length))block;
+@end
+
+@interface AudioStreamManager (SeekTableMethods)
+- (NSData *) seekTableForURL:(NSURL *)url fileSize:(SInt64)fileSize modificationDate:(NSTimeInterval)modificationDate;
+- (void) setSeekTable:(NSData *)seekTable forURL:(NSURL *)url fileSize:(SInt64)fileSize modificationDate:(NSTimeInterval)modificationDate;
+- (NSArray *) startingFramesForURL:(NSURL *)url;
+@end
+
+// Silence at the beginning and end of a stream, in seconds
+@interface AudioStreamManager (SilenceMethods)
+- (BOOL) getLeadingSilence:(NSTimeInterval *)leadingSilence trailingSilence:(NSTimeInterval *)trailingSilence forStreamID:(NSNumber *)objectID;
+- (void) setLeadingSilence:(NSTimeInterval)leadingSilence trailingSilence:(NSTimeInterval)trailingSilence forStreamID:(NSNumber *)objectID;
+@end
+
+// The play queue is saved as the list of stream IDs in queue order
+// Only the entries after the first difference from the previous save are rewritten
+@interface AudioStreamManager (PlayQueueMethods)
+- (NSArray *) playQueueStreams;
+- (void) setPlayQueueStreamIDs:(NSArray *)objectIDs;
 @end
 
 @interface AudioStreamManager (SmartPlaylistMethods)
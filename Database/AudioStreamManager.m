@@ -38,6 +38,9 @@
 - (BOOL) updateInProgress;
 
 - (NSMutableArray *) fetchStreams;
+- (NSMutableArray *) fetchStreamsForPlaylist:(Playlist *)playlist;
+- (NSMutableArray *) fetchPlayQueueStreams;
+- (NSArray *) playQueueStreamIDs;
 
 - (AudioStream *) loadStream:(sqlite3_stmt *)statement;
 
@@ -45,9 +48,109 @@
 - (void) doUpdateStream:(AudioStream *)stream;
 - (void) doDeleteStream:(AudioStream *)stream;
 
+- (uint64_t) changedColumnsForStream:(AudioStream *)stream;
+- (NSString *) updateSQLForColumns:(uint64_t)columns;
+- (sqlite3_stmt *) updateStatementForColumns:(uint64_t)columns;
+
+- (NSMutableDictionary *) bindingsForStream:(AudioStream *)stream columns:(uint64_t)columns;
+- (void) queueInsertStreams:(NSArray *)streams;
+- (void) queueUpdateStreams:(NSArray *)streams columns:(uint64_t)columns;
+- (void) didInsertStreams:(NSArray *)streams rowIDs:(NSArray *)rowIDs;
+- (AudioStream *) pendingStreamForURL:(NSURL *)url startingFrame:(NSNumber *)startingFrame frameCount:(NSNumber *)frameCount;
+
 - (NSArray *) streamKeys;
 @end
 
+// ========================================
+// The updatable columns of the streams table, in table order
+// Each entry is (column name, AudioStream key, eObjectType); a set of
+// columns is represented by a bitmask of indexes into this array
+// ========================================
+#define STREAM_COLUMN(column, key, type) [NSArray arrayWithObjects:column, key, [NSNumber numberWithInt:type], nil]
+
+static NSArray *
+streamColumnDescriptions(void)
+{
+	static NSArray			*sColumns		= nil;
+	static dispatch_once_t	onceToken;
+	
+	dispatch_once(&onceToken, ^{
+		sColumns = [NSArray arrayWithObjects:
+			STREAM_COLUMN(@"url", StreamURLKey, eObjectTypeURL),
+			STREAM_COLUMN(@"url_bookmark", StreamURLBookmarkKey, eObjectTypeBlob),
+			STREAM_COLUMN(@"starting_frame", StreamStartingFrameKey, eObjectTypeLongLong),
+			STREAM_COLUMN(@"frame_count", StreamFrameCountKey, eObjectTypeUnsignedInt),
+			STREAM_COLUMN(@"date_added", StatisticsDateAddedKey, eObjectTypeDate),
+			STREAM_COLUMN(@"first_played_date", StatisticsFirstPlayedDateKey, eObjectTypeDate),
+			STREAM_COLUMN(@"last_played_date", StatisticsLastPlayedDateKey, eObjectTypeDate),
+			STREAM_COLUMN(@"last_skipped_date", StatisticsLastSkippedDateKey, eObjectTypeDate),
+			STREAM_COLUMN(@"play_count", StatisticsPlayCountKey, eObjectTypeUnsignedInt),
+			STREAM_COLUMN(@"skip_count", StatisticsSkipCountKey, eObjectTypeUnsignedInt),
+			STREAM_COLUMN(@"rating", StatisticsRatingKey, eObjectTypeUnsignedInt),
+			STREAM_COLUMN(@"title", MetadataTitleKey, eObjectTypeString),
+			STREAM_COLUMN(@"album_title", MetadataAlbumTitleKey, eObjectTypeString),
+			STREAM_COLUMN(@"artist", MetadataArtistKey, eObjectTypeString),
+			STREAM_COLUMN(@"album_artist", MetadataAlbumArtistKey, eObjectTypeString),
+			STREAM_COLUMN(@"genre", MetadataGenreKey, eObjectTypeString),
+			STREAM_COLUMN(@"composer", MetadataComposerKey, eObjectTypeString),
+			STREAM_COLUMN(@"date", MetadataDateKey, eObjectTypeString),
+			STREAM_COLUMN(@"compilation", MetadataCompilationKey, eObjectTypeBool),
+			STREAM_COLUMN(@"track_number", MetadataTrackNumberKey, eObjectTypeInt),
+			STREAM_COLUMN(@"track_total", MetadataTrackTotalKey, eObjectTypeInt),
+			STREAM_COLUMN(@"disc_number", MetadataDiscNumberKey, eObjectTypeInt),
+			STREAM_COLUMN(@"disc_total", MetadataDiscTotalKey, eObjectTypeInt),
+			STREAM_COLUMN(@"comment", MetadataCommentKey, eObjectTypeString),
+			STREAM_COLUMN(@"isrc", MetadataISRCKey, eObjectTypeString),
+			STREAM_COLUMN(@"mcn", MetadataMCNKey, eObjectTypeString),
+			STREAM_COLUMN(@"bpm", MetadataBPMKey, eObjectTypeInt),
+			STREAM_COLUMN(@"musicdns_puid", MetadataMusicDNSPUIDKey, eObjectTypeString),
+			STREAM_COLUMN(@"musicbrainz_id", MetadataMusicBrainzIDKey, eObjectTypeString),
+			STREAM_COLUMN(@"reference_loudness", ReplayGainReferenceLoudnessKey, eObjectTypeDouble),
+			STREAM_COLUMN(@"track_replay_gain", ReplayGainTrackGainKey, eObjectTypeDouble),
+			STREAM_COLUMN(@"track_peak", ReplayGainTrackPeakKey, eObjectTypeDouble),
+			STREAM_COLUMN(@"album_replay_gain", ReplayGainAlbumGainKey, eObjectTypeDouble),
+			STREAM_COLUMN(@"album_peak", ReplayGainAlbumPeakKey, eObjectTypeDouble),
+			STREAM_COLUMN(@"file_type", PropertiesFileTypeKey, eObjectTypeString),
+			STREAM_COLUMN(@"data_format", PropertiesDataFormatKey, eObjectTypeString),
+			STREAM_COLUMN(@"format_description", PropertiesFormatDescriptionKey, eObjectTypeString),
+			STREAM_COLUMN(@"bits_per_channel", PropertiesBitsPerChannelKey, eObjectTypeUnsignedInt),
+			STREAM_COLUMN(@"channels_per_frame", PropertiesChannelsPerFrameKey, eObjectTypeUnsignedInt),
+			STREAM_COLUMN(@"sample_rate", PropertiesSampleRateKey, eObjectTypeDouble),
+			STREAM_COLUMN(@"total_frames", PropertiesTotalFramesKey, eObjectTypeLongLong),
+			STREAM_COLUMN(@"bitrate", PropertiesBitrateKey, eObjectTypeDouble),
+			STREAM_COLUMN(@"file_size", FileSizeKey, eObjectTypeLongLong),
+			STREAM_COLUMN(@"file_modification_date", FileModificationDateKey, eObjectTypeDate),
+			STREAM_COLUMN(@"file_inode", FileInodeKey, eObjectTypeUnsignedLongLong),
+			nil];
+	});
+	
+	return sColumns;
+}
+
+// ========================================
+// Convert text typed by the user into an FTS5 query
+// Each whitespace-separated word becomes a quoted prefix term, so the
+// words match in any column and order and FTS5 syntax is never interpreted
+// ========================================
+static NSString *
+fullTextQueryForSearchString(NSString *searchString)
+{
+	NSMutableArray *terms = [NSMutableArray array];
+	
+	for(NSString *word in [searchString componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]]) {
+		if(0 == [word length])
+			continue;
+		
+		NSString *escapedWord = [word stringByReplacingOccurrencesOfString:@"\"" withString:@"\"\""];
+		[terms addObject:[NSString stringWithFormat:@"\"%@\"*", escapedWord]];
+	}
+	
+	if(0 == [terms count])
+		return nil;
+	
+	return [terms componentsJoinedByString:@" "];
+}
+
 @implementation AudioStreamManager
 
 - (id) init
@@ -58,6 +161,7 @@
 		_insertedStreams	= [[NSMutableSet alloc] init];
 		_updatedStreams		= [[NSMutableSet alloc] init];
 		_deletedStreams		= [[NSMutableSet alloc] init];	
+		_pendingStreams		= [[NSMutableDictionary alloc] init];
 	}
 	return self;
 }
@@ -122,10 +226,57 @@
 	return streams;
 }
 
+- (NSArray *) streamIDsMatchingSearch:(NSString *)searchString
+{
+	NSParameterAssert(nil != searchString);
+	
+	NSMutableArray	*objectIDs		= [[NSMutableArray alloc] init];
+	NSString		*query			= fullTextQueryForSearchString(searchString);
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_stream_ids_matching_search"];
+	int				result			= SQLITE_OK;
+	
+	if(nil == query)
+		return objectIDs;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+#if SQL_DEBUG
+	clock_t start = clock();
+#endif
+	
+	result = sqlite3_bind_text(statement, sqlite3_bind_parameter_index(statement, ":query"), [query UTF8String], -1, SQLITE_TRANSIENT);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	// No limit; the caller filters the library with the complete result set
+	result = sqlite3_bind_int(statement, sqlite3_bind_parameter_index(statement, ":limit"), -1);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	while(SQLITE_ROW == (result = sqlite3_step(statement)))
+		[objectIDs addObject:@((NSInteger)sqlite3_column_int64(statement, 0))];
+	
+	NSAssert1(SQLITE_DONE == result, @"Error while searching streams (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_clear_bindings(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+#if SQL_DEBUG
+	clock_t end = clock();
+	double elapsed = (end - start) / (double)CLOCKS_PER_SEC;
+	NSLog(@"Found %ld streams matching \"%@\" in %f seconds", (long)[objectIDs count], query, elapsed);
+#endif
+	
+	return objectIDs;
+}
+
 - (AudioStream *) streamForID:(NSNumber *)objectID
 {
 	NSParameterAssert(nil != objectID);
 	
+	// Streams queued for writing have no ID yet, so anything with one is registered or in the database
 	AudioStream *stream = (__bridge AudioStream *)NSMapGet(_registeredStreams, (void *)[objectID unsignedIntegerValue]);
 	if(nil != stream)
 		return stream;
@@ -176,6 +327,11 @@
 	NSParameterAssert(nil != startingFrame);
 	NSParameterAssert(nil != frameCount);
 
+	// Readers see the last committed state, so streams still queued for writing are matched here
+	AudioStream *pendingStream = [self pendingStreamForURL:url startingFrame:startingFrame frameCount:frameCount];
+	if(nil != pendingStream)
+		return pendingStream;
+	
 	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_stream_by_url"];
 	int				result			= SQLITE_OK;
 	AudioStream		*stream			= nil;
@@ -224,6 +380,9 @@
 	
 	if([self updateInProgress])
 		[_insertedStreams addObject:stream];
+	// The stream is registered and added to the library once its row is written
+	else if([[CollectionManager manager] writesInBackground])
+		[self queueInsertStreams:[NSArray arrayWithObject:stream]];
 	else {
 		NSIndexSet *indexes = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange([_cachedStreams count], 1)];
 
@@ -254,7 +413,10 @@
 	if([self updateInProgress])
 		[_updatedStreams addObject:stream];
 	else {
-		[self doUpdateStream:stream];	
+		if([[CollectionManager manager] writesInBackground])
+			[self queueUpdateStreams:[NSArray arrayWithObject:stream] columns:[self changedColumnsForStream:stream]];
+		else
+			[self doUpdateStream:stream];	
 		
 		[[NSNotificationCenter defaultCenter] postNotificationName:AudioStreamDidChangeNotification 
 															object:self 
@@ -268,6 +430,10 @@
 {
 	NSParameterAssert(nil != stream);
 
+	// A stream inserted a moment ago has no ID until its row is written
+	if(nil == [stream valueForKey:ObjectIDKey])
+		[[CollectionManager manager] waitForBackgroundWrites];
+	
 	if([self updateInProgress])
 		[_deletedStreams addObject:stream];
 	else {
@@ -324,6 +490,7 @@
 - (BOOL) disconnectedFromDatabase:(NSError **)error
 {
 	_db = NULL;
+	_savedPlayQueueIDs = nil;
 	return [self finalizeSQL:error];
 }
 
@@ -332,6 +499,7 @@
 	[self willChangeValueForKey:@"streams"];
 	NSResetMapTable(_registeredStreams);
 	_cachedStreams = nil;
+	_savedPlayQueueIDs = nil;
 	[self didChangeValueForKey:@"streams"];
 }
 
@@ -349,12 +517,39 @@
 - (void) processUpdate
 {
 	NSAssert(YES == _updating, @"No update in progress");
+	
+	// With a writer connection inserts and updates are queued for it, and
+	// the inserted streams are added to the library once they are written
+	BOOL writesInBackground = [[CollectionManager manager] writesInBackground];
 		
 	// ========================================
 	// Process updates first
 	if(0 != [_updatedStreams count]) {
-		for(AudioStream *stream in _updatedStreams)
-			[self doUpdateStream:stream];
+		// Group the streams by their changed columns so each partial UPDATE is stepped back-to-back
+		NSMutableDictionary *streamsByColumns = [NSMutableDictionary dictionary];
+		
+		for(AudioStream *stream in _updatedStreams) {
+			NSNumber		*columns	= [NSNumber numberWithUnsignedLongLong:[self changedColumnsForStream:stream]];
+			NSMutableArray	*streams	= [streamsByColumns objectForKey:columns];
+			
+			if(nil == streams) {
+				streams = [NSMutableArray array];
+				[streamsByColumns setObject:streams forKey:columns];
+			}
+			
+			[streams addObject:stream];
+		}
+		
+		for(NSNumber *columns in streamsByColumns) {
+			NSArray *streams = [streamsByColumns objectForKey:columns];
+			
+			if(writesInBackground)
+				[self queueUpdateStreams:streams columns:[columns unsignedLongLongValue]];
+			else {
+				for(AudioStream *stream in streams)
+					[self doUpdateStream:stream];
+			}
+		}
 	}
 	
 	// ========================================
@@ -366,7 +561,11 @@
 	
 	// ========================================
 	// Finally, process inserts, removing any that fail
-	if(0 != [_insertedStreams count]) {
+	if(0 != [_insertedStreams count] && writesInBackground) {
+		[self queueInsertStreams:[_insertedStreams allObjects]];
+		[_insertedStreams removeAllObjects];
+	}
+	else if(0 != [_insertedStreams count]) {
 		for(AudioStream *stream in _insertedStreams) {
 			if(NO == [self doInsertStream:stream])
 				[_insertedStreams removeObject:stream];
@@ -486,15 +685,36 @@
 
 @implementation AudioStreamManager (PlaylistMethods)
 
+// Playlists are first resolved by ID against the registered streams, since the
+// IDs come straight from the (playlist_id, stream_index) primary key without
+// touching the streams table.  Full rows are only fetched if a stream isn't registered.
 - (NSArray *) streamsForPlaylist:(Playlist *)playlist
 {
 	NSParameterAssert(nil != playlist);
 	
-	NSMutableArray	*streams		= [[NSMutableArray alloc] init];
-	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_streams_for_playlist"];
-	int				result			= SQLITE_OK;
+	NSArray			*objectIDs		= [self streamIDsForPlaylist:playlist];
+	NSMutableArray	*streams		= [[NSMutableArray alloc] initWithCapacity:[objectIDs count]];
 	AudioStream		*stream			= nil;
-				
+	
+	for(NSNumber *objectID in objectIDs) {
+		stream = (__bridge AudioStream *)NSMapGet(_registeredStreams, (void *)[objectID unsignedIntegerValue]);
+		if(nil == stream)
+			return [self fetchStreamsForPlaylist:playlist];
+		
+		[streams addObject:stream];
+	}
+	
+	return streams;
+}
+
+- (NSArray *) streamIDsForPlaylist:(Playlist *)playlist
+{
+	NSParameterAssert(nil != playlist);
+	
+	NSMutableArray	*objectIDs		= [[NSMutableArray alloc] init];
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_stream_ids_for_playlist"];
+	int				result			= SQLITE_OK;
+	
 	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
 	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
 	
@@ -505,12 +725,10 @@
 	result = sqlite3_bind_int(statement, sqlite3_bind_parameter_index(statement, ":playlist_id"), [[playlist valueForKey:ObjectIDKey] unsignedIntegerValue]);
 	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
 	
-	while(SQLITE_ROW == (result = sqlite3_step(statement))) {
-		stream = [self loadStream:statement];
-		[streams addObject:stream];
-	}
+	while(SQLITE_ROW == (result = sqlite3_step(statement)))
+		[objectIDs addObject:@((NSInteger)sqlite3_column_int64(statement, 0))];
 	
-	NSAssert1(SQLITE_DONE == result, @"Error while fetching streams (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	NSAssert1(SQLITE_DONE == result, @"Error while fetching stream IDs (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
 	
 	result = sqlite3_reset(statement);
 	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
@@ -518,12 +736,345 @@
 #if SQL_DEBUG
 	clock_t end = clock();
 	double elapsed = (end - start) / (double)CLOCKS_PER_SEC;
-	NSLog(@"Loaded %ld streams in %f seconds (%f per second)", (long)[streams count], elapsed, (double)[streams count] / elapsed);
+	NSLog(@"Loaded %ld stream IDs in %f seconds (%f per second)", (long)[objectIDs count], elapsed, (double)[objectIDs count] / elapsed);
 #endif
 	
+	return objectIDs;
+}
+
+@end
+
+@implementation AudioStreamManager (FingerprintMethods)
+
+- (NSArray *) streamIDsWithoutFingerprints
+{
+	NSMutableArray	*objectIDs		= [[NSMutableArray alloc] init];
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_stream_ids_without_fingerprints"];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	while(SQLITE_ROW == (result = sqlite3_step(statement)))
+		[objectIDs addObject:@((NSInteger)sqlite3_column_int64(statement, 0))];
+	
+	NSAssert1(SQLITE_DONE == result, @"Error while fetching stream IDs (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	return objectIDs;
+}
+
+- (NSData *) fingerprintForStreamID:(NSNumber *)objectID
+{
+	NSParameterAssert(nil != objectID);
+	
+	NSData			*fingerprint	= nil;
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_stream_fingerprint"];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	result = sqlite3_bind_int64(statement, sqlite3_bind_parameter_index(statement, ":stream_id"), [objectID longLongValue]);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	if(SQLITE_ROW == (result = sqlite3_step(statement)))
+		fingerprint = [NSData dataWithBytes:sqlite3_column_blob(statement, 0) length:sqlite3_column_bytes(statement, 0)];
+	
+	NSAssert1(SQLITE_ROW == result || SQLITE_DONE == result, @"Error while fetching fingerprint (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_clear_bindings(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	return fingerprint;
+}
+
+- (void) setFingerprint:(NSData *)fingerprint signature:(NSData *)signature forStreamID:(NSNumber *)objectID
+{
+	NSParameterAssert(nil != fingerprint);
+	NSParameterAssert(nil != signature);
+	NSParameterAssert(nil != objectID);
+	
+	[[CollectionManager manager] performBackgroundWriteForAction:@"insert_stream_fingerprint" bindings:[NSDictionary dictionaryWithObjectsAndKeys:
+		objectID, @":stream_id",
+		signature, @":signature",
+		fingerprint, @":fingerprint",
+		nil]];
+}
+
+- (void) enumerateFingerprintSignaturesUsingBlock:(void (^)(NSInteger streamID, const void *signature, NSUInteger length))block
+{
+	NSParameterAssert(nil != block);
+	
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_all_stream_fingerprint_signatures"];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+#if SQL_DEBUG
+	clock_t start = clock();
+#endif
+	
+	// The signature bytes are only valid for the duration of the block
+	while(SQLITE_ROW == (result = sqlite3_step(statement)))
+		block((NSInteger)sqlite3_column_int64(statement, 0), sqlite3_column_blob(statement, 1), (NSUInteger)sqlite3_column_bytes(statement, 1));
+	
+	NSAssert1(SQLITE_DONE == result, @"Error while fetching fingerprint signatures (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+#if SQL_DEBUG
+	clock_t end = clock();
+	double elapsed = (end - start) / (double)CLOCKS_PER_SEC;
+	NSLog(@"Loaded fingerprint signatures in %f seconds", elapsed);
+#endif
+}
+
+@end
+
+@implementation AudioStreamManager (SeekTableMethods)
+
+- (NSData *) seekTableForURL:(NSURL *)url fileSize:(SInt64)fileSize modificationDate:(NSTimeInterval)modificationDate
+{
+	NSParameterAssert(nil != url);
+	
+	NSData			*seekTable		= nil;
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_seek_table"];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	result = sqlite3_bind_text(statement, sqlite3_bind_parameter_index(statement, ":url"), [[url absoluteString] UTF8String], -1, SQLITE_TRANSIENT);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_bind_int64(statement, sqlite3_bind_parameter_index(statement, ":file_size"), fileSize);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_bind_double(statement, sqlite3_bind_parameter_index(statement, ":modification_date"), modificationDate);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	// A table for an earlier version of the file is ignored
+	if(SQLITE_ROW == (result = sqlite3_step(statement)))
+		seekTable = [NSData dataWithBytes:sqlite3_column_blob(statement, 0) length:sqlite3_column_bytes(statement, 0)];
+	
+	NSAssert1(SQLITE_ROW == result || SQLITE_DONE == result, @"Error while fetching seek table (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_clear_bindings(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	return seekTable;
+}
+
+- (void) setSeekTable:(NSData *)seekTable forURL:(NSURL *)url fileSize:(SInt64)fileSize modificationDate:(NSTimeInterval)modificationDate
+{
+	NSParameterAssert(nil != seekTable);
+	NSParameterAssert(nil != url);
+	
+	[[CollectionManager manager] performBackgroundWriteForAction:@"insert_seek_table" bindings:[NSDictionary dictionaryWithObjectsAndKeys:
+		[url absoluteString], @":url",
+		[NSNumber numberWithLongLong:fileSize], @":file_size",
+		[NSNumber numberWithDouble:modificationDate], @":modification_date",
+		seekTable, @":entries",
+		nil]];
+}
+
+- (NSArray *) startingFramesForURL:(NSURL *)url
+{
+	NSParameterAssert(nil != url);
+	
+	NSMutableArray	*startingFrames	= [[NSMutableArray alloc] init];
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_starting_frames_for_url"];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	result = sqlite3_bind_text(statement, sqlite3_bind_parameter_index(statement, ":url"), [[url absoluteString] UTF8String], -1, SQLITE_TRANSIENT);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	while(SQLITE_ROW == (result = sqlite3_step(statement)))
+		[startingFrames addObject:@(sqlite3_column_int64(statement, 0))];
+	
+	NSAssert1(SQLITE_DONE == result, @"Error while fetching starting frames (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_clear_bindings(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	// Streams still queued for writing aren't in the database yet
+	NSArray *pendingStreams = [_pendingStreams objectForKey:url];
+	if(nil != pendingStreams) {
+		for(AudioStream *stream in pendingStreams) {
+			if(-1 != [[stream valueForKey:StreamStartingFrameKey] longLongValue])
+				[startingFrames addObject:[stream valueForKey:StreamStartingFrameKey]];
+		}
+		
+		[startingFrames sortUsingSelector:@selector(compare:)];
+	}
+	
+	return startingFrames;
+}
+
+@end
+
+@implementation AudioStreamManager (SilenceMethods)
+
+- (BOOL) getLeadingSilence:(NSTimeInterval *)leadingSilence trailingSilence:(NSTimeInterval *)trailingSilence forStreamID:(NSNumber *)objectID
+{
+	NSParameterAssert(NULL != leadingSilence);
+	NSParameterAssert(NULL != trailingSilence);
+	NSParameterAssert(nil != objectID);
+	
+	BOOL			found			= NO;
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_stream_silence"];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	result = sqlite3_bind_int64(statement, sqlite3_bind_parameter_index(statement, ":stream_id"), [objectID longLongValue]);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	if(SQLITE_ROW == (result = sqlite3_step(statement))) {
+		*leadingSilence		= sqlite3_column_double(statement, 0);
+		*trailingSilence	= sqlite3_column_double(statement, 1);
+		found				= YES;
+	}
+	
+	NSAssert1(SQLITE_ROW == result || SQLITE_DONE == result, @"Error while fetching silence boundaries (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_clear_bindings(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	return found;
+}
+
+- (void) setLeadingSilence:(NSTimeInterval)leadingSilence trailingSilence:(NSTimeInterval)trailingSilence forStreamID:(NSNumber *)objectID
+{
+	NSParameterAssert(0 <= leadingSilence);
+	NSParameterAssert(0 <= trailingSilence);
+	NSParameterAssert(nil != objectID);
+	
+	[[CollectionManager manager] performBackgroundWriteForAction:@"insert_stream_silence" bindings:[NSDictionary dictionaryWithObjectsAndKeys:
+		objectID, @":stream_id",
+		[NSNumber numberWithDouble:leadingSilence], @":leading_silence",
+		[NSNumber numberWithDouble:trailingSilence], @":trailing_silence",
+		nil]];
+}
+
+@end
+
+@implementation AudioStreamManager (PlayQueueMethods)
+
+- (NSArray *) playQueueStreams
+{
+	NSArray			*objectIDs		= [self playQueueStreamIDs];
+	NSMutableArray	*streams		= [[NSMutableArray alloc] initWithCapacity:[objectIDs count]];
+	AudioStream		*stream			= nil;
+	
+	_savedPlayQueueIDs = objectIDs;
+	
+	// Use the registered streams if they are all loaded, otherwise fetch the queue with a single join
+	for(NSNumber *objectID in objectIDs) {
+		stream = (__bridge AudioStream *)NSMapGet(_registeredStreams, (void *)[objectID unsignedIntegerValue]);
+		if(nil == stream)
+			return [self fetchPlayQueueStreams];
+		
+		[streams addObject:stream];
+	}
+	
 	return streams;
 }
 
+- (void) setPlayQueueStreamIDs:(NSArray *)objectIDs
+{
+	NSParameterAssert(nil != objectIDs);
+	
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"delete_play_queue_entries_from_index"];
+	int				result			= SQLITE_OK;
+	NSUInteger		firstChange		= 0;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	// Entries before the first difference are already stored
+	if(nil != _savedPlayQueueIDs) {
+		NSUInteger commonCount = MIN([objectIDs count], [_savedPlayQueueIDs count]);
+		
+		while(firstChange < commonCount && [[objectIDs objectAtIndex:firstChange] isEqualToNumber:[_savedPlayQueueIDs objectAtIndex:firstChange]])
+			++firstChange;
+		
+		if(firstChange == [objectIDs count] && firstChange == [_savedPlayQueueIDs count])
+			return;
+	}
+	
+#if SQL_DEBUG
+	clock_t start = clock();
+#endif
+	
+	[[CollectionManager manager] doBeginTransaction];
+	
+	// First delete the entries that changed
+	result = sqlite3_bind_int64(statement, sqlite3_bind_parameter_index(statement, ":queue_index"), firstChange);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_step(statement);
+	NSAssert1(SQLITE_DONE == result, @"Unable to delete play queue entries (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_clear_bindings(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	// And then insert the new ones
+	statement = [self preparedStatementForAction:@"insert_play_queue_entry"];
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	for(NSUInteger thisIndex = firstChange; thisIndex < [objectIDs count]; ++thisIndex) {
+		result = sqlite3_bind_int64(statement, sqlite3_bind_parameter_index(statement, ":queue_index"), thisIndex);
+		NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_bind_int64(statement, sqlite3_bind_parameter_index(statement, ":stream_id"), [[objectIDs objectAtIndex:thisIndex] longLongValue]);
+		NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_step(statement);
+		NSAssert2(SQLITE_DONE == result, @"Unable to insert a play queue entry at index %ld (%@).", (long)thisIndex, [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_reset(statement);
+		NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+		
+		result = sqlite3_clear_bindings(statement);
+		NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to clear sql statement bindings (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	}
+	
+	[[CollectionManager manager] doCommitTransaction];
+	
+	_savedPlayQueueIDs = [objectIDs copy];
+	
+#if SQL_DEBUG
+	clock_t end = clock();
+	double elapsed = (end - start) / (double)CLOCKS_PER_SEC;
+	NSLog(@"Rewrote %ld of %ld play queue entries in %f seconds", (long)([objectIDs count] - firstChange), (long)[objectIDs count], elapsed);
+#endif
+}
+
 @end
 
 @implementation AudioStreamManager (SmartPlaylistMethods)
@@ -572,7 +1123,7 @@
 	NSString		*path				= nil;
 	NSString		*sql				= nil;
 	NSArray			*files				= [NSArray arrayWithObjects:
-		@"select_all_streams", @"select_stream_by_id", @"select_stream_by_url", @"select_streams_for_playlist", @"insert_stream", @"update_stream", @"delete_stream", nil];
+		@"select_all_streams", @"select_stream_by_id", @"select_stream_by_url", @"select_streams_for_playlist", @"select_stream_ids_for_playlist", @"select_stream_ids_matching_search", @"insert_stream", @"delete_stream", @"select_stream_ids_without_fingerprints", @"select_stream_fingerprint", @"select_all_stream_fingerprint_signatures", @"select_seek_table", @"select_starting_frames_for_url", @"select_stream_silence", @"select_play_queue_stream_ids", @"select_play_queue_streams", @"delete_play_queue_entries_from_index", @"insert_play_queue_entry", nil];
 	sqlite3_stmt	*statement			= NULL;
 	const char		*tail				= NULL;
 	
@@ -686,6 +1237,97 @@
 	return streams;
 }
 
+- (NSMutableArray *) fetchStreamsForPlaylist:(Playlist *)playlist
+{
+	NSParameterAssert(nil != playlist);
+	
+	NSMutableArray	*streams		= [[NSMutableArray alloc] init];
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_streams_for_playlist"];
+	int				result			= SQLITE_OK;
+	AudioStream		*stream			= nil;
+				
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+#if SQL_DEBUG
+	clock_t start = clock();
+#endif
+	
+	result = sqlite3_bind_int(statement, sqlite3_bind_parameter_index(statement, ":playlist_id"), [[playlist valueForKey:ObjectIDKey] unsignedIntegerValue]);
+	NSAssert1(SQLITE_OK == result, @"Unable to bind parameter to sql statement (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	while(SQLITE_ROW == (result = sqlite3_step(statement))) {
+		stream = [self loadStream:statement];
+		[streams addObject:stream];
+	}
+	
+	NSAssert1(SQLITE_DONE == result, @"Error while fetching streams (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+#if SQL_DEBUG
+	clock_t end = clock();
+	double elapsed = (end - start) / (double)CLOCKS_PER_SEC;
+	NSLog(@"Loaded %ld streams in %f seconds (%f per second)", (long)[streams count], elapsed, (double)[streams count] / elapsed);
+#endif
+	
+	return streams;
+}
+
+- (NSMutableArray *) fetchPlayQueueStreams
+{
+	NSMutableArray	*streams		= [[NSMutableArray alloc] init];
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_play_queue_streams"];
+	int				result			= SQLITE_OK;
+	AudioStream		*stream			= nil;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+#if SQL_DEBUG
+	clock_t start = clock();
+#endif
+	
+	while(SQLITE_ROW == (result = sqlite3_step(statement))) {
+		stream = [self loadStream:statement];
+		[streams addObject:stream];
+	}
+	
+	NSAssert1(SQLITE_DONE == result, @"Error while fetching streams (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+#if SQL_DEBUG
+	clock_t end = clock();
+	double elapsed = (end - start) / (double)CLOCKS_PER_SEC;
+	NSLog(@"Loaded %ld play queue streams in %f seconds (%f per second)", (long)[streams count], elapsed, (double)[streams count] / elapsed);
+#endif
+	
+	return streams;
+}
+
+- (NSArray *) playQueueStreamIDs
+{
+	NSMutableArray	*objectIDs		= [[NSMutableArray alloc] init];
+	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"select_play_queue_stream_ids"];
+	int				result			= SQLITE_OK;
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
+	
+	while(SQLITE_ROW == (result = sqlite3_step(statement)))
+		[objectIDs addObject:@((NSInteger)sqlite3_column_int64(statement, 0))];
+	
+	NSAssert1(SQLITE_DONE == result, @"Error while fetching stream IDs (%@).", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	result = sqlite3_reset(statement);
+	NSAssert1(SQLITE_OK == result, NSLocalizedStringFromTable(@"Unable to reset sql statement (%@).", @"Database", @""), [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	return objectIDs;
+}
+
 - (AudioStream *) loadStream:(sqlite3_stmt *)statement
 {
 	NSParameterAssert(NULL != statement);
@@ -701,6 +1343,18 @@
 	if(nil != stream)
 		return stream;
 	
+	// A row committed before its insertion was handled belongs to the stream that is still pending
+	if(0 != [_pendingStreams count] && SQLITE_NULL != sqlite3_column_type(statement, 1)) {
+		NSURL *url = [NSURL URLWithString:[NSString stringWithUTF8String:(const char *)sqlite3_column_text(statement, 1)]];
+		
+		stream = [self pendingStreamForURL:url startingFrame:@(sqlite3_column_int64(statement, 3)) frameCount:@(sqlite3_column_int(statement, 4))];
+		if(nil != stream) {
+			[stream initValue:@(objectID) forKey:ObjectIDKey];
+			NSMapInsert(_registeredStreams, (void *)objectID, (__bridge void *)stream);
+			return stream;
+		}
+	}
+	
 	stream = [[AudioStream alloc] init];
 	
 	// Stream ID and location
@@ -758,6 +1412,11 @@
 	getColumnValue(statement, 41, stream, PropertiesTotalFramesKey, eObjectTypeLongLong);
 	getColumnValue(statement, 42, stream, PropertiesBitrateKey, eObjectTypeDouble);
 	
+	// File system state when the stream was last scanned
+	getColumnValue(statement, 43, stream, FileSizeKey, eObjectTypeLongLong);
+	getColumnValue(statement, 44, stream, FileModificationDateKey, eObjectTypeDate);
+	getColumnValue(statement, 45, stream, FileInodeKey, eObjectTypeUnsignedLongLong);
+	
 	// Register the object	
 	NSMapInsert(_registeredStreams, (void *)objectID, (__bridge void *)stream);
 	
@@ -782,58 +1441,10 @@
 #endif
 	
 	@try {
-		// Location
-		bindParameter(statement, 1, stream, StreamURLKey, eObjectTypeURL);
-		bindParameter(statement, 2, stream, StreamURLBookmarkKey, eObjectTypeBlob);
-		bindParameter(statement, 3, stream, StreamStartingFrameKey, eObjectTypeLongLong);
-		bindParameter(statement, 4, stream, StreamFrameCountKey, eObjectTypeUnsignedInt);
-		
-		// Statistics
-		bindParameter(statement, 5, stream, StatisticsDateAddedKey, eObjectTypeDate);
-		bindParameter(statement, 6, stream, StatisticsFirstPlayedDateKey, eObjectTypeDate);
-		bindParameter(statement, 7, stream, StatisticsLastPlayedDateKey, eObjectTypeDate);
-		bindParameter(statement, 8, stream, StatisticsLastSkippedDateKey, eObjectTypeDate);
-		bindParameter(statement, 9, stream, StatisticsPlayCountKey, eObjectTypeUnsignedInt);
-		bindParameter(statement, 10, stream, StatisticsSkipCountKey, eObjectTypeUnsignedInt);
-		bindParameter(statement, 11, stream, StatisticsRatingKey, eObjectTypeUnsignedInt);
-		
-		// Metadata
-		bindParameter(statement, 12, stream, MetadataTitleKey, eObjectTypeString);
-		bindParameter(statement, 13, stream, MetadataAlbumTitleKey, eObjectTypeString);
-		bindParameter(statement, 14, stream, MetadataArtistKey, eObjectTypeString);
-		bindParameter(statement, 15, stream, MetadataAlbumArtistKey, eObjectTypeString);
-		bindParameter(statement, 16, stream, MetadataGenreKey, eObjectTypeString);
-		bindParameter(statement, 17, stream, MetadataComposerKey, eObjectTypeString);
-		bindParameter(statement, 18, stream, MetadataDateKey, eObjectTypeString);	
-		bindParameter(statement, 19, stream, MetadataCompilationKey, eObjectTypeBool);
-		bindParameter(statement, 20, stream, MetadataTrackNumberKey, eObjectTypeInt);
-		bindParameter(statement, 21, stream, MetadataTrackTotalKey, eObjectTypeInt);
-		bindParameter(statement, 22, stream, MetadataDiscNumberKey, eObjectTypeInt);
-		bindParameter(statement, 23, stream, MetadataDiscTotalKey, eObjectTypeInt);
-		bindParameter(statement, 24, stream, MetadataCommentKey, eObjectTypeString);
-		bindParameter(statement, 25, stream, MetadataISRCKey, eObjectTypeString);
-		bindParameter(statement, 26, stream, MetadataMCNKey, eObjectTypeString);
-		bindParameter(statement, 27, stream, MetadataBPMKey, eObjectTypeInt);
-		
-		bindParameter(statement, 28, stream, MetadataMusicDNSPUIDKey, eObjectTypeString);
-		bindParameter(statement, 29, stream, MetadataMusicBrainzIDKey, eObjectTypeString);
-		
-		// Replay Gain
-		bindParameter(statement, 30, stream, ReplayGainReferenceLoudnessKey, eObjectTypeDouble);
-		bindParameter(statement, 31, stream, ReplayGainTrackGainKey, eObjectTypeDouble);
-		bindParameter(statement, 32, stream, ReplayGainTrackPeakKey, eObjectTypeDouble);
-		bindParameter(statement, 33, stream, ReplayGainAlbumGainKey, eObjectTypeDouble);
-		bindParameter(statement, 34, stream, ReplayGainAlbumPeakKey, eObjectTypeDouble);
-		
-		// Properties
-		bindParameter(statement, 35, stream, PropertiesFileTypeKey, eObjectTypeString);
-		bindParameter(statement, 36, stream, PropertiesDataFormatKey, eObjectTypeString);
-		bindParameter(statement, 37, stream, PropertiesFormatDescriptionKey, eObjectTypeString);
-		bindParameter(statement, 38, stream, PropertiesBitsPerChannelKey, eObjectTypeUnsignedInt);
-		bindParameter(statement, 39, stream, PropertiesChannelsPerFrameKey, eObjectTypeUnsignedInt);
-		bindParameter(statement, 40, stream, PropertiesSampleRateKey, eObjectTypeDouble);
-		bindParameter(statement, 41, stream, PropertiesTotalFramesKey, eObjectTypeLongLong);
-		bindParameter(statement, 42, stream, PropertiesBitrateKey, eObjectTypeDouble);
+		for(NSArray *column in streamColumnDescriptions()) {
+			NSString *parameter = [@":" stringByAppendingString:[column objectAtIndex:0]];
+			bindNamedParameter(statement, [parameter UTF8String], stream, [column objectAtIndex:1], (eObjectType)[[column objectAtIndex:2] intValue]);
+		}
 		
 		result = sqlite3_step(statement);
 		NSAssert2(SQLITE_DONE == result, @"Unable to insert a record for %@ (%@).", [[NSFileManager defaultManager] displayNameAtPath:[[stream currentStreamURL] path]], [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
@@ -876,69 +1487,39 @@
 	NSParameterAssert(nil != stream);
 	NSParameterAssert(nil != [stream valueForKey:ObjectIDKey]);
 	
-	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"update_stream"];
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+
+	// Only the columns backing changed values are written
+	uint64_t		columns			= [self changedColumnsForStream:stream];
+	if(0 == columns) {
+		[stream synchronizeSavedValuesWithChangedValues];
+		return;
+	}
+	
+	sqlite3_stmt	*statement		= [self updateStatementForColumns:columns];
 	int				result			= SQLITE_OK;
+	NSArray			*streamColumns	= streamColumnDescriptions();
+	NSUInteger		columnCount		= 0;
+	NSUInteger		i;
 	
-	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
 	NSAssert(NULL != statement, NSLocalizedStringFromTable(@"Unable to locate SQL.", @"Database", @""));
 	
 #if SQL_DEBUG
 	clock_t start = clock();
 #endif
 	
-	// ID and Location
 	bindNamedParameter(statement, ":id", stream, ObjectIDKey, eObjectTypeUnsignedInt);
-	bindNamedParameter(statement, ":url", stream, StreamURLKey, eObjectTypeURL);
-	bindNamedParameter(statement, ":url_bookmark", stream, StreamURLBookmarkKey, eObjectTypeBlob);
-	bindNamedParameter(statement, ":starting_frame", stream, StreamStartingFrameKey, eObjectTypeLongLong);
-	bindNamedParameter(statement, ":frame_count", stream, StreamFrameCountKey, eObjectTypeUnsignedInt);
-	
-	// Statistics
-	bindNamedParameter(statement, ":date_added", stream, StatisticsDateAddedKey, eObjectTypeDate);
-	bindNamedParameter(statement, ":first_played_date", stream, StatisticsFirstPlayedDateKey, eObjectTypeDate);
-	bindNamedParameter(statement, ":last_played_date", stream, StatisticsLastPlayedDateKey, eObjectTypeDate);
-	bindNamedParameter(statement, ":last_skipped_date", stream, StatisticsLastSkippedDateKey, eObjectTypeDate);
-	bindNamedParameter(statement, ":play_count", stream, StatisticsPlayCountKey, eObjectTypeUnsignedInt);
-	bindNamedParameter(statement, ":skip_count", stream, StatisticsSkipCountKey, eObjectTypeUnsignedInt);
-	bindNamedParameter(statement, ":rating", stream, StatisticsRatingKey, eObjectTypeUnsignedInt);
-	
-	// Metadata
-	bindNamedParameter(statement, ":title", stream, MetadataTitleKey, eObjectTypeString);
-	bindNamedParameter(statement, ":album_title", stream, MetadataAlbumTitleKey, eObjectTypeString);
-	bindNamedParameter(statement, ":artist", stream, MetadataArtistKey, eObjectTypeString);
-	bindNamedParameter(statement, ":album_artist", stream, MetadataAlbumArtistKey, eObjectTypeString);
-	bindNamedParameter(statement, ":genre", stream, MetadataGenreKey, eObjectTypeString);
-	bindNamedParameter(statement, ":composer", stream, MetadataComposerKey, eObjectTypeString);
-	bindNamedParameter(statement, ":date", stream, MetadataDateKey, eObjectTypeString);	
-	bindNamedParameter(statement, ":compilation", stream, MetadataCompilationKey, eObjectTypeBool);
-	bindNamedParameter(statement, ":track_number", stream, MetadataTrackNumberKey, eObjectTypeInt);
-	bindNamedParameter(statement, ":track_total", stream, MetadataTrackTotalKey, eObjectTypeInt);
-	bindNamedParameter(statement, ":disc_number", stream, MetadataDiscNumberKey, eObjectTypeInt);
-	bindNamedParameter(statement, ":disc_total", stream, MetadataDiscTotalKey, eObjectTypeInt);
-	bindNamedParameter(statement, ":comment", stream, MetadataCommentKey, eObjectTypeString);
-	bindNamedParameter(statement, ":isrc", stream, MetadataISRCKey, eObjectTypeString);
-	bindNamedParameter(statement, ":mcn", stream, MetadataMCNKey, eObjectTypeString);
-	bindNamedParameter(statement, ":bpm", stream, MetadataBPMKey, eObjectTypeInt);
-
-	bindNamedParameter(statement, ":musicdns_puid", stream, MetadataMusicDNSPUIDKey, eObjectTypeString);
-	bindNamedParameter(statement, ":musicbrainz_id", stream, MetadataMusicBrainzIDKey, eObjectTypeString);
-
-	// Replay gain
-	bindNamedParameter(statement, ":reference_loudness", stream, ReplayGainReferenceLoudnessKey, eObjectTypeDouble);
-	bindNamedParameter(statement, ":track_replay_gain", stream, ReplayGainTrackGainKey, eObjectTypeDouble);
-	bindNamedParameter(statement, ":track_peak", stream, ReplayGainTrackPeakKey, eObjectTypeDouble);
-	bindNamedParameter(statement, ":album_replay_gain", stream, ReplayGainAlbumGainKey, eObjectTypeDouble);
-	bindNamedParameter(statement, ":album_peak", stream, ReplayGainAlbumPeakKey, eObjectTypeDouble);
-	
-	// Properties
-	bindNamedParameter(statement, ":file_type", stream, PropertiesFileTypeKey, eObjectTypeString);
-	bindNamedParameter(statement, ":data_format", stream, PropertiesDataFormatKey, eObjectTypeString);
-	bindNamedParameter(statement, ":format_description", stream, PropertiesFormatDescriptionKey, eObjectTypeString);
-	bindNamedParameter(statement, ":bits_per_channel", stream, PropertiesBitsPerChannelKey, eObjectTypeUnsignedInt);
-	bindNamedParameter(statement, ":channels_per_frame", stream, PropertiesChannelsPerFrameKey, eObjectTypeUnsignedInt);
-	bindNamedParameter(statement, ":sample_rate", stream, PropertiesSampleRateKey, eObjectTypeDouble);
-	bindNamedParameter(statement, ":total_frames", stream, PropertiesTotalFramesKey, eObjectTypeLongLong);
-	bindNamedParameter(statement, ":bitrate", stream, PropertiesBitrateKey, eObjectTypeDouble);
+
+	for(i = 0; i < [streamColumns count]; ++i) {
+		if(0 == (columns & (1ULL << i)))
+			continue;
+		
+		NSArray		*column		= [streamColumns objectAtIndex:i];
+		NSString	*parameter	= [@":" stringByAppendingString:[column objectAtIndex:0]];
+		
+		bindNamedParameter(statement, [parameter UTF8String], stream, [column objectAtIndex:1], (eObjectType)[[column objectAtIndex:2] intValue]);
+		++columnCount;
+	}
 	
 	result = sqlite3_step(statement);
 	NSAssert2(SQLITE_DONE == result, @"Unable to update the record for %@ (%@).", stream, [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
@@ -952,13 +1533,70 @@
 #if SQL_DEBUG
 	clock_t end = clock();
 	double elapsed = (end - start) / (double)CLOCKS_PER_SEC;
-	NSLog(@"Stream update time = %f seconds", elapsed);
+	NSLog(@"Stream update time = %f seconds (%ld of %ld columns)", elapsed, (long)columnCount, (long)[streamColumns count]);
 #endif
 
 	// Reset the object with the stored values
 	[stream synchronizeSavedValuesWithChangedValues];
 }
 
+- (uint64_t) changedColumnsForStream:(AudioStream *)stream
+{
+	NSParameterAssert(nil != stream);
+	
+	NSDictionary	*changedValues	= [stream changedValues];
+	NSArray			*streamColumns	= streamColumnDescriptions();
+	uint64_t		columns			= 0;
+	NSUInteger		i;
+	
+	for(i = 0; i < [streamColumns count]; ++i) {
+		if(nil != [changedValues objectForKey:[[streamColumns objectAtIndex:i] objectAtIndex:1]])
+			columns |= (1ULL << i);
+	}
+	
+	return columns;
+}
+
+- (NSString *) updateSQLForColumns:(uint64_t)columns
+{
+	NSParameterAssert(0 != columns);
+	
+	NSArray			*streamColumns	= streamColumnDescriptions();
+	NSMutableArray	*assignments	= [NSMutableArray array];
+	NSUInteger		i;
+	
+	for(i = 0; i < [streamColumns count]; ++i) {
+		if(columns & (1ULL << i)) {
+			NSString *name = [[streamColumns objectAtIndex:i] objectAtIndex:0];
+			[assignments addObject:[NSString stringWithFormat:@"%@ = :%@", name, name]];
+		}
+	}
+	
+	return [NSString stringWithFormat:@"UPDATE 'streams' SET %@ WHERE id = :id;", [assignments componentsJoinedByString:@", "]];
+}
+
+- (sqlite3_stmt *) updateStatementForColumns:(uint64_t)columns
+{
+	NSParameterAssert(0 != columns);
+	
+	// Generated statements live in _sql so they are finalized along with the others
+	NSString		*action			= [NSString stringWithFormat:@"update_stream_%016llx", columns];
+	PointerWrapper	*wrappedPtr		= [_sql valueForKey:action];
+	
+	if(nil != wrappedPtr)
+		return (sqlite3_stmt *)[wrappedPtr statementPointer];
+	
+	NSString		*sql			= [self updateSQLForColumns:columns];
+	sqlite3_stmt	*statement		= NULL;
+	int				result			= sqlite3_prepare_v2(_db, [sql UTF8String], -1, &statement, NULL);
+	
+	NSAssert2(SQLITE_OK == result, @"Unable to prepare \"%@\" (%@).", sql, [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	
+	[_sql setValue:[PointerWrapper pointerWrapperWithPointer:statement] forKey:action];
+	
+	return statement;
+}
+
 - (void) doDeleteStream:(AudioStream *)stream
 {
 	NSParameterAssert(nil != stream);
@@ -997,6 +1635,151 @@
 	NSMapRemove(_registeredStreams, (void *)objectID);
 }
 
+#pragma mark Background Writes
+
+// The values are copied so they can be bound on the writer queue
+- (NSMutableDictionary *) bindingsForStream:(AudioStream *)stream columns:(uint64_t)columns
+{
+	NSParameterAssert(nil != stream);
+	
+	NSArray				*streamColumns	= streamColumnDescriptions();
+	NSMutableDictionary	*bindings		= [NSMutableDictionary dictionary];
+	NSUInteger			i;
+	
+	for(i = 0; i < [streamColumns count]; ++i) {
+		if(0 == (columns & (1ULL << i)))
+			continue;
+		
+		NSArray *column = [streamColumns objectAtIndex:i];
+		[bindings setObject:parameterValue(stream, [column objectAtIndex:1], (eObjectType)[[column objectAtIndex:2] intValue]) 
+					 forKey:[@":" stringByAppendingString:[column objectAtIndex:0]]];
+	}
+	
+	return bindings;
+}
+
+- (void) queueInsertStreams:(NSArray *)streams
+{
+	NSParameterAssert(nil != streams);
+	
+	NSMutableArray	*bindings		= [NSMutableArray arrayWithCapacity:[streams count]];
+	uint64_t		allColumns		= (1ULL << [streamColumnDescriptions() count]) - 1;
+	
+	for(AudioStream *stream in streams) {
+		[bindings addObject:[self bindingsForStream:stream columns:allColumns]];
+		
+		// Until the row is written, lookups by URL find the stream here
+		NSURL			*url				= [stream valueForKey:StreamURLKey];
+		NSMutableArray	*pendingStreams		= [_pendingStreams objectForKey:url];
+		
+		if(nil == pendingStreams) {
+			pendingStreams = [NSMutableArray array];
+			[_pendingStreams setObject:pendingStreams forKey:url];
+		}
+		
+		[pendingStreams addObject:stream];
+	}
+	
+	[[CollectionManager manager] performBackgroundWritesForAction:@"insert_stream" bindings:bindings completionHandler:^(NSArray *rowIDs) {
+		[self didInsertStreams:streams rowIDs:rowIDs];
+	}];
+}
+
+- (void) queueUpdateStreams:(NSArray *)streams columns:(uint64_t)columns
+{
+	NSParameterAssert(nil != streams);
+	
+	// The values are captured when the write is queued, so the streams are saved as of now
+	if(0 != columns) {
+		NSString		*action			= [NSString stringWithFormat:@"update_stream_%016llx", columns];
+		NSMutableArray	*bindings		= [NSMutableArray arrayWithCapacity:[streams count]];
+		
+		for(AudioStream *stream in streams) {
+			NSMutableDictionary *binding = [self bindingsForStream:stream columns:columns];
+			[binding setObject:parameterValue(stream, ObjectIDKey, eObjectTypeUnsignedInt) forKey:@":id"];
+			[bindings addObject:binding];
+		}
+		
+		[[CollectionManager manager] registerSQL:[self updateSQLForColumns:columns] forAction:action];
+		[[CollectionManager manager] performBackgroundWritesForAction:action bindings:bindings completionHandler:nil];
+	}
+	
+	for(AudioStream *stream in streams)
+		[stream synchronizeSavedValuesWithChangedValues];
+}
+
+// Called on the main thread once the rows are written
+- (void) didInsertStreams:(NSArray *)streams rowIDs:(NSArray *)rowIDs
+{
+	NSParameterAssert(nil != streams);
+	
+	// Written or not, the streams are no longer pending
+	for(AudioStream *stream in streams) {
+		NSURL			*url				= [stream valueForKey:StreamURLKey];
+		NSMutableArray	*pendingStreams		= [_pendingStreams objectForKey:url];
+		
+		[pendingStreams removeObjectIdenticalTo:stream];
+		if(0 == [pendingStreams count])
+			[_pendingStreams removeObjectForKey:url];
+	}
+	
+	// The failure was reported when the transaction was rolled back
+	if(nil == rowIDs)
+		return;
+	
+	NSMutableArray	*insertedStreams	= [NSMutableArray arrayWithCapacity:[streams count]];
+	NSUInteger		i;
+	
+	for(i = 0; i < [streams count]; ++i) {
+		id			rowID		= [rowIDs objectAtIndex:i];
+		AudioStream	*stream		= [streams objectAtIndex:i];
+		
+		if([NSNull null] == rowID)
+			continue;
+		
+		// A stream loaded from the committed row before now may already be in the library
+		if(nil != [stream valueForKey:ObjectIDKey] && NSNotFound != [_cachedStreams indexOfObjectIdenticalTo:stream])
+			continue;
+		
+		[stream initValue:rowID forKey:ObjectIDKey];
+		NSMapInsert(_registeredStreams, (void *)[rowID unsignedIntegerValue], (__bridge void *)stream);
+		
+		[insertedStreams addObject:stream];
+	}
+	
+	if(0 == [insertedStreams count])
+		return;
+	
+	NSIndexSet *indexes = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange([_cachedStreams count], [insertedStreams count])];
+	
+	[self willChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"streams"];
+	[_cachedStreams addObjectsFromArray:insertedStreams];
+	[self didChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"streams"];
+	
+	if(1 == [insertedStreams count])
+		[[NSNotificationCenter defaultCenter] postNotificationName:AudioStreamAddedToLibraryNotification 
+															object:self 
+														  userInfo:[NSDictionary dictionaryWithObject:[insertedStreams lastObject] forKey:AudioStreamObjectKey]];
+	else
+		[[NSNotificationCenter defaultCenter] postNotificationName:AudioStreamsAddedToLibraryNotification 
+															object:self
+														  userInfo:[NSDictionary dictionaryWithObject:insertedStreams forKey:AudioStreamsObjectKey]];
+}
+
+- (AudioStream *) pendingStreamForURL:(NSURL *)url startingFrame:(NSNumber *)startingFrame frameCount:(NSNumber *)frameCount
+{
+	NSParameterAssert(nil != url);
+	NSParameterAssert(nil != startingFrame);
+	NSParameterAssert(nil != frameCount);
+	
+	for(AudioStream *stream in [_pendingStreams objectForKey:url]) {
+		if([[stream valueForKey:StreamStartingFrameKey] longLongValue] == [startingFrame longLongValue] && [[stream valueForKey:StreamFrameCountKey] unsignedIntValue] == [frameCount unsignedIntValue])
+			return stream;
+	}
+	
+	return nil;
+}
+
 - (NSArray *) streamKeys
 {
 	@synchronized(self) {
@@ -1050,6 +1833,10 @@
 				PropertiesSampleRateKey,
 				PropertiesTotalFramesKey,
 				PropertiesBitrateKey,
+
+				FileSizeKey,
+				FileModificationDateKey,
+				FileInodeKey,
 								
 				nil];			
 		}
@@ -44,6 +44,20 @@ enum {
 	sqlite3					*_db;				// The database
 	NSMutableDictionary		*_sql;				// Prepared SQL statements
 	
+	sqlite3					*_writerDB;			// Separate connection for background writes, if the journal mode allows one
+	dispatch_queue_t		_writerQueue;		// Serializes use of the writer connection
+	NSMutableDictionary		*_writeSQL;			// Prepared SQL statements for background writes
+	NSMutableDictionary		*_generatedSQL;		// SQL for background writes that isn't in the bundle
+	NSMutableArray			*_pendingWrites;	// Writes waiting to be performed
+	NSMutableArray			*_finishedWrites;	// Committed writes whose completion handlers haven't run
+	
+	sqlite3					*_diskDB;			// The file backing an in-memory database, if any
+	dispatch_queue_t		_flushQueue;		// Serializes copying the in-memory database to disk
+	dispatch_source_t		_flushTimer;		// Fires every databaseFlushInterval seconds
+	int						_flushedChanges;	// Value of sqlite3_total_changes() at the last flush
+	int						_flushedSchemaVersion;	// Schema version at the last full copy, or -1 if one is needed
+	BOOL					_flushCopiesChanges;	// Whether changed rows are logged so a flush copies only those
+	
 	AudioStreamManager		*_streamManager;
 	PlaylistManager			*_playlistManager;
 	SmartPlaylistManager	*_smartPlaylistManager;
@@ -69,9 +83,16 @@ enum {
 // Database connection
 - (BOOL) updateDatabaseIfNeeded:(NSString *)databasePath error:(NSError **)error;
 - (BOOL) connectToDatabase:(NSString *)databasePath error:(NSError **)error;
+// If inMemory is YES the database at databasePath is loaded into memory and all queries run there;
+// the rows changed since the last flush are copied back to databasePath every databaseFlushInterval seconds
+// and on disconnect
+- (BOOL) connectToDatabase:(NSString *)databasePath inMemory:(BOOL)inMemory error:(NSError **)error;
 - (BOOL) disconnectFromDatabase:(NSError **)error;
 - (BOOL) isConnectedToDatabase;
 
+// Writes any unsaved changes in an in-memory database to disk, and waits until they are written
+- (void) flushDatabaseToDisk;
+
 // ========================================
 // Mass updating (transaction) support
 - (void) beginUpdate;
@@ -95,6 +116,35 @@ enum {
 
 @end
 
+// ========================================
+// Writes are queued and performed on a separate connection, several to a
+// transaction, so they never hold up the main thread.  Stream inserts and
+// updates go this way, as do seek tables, fingerprints and the like.
+// Completion handlers run on the main thread after the transaction commits,
+// in the order the writes were queued, with the row ID of each write (NSNull
+// if it failed) or nil if the transaction failed.  A batch that finds the
+// database busy is retried a few times, and one that still fails is reported
+// to the user.  Without a separate connection (in-memory databases or journal
+// modes other than WAL) writes are performed immediately on the main
+// connection and the handler called before returning.  The bindings map named
+// SQL parameters to NSNumber, NSString, NSData or NSNull values.
+// Readers see the last committed state without waiting for queued writes.
+// Only callers that need the row ID of something just inserted, such as the
+// playlist entries and the play queue, call waitForBackgroundWrites, which on
+// the main thread also runs the completion handlers of the finished writes.
+// It must not be called while the main connection has a transaction open,
+// since the writer can't commit until that transaction ends.
+@interface CollectionManager (BackgroundWriting)
+- (BOOL) writesInBackground;
+
+// SQL generated at run time is registered under an action name before use
+- (void) registerSQL:(NSString *)sql forAction:(NSString *)action;
+
+- (void) performBackgroundWriteForAction:(NSString *)action bindings:(NSDictionary *)bindings;
+- (void) performBackgroundWritesForAction:(NSString *)action bindings:(NSArray *)bindings completionHandler:(void (^)(NSArray *rowIDs))handler;
+- (void) waitForBackgroundWrites;
+@end
+
 @interface CollectionManager (TransactionSupport)
 - (void) doBeginTransaction;
 - (void) doCommitTransaction;
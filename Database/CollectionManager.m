@@ -30,6 +30,15 @@
 
 #import "SQLiteUtilityFunctions.h"
 #import "PointerWrapper.h"
+#import "AudioLibrary.h"
+
+// Pages copied to disk per step when flushing an in-memory database, and the pause between steps
+#define FLUSH_PAGES_PER_STEP		1024
+#define FLUSH_STEP_INTERVAL			1000
+
+// Attempts at a batch of background writes while another connection holds the database, and the pause between them (longer each time)
+#define WRITE_BATCH_ATTEMPTS		5
+#define WRITE_RETRY_INTERVAL		0.25
 
 @interface CollectionManager (private)
 BOOL 
@@ -79,7 +88,10 @@ executeSQLFromFileInBundle(sqlite3		*db,
 		if(NULL == statement)
 			break;
 		
+		// A row is also a failure, so checks can report an outdated schema by matching it
 		if(SQLITE_DONE != sqlite3_step(statement)) {
+			sqlite3_finalize(statement);
+			
 			if(nil != error) {
 				NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
 				
@@ -115,6 +127,61 @@ executeSQLFromFileInBundle(sqlite3		*db,
 	return YES;
 }
 
+// Returns the schema version of db's main database, or -1 on error
+static int
+schemaVersion(sqlite3 *db)
+{
+	NSCParameterAssert(NULL != db);
+	
+	sqlite3_stmt	*statement		= NULL;
+	int				version			= -1;
+	
+	if(SQLITE_OK == sqlite3_prepare_v2(db, "PRAGMA main.schema_version", -1, &statement, NULL)) {
+		if(SQLITE_ROW == sqlite3_step(statement))
+			version = sqlite3_column_int(statement, 0);
+		sqlite3_finalize(statement);
+	}
+	
+	return version;
+}
+
+// Binds the values in bindings to the named parameters of statement
+static int
+bindNamedParameters(sqlite3_stmt	*statement,
+					NSDictionary	*bindings)
+{
+	NSCParameterAssert(NULL != statement);
+	
+	int result = SQLITE_OK;
+	
+	for(NSString *name in bindings) {
+		int		parameterIndex		= sqlite3_bind_parameter_index(statement, [name UTF8String]);
+		id		value				= [bindings objectForKey:name];
+		
+		if(0 == parameterIndex)
+			return SQLITE_RANGE;
+		
+		if([value isKindOfClass:[NSNumber class]]) {
+			const char *type = [value objCType];
+			if(0 == strcmp(type, @encode(double)) || 0 == strcmp(type, @encode(float)))
+				result = sqlite3_bind_double(statement, parameterIndex, [value doubleValue]);
+			else
+				result = sqlite3_bind_int64(statement, parameterIndex, [value longLongValue]);
+		}
+		else if([value isKindOfClass:[NSString class]])
+			result = sqlite3_bind_text(statement, parameterIndex, [value UTF8String], -1, SQLITE_TRANSIENT);
+		else if([value isKindOfClass:[NSData class]])
+			result = sqlite3_bind_blob(statement, parameterIndex, [value bytes], (int)[value length], SQLITE_TRANSIENT);
+		else
+			result = sqlite3_bind_null(statement, parameterIndex);
+		
+		if(SQLITE_OK != result)
+			return result;
+	}
+	
+	return result;
+}
+
 // ========================================
 // Symbolic constants
 NSString *const DatabaseErrorDomain = @"org.sbooth.Play.ErrorDomain.Database";
@@ -126,6 +193,11 @@ NSString *const DatabaseErrorDomain = @"org.sbooth.Play.ErrorDomain.Database";
 - (BOOL) createPlaylistEntryTable:(NSError **)error;
 - (BOOL) createSmartPlaylistTable:(NSError **)error;
 - (BOOL) createWatchFolderTable:(NSError **)error;
+- (BOOL) createStreamSearchTable:(NSError **)error;
+- (BOOL) createStreamFingerprintTable:(NSError **)error;
+- (BOOL) createSeekTableTable:(NSError **)error;
+- (BOOL) createStreamSilenceTable:(NSError **)error;
+- (BOOL) createPlayQueueTable:(NSError **)error;
 - (BOOL) createTriggers:(NSError **)error;
 
 - (BOOL) prepareSQL:(NSError **)error;
@@ -133,6 +205,29 @@ NSString *const DatabaseErrorDomain = @"org.sbooth.Play.ErrorDomain.Database";
 - (sqlite3_stmt *) preparedStatementForAction:(NSString *)action;
 @end
 
+@interface CollectionManager (BackgroundWritingPrivate)
+- (BOOL) applyConnectionProfileToDatabase:(sqlite3 *)db;
+
+- (BOOL) openWriterConnection:(NSString *)databasePath;
+- (void) closeWriterConnection;
+
+- (void) performPendingWrites;
+- (int) performWrites:(NSArray *)writes rowIDs:(NSMutableArray *)rowIDs;
+- (void) reportFailedWrites:(NSUInteger)count result:(int)result;
+- (BOOL) performWriteForAction:(NSString *)action bindings:(NSDictionary *)bindings;
+- (void) runBackgroundWriteCompletions;
+- (sqlite3_stmt *) writeStatementForAction:(NSString *)action;
+- (void) finalizeWriteSQL;
+@end
+
+@interface CollectionManager (InMemoryDatabasePrivate)
+- (BOOL) loadDatabaseIntoMemory:(NSString *)databasePath error:(NSError **)error;
+- (void) startFlushTimer;
+- (void) stopFlushTimer;
+- (void) flushChangesToDisk;
+- (BOOL) copyDatabaseToDisk;
+@end
+
 // ========================================
 // The singleton instance
 // ========================================
@@ -151,8 +246,15 @@ static CollectionManager *collectionManagerInstance = nil;
 
 - (id) init
 {
-	if((self = [super init]))
-		_sql = [[NSMutableDictionary alloc] init];
+	if((self = [super init])) {
+		_sql			= [[NSMutableDictionary alloc] init];
+		_writeSQL		= [[NSMutableDictionary alloc] init];
+		_generatedSQL	= [[NSMutableDictionary alloc] init];
+		_pendingWrites	= [[NSMutableArray alloc] init];
+		_finishedWrites	= [[NSMutableArray alloc] init];
+		_writerQueue	= dispatch_queue_create("org.sbooth.Play.CollectionManager.writer", DISPATCH_QUEUE_SERIAL);
+		_flushQueue		= dispatch_queue_create("org.sbooth.Play.CollectionManager.flush", DISPATCH_QUEUE_SERIAL);
+	}
 	return self;
 }
 
@@ -259,7 +361,38 @@ static CollectionManager *collectionManagerInstance = nil;
 		// Add the missing NSURL bookmarks
 		rescanURLs = YES;
 	}
-	
+
+	// The fourth database upgrade clustered the playlist entries on (playlist_id, stream_index)
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_playlist_entry_index_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_playlist_entry_index", error))
+			return NO;
+	}
+
+	// The fifth database upgrade added the file size, modification date and inode seen at the last scan
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_file_stamp_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_file_stamps", error))
+			return NO;
+	}
+
+	// The sixth database upgrade added the full-text search index, which is populated from the existing streams
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_stream_search_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_stream_search", error))
+			return NO;
+	}
+
+	// The seventh database upgrade added the date to the full-text search index so year searches match
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_stream_search_date_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_stream_search_date", error))
+			return NO;
+	}
+
+	// The eighth database upgrade replaced the seek table trigger, which ran before the stream was deleted
+	// and so never found the seek table orphaned, and removes the seek tables it left behind
+	if(NO == executeSQLFromFileInBundle(db, @"check_for_seek_table_trigger_support", error)) {
+		if(NO == executeSQLFromFileInBundle(db, @"upgrade_database_for_seek_table_trigger", error))
+			return NO;
+	}
+
 	if(SQLITE_OK != sqlite3_close(db)) {
 		if(nil != error) {
 			NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
@@ -336,13 +469,18 @@ static CollectionManager *collectionManagerInstance = nil;
 }
 
 - (BOOL) connectToDatabase:(NSString *)databasePath error:(NSError **)error
+{
+	return [self connectToDatabase:databasePath inMemory:NO error:error];
+}
+
+- (BOOL) connectToDatabase:(NSString *)databasePath inMemory:(BOOL)inMemory error:(NSError **)error
 {
 	NSParameterAssert(nil != databasePath);
 	
 	if([self isConnectedToDatabase] && NO == [self disconnectFromDatabase:error])
 		return NO;
 	
-	if(SQLITE_OK != sqlite3_open([databasePath UTF8String], &_db)) {
+	if(SQLITE_OK != sqlite3_open((inMemory ? ":memory:" : [databasePath UTF8String]), &_db)) {
 		if(nil != error) {
 			NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
 			
@@ -357,10 +495,25 @@ static CollectionManager *collectionManagerInstance = nil;
 		
 		return NO;
 	}
+	
+	if(inMemory) {
+		if(NO == [self loadDatabaseIntoMemory:databasePath error:error])
+			return NO;
+	}
+	// A separate connection for background writes only makes sense if readers don't block on it
+	else if([self applyConnectionProfileToDatabase:_db] && [[NSUserDefaults standardUserDefaults] boolForKey:@"useBackgroundDatabaseWriter"])
+		[self openWriterConnection:databasePath];
 		
 	if(NO == [self createTables:error])
 		return NO;
 	
+	// Without the log every flush copies the whole database
+	if(inMemory) {
+		_flushCopiesChanges = startLoggingChanges(_db);
+		if(NO == _flushCopiesChanges)
+			NSLog(@"CollectionManager: Unable to log changes to the database (%@)", [NSString stringWithUTF8String:sqlite3_errmsg(_db)]);
+	}
+	
 	if(NO == [self prepareSQL:error])
 		return NO;
 	
@@ -372,6 +525,9 @@ static CollectionManager *collectionManagerInstance = nil;
 		return NO;
 	if(NO == [[self watchFolderManager] connectedToDatabase:_db error:error])
 		return NO;
+	
+	if(inMemory)
+		[self startFlushTimer];
 
 	return YES;
 }
@@ -380,6 +536,21 @@ static CollectionManager *collectionManagerInstance = nil;
 {
 	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
 	
+	// Finish any queued writes before the connections go away
+	[self waitForBackgroundWrites];
+	[self closeWriterConnection];
+	[self finalizeWriteSQL];
+	
+	if(NULL != _diskDB) {
+		[self stopFlushTimer];
+		[self flushDatabaseToDisk];
+		
+		if(SQLITE_OK != sqlite3_close(_diskDB))
+			NSLog(@"CollectionManager: Unable to close the database file (%@)", [NSString stringWithUTF8String:sqlite3_errmsg(_diskDB)]);
+		
+		_diskDB = NULL;
+	}
+	
 	if(NO == [[self streamManager] disconnectedFromDatabase:error])
 		return NO;
 	if(NO == [[self playlistManager] disconnectedFromDatabase:error])
@@ -419,6 +590,19 @@ static CollectionManager *collectionManagerInstance = nil;
 	return NULL != _db;
 }
 
+- (void) flushDatabaseToDisk
+{
+	if(NULL == _diskDB)
+		return;
+	
+	// The flush waits for open transactions to finish, which would never happen
+	NSAssert(0 != sqlite3_get_autocommit(_db), @"Unable to flush the database during a transaction");
+	
+	dispatch_sync(_flushQueue, ^{
+		[self flushChangesToDisk];
+	});
+}
+
 #pragma mark Mass updating (transaction) support
 
 - (void) beginUpdate
@@ -536,6 +720,16 @@ static CollectionManager *collectionManagerInstance = nil;
 		return NO;
 	if(NO == [self createWatchFolderTable:error])
 		return NO;
+	if(NO == [self createStreamSearchTable:error])
+		return NO;
+	if(NO == [self createStreamFingerprintTable:error])
+		return NO;
+	if(NO == [self createSeekTableTable:error])
+		return NO;
+	if(NO == [self createStreamSilenceTable:error])
+		return NO;
+	if(NO == [self createPlayQueueTable:error])
+		return NO;
 	
 	if(NO == [self createTriggers:error])
 		return NO;
@@ -578,11 +772,46 @@ static CollectionManager *collectionManagerInstance = nil;
 	return executeSQLFromFileInBundle(_db, @"create_watch_folder_table", error);
 }
 
+- (BOOL) createStreamSearchTable:(NSError **)error
+{
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	
+	return executeSQLFromFileInBundle(_db, @"create_stream_search_table", error);
+}
+
+- (BOOL) createStreamFingerprintTable:(NSError **)error
+{
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	
+	return executeSQLFromFileInBundle(_db, @"create_stream_fingerprint_table", error);
+}
+
+- (BOOL) createSeekTableTable:(NSError **)error
+{
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	
+	return executeSQLFromFileInBundle(_db, @"create_seek_table_table", error);
+}
+
+- (BOOL) createStreamSilenceTable:(NSError **)error
+{
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	
+	return executeSQLFromFileInBundle(_db, @"create_stream_silence_table", error);
+}
+
+- (BOOL) createPlayQueueTable:(NSError **)error
+{
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	
+	return executeSQLFromFileInBundle(_db, @"create_play_queue_table", error);
+}
+
 - (BOOL) createTriggers:(NSError **)error
 {
 	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
 	
-	if(NO == executeSQLFromFileInBundle(_db, @"delete_playlist_trigger", error) || NO == executeSQLFromFileInBundle(_db, @"delete_stream_trigger", error))
+	if(NO == executeSQLFromFileInBundle(_db, @"delete_playlist_trigger", error) || NO == executeSQLFromFileInBundle(_db, @"delete_stream_trigger", error) || NO == executeSQLFromFileInBundle(_db, @"stream_search_triggers", error) || NO == executeSQLFromFileInBundle(_db, @"delete_stream_fingerprint_trigger", error) || NO == executeSQLFromFileInBundle(_db, @"delete_seek_table_trigger", error) || NO == executeSQLFromFileInBundle(_db, @"delete_stream_silence_trigger", error) || NO == executeSQLFromFileInBundle(_db, @"delete_play_queue_trigger", error))
 		return NO;
 	else
 		return YES;
@@ -664,6 +893,525 @@ static CollectionManager *collectionManagerInstance = nil;
 @end
 
 
+@implementation CollectionManager (BackgroundWriting)
+
+- (BOOL) writesInBackground
+{
+	return (NULL != _writerDB);
+}
+
+- (void) registerSQL:(NSString *)sql forAction:(NSString *)action
+{
+	NSParameterAssert(nil != sql);
+	NSParameterAssert(nil != action);
+	
+	@synchronized(_generatedSQL) {
+		[_generatedSQL setObject:sql forKey:action];
+	}
+}
+
+- (void) performBackgroundWriteForAction:(NSString *)action bindings:(NSDictionary *)bindings
+{
+	NSParameterAssert(nil != bindings);
+	
+	[self performBackgroundWritesForAction:action bindings:[NSArray arrayWithObject:bindings] completionHandler:nil];
+}
+
+- (void) performBackgroundWritesForAction:(NSString *)action bindings:(NSArray *)bindings completionHandler:(void (^)(NSArray *rowIDs))handler
+{
+	NSParameterAssert(nil != action);
+	NSParameterAssert(nil != bindings);
+	
+	NSAssert([self isConnectedToDatabase], NSLocalizedStringFromTable(@"Not connected to database", @"Database", @""));
+	
+	if(NULL == _writerDB) {
+		NSMutableArray *rowIDs = [NSMutableArray arrayWithCapacity:[bindings count]];
+		
+		for(NSDictionary *binding in bindings) {
+			if([self performWriteForAction:action bindings:binding])
+				[rowIDs addObject:@((NSInteger)sqlite3_last_insert_rowid(_db))];
+			else
+				[rowIDs addObject:[NSNull null]];
+		}
+		
+		if(nil != handler)
+			handler(rowIDs);
+		return;
+	}
+	
+	BOOL scheduleWrite = NO;
+	
+	// Writes that arrive while a batch is pending join it
+	@synchronized(_pendingWrites) {
+		scheduleWrite = (0 == [_pendingWrites count]);
+		[_pendingWrites addObject:[NSArray arrayWithObjects:action, bindings, (nil != handler ? (id)[handler copy] : (id)[NSNull null]), nil]];
+	}
+	
+	if(scheduleWrite)
+		dispatch_async(_writerQueue, ^{
+			[self performPendingWrites];
+		});
+}
+
+- (void) waitForBackgroundWrites
+{
+	if(NULL == _writerDB)
+		return;
+	
+	NSAssert(0 != sqlite3_get_autocommit(_db), @"Waiting for background writes with a transaction open would deadlock");
+	
+	dispatch_sync(_writerQueue, ^{});
+	
+	// The handlers for what was just written are already queued on the main thread, but callers expect their effects now
+	if([NSThread isMainThread])
+		[self runBackgroundWriteCompletions];
+}
+
+@end
+
+@implementation CollectionManager (BackgroundWritingPrivate)
+
+- (BOOL) applyConnectionProfileToDatabase:(sqlite3 *)db
+{
+	NSParameterAssert(NULL != db);
+	
+	NSUserDefaults	*defaults		= [NSUserDefaults standardUserDefaults];
+	NSString		*journalMode	= [defaults stringForKey:@"databaseJournalMode"];
+	sqlite3_stmt	*statement		= NULL;
+	BOOL			usesWAL			= NO;
+	
+	sqlite3_busy_timeout(db, (int)[defaults integerForKey:@"databaseBusyTimeout"]);
+	
+	NSArray *pragmas = [NSArray arrayWithObjects:
+		[NSString stringWithFormat:@"PRAGMA synchronous = %@", [defaults stringForKey:@"databaseSynchronous"]],
+		[NSString stringWithFormat:@"PRAGMA cache_size = %ld", (long)[defaults integerForKey:@"databaseCacheSize"]],
+		[NSString stringWithFormat:@"PRAGMA mmap_size = %lld", [[defaults objectForKey:@"databaseMmapSize"] longLongValue]],
+		nil];
+	
+	// A setting that can't be applied isn't fatal, the database just runs with SQLite's default
+	for(NSString *pragma in pragmas)
+		if(SQLITE_OK != sqlite3_exec(db, [pragma UTF8String], NULL, NULL, NULL))
+			NSLog(@"CollectionManager: Unable to apply \"%@\" (%@)", pragma, [NSString stringWithUTF8String:sqlite3_errmsg(db)]);
+	
+	if(0 == [journalMode length])
+		return NO;
+	
+	// In-memory databases silently keep their own journal mode
+	NSString *sql = [NSString stringWithFormat:@"PRAGMA journal_mode = %@", journalMode];
+	if(SQLITE_OK == sqlite3_prepare_v2(db, [sql UTF8String], -1, &statement, NULL)) {
+		if(SQLITE_ROW == sqlite3_step(statement))
+			usesWAL = (0 == sqlite3_stricmp("wal", (const char *)sqlite3_column_text(statement, 0)));
+		sqlite3_finalize(statement);
+	}
+	else
+		NSLog(@"CollectionManager: Unable to set the journal mode to %@ (%@)", journalMode, [NSString stringWithUTF8String:sqlite3_errmsg(db)]);
+	
+	return usesWAL;
+}
+
+- (BOOL) openWriterConnection:(NSString *)databasePath
+{
+	NSParameterAssert(nil != databasePath);
+	
+	if(SQLITE_OK != sqlite3_open_v2([databasePath fileSystemRepresentation], &_writerDB, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL)) {
+		NSLog(@"CollectionManager: Unable to open a writer connection (%@)", [NSString stringWithUTF8String:sqlite3_errmsg(_writerDB)]);
+		sqlite3_close(_writerDB);
+		_writerDB = NULL;
+		return NO;
+	}
+	
+	[self applyConnectionProfileToDatabase:_writerDB];
+	
+	return YES;
+}
+
+- (void) closeWriterConnection
+{
+	if(NULL == _writerDB)
+		return;
+	
+	// Statements are prepared against the writer connection and must be finalized first
+	[self finalizeWriteSQL];
+	
+	if(SQLITE_OK != sqlite3_close(_writerDB))
+		NSLog(@"CollectionManager: Unable to close the writer connection (%@)", [NSString stringWithUTF8String:sqlite3_errmsg(_writerDB)]);
+	
+	_writerDB = NULL;
+}
+
+// Called on the writer queue
+- (void) performPendingWrites
+{
+	NSArray *writes = nil;
+	
+	@synchronized(_pendingWrites) {
+		writes = [_pendingWrites copy];
+		[_pendingWrites removeAllObjects];
+	}
+	
+	if(0 == [writes count])
+		return;
+	
+	@autoreleasepool {
+		NSMutableArray	*completions	= [NSMutableArray array];
+		NSUInteger		attempt			= 0;
+		int				result			= SQLITE_OK;
+		
+		// The busy timeout has already run out, so back off before trying the whole batch again
+		for(;;) {
+			[completions removeAllObjects];
+			result = [self performWrites:writes rowIDs:completions];
+			
+			if((SQLITE_BUSY != result && SQLITE_LOCKED != result) || WRITE_BATCH_ATTEMPTS == ++attempt)
+				break;
+			
+			[NSThread sleepForTimeInterval:WRITE_RETRY_INTERVAL * attempt];
+		}
+		
+		BOOL committed = (SQLITE_OK == result);
+		if(NO == committed) {
+			NSUInteger count = [writes count];
+			dispatch_async(dispatch_get_main_queue(), ^{
+				[self reportFailedWrites:count result:result];
+			});
+		}
+		
+		// Every handler runs, with nil for writes that were rolled back
+		NSMutableArray *finishedWrites = [NSMutableArray array];
+		for(NSUInteger i = 0; i < [writes count]; ++i) {
+			id handler = [[writes objectAtIndex:i] objectAtIndex:2];
+			if([NSNull null] == handler)
+				continue;
+			
+			[finishedWrites addObject:[NSArray arrayWithObjects:handler, (committed ? [completions objectAtIndex:i] : [NSNull null]), nil]];
+		}
+		
+		if(0 == [finishedWrites count])
+			return;
+		
+		@synchronized(_finishedWrites) {
+			[_finishedWrites addObjectsFromArray:finishedWrites];
+		}
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			[self runBackgroundWriteCompletions];
+		});
+	}
+}
+
+// Called on the writer queue, returns the result of the COMMIT or of the BEGIN if the transaction couldn't start
+- (int) performWrites:(NSArray *)writes rowIDs:(NSMutableArray *)rowIDs
+{
+	NSParameterAssert(nil != writes);
+	NSParameterAssert(nil != rowIDs);
+	
+	int result = sqlite3_exec(_writerDB, "BEGIN IMMEDIATE TRANSACTION", NULL, NULL, NULL);
+	if(SQLITE_OK != result) {
+		NSLog(@"CollectionManager: Unable to begin a background write (%@)", [NSString stringWithUTF8String:sqlite3_errmsg(_writerDB)]);
+		return result;
+	}
+	
+	for(NSArray *write in writes) {
+		NSString		*action			= [write objectAtIndex:0];
+		NSArray			*bindings		= [write objectAtIndex:1];
+		NSMutableArray	*writeRowIDs	= [NSMutableArray arrayWithCapacity:[bindings count]];
+		
+		for(NSDictionary *binding in bindings) {
+			if([self performWriteForAction:action bindings:binding])
+				[writeRowIDs addObject:@((NSInteger)sqlite3_last_insert_rowid(_writerDB))];
+			else
+				[writeRowIDs addObject:[NSNull null]];
+		}
+		
+		[rowIDs addObject:writeRowIDs];
+	}
+	
+	result = sqlite3_exec(_writerDB, "COMMIT TRANSACTION", NULL, NULL, NULL);
+	if(SQLITE_OK != result) {
+		NSLog(@"CollectionManager: Unable to commit %lu background writes (%@)", (unsigned long)[writes count], [NSString stringWithUTF8String:sqlite3_errmsg(_writerDB)]);
+		sqlite3_exec(_writerDB, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+	}
+	
+	return result;
+}
+
+// Called on the main thread
+- (void) reportFailedWrites:(NSUInteger)count result:(int)result
+{
+	// A database that stays locked fails batch after batch, but one alert is enough
+	static BOOL sPresentingError = NO;
+	if(sPresentingError)
+		return;
+	
+	NSLog(@"CollectionManager: %lu background writes were lost (%@)", (unsigned long)count, [NSString stringWithUTF8String:sqlite3_errstr(result)]);
+	
+	NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
+	
+	[errorDictionary setObject:NSLocalizedStringFromTable(@"Changes to the library could not be saved.", @"Errors", @"") forKey:NSLocalizedDescriptionKey];
+	[errorDictionary setObject:NSLocalizedStringFromTable(@"Unable to write to the database", @"Errors", @"") forKey:NSLocalizedFailureReasonErrorKey];
+	[errorDictionary setObject:[NSString stringWithFormat:NSLocalizedStringFromTable(@"The SQLite error was: %@", @"Errors", @""), [NSString stringWithUTF8String:sqlite3_errstr(result)]] forKey:NSLocalizedRecoverySuggestionErrorKey];
+	
+	NSError *error = [NSError errorWithDomain:DatabaseErrorDomain 
+										 code:DatabaseSQLiteError 
+									 userInfo:errorDictionary];
+	
+	sPresentingError = YES;
+	[[AudioLibrary library] presentError:error];
+	sPresentingError = NO;
+}
+
+- (BOOL) performWriteForAction:(NSString *)action bindings:(NSDictionary *)bindings
+{
+	sqlite3			*db				= (NULL != _writerDB ? _writerDB : _db);
+	sqlite3_stmt	*statement		= [self writeStatementForAction:action];
+	int				result			= SQLITE_OK;
+	
+	if(NULL == statement) {
+		NSLog(@"CollectionManager: Unable to prepare the SQL for \"%@\" (%@)", action, [NSString stringWithUTF8String:sqlite3_errmsg(db)]);
+		return NO;
+	}
+	
+	// Failures are logged rather than asserted, since this usually runs on the writer queue
+	result = bindNamedParameters(statement, bindings);
+	if(SQLITE_OK == result)
+		result = sqlite3_step(statement);
+	
+	if(SQLITE_DONE != result)
+		NSLog(@"CollectionManager: Unable to perform \"%@\" (%@)", action, [NSString stringWithUTF8String:sqlite3_errmsg(db)]);
+	
+	sqlite3_reset(statement);
+	sqlite3_clear_bindings(statement);
+	
+	return (SQLITE_DONE == result);
+}
+
+// Called on the main thread
+- (void) runBackgroundWriteCompletions
+{
+	NSArray *finishedWrites = nil;
+	
+	@synchronized(_finishedWrites) {
+		finishedWrites = [_finishedWrites copy];
+		[_finishedWrites removeAllObjects];
+	}
+	
+	for(NSArray *finishedWrite in finishedWrites) {
+		void (^handler)(NSArray *)	= [finishedWrite objectAtIndex:0];
+		id rowIDs					= [finishedWrite objectAtIndex:1];
+		
+		handler([NSNull null] == rowIDs ? nil : rowIDs);
+	}
+}
+
+- (sqlite3_stmt *) writeStatementForAction:(NSString *)action
+{
+	sqlite3_stmt *statement = (sqlite3_stmt *)[[_writeSQL valueForKey:action] statementPointer];
+	if(NULL != statement)
+		return statement;
+	
+	NSString *sql = nil;
+	@synchronized(_generatedSQL) {
+		sql = [_generatedSQL objectForKey:action];
+	}
+	
+	if(nil == sql)
+		sql = [NSString stringWithContentsOfFile:[[NSBundle mainBundle] pathForResource:action ofType:@"sql"] encoding:NSUTF8StringEncoding error:nil];
+	
+	if(nil == sql || SQLITE_OK != sqlite3_prepare_v2((NULL != _writerDB ? _writerDB : _db), [sql UTF8String], -1, &statement, NULL))
+		return NULL;
+	
+	[_writeSQL setValue:[PointerWrapper pointerWrapperWithPointer:statement] forKey:action];
+	
+	return statement;
+}
+
+- (void) finalizeWriteSQL
+{
+	for(PointerWrapper *wrappedPtr in [_writeSQL allValues])
+		sqlite3_finalize((sqlite3_stmt *)[wrappedPtr statementPointer]);
+	
+	[_writeSQL removeAllObjects];
+}
+
+@end
+
+@implementation CollectionManager (InMemoryDatabasePrivate)
+
+- (BOOL) loadDatabaseIntoMemory:(NSString *)databasePath error:(NSError **)error
+{
+	NSParameterAssert(nil != databasePath);
+	
+	NSDate		*startTime		= [NSDate date];
+	int			result			= SQLITE_OK;
+	int			pageCount		= 0;
+	
+	// The file stays open so changes can be copied back to it
+	result = sqlite3_open([databasePath UTF8String], &_diskDB);
+	if(SQLITE_OK == result) {
+		sqlite3_busy_timeout(_diskDB, (int)[[NSUserDefaults standardUserDefaults] integerForKey:@"databaseBusyTimeout"]);
+		
+		sqlite3_backup *backup = sqlite3_backup_init(_db, "main", _diskDB, "main");
+		if(NULL != backup) {
+			sqlite3_backup_step(backup, -1);
+			pageCount = sqlite3_backup_pagecount(backup);
+			sqlite3_backup_finish(backup);
+		}
+		
+		result = sqlite3_errcode(_db);
+	}
+	
+	if(SQLITE_OK != result) {
+		if(nil != error) {
+			NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
+			
+			[errorDictionary setObject:[NSString stringWithFormat:NSLocalizedStringFromTable(@"The file \"%@\" could not be opened.", @"Errors", @""), [[NSFileManager defaultManager] displayNameAtPath:databasePath]] forKey:NSLocalizedDescriptionKey];
+			[errorDictionary setObject:NSLocalizedStringFromTable(@"Unable to open the database", @"Errors", @"") forKey:NSLocalizedFailureReasonErrorKey];
+			[errorDictionary setObject:[NSString stringWithFormat:NSLocalizedStringFromTable(@"The SQLite error was: %@", @"Errors", @""), [NSString stringWithUTF8String:sqlite3_errstr(result)]] forKey:NSLocalizedRecoverySuggestionErrorKey];
+			
+			*error = [NSError errorWithDomain:DatabaseErrorDomain 
+										 code:DatabaseSQLiteError 
+									 userInfo:errorDictionary];
+		}
+		
+		sqlite3_close(_diskDB);
+		_diskDB = NULL;
+		
+		return NO;
+	}
+	
+	NSLog(@"CollectionManager: Loaded %@ into memory in %.3f seconds (%d pages)", [databasePath lastPathComponent], -[startTime timeIntervalSinceNow], pageCount);
+	
+	_flushedChanges			= sqlite3_total_changes(_db);
+	_flushedSchemaVersion	= schemaVersion(_db);
+	
+	return YES;
+}
+
+- (void) startFlushTimer
+{
+	NSTimeInterval flushInterval = [[NSUserDefaults standardUserDefaults] doubleForKey:@"databaseFlushInterval"];
+	if(0 >= flushInterval)
+		return;
+	
+	_flushTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _flushQueue);
+	
+	dispatch_source_set_timer(_flushTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(flushInterval * NSEC_PER_SEC)), (uint64_t)(flushInterval * NSEC_PER_SEC), NSEC_PER_SEC);
+	
+	dispatch_source_set_event_handler(_flushTimer, ^{
+		[self flushChangesToDisk];
+	});
+	
+	dispatch_resume(_flushTimer);
+}
+
+- (void) stopFlushTimer
+{
+	if(nil == _flushTimer)
+		return;
+	
+	dispatch_source_cancel(_flushTimer);
+	_flushTimer = nil;
+}
+
+// Called on the flush queue
+// Only the rows logged as changed since the last flush are copied, in a single transaction on the file,
+// so the cost follows the size of the change rather than the size of the library; if the tables have
+// changed shape (as when they were first created) or the changes can't be copied, the whole database is
+- (void) flushChangesToDisk
+{
+	if(NULL == _diskDB)
+		return;
+	
+	sqlite3_mutex	*mutex		= sqlite3_db_mutex(_db);
+	int				changes		= 0;
+	int				version		= -1;
+	int				result		= SQLITE_OK;
+	
+	sqlite3_mutex_enter(mutex);
+	changes = sqlite3_total_changes(_db);
+	version = schemaVersion(_db);
+	sqlite3_mutex_leave(mutex);
+	
+	if(changes == _flushedChanges && version == _flushedSchemaVersion)
+		return;
+	
+#if DEBUG
+	NSDate			*startTime	= [NSDate date];
+#endif
+	
+	if(_flushCopiesChanges && version == _flushedSchemaVersion) {
+		result = copyLoggedChanges(_db, _diskDB);
+		
+		// A transaction is open, so the changes are copied next time
+		if(SQLITE_BUSY == result)
+			return;
+		
+		if(SQLITE_OK == result) {
+			_flushedChanges = changes;
+#if DEBUG
+			NSLog(@"CollectionManager: Flushed changes to disk in %.3f seconds", -[startTime timeIntervalSinceNow]);
+#endif
+			return;
+		}
+		
+		NSLog(@"CollectionManager: Unable to flush changes to disk (%@), copying the whole database", [NSString stringWithUTF8String:sqlite3_errstr(result)]);
+	}
+	
+	// The log was cleared, so nothing short of a full copy will bring the file up to date
+	if(NO == [self copyDatabaseToDisk]) {
+		_flushedSchemaVersion = -1;
+		return;
+	}
+	
+	_flushedChanges			= changes;
+	_flushedSchemaVersion	= version;
+	
+#if DEBUG
+	NSLog(@"CollectionManager: Flushed the database to disk in %.3f seconds", -[startTime timeIntervalSinceNow]);
+#endif
+}
+
+// Called on the flush queue
+// The copy is made a few pages at a time so the main thread is never locked out for long;
+// changes made through _db while it runs are carried into the copy by SQLite
+- (BOOL) copyDatabaseToDisk
+{
+	sqlite3_mutex	*mutex		= sqlite3_db_mutex(_db);
+	int				result		= SQLITE_OK;
+	
+	// The copy includes everything logged so far
+	if(_flushCopiesChanges)
+		discardLoggedChanges(_db);
+	
+	sqlite3_backup	*backup		= sqlite3_backup_init(_diskDB, "main", _db, "main");
+	
+	if(NULL == backup) {
+		NSLog(@"CollectionManager: Unable to flush the database to disk (%@)", [NSString stringWithUTF8String:sqlite3_errmsg(_diskDB)]);
+		return NO;
+	}
+	
+	do {
+		// Holding the connection's mutex keeps a transaction from starting during the step;
+		// copying while one is open could write half of it to disk
+		sqlite3_mutex_enter(mutex);
+		result = (0 != sqlite3_get_autocommit(_db) ? sqlite3_backup_step(backup, FLUSH_PAGES_PER_STEP) : SQLITE_BUSY);
+		sqlite3_mutex_leave(mutex);
+		
+		if(SQLITE_OK == result || SQLITE_BUSY == result || SQLITE_LOCKED == result)
+			usleep(FLUSH_STEP_INTERVAL);
+	} while(SQLITE_OK == result || SQLITE_BUSY == result || SQLITE_LOCKED == result);
+	
+	result = sqlite3_backup_finish(backup);
+	if(SQLITE_OK != result) {
+		NSLog(@"CollectionManager: Unable to flush the database to disk (%@)", [NSString stringWithUTF8String:sqlite3_errmsg(_diskDB)]);
+		return NO;
+	}
+	
+	return YES;
+}
+
+@end
+
 @implementation CollectionManager (TransactionSupport)
 
 #pragma mark Transactions
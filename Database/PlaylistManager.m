@@ -693,6 +693,10 @@
 	NSParameterAssert(nil != playlist);
 	//	NSParameterAssert(nil != [playlist valueForKey:ObjectIDKey]);
 	
+	// Streams added to the library a moment ago have no ID until their rows are written
+	if(NSNotFound != [[[playlist streams] valueForKey:ObjectIDKey] indexOfObject:[NSNull null]])
+		[[CollectionManager manager] waitForBackgroundWrites];
+	
 	sqlite3_stmt	*statement		= [self preparedStatementForAction:@"delete_playlist_entries_for_playlist"];
 	int				result			= SQLITE_OK;
 	intptr_t		objectID		= [[playlist valueForKey:ObjectIDKey] unsignedIntegerValue];
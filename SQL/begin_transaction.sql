@@ -1 +1 @@
-BEGIN TRANSACTION
+BEGIN IMMEDIATE TRANSACTION
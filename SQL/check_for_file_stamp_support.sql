@@ -0,0 +1 @@
+SELECT file_size, file_modification_date, file_inode FROM 'streams' LIMIT 0;
@@ -0,0 +1 @@
+SELECT stream_id FROM 'playlist_entries' INDEXED BY 'playlist_entries_by_stream' LIMIT 0;
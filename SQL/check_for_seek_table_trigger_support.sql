@@ -0,0 +1 @@
+SELECT 1 FROM 'sqlite_master' WHERE type == 'trigger' AND name == 'seek_table_was_orphaned' AND sql NOT LIKE '%AFTER DELETE%';
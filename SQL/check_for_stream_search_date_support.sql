@@ -0,0 +1 @@
+SELECT date FROM 'stream_search' LIMIT 0;
@@ -0,0 +1 @@
+SELECT rowid FROM 'stream_search' LIMIT 0;
@@ -0,0 +1,5 @@
+CREATE TABLE IF NOT EXISTS 'play_queue' (
+
+	'queue_index'				INTEGER PRIMARY KEY NOT NULL,
+	'stream_id'					INTEGER NOT NULL
+);
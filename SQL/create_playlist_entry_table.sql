@@ -1,8 +1,11 @@
 CREATE TABLE IF NOT EXISTS 'playlist_entries' (
 
-	'id' 					INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
-	'playlist_id'			INTEGER,
-	'stream_id'				INTEGER,
-	'stream_index' 			INTEGER
+	'playlist_id'			INTEGER NOT NULL,
+	'stream_index' 			INTEGER NOT NULL,
+	'stream_id'				INTEGER NOT NULL,
 
-);
+	PRIMARY KEY (playlist_id, stream_index)
+
+) WITHOUT ROWID;
+
+CREATE INDEX IF NOT EXISTS 'playlist_entries_by_stream' ON 'playlist_entries' (stream_id);
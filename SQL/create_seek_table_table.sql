@@ -0,0 +1,7 @@
+CREATE TABLE IF NOT EXISTS 'seek_tables' (
+
+	'url'						TEXT PRIMARY KEY NOT NULL,
+	'file_size'					INTEGER NOT NULL,
+	'modification_date'			REAL NOT NULL,
+	'entries'					BLOB NOT NULL
+);
@@ -0,0 +1,6 @@
+CREATE TABLE IF NOT EXISTS 'stream_fingerprints' (
+
+	'stream_id'					INTEGER PRIMARY KEY NOT NULL,
+	'signature'					BLOB NOT NULL,
+	'fingerprint'				BLOB NOT NULL
+);
@@ -0,0 +1,16 @@
+CREATE VIRTUAL TABLE IF NOT EXISTS 'stream_search' USING fts5 (
+
+	title,
+	artist,
+	album_title,
+	album_artist,
+	composer,
+	genre,
+	comment,
+	date,
+
+	content = 'streams',
+	content_rowid = 'id',
+	tokenize = 'unicode61 remove_diacritics 2',
+	prefix = '1 2 3'
+);
@@ -0,0 +1,6 @@
+CREATE TABLE IF NOT EXISTS 'stream_silence' (
+
+	'stream_id'					INTEGER PRIMARY KEY NOT NULL,
+	'leading_silence'			REAL NOT NULL,
+	'trailing_silence'			REAL NOT NULL
+);
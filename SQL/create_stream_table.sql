@@ -48,6 +48,10 @@ CREATE TABLE IF NOT EXISTS 'streams' (
 	'sample_rate'				REAL,
 	'total_frames'				INTEGER,
 	'bitrate'					REAL,
+
+	'file_size'					INTEGER,
+	'file_modification_date'	REAL,
+	'file_inode'				INTEGER,
 	
 	UNIQUE (url, starting_frame, frame_count)
 	
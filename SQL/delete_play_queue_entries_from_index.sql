@@ -0,0 +1 @@
+DELETE FROM 'play_queue' WHERE queue_index >= :queue_index;
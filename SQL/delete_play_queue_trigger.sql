@@ -0,0 +1,4 @@
+CREATE TRIGGER IF NOT EXISTS 'play_queue_stream_was_deleted' DELETE ON 'streams'
+	BEGIN
+		DELETE FROM 'play_queue' WHERE stream_id == old.id;
+	END;
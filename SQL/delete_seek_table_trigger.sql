@@ -0,0 +1,5 @@
+CREATE TRIGGER IF NOT EXISTS 'seek_table_was_orphaned' AFTER DELETE ON 'streams'
+	WHEN NOT EXISTS (SELECT 1 FROM 'streams' WHERE url == old.url)
+	BEGIN
+		DELETE FROM 'seek_tables' WHERE url == old.url;
+	END;
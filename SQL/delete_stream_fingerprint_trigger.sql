@@ -0,0 +1,4 @@
+CREATE TRIGGER IF NOT EXISTS 'stream_fingerprint_was_deleted' DELETE ON 'streams'
+	BEGIN
+		DELETE FROM 'stream_fingerprints' WHERE stream_id == old.id;
+	END;
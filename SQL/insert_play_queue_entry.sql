@@ -0,0 +1 @@
+INSERT INTO 'play_queue' (queue_index, stream_id) VALUES (:queue_index, :stream_id);
@@ -0,0 +1 @@
+INSERT OR REPLACE INTO 'seek_tables' (url, file_size, modification_date, entries) VALUES (:url, :file_size, :modification_date, :entries);
@@ -0,0 +1 @@
+INSERT OR REPLACE INTO 'stream_fingerprints' (stream_id, signature, fingerprint) VALUES (:stream_id, :signature, :fingerprint);
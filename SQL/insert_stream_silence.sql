@@ -0,0 +1 @@
+INSERT OR REPLACE INTO 'stream_silence' (stream_id, leading_silence, trailing_silence) VALUES (:stream_id, :leading_silence, :trailing_silence);
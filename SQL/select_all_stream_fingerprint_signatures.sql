@@ -0,0 +1 @@
+SELECT stream_id, signature FROM 'stream_fingerprints';
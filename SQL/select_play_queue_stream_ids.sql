@@ -0,0 +1 @@
+SELECT stream_id FROM 'play_queue' ORDER BY queue_index;
@@ -0,0 +1 @@
+SELECT s.* FROM 'play_queue' AS q, 'streams' AS s WHERE s.id == q.stream_id ORDER BY q.queue_index;
@@ -0,0 +1 @@
+SELECT entries FROM 'seek_tables' WHERE url == :url AND file_size == :file_size AND modification_date == :modification_date;
@@ -0,0 +1 @@
+SELECT starting_frame FROM 'streams' WHERE url == :url AND starting_frame != -1 ORDER BY starting_frame;
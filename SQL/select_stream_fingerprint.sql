@@ -0,0 +1 @@
+SELECT fingerprint FROM 'stream_fingerprints' WHERE stream_id == :stream_id;
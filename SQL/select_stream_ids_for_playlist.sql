@@ -0,0 +1 @@
+SELECT stream_id FROM 'playlist_entries' WHERE playlist_id == :playlist_id ORDER BY stream_index;
@@ -0,0 +1 @@
+SELECT rowid FROM 'stream_search' WHERE stream_search MATCH :query ORDER BY bm25(stream_search, 10.0, 5.0, 5.0, 5.0, 3.0, 2.0, 1.0, 1.0) LIMIT :limit;
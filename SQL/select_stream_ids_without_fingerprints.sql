@@ -0,0 +1 @@
+SELECT id FROM 'streams' WHERE id NOT IN (SELECT stream_id FROM 'stream_fingerprints');
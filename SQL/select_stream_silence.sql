@@ -0,0 +1 @@
+SELECT leading_silence, trailing_silence FROM 'stream_silence' WHERE stream_id == :stream_id;
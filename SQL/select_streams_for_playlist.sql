@@ -1 +1 @@
-SELECT * FROM 'streams' AS s, 'playlist_entries' AS p WHERE s.id IN (SELECT stream_id FROM 'playlist_entries' WHERE playlist_id == :playlist_id) AND s.id == p.stream_id AND p.playlist_id == :playlist_id ORDER BY stream_index;
+SELECT s.* FROM 'playlist_entries' AS p, 'streams' AS s WHERE p.playlist_id == :playlist_id AND s.id == p.stream_id ORDER BY p.stream_index;
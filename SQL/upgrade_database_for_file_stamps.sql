@@ -0,0 +1,3 @@
+ALTER TABLE 'streams' ADD COLUMN 'file_size' INTEGER;
+ALTER TABLE 'streams' ADD COLUMN 'file_modification_date' REAL;
+ALTER TABLE 'streams' ADD COLUMN 'file_inode' INTEGER;
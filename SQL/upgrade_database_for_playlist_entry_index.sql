@@ -0,0 +1,42 @@
+-- Ensure atomicity of this script
+BEGIN TRANSACTION;
+
+-- The triggers reference the table being replaced, so drop them (they are recreated on connect)
+DROP TRIGGER IF EXISTS 'stream_was_deleted';
+DROP TRIGGER IF EXISTS 'playlist_was_deleted';
+
+-- Rename the playlist entries table, for later use
+ALTER TABLE 'playlist_entries' RENAME TO 'playlist_entries_backup';
+
+-- Create the new playlist entries table, clustered on (playlist_id, stream_index)
+CREATE TABLE 'playlist_entries' (
+
+	'playlist_id'			INTEGER NOT NULL,
+	'stream_index' 			INTEGER NOT NULL,
+	'stream_id'				INTEGER NOT NULL,
+
+	PRIMARY KEY (playlist_id, stream_index)
+
+) WITHOUT ROWID;
+
+-- Copy the old data into the new table
+INSERT OR REPLACE INTO 'playlist_entries' (
+		playlist_id,
+		stream_index,
+		stream_id
+		)
+	SELECT
+		playlist_id,
+		stream_index,
+		stream_id
+	FROM 'playlist_entries_backup'
+	WHERE playlist_id NOT NULL AND stream_index NOT NULL AND stream_id NOT NULL;
+
+-- Delete the old table
+DROP TABLE 'playlist_entries_backup';
+
+-- Index used when streams are deleted
+CREATE INDEX 'playlist_entries_by_stream' ON 'playlist_entries' (stream_id);
+
+-- Finito
+COMMIT;
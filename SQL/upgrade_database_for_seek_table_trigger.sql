@@ -0,0 +1,11 @@
+-- Ensure atomicity of this script
+BEGIN TRANSACTION;
+
+-- The trigger is recreated on connect
+DROP TRIGGER IF EXISTS 'seek_table_was_orphaned';
+
+-- Remove the seek tables for files no longer in the library
+DELETE FROM 'seek_tables' WHERE url NOT IN (SELECT url FROM 'streams');
+
+-- Finito
+COMMIT;
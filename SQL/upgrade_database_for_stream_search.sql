@@ -0,0 +1,38 @@
+CREATE VIRTUAL TABLE IF NOT EXISTS 'stream_search' USING fts5 (
+
+	title,
+	artist,
+	album_title,
+	album_artist,
+	composer,
+	genre,
+	comment,
+	date,
+
+	content = 'streams',
+	content_rowid = 'id',
+	tokenize = 'unicode61 remove_diacritics 2',
+	prefix = '1 2 3'
+);
+
+CREATE TRIGGER IF NOT EXISTS 'stream_search_was_inserted' AFTER INSERT ON 'streams'
+	BEGIN
+		INSERT INTO 'stream_search' (rowid, title, artist, album_title, album_artist, composer, genre, comment, date)
+			VALUES (new.id, new.title, new.artist, new.album_title, new.album_artist, new.composer, new.genre, new.comment, new.date);
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'stream_search_was_deleted' AFTER DELETE ON 'streams'
+	BEGIN
+		INSERT INTO 'stream_search' ('stream_search', rowid, title, artist, album_title, album_artist, composer, genre, comment, date)
+			VALUES ('delete', old.id, old.title, old.artist, old.album_title, old.album_artist, old.composer, old.genre, old.comment, old.date);
+	END;
+
+CREATE TRIGGER IF NOT EXISTS 'stream_search_was_updated' AFTER UPDATE OF title, artist, album_title, album_artist, composer, genre, comment, date ON 'streams'
+	BEGIN
+		INSERT INTO 'stream_search' ('stream_search', rowid, title, artist, album_title, album_artist, composer, genre, comment, date)
+			VALUES ('delete', old.id, old.title, old.artist, old.album_title, old.album_artist, old.composer, old.genre, old.comment, old.date);
+		INSERT INTO 'stream_search' (rowid, title, artist, album_title, album_artist, composer, genre, comment, date)
+			VALUES (new.id, new.title, new.artist, new.album_title, new.album_artist, new.composer, new.genre, new.comment, new.date);
+	END;
+
+INSERT INTO 'stream_search' ('stream_search') VALUES ('rebuild');
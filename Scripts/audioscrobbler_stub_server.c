@@ -0,0 +1,197 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// ========================================
+// A stand-in for the Last.fm client, for exercising AudioScrobbler
+// Accepts one connection at a time on localhost, prints each command it
+// receives and answers it with "OK", as the client does
+//   cc -O2 -o audioscrobbler_stub_server audioscrobbler_stub_server.c
+//   ./audioscrobbler_stub_server [-p port] [-d commands] [-w milliseconds]
+// -d drops the connection without answering after every given number of
+//    commands, so resending of unacknowledged commands can be observed
+// -w waits before each answer, to simulate a slow client
+// On exit (^C) the number of commands received and repeated is printed
+// ========================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LINE_BUFFER_SIZE		4096
+
+static volatile sig_atomic_t	sKeepRunning		= 1;
+
+static unsigned long			sCommandCount		= 0;
+static unsigned long			sRepeatCount		= 0;
+static char						sPreviousCommand	[ LINE_BUFFER_SIZE ];
+
+static void
+handleSignal(int signal)
+{
+	(void)signal;
+	sKeepRunning = 0;
+}
+
+static int
+writeAll(int fd, const char *buffer, size_t length)
+{
+	while(0 < length) {
+		ssize_t bytesWritten = write(fd, buffer, length);
+		if(-1 == bytesWritten) {
+			if(EINTR == errno)
+				continue;
+			return -1;
+		}
+		
+		buffer += bytesWritten;
+		length -= (size_t)bytesWritten;
+	}
+	
+	return 0;
+}
+
+// Returns when the peer disconnects or the connection is dropped on purpose
+static void
+serveConnection(int fd, unsigned long dropInterval, unsigned waitMilliseconds)
+{
+	char			line		[ LINE_BUFFER_SIZE ];
+	size_t			used		= 0;
+	unsigned long	served		= 0;
+	
+	while(sKeepRunning) {
+		ssize_t bytesRead = read(fd, line + used, sizeof(line) - 1 - used);
+		if(-1 == bytesRead && EINTR == errno)
+			continue;
+		if(0 >= bytesRead)
+			return;
+		
+		used += (size_t)bytesRead;
+		line[used] = '\0';
+		
+		char *newline;
+		while(NULL != (newline = strchr(line, '\n'))) {
+			*newline = '\0';
+			
+			++served;
+			++sCommandCount;
+			
+			// A command identical to the previous one was probably resent
+			if(0 == strcmp(line, sPreviousCommand))
+				++sRepeatCount;
+			snprintf(sPreviousCommand, sizeof(sPreviousCommand), "%s", line);
+			
+			printf("%ld %s\n", (long)time(NULL), line);
+			fflush(stdout);
+			
+			if(0 != dropInterval && 0 == served % dropInterval) {
+				printf("-- dropping connection\n");
+				return;
+			}
+			
+			if(0 != waitMilliseconds)
+				usleep(1000 * waitMilliseconds);
+			
+			if(-1 == writeAll(fd, "OK\n", 3))
+				return;
+			
+			used -= (size_t)(newline + 1 - line);
+			memmove(line, newline + 1, used + 1);
+		}
+		
+		// Discard overlong lines rather than stalling
+		if(sizeof(line) - 1 == used)
+			used = 0;
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned short		port				= 33367;
+	unsigned long		dropInterval		= 0;
+	unsigned			waitMilliseconds	= 0;
+	int					option;
+	
+	while(-1 != (option = getopt(argc, argv, "p:d:w:"))) {
+		switch(option) {
+			case 'p':	port				= (unsigned short)strtoul(optarg, NULL, 10);	break;
+			case 'd':	dropInterval		= strtoul(optarg, NULL, 10);					break;
+			case 'w':	waitMilliseconds	= (unsigned)strtoul(optarg, NULL, 10);			break;
+			default:
+				fprintf(stderr, "Usage: %s [-p port] [-d commands] [-w milliseconds]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handleSignal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	if(-1 == listener) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+	
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family		= AF_INET;
+	address.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+	address.sin_port		= htons(port);
+	
+	if(-1 == bind(listener, (const struct sockaddr *)&address, sizeof(address)) || -1 == listen(listener, 1)) {
+		perror("bind");
+		close(listener);
+		return EXIT_FAILURE;
+	}
+	
+	printf("-- listening on port %u\n", port);
+	fflush(stdout);
+	
+	while(sKeepRunning) {
+		int connection = accept(listener, NULL, NULL);
+		if(-1 == connection)
+			continue;
+		
+		printf("-- connected\n");
+		serveConnection(connection, dropInterval, waitMilliseconds);
+		close(connection);
+		printf("-- disconnected\n");
+	}
+	
+	close(listener);
+	
+	printf("-- %lu commands received, %lu repeated\n", sCommandCount, sRepeatCount);
+	
+	return EXIT_SUCCESS;
+}
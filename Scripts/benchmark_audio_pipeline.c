@@ -0,0 +1,267 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// ========================================
+// A portable C port of the slice loop in AudioPipelineBenchmark, for measuring
+// the slice refill path off the Mac (for example in continuous integration)
+//   cc -O2 -o benchmark_audio_pipeline benchmark_audio_pipeline.c -lm -lpthread
+//   ./benchmark_audio_pipeline [slices [frames per slice [seconds]]]
+// A synthetic decoder converts 16-bit interleaved PCM in memory to deinterleaved
+// float, as the integer decoders do, returning short reads now and then
+// Each slice is locked, cleared, filled and marked complete, then handed to a null
+// sink that renders it at once, as in -[AudioScheduler processSlicesInThread]
+// The decoder is run twice: allocating its conversion buffer for every read (as
+// the WavPack and Monkey's Audio decoders do) and reusing one buffer
+// ========================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#define CHANNELS					2
+#define SAMPLE_RATE					44100
+
+#define MIN(a, b)					((a) < (b) ? (a) : (b))
+
+// ========================================
+// Slices, as in ScheduledAudioSlice
+// ========================================
+#define SLICE_FLAG_COMPLETE			0x01
+
+typedef struct {
+	float				*buffers [ CHANNELS ];		// Non-interleaved
+	uint32_t			frameCount;
+	uint32_t			flags;
+	pthread_mutex_t		lock;
+} Slice;
+
+// ========================================
+// The decoder
+// ========================================
+typedef struct {
+	const int16_t		*samples;					// Interleaved
+	int64_t				frameCount;
+	int64_t				currentFrame;
+	int					allocatesPerRead;
+	int32_t				*conversionBuffer;			// Used when not allocating per read
+	uint32_t			conversionBufferFrames;
+	uint64_t			allocations;
+} Decoder;
+
+static double
+currentTime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + ((double)now.tv_nsec / 1000000000.0);
+}
+
+static int
+compareLatencies(const void *a, const void *b)
+{
+	double lhs = *(const double *)a;
+	double rhs = *(const double *)b;
+	return (lhs < rhs ? -1 : (lhs > rhs ? 1 : 0));
+}
+
+static double
+latencyPercentile(const double *sortedLatencies, size_t count, double percentile)
+{
+	size_t index = (size_t)ceil(percentile * count);
+	return sortedLatencies[(0 < index ? index - 1 : 0)];
+}
+
+static uint32_t
+decoderRead(Decoder *decoder, Slice *slice, uint32_t frameCount)
+{
+	// Decoders return whole blocks, so reads sometimes come up short
+	if(0 == rand() % 16)
+		frameCount = 1 + (uint32_t)(rand() % frameCount);
+	
+	uint32_t	framesRead	= (uint32_t)MIN((int64_t)frameCount, decoder->frameCount - decoder->currentFrame);
+	int32_t		*buffer		= decoder->conversionBuffer;
+	uint32_t	frame;
+	unsigned	channel;
+	
+	if(0 == framesRead)
+		return 0;
+	
+	if(decoder->allocatesPerRead) {
+		buffer = calloc((size_t)framesRead * CHANNELS, sizeof(int32_t));
+		++decoder->allocations;
+	}
+	
+	if(NULL == buffer || framesRead > decoder->conversionBufferFrames)
+		return 0;
+	
+	// Widen, as libwavpack and libmac return 32-bit samples
+	const int16_t *source = decoder->samples + (decoder->currentFrame * CHANNELS);
+	for(frame = 0; frame < framesRead * CHANNELS; ++frame)
+		buffer[frame] = source[frame];
+	
+	// Deinterleave and convert to float
+	for(channel = 0; channel < CHANNELS; ++channel) {
+		float *output = slice->buffers[channel];
+		for(frame = 0; frame < framesRead; ++frame)
+			output[frame] = buffer[(frame * CHANNELS) + channel] / 32768.f;
+	}
+	
+	if(decoder->allocatesPerRead)
+		free(buffer);
+	
+	decoder->currentFrame += framesRead;
+	
+	return framesRead;
+}
+
+static int
+benchmark(const char *name, Decoder *decoder, Slice *slices, unsigned sliceCount, uint32_t framesPerSlice)
+{
+	size_t		capacity	= (size_t)(decoder->frameCount / framesPerSlice) * 2 + 2;
+	double		*latencies	= calloc(capacity, sizeof(double));
+	size_t		count		= 0;
+	double		elapsed		= 0;
+	int64_t		frames		= 0;
+	unsigned	i			= 0;
+	
+	if(NULL == latencies)
+		return 0;
+	
+	decoder->currentFrame	= 0;
+	decoder->allocations	= 0;
+	srand(1);
+	
+	while(count < capacity) {
+		Slice *slice = slices + i;
+		
+		double start = currentTime();
+		
+		pthread_mutex_lock(&slice->lock);
+		
+		unsigned channel;
+		for(channel = 0; channel < CHANNELS; ++channel)
+			memset(slice->buffers[channel], 0, framesPerSlice * sizeof(float));
+		
+		uint32_t frameCount = decoderRead(decoder, slice, framesPerSlice);
+		
+		// The null sink: the slice is complete as soon as it is filled
+		slice->frameCount	= frameCount;
+		slice->flags		= SLICE_FLAG_COMPLETE;
+		
+		pthread_mutex_unlock(&slice->lock);
+		
+		double latency = currentTime() - start;
+		
+		if(0 == frameCount)
+			break;
+		
+		latencies[count++]	= latency;
+		elapsed				+= latency;
+		frames				+= frameCount;
+		i					= (i + 1) % sliceCount;
+	}
+	
+	if(0 == count || 0 == elapsed) {
+		printf("%s: no audio decoded\n", name);
+		free(latencies);
+		return 0;
+	}
+	
+	qsort(latencies, count, sizeof(double), compareLatencies);
+	
+	// Jitter is the standard deviation of the refill latency
+	double mean		= elapsed / count;
+	double variance	= 0;
+	size_t j;
+	for(j = 0; j < count; ++j)
+		variance += (latencies[j] - mean) * (latencies[j] - mean);
+	variance /= count;
+	
+	printf("%s: %lld frames, %.0f frames/sec\n", name, (long long)frames, frames / elapsed);
+	printf("%s: refill latency p50 %.1f µs, p99 %.1f µs, p99.9 %.1f µs, max %.1f µs, jitter %.1f µs\n", name,
+		   1e6 * latencyPercentile(latencies, count, 0.5), 1e6 * latencyPercentile(latencies, count, 0.99), 1e6 * latencyPercentile(latencies, count, 0.999),
+		   1e6 * latencies[count - 1], 1e6 * sqrt(variance));
+	printf("%s: %.3f heap allocations per slice\n", name, decoder->allocations / (double)count);
+	
+	free(latencies);
+	
+	return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned	sliceCount		= (1 < argc ? (unsigned)strtoul(argv[1], NULL, 10) : 20);
+	uint32_t	framesPerSlice	= (2 < argc ? (uint32_t)strtoul(argv[2], NULL, 10) : 4096);
+	unsigned	seconds			= (3 < argc ? (unsigned)strtoul(argv[3], NULL, 10) : 600);
+	int64_t		frameCount		= (int64_t)seconds * SAMPLE_RATE;
+	int16_t		*samples		= malloc((size_t)frameCount * CHANNELS * sizeof(int16_t));
+	Slice		*slices			= calloc(sliceCount, sizeof(Slice));
+	uint32_t	seed			= 1;
+	unsigned	i, channel;
+	int64_t		sample;
+	
+	if(0 == sliceCount || 0 == framesPerSlice || NULL == samples || NULL == slices)
+		return EXIT_FAILURE;
+	
+	for(sample = 0; sample < frameCount * CHANNELS; ++sample) {
+		seed			= (seed * 1664525u) + 1013904223u;
+		samples[sample]	= (int16_t)((int32_t)(seed >> 16) - 32768);
+	}
+	
+	for(i = 0; i < sliceCount; ++i) {
+		pthread_mutex_init(&slices[i].lock, NULL);
+		for(channel = 0; channel < CHANNELS; ++channel) {
+			slices[i].buffers[channel] = calloc(framesPerSlice, sizeof(float));
+			if(NULL == slices[i].buffers[channel])
+				return EXIT_FAILURE;
+		}
+	}
+	
+	Decoder decoder = { samples, frameCount, 0, 0, calloc((size_t)framesPerSlice * CHANNELS, sizeof(int32_t)), framesPerSlice, 0 };
+	if(NULL == decoder.conversionBuffer)
+		return EXIT_FAILURE;
+	
+	printf("Audio pipeline benchmark (%u slices of %u frames, %u seconds)\n", sliceCount, framesPerSlice, seconds);
+	
+	decoder.allocatesPerRead = 1;
+	if(0 == benchmark("allocating decoder", &decoder, slices, sliceCount, framesPerSlice))
+		return EXIT_FAILURE;
+	
+	decoder.allocatesPerRead = 0;
+	if(0 == benchmark("reusing decoder", &decoder, slices, sliceCount, framesPerSlice))
+		return EXIT_FAILURE;
+	
+	for(i = 0; i < sliceCount; ++i) {
+		pthread_mutex_destroy(&slices[i].lock);
+		for(channel = 0; channel < CHANNELS; ++channel)
+			free(slices[i].buffers[channel]);
+	}
+	
+	free(decoder.conversionBuffer);
+	free(slices);
+	free(samples);
+	
+	return EXIT_SUCCESS;
+}
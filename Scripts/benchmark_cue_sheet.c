@@ -0,0 +1,115 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// ========================================
+// Measures the throughput of the cue sheet scanner used by CueSheetParser
+//   cc -O2 -o benchmark_cue_sheet benchmark_cue_sheet.c ../Utilities/CueSheetScanner.c
+//   ./benchmark_cue_sheet [tracks [passes]]
+// A synthetic cue sheet with the given number of tracks is scanned repeatedly
+// ========================================
+
+#include "../Utilities/CueSheetScanner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double
+currentTime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + ((double)now.tv_nsec / 1000000000.0);
+}
+
+static char *
+createCueSheet(unsigned tracks, size_t *length)
+{
+	size_t	capacity	= 256 + (256 * (size_t)tracks);
+	char	*cueSheet	= malloc(capacity);
+	size_t	used		= 0;
+	
+	if(NULL == cueSheet)
+		return NULL;
+	
+	used += (size_t)snprintf(cueSheet + used, capacity - used, 
+							 "REM GENRE \"Classical\"\r\nREM DATE 1987\r\nPERFORMER \"Some Orchestra\"\r\nTITLE \"Some Box Set\"\r\nFILE \"Some Box Set.flac\" WAVE\r\n");
+	
+	unsigned track;
+	for(track = 1; track <= tracks; ++track) {
+		unsigned sector = 17 * 75 * track;
+		used += (size_t)snprintf(cueSheet + used, capacity - used, 
+								 "  TRACK %02u AUDIO\r\n    TITLE \"Movement %u\"\r\n    PERFORMER \"Some Orchestra\"\r\n    INDEX 01 %02u:%02u:%02u\r\n", 
+								 track, track, sector / (60 * 75), (sector / 75) % 60, sector % 75);
+	}
+	
+	*length = used;
+	return cueSheet;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned	tracks		= (1 < argc ? (unsigned)strtoul(argv[1], NULL, 10) : 99);
+	unsigned	passes		= (2 < argc ? (unsigned)strtoul(argv[2], NULL, 10) : 20000);
+	size_t		length		= 0;
+	char		*cueSheet	= createCueSheet(tracks, &length);
+	
+	if(NULL == cueSheet) {
+		fprintf(stderr, "Unable to allocate memory\n");
+		return EXIT_FAILURE;
+	}
+	
+	unsigned long	commands	= 0;
+	unsigned long	checksum	= 0;
+	double			start		= currentTime();
+	
+	unsigned pass;
+	for(pass = 0; pass < passes; ++pass) {
+		size_t			byteOrderMarkLength		= 0;
+		(void)cueSheetDetectEncoding((const uint8_t *)cueSheet, length, &byteOrderMarkLength);
+		
+		const uint8_t	*p						= (const uint8_t *)cueSheet + byteOrderMarkLength;
+		const uint8_t	*end					= (const uint8_t *)cueSheet + length;
+		const uint8_t	*lineStart				= NULL;
+		const uint8_t	*lineEnd				= NULL;
+		CueSheetCommand	command;
+		
+		while(cueSheetNextLine(&p, end, &lineStart, &lineEnd)) {
+			cueSheetScanCommand(lineStart, lineEnd, &command);
+			checksum += command.type + command.sector + command.argumentLength;
+			++commands;
+		}
+	}
+	
+	double elapsed = currentTime() - start;
+	
+	printf("%u tracks, %zu bytes, %u passes\n", tracks, length, passes);
+	printf("%.3f s, %.1f MB/s, %.1f ns per command (checksum %lu)\n", 
+		   elapsed, 
+		   ((double)length * passes) / (elapsed * 1000000.0), 
+		   (elapsed * 1000000000.0) / (double)commands, 
+		   checksum);
+	
+	free(cueSheet);
+	
+	return EXIT_SUCCESS;
+}
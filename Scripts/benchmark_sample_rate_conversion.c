@@ -0,0 +1,517 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// ========================================
+// A portable C port of ConvertingAudioDecoder's sample rate conversion, for
+// checking and measuring the filter off the Mac
+//   cc -O2 -o benchmark_sample_rate_conversion benchmark_sample_rate_conversion.c -lm
+//   ./benchmark_sample_rate_conversion [seconds]
+// vDSP_desamp and cblas_scopy are replaced by scalar loops, so the
+// throughput is a lower bound for the Accelerate version
+// For each quality and a few pairs of sample rates this checks the output
+// length, that short decoder reads and odd request sizes give the same output
+// as one large read, and that output after a seek matches, then measures
+// THD+N for a 1 kHz sine at -6 dBFS and the conversion throughput
+// ========================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define INPUT_BUFFER_FRAMES			4096
+#define MAXIMUM_PHASES				2048
+
+#define MIN(a, b)					((a) < (b) ? (a) : (b))
+#define MAX(a, b)					((a) > (b) ? (a) : (b))
+
+static const struct {
+	unsigned	taps;
+	double		beta;
+	double		cutoff;
+	const char	*name;
+} sQualities [] = {
+	{ 16,	6.0,	0.86,	"low" },
+	{ 32,	8.0,	0.92,	"medium" },
+	{ 64,	10.0,	0.95,	"high" }
+};
+
+// ========================================
+// The decoder: mono audio in memory, read in short pieces when asked
+// ========================================
+typedef struct {
+	const float		*samples;
+	int64_t			frameCount;
+	int64_t			currentFrame;
+	int				shortReads;
+} Source;
+
+static uint32_t
+sourceRead(Source *source, float *buffer, uint32_t frameCount)
+{
+	if(source->shortReads) {
+		uint32_t limit = 1 + (uint32_t)(rand() % 700);
+		frameCount = MIN(frameCount, limit);
+	}
+	
+	uint32_t framesRead = (uint32_t)MIN((int64_t)frameCount, source->frameCount - source->currentFrame);
+	memcpy(buffer, source->samples + source->currentFrame, framesRead * sizeof(float));
+	source->currentFrame += framesRead;
+	
+	return framesRead;
+}
+
+// ========================================
+// The converter, following ConvertingAudioDecoder
+// ========================================
+typedef struct {
+	Source			*source;
+	
+	uint32_t		interpolation;
+	uint32_t		decimation;
+	uint32_t		taps;
+	uint32_t		leadingTaps;
+	float			*filters;
+	uint32_t		blockFrames;
+	float			*phaseOutput;
+	
+	float			*input;
+	float			*history;
+	uint32_t		historyCapacity;
+	uint32_t		historyLength;
+	int64_t			historyStart;
+	int				decoderAtEnd;
+	
+	int64_t			totalFrames;
+	int64_t			currentFrame;
+} Converter;
+
+static uint32_t
+greatestCommonDivisor(uint32_t a, uint32_t b)
+{
+	while(0 != b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static double
+besselI0(double x)
+{
+	double sum = 1, term = 1;
+	for(unsigned k = 1; k < 64; ++k) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if(term < 1e-12 * sum)
+			break;
+	}
+	return sum;
+}
+
+static void
+appendSilence(Converter *converter, uint32_t frameCount)
+{
+	memset(converter->history + converter->historyLength, 0, frameCount * sizeof(float));
+	converter->historyLength += frameCount;
+}
+
+static void
+resetHistoryAtFrame(Converter *converter, int64_t frame)
+{
+	converter->historyStart		= frame;
+	converter->historyLength	= 0;
+	converter->decoderAtEnd		= 0;
+	
+	if(0 > frame)
+		appendSilence(converter, (uint32_t)-frame);
+}
+
+static int
+converterInit(Converter *converter, Source *source, uint32_t inputRate, uint32_t outputRate, unsigned quality)
+{
+	memset(converter, 0, sizeof(*converter));
+	
+	uint32_t divisor = greatestCommonDivisor(inputRate, outputRate);
+	
+	converter->source			= source;
+	converter->interpolation	= outputRate / divisor;
+	converter->decimation		= inputRate / divisor;
+	
+	if(MAXIMUM_PHASES < converter->interpolation)
+		return 0;
+	
+	int matching = (1 == converter->interpolation && 1 == converter->decimation);
+	
+	converter->taps			= (matching ? 1 : sQualities[quality].taps);
+	converter->leadingTaps	= (converter->taps - 1) / 2;
+	converter->filters		= calloc((size_t)converter->interpolation * converter->taps, sizeof(float));
+	
+	double	cutoff			= (matching ? 1 : MIN(1, (double)converter->interpolation / converter->decimation) * sQualities[quality].cutoff);
+	double	beta			= (matching ? 0 : sQualities[quality].beta);
+	double	halfWidth		= converter->taps / 2.0;
+	
+	for(uint32_t phase = 0; phase < converter->interpolation; ++phase) {
+		float	*filter		= converter->filters + (phase * converter->taps);
+		double	sum			= 0;
+		
+		for(uint32_t tap = 0; tap < converter->taps; ++tap) {
+			double	t			= (double)tap - converter->leadingTaps - ((double)phase / converter->interpolation);
+			double	x			= t / halfWidth;
+			double	window		= (1 >= fabs(x) ? besselI0(beta * sqrt(1 - (x * x))) / besselI0(beta) : 0);
+			double	sinc		= (1e-9 > fabs(t) ? 1 : sin(M_PI * cutoff * t) / (M_PI * cutoff * t));
+			
+			filter[tap]		= (float)(cutoff * sinc * window);
+			sum				+= filter[tap];
+		}
+		
+		for(uint32_t tap = 0; tap < converter->taps; ++tap)
+			filter[tap] /= sum;
+	}
+	
+	converter->blockFrames		= (uint32_t)((((uint64_t)INPUT_BUFFER_FRAMES - 1) * converter->interpolation) / converter->decimation) + 1;
+	converter->phaseOutput		= calloc(converter->blockFrames, sizeof(float));
+	converter->input			= calloc(INPUT_BUFFER_FRAMES, sizeof(float));
+	converter->historyCapacity	= converter->taps + INPUT_BUFFER_FRAMES;
+	converter->history			= calloc(converter->historyCapacity, sizeof(float));
+	
+	if(NULL == converter->filters || NULL == converter->phaseOutput || NULL == converter->input || NULL == converter->history)
+		return 0;
+	
+	converter->totalFrames = ((source->frameCount * converter->interpolation) + converter->decimation - 1) / converter->decimation;
+	
+	resetHistoryAtFrame(converter, source->currentFrame - converter->leadingTaps);
+	converter->currentFrame = (source->currentFrame * converter->interpolation) / converter->decimation;
+	
+	return 1;
+}
+
+static void
+converterFree(Converter *converter)
+{
+	free(converter->filters);
+	free(converter->phaseOutput);
+	free(converter->input);
+	free(converter->history);
+}
+
+static int
+fillHistory(Converter *converter, int64_t firstFrame, int64_t lastFrame)
+{
+	while(converter->historyStart + converter->historyLength <= lastFrame) {
+		if(INPUT_BUFFER_FRAMES > converter->historyCapacity - converter->historyLength && firstFrame > converter->historyStart) {
+			uint32_t framesToDiscard = (uint32_t)MIN(firstFrame - converter->historyStart, (int64_t)converter->historyLength);
+			
+			memmove(converter->history, converter->history + framesToDiscard, (converter->historyLength - framesToDiscard) * sizeof(float));
+			
+			converter->historyStart		+= framesToDiscard;
+			converter->historyLength	-= framesToDiscard;
+		}
+		
+		uint32_t framesToRead = MIN(converter->historyCapacity - converter->historyLength, INPUT_BUFFER_FRAMES);
+		if(0 == framesToRead)
+			return 0;
+		
+		if(converter->decoderAtEnd) {
+			appendSilence(converter, framesToRead);
+			continue;
+		}
+		
+		uint32_t framesRead = sourceRead(converter->source, converter->input, framesToRead);
+		if(0 == framesRead) {
+			int64_t inputFrames = converter->historyStart + converter->historyLength;
+			
+			converter->decoderAtEnd	= 1;
+			converter->totalFrames	= MIN(converter->totalFrames, ((inputFrames * converter->interpolation) + converter->decimation - 1) / converter->decimation);
+			continue;
+		}
+		
+		memcpy(converter->history + converter->historyLength, converter->input, framesRead * sizeof(float));
+		converter->historyLength += framesRead;
+	}
+	
+	return 1;
+}
+
+// Stand-ins for vDSP_desamp and cblas_scopy
+static void
+desamp(const float *input, uint32_t decimation, const float *filter, float *output, uint32_t count, uint32_t taps)
+{
+	for(uint32_t n = 0; n < count; ++n) {
+		const float		*x		= input + ((size_t)n * decimation);
+		float			sum		= 0;
+		
+		for(uint32_t p = 0; p < taps; ++p)
+			sum += x[p] * filter[p];
+		
+		output[n] = sum;
+	}
+}
+
+static void
+scopy(uint32_t count, const float *input, float *output, uint32_t stride)
+{
+	for(uint32_t n = 0; n < count; ++n)
+		output[(size_t)n * stride] = input[n];
+}
+
+static uint32_t
+converterRead(Converter *converter, float *output, uint32_t frameCount)
+{
+	uint32_t framesWritten = 0;
+	
+	while(framesWritten < frameCount && converter->currentFrame < converter->totalFrames) {
+		uint32_t	blockFrames		= (uint32_t)MIN((int64_t)MIN(frameCount - framesWritten, converter->blockFrames), converter->totalFrames - converter->currentFrame);
+		int64_t		firstFrame		= ((converter->currentFrame * converter->decimation) / converter->interpolation) - converter->leadingTaps;
+		int64_t		lastFrame		= (((converter->currentFrame + blockFrames - 1) * converter->decimation) / converter->interpolation) - converter->leadingTaps + converter->taps - 1;
+		
+		if(!fillHistory(converter, firstFrame, lastFrame))
+			break;
+		
+		if(converter->currentFrame >= converter->totalFrames)
+			break;
+		
+		blockFrames = (uint32_t)MIN((int64_t)blockFrames, converter->totalFrames - converter->currentFrame);
+		
+		for(uint32_t frame = 0; frame < MIN(blockFrames, converter->interpolation); ++frame) {
+			int64_t			position	= (converter->currentFrame + frame) * converter->decimation;
+			const float		*filter		= converter->filters + ((position % converter->interpolation) * converter->taps);
+			uint32_t		offset		= (uint32_t)((position / converter->interpolation) - converter->leadingTaps - converter->historyStart);
+			uint32_t		count		= (blockFrames - frame + converter->interpolation - 1) / converter->interpolation;
+			float			*out		= output + framesWritten + frame;
+			
+			if(1 == converter->interpolation)
+				desamp(converter->history + offset, converter->decimation, filter, out, count, converter->taps);
+			else {
+				desamp(converter->history + offset, converter->decimation, filter, converter->phaseOutput, count, converter->taps);
+				scopy(count, converter->phaseOutput, out, converter->interpolation);
+			}
+		}
+		
+		framesWritten				+= blockFrames;
+		converter->currentFrame		+= blockFrames;
+	}
+	
+	return framesWritten;
+}
+
+static void
+converterSeek(Converter *converter, int64_t frame)
+{
+	int64_t		inputFrame		= (frame * converter->decimation) / converter->interpolation;
+	int64_t		firstFrame		= MAX(0, inputFrame - (int64_t)converter->leadingTaps);
+	
+	converter->source->currentFrame = firstFrame;
+	
+	resetHistoryAtFrame(converter, inputFrame - converter->leadingTaps);
+	converter->currentFrame = frame;
+}
+
+// ========================================
+// Measurements
+// ========================================
+static double
+currentTime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + ((double)now.tv_nsec / 1000000000.0);
+}
+
+// Fits a sinusoid at frequency (and DC) by least squares and returns the residual relative to it, in dB
+static double
+thdPlusNoise(const float *samples, size_t frameCount, double frequency, double sampleRate)
+{
+	double sxx[3][3] = { { 0 } }, sxy[3] = { 0 };
+	
+	for(size_t i = 0; i < frameCount; ++i) {
+		double	w		= 2 * M_PI * frequency * i / sampleRate;
+		double	b [3]	= { sin(w), cos(w), 1 };
+		
+		for(int r = 0; r < 3; ++r) {
+			sxy[r] += b[r] * samples[i];
+			for(int c = 0; c < 3; ++c)
+				sxx[r][c] += b[r] * b[c];
+		}
+	}
+	
+	// Solve the 3x3 normal equations by Gaussian elimination
+	for(int k = 0; k < 3; ++k) {
+		for(int r = k + 1; r < 3; ++r) {
+			double f = sxx[r][k] / sxx[k][k];
+			for(int c = k; c < 3; ++c)
+				sxx[r][c] -= f * sxx[k][c];
+			sxy[r] -= f * sxy[k];
+		}
+	}
+	
+	double coefficients [3];
+	for(int k = 2; 0 <= k; --k) {
+		double sum = sxy[k];
+		for(int c = k + 1; c < 3; ++c)
+			sum -= sxx[k][c] * coefficients[c];
+		coefficients[k] = sum / sxx[k][k];
+	}
+	
+	double signal = 0, residual = 0;
+	for(size_t i = 0; i < frameCount; ++i) {
+		double	w		= 2 * M_PI * frequency * i / sampleRate;
+		double	fit		= (coefficients[0] * sin(w)) + (coefficients[1] * cos(w));
+		double	error	= samples[i] - fit - coefficients[2];
+		
+		signal		+= fit * fit;
+		residual	+= error * error;
+	}
+	
+	return 10 * log10(residual / signal);
+}
+
+static int
+checkConversion(const float *input, int64_t inputFrames, uint32_t inputRate, uint32_t outputRate, unsigned quality)
+{
+	Source		source		= { input, inputFrames, 0, 0 };
+	Converter	converter;
+	
+	if(!converterInit(&converter, &source, inputRate, outputRate, quality))
+		return 0;
+	
+	int64_t		expectedFrames		= ((inputFrames * converter.interpolation) + converter.decimation - 1) / converter.decimation;
+	float		*reference			= calloc((size_t)expectedFrames + 1, sizeof(float));
+	float		*output				= calloc((size_t)expectedFrames + 1, sizeof(float));
+	int			passed				= 1;
+	
+	// One large read
+	uint32_t framesRead = converterRead(&converter, reference, (uint32_t)expectedFrames + 1);
+	if(framesRead != expectedFrames) {
+		printf("    length: %u frames, expected %lld\n", framesRead, (long long)expectedFrames);
+		passed = 0;
+	}
+	
+	// Short decoder reads and odd request sizes
+	source.currentFrame		= 0;
+	source.shortReads		= 1;
+	converter.totalFrames	= expectedFrames;
+	resetHistoryAtFrame(&converter, -(int64_t)converter.leadingTaps);
+	converter.currentFrame	= 0;
+	
+	int64_t framesWritten = 0;
+	for(;;) {
+		uint32_t request = 1 + (uint32_t)(rand() % 1500);
+		uint32_t n = converterRead(&converter, output + framesWritten, request);
+		if(0 == n)
+			break;
+		framesWritten += n;
+	}
+	
+	if(framesWritten != expectedFrames || 0 != memcmp(reference, output, (size_t)expectedFrames * sizeof(float))) {
+		printf("    short reads don't match one large read\n");
+		passed = 0;
+	}
+	
+	// Seeks
+	for(int i = 0; i < 8; ++i) {
+		int64_t frame = rand() % expectedFrames;
+		
+		converter.totalFrames = expectedFrames;
+		converterSeek(&converter, frame);
+		
+		uint32_t n = converterRead(&converter, output, 5000);
+		if(n != MIN(5000, expectedFrames - frame) || 0 != memcmp(reference + frame, output, n * sizeof(float))) {
+			printf("    output after a seek to frame %lld doesn't match\n", (long long)frame);
+			passed = 0;
+		}
+	}
+	
+	free(reference);
+	free(output);
+	converterFree(&converter);
+	
+	return passed;
+}
+
+int
+main(int argc, char *argv [])
+{
+	double			seconds		= (1 < argc ? atof(argv[1]) : 10);
+	const uint32_t	rates [][2]	= { { 44100, 48000 }, { 96000, 44100 }, { 48000, 44100 }, { 22050, 44100 } };
+	int				failures	= 0;
+	
+	srand(1);
+	
+	printf("quality   conversion         checks   THD+N       throughput\n");
+	
+	for(unsigned quality = 0; quality < sizeof(sQualities) / sizeof(sQualities[0]); ++quality) {
+		for(size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); ++r) {
+			uint32_t	inputRate		= rates[r][0];
+			uint32_t	outputRate		= rates[r][1];
+			int64_t		inputFrames		= (int64_t)(seconds * inputRate);
+			float		*input			= malloc((size_t)inputFrames * sizeof(float));
+			
+			for(int64_t i = 0; i < inputFrames; ++i)
+				input[i] = (float)(0.5 * sin(2 * M_PI * 1000 * i / inputRate));
+			
+			// The checks use a short excerpt
+			int passed = checkConversion(input, MIN(inputFrames, (int64_t)inputRate / 2), inputRate, outputRate, quality);
+			if(!passed)
+				++failures;
+			
+			Source		source		= { input, inputFrames, 0, 0 };
+			Converter	converter;
+			
+			if(!converterInit(&converter, &source, inputRate, outputRate, quality)) {
+				free(input);
+				continue;
+			}
+			
+			float		*output			= malloc(((size_t)converter.totalFrames + 1) * sizeof(float));
+			int64_t		framesWritten	= 0;
+			double		start			= currentTime();
+			
+			for(;;) {
+				uint32_t n = converterRead(&converter, output + framesWritten, 4096);
+				if(0 == n)
+					break;
+				framesWritten += n;
+			}
+			
+			double elapsed = currentTime() - start;
+			
+			// Skip the filter's start and end
+			size_t margin = (size_t)outputRate / 10;
+			double thdn = thdPlusNoise(output + margin, (size_t)framesWritten - (2 * margin), 1000, outputRate);
+			
+			printf("%-9s %5u -> %5u Hz   %-6s   %6.1f dB   %6.1f Mframes/s\n", sQualities[quality].name, inputRate, outputRate, 
+				   (passed ? "ok" : "FAILED"), thdn, framesWritten / elapsed / 1e6);
+			
+			free(output);
+			free(input);
+			converterFree(&converter);
+		}
+	}
+	
+	return (0 == failures ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,365 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// ========================================
+// Measures WavPackDecoder's seek table against libwavpack's own seeking, off the Mac
+//   cc -O2 -o benchmark_wavpack_seeking benchmark_wavpack_seeking.c -lwavpack
+//   ./benchmark_wavpack_seeking [file.wv [seeks]]
+// Without a file, an hour of 44.1 kHz stereo noise is encoded to a temporary file
+// (quiet noise compresses about as poorly as real music, so the blocks are as large)
+// The seek table is built as WavPackDecoder's buildSeekTable does, with one entry
+// every SEEK_TABLE_INTERVAL seconds; each seek is then timed both ways, as the
+// decoder performs it, and the audio decoded after each seek is compared
+// ========================================
+
+#include <wavpack/wavpack.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define SEEK_TABLE_INTERVAL			5
+#define WAVPACK_HEADER_SIZE			32
+#define SKIP_BUFFER_FRAMES			4096
+#define COMPARE_FRAMES				1024
+
+#define SYNTHETIC_SECONDS			3600
+#define SYNTHETIC_SAMPLE_RATE		44100
+#define SYNTHETIC_CHANNELS			2
+
+#define MIN(a, b)					((a) < (b) ? (a) : (b))
+
+typedef struct {
+	int64_t		frame;		// The first frame in the block
+	int64_t		offset;		// The file offset of the block's header
+} SeekPoint;
+
+static double
+currentTime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + ((double)now.tv_nsec / 1000000000.0);
+}
+
+static uint32_t
+readLittleInt32(const uint8_t *bytes)
+{
+	return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+// ========================================
+// Stream reader callbacks, as in WavPackDecoder
+static int32_t		readBytes(void *id, void *data, int32_t bcount)			{ return (int32_t)fread(data, 1, (size_t)bcount, (FILE *)id); }
+static uint32_t		getPosition(void *id)									{ return (uint32_t)ftello((FILE *)id); }
+static int			setPositionAbsolute(void *id, uint32_t pos)				{ return fseeko((FILE *)id, pos, SEEK_SET); }
+static int			setPositionRelative(void *id, int32_t delta, int mode)	{ return fseeko((FILE *)id, delta, mode); }
+static int			pushBackByte(void *id, int c)							{ return ungetc(c, (FILE *)id); }
+static int			canSeek(void *id)										{ return 1; }
+static int32_t		writeBytes(void *id, void *data, int32_t bcount)		{ return (int32_t)fwrite(data, 1, (size_t)bcount, (FILE *)id); }
+
+static uint32_t
+getLength(void *id)
+{
+	struct stat sb;
+	return (-1 == fstat(fileno((FILE *)id), &sb) ? 0 : (uint32_t)sb.st_size);
+}
+
+static WavpackStreamReader sStreamReader = {
+	readBytes, getPosition, setPositionAbsolute, setPositionRelative, pushBackByte, getLength, canSeek, writeBytes
+};
+
+// ========================================
+// Encoding the synthetic file
+static int
+writeBlock(void *id, void *data, int32_t bcount)
+{
+	return ((size_t)bcount == fwrite(data, 1, (size_t)bcount, (FILE *)id));
+}
+
+static int
+createNoiseFile(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if(NULL == file)
+		return 0;
+	
+	WavpackContext	*wpc		= WavpackOpenFileOutput(writeBlock, file, NULL);
+	WavpackConfig	config;
+	uint32_t		frames		= SYNTHETIC_SECONDS * SYNTHETIC_SAMPLE_RATE;
+	int32_t			*buffer		= malloc(SKIP_BUFFER_FRAMES * SYNTHETIC_CHANNELS * sizeof(int32_t));
+	uint32_t		seed		= 1;
+	int				success		= (NULL != wpc && NULL != buffer);
+	
+	memset(&config, 0, sizeof(config));
+	config.bytes_per_sample		= 2;
+	config.bits_per_sample		= 16;
+	config.channel_mask			= 3;
+	config.num_channels			= SYNTHETIC_CHANNELS;
+	config.sample_rate			= SYNTHETIC_SAMPLE_RATE;
+	
+	if(success)
+		success = (WavpackSetConfiguration(wpc, &config, frames) && WavpackPackInit(wpc));
+	
+	while(success && 0 < frames) {
+		uint32_t	count	= MIN(frames, SKIP_BUFFER_FRAMES);
+		uint32_t	i;
+		
+		// Quiet noise, so the blocks are realistically large but not incompressible
+		for(i = 0; i < count * SYNTHETIC_CHANNELS; ++i) {
+			seed		= (seed * 1664525u) + 1013904223u;
+			buffer[i]	= (int32_t)(seed >> 16) - 32768;
+			buffer[i]	/= 4;
+		}
+		
+		success	= WavpackPackSamples(wpc, buffer, count);
+		frames	-= count;
+	}
+	
+	if(success)
+		success = WavpackFlushSamples(wpc);
+	
+	if(NULL != wpc)
+		WavpackCloseFile(wpc);
+	free(buffer);
+	
+	return (0 == fclose(file) && success);
+}
+
+// ========================================
+// A port of WavPackDecoder's buildSeekTable, without the cue sheet tracks
+static SeekPoint *
+buildSeekTable(const char *path, int64_t interval, size_t *count)
+{
+	FILE *file = fopen(path, "r");
+	if(NULL == file)
+		return NULL;
+	
+	SeekPoint		*points			= NULL;
+	size_t			capacity		= 0;
+	int64_t			nextInterval	= 0;
+	off_t			offset			= 0;
+	uint8_t			header			[ WAVPACK_HEADER_SIZE ];
+	
+	*count = 0;
+	
+	for(;;) {
+		if(-1 == fseeko(file, offset, SEEK_SET) || WAVPACK_HEADER_SIZE != fread(header, 1, WAVPACK_HEADER_SIZE, file))
+			break;
+		
+		if(memcmp(header, "wvpk", 4))
+			break;
+		
+		uint32_t	blockSize		= readLittleInt32(header + 4);
+		uint32_t	blockIndex		= readLittleInt32(header + 16);
+		uint32_t	blockSamples	= readLittleInt32(header + 20);
+		uint32_t	flags			= readLittleInt32(header + 24);
+		
+		if(0 != blockSamples && (INITIAL_BLOCK & flags) && blockIndex >= nextInterval) {
+			if(*count == capacity) {
+				capacity	= (0 == capacity ? 256 : 2 * capacity);
+				points		= realloc(points, capacity * sizeof(SeekPoint));
+				if(NULL == points)
+					break;
+			}
+			
+			points[*count].frame	= blockIndex;
+			points[*count].offset	= offset;
+			++*count;
+			
+			nextInterval = blockIndex + interval;
+		}
+		
+		offset += 8 + blockSize;
+	}
+	
+	fclose(file);
+	
+	return points;
+}
+
+static const SeekPoint *
+seekPointForFrame(const SeekPoint *points, size_t count, int64_t frame)
+{
+	size_t low = 0, high = count;
+	
+	while(low < high) {
+		size_t middle = low + (high - low) / 2;
+		if(points[middle].frame <= frame)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	
+	return (0 == low ? NULL : points + (low - 1));
+}
+
+static int
+skipFrames(WavpackContext *wpc, int32_t *buffer, int64_t frameCount)
+{
+	while(0 < frameCount) {
+		uint32_t samplesRead = WavpackUnpackSamples(wpc, buffer, (uint32_t)MIN(frameCount, SKIP_BUFFER_FRAMES));
+		if(0 == samplesRead)
+			return 0;
+		frameCount -= samplesRead;
+	}
+	
+	return 1;
+}
+
+// Opens the file at the seek point and decodes up to frame, as WavPackDecoder's openAtSeekPoint: and skipFrames: do
+static WavpackContext *
+openAtFrame(const char *path, const SeekPoint *point, int64_t frame, int32_t *buffer, FILE **file)
+{
+	char			errorBuf		[ 80 ];
+	WavpackContext	*wpc			= NULL;
+	
+	*file = fopen(path, "r");
+	if(NULL == *file)
+		return NULL;
+	
+	if(0 == fseeko(*file, point->offset, SEEK_SET))
+		wpc = WavpackOpenFileInputEx(&sStreamReader, *file, NULL, errorBuf, OPEN_NORMALIZE, 0);
+	
+	if(NULL == wpc || (int64_t)WavpackGetSampleIndex(wpc) != point->frame || 0 == skipFrames(wpc, buffer, frame - point->frame)) {
+		if(NULL != wpc)
+			WavpackCloseFile(wpc);
+		fclose(*file), *file = NULL;
+		return NULL;
+	}
+	
+	return wpc;
+}
+
+int
+main(int argc, char *argv[])
+{
+	char			path			[ 64 ];
+	const char		*filename		= (1 < argc ? argv[1] : NULL);
+	unsigned		seeks			= (2 < argc ? (unsigned)strtoul(argv[2], NULL, 10) : 200);
+	char			errorBuf		[ 80 ];
+	double			start, elapsed;
+	
+	if(NULL == filename) {
+		snprintf(path, sizeof(path), "/tmp/benchmark_wavpack_seeking.XXXXXX");
+		int fd = mkstemp(path);
+		if(-1 == fd)
+			return EXIT_FAILURE;
+		close(fd);
+		
+		start = currentTime();
+		if(0 == createNoiseFile(path)) {
+			fprintf(stderr, "Unable to encode %s\n", path);
+			unlink(path);
+			return EXIT_FAILURE;
+		}
+		printf("Encoded %u seconds of noise in %.2f s\n", SYNTHETIC_SECONDS, currentTime() - start);
+		
+		filename = path;
+	}
+	
+	WavpackContext *wpc = WavpackOpenFileInput(filename, errorBuf, OPEN_NORMALIZE, 0);
+	if(NULL == wpc) {
+		fprintf(stderr, "Unable to open %s: %s\n", filename, errorBuf);
+		return EXIT_FAILURE;
+	}
+	
+	int			channels	= WavpackGetNumChannels(wpc);
+	int64_t		frames		= WavpackGetNumSamples(wpc);
+	int64_t		interval	= (int64_t)SEEK_TABLE_INTERVAL * WavpackGetSampleRate(wpc);
+	int32_t		*buffer		= malloc(SKIP_BUFFER_FRAMES * (size_t)channels * sizeof(int32_t));
+	int32_t		*expected	= malloc(COMPARE_FRAMES * (size_t)channels * sizeof(int32_t));
+	int32_t		*actual		= malloc(COMPARE_FRAMES * (size_t)channels * sizeof(int32_t));
+	int64_t		*targets	= malloc(seeks * sizeof(int64_t));
+	size_t		count		= 0;
+	unsigned	mismatches	= 0;
+	unsigned	i;
+	
+	if(NULL == buffer || NULL == expected || NULL == actual || NULL == targets || COMPARE_FRAMES >= frames)
+		return EXIT_FAILURE;
+	
+	start				= currentTime();
+	SeekPoint *points	= buildSeekTable(filename, interval, &count);
+	elapsed				= currentTime() - start;
+	
+	printf("Built a seek table of %zu entries (%zu bytes) for %lld frames in %.2f ms\n", count, count * sizeof(SeekPoint), (long long)frames, 1000 * elapsed);
+	
+	if(NULL == points)
+		return EXIT_FAILURE;
+	
+	srand(1);
+	for(i = 0; i < seeks; ++i)
+		targets[i] = (int64_t)(((double)rand() / RAND_MAX) * (frames - COMPARE_FRAMES));
+	
+	// libwavpack's seeking, reusing one context as the decoder does
+	double seekTime = 0;
+	for(i = 0; i < seeks; ++i) {
+		start = currentTime();
+		if(0 == WavpackSeekSample(wpc, (uint32_t)targets[i])) {
+			fprintf(stderr, "WavpackSeekSample failed at frame %lld\n", (long long)targets[i]);
+			return EXIT_FAILURE;
+		}
+		seekTime += currentTime() - start;
+	}
+	
+	// Seeking with the table, reopening the file at the nearest seek point each time
+	double tableTime = 0;
+	for(i = 0; i < seeks; ++i) {
+		const SeekPoint		*point		= seekPointForFrame(points, count, targets[i]);
+		FILE				*file		= NULL;
+		
+		start = currentTime();
+		WavpackContext *seeker = (NULL == point ? NULL : openAtFrame(filename, point, targets[i], buffer, &file));
+		tableTime += currentTime() - start;
+		
+		if(NULL == seeker) {
+			fprintf(stderr, "Unable to seek with the table to frame %lld\n", (long long)targets[i]);
+			return EXIT_FAILURE;
+		}
+		
+		// The same audio must follow both seeks
+		if(0 == WavpackSeekSample(wpc, (uint32_t)targets[i]) || COMPARE_FRAMES != WavpackUnpackSamples(wpc, expected, COMPARE_FRAMES) || 
+		   COMPARE_FRAMES != WavpackUnpackSamples(seeker, actual, COMPARE_FRAMES) || memcmp(expected, actual, COMPARE_FRAMES * (size_t)channels * sizeof(int32_t)))
+			++mismatches;
+		
+		WavpackCloseFile(seeker);
+		fclose(file);
+	}
+	
+	printf("%u seeks: libwavpack %.3f ms, seek table %.3f ms per seek (%.1fx)\n", seeks, 1000 * seekTime / seeks, 1000 * tableTime / seeks, (0 < tableTime ? seekTime / tableTime : 0));
+	printf("%u mismatches\n", mismatches);
+	
+	WavpackCloseFile(wpc);
+	free(points);
+	free(buffer);
+	free(expected);
+	free(actual);
+	free(targets);
+	
+	if(filename == path)
+		unlink(path);
+	
+	return (0 == mismatches ? EXIT_SUCCESS : EXIT_FAILURE);
+}
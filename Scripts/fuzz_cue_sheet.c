@@ -0,0 +1,242 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// ========================================
+// Fuzz harness for the cue sheet scanner used by CueSheetParser
+// With libFuzzer:
+//   clang -g -O1 -fsanitize=fuzzer,address,undefined -o fuzz_cue_sheet fuzz_cue_sheet.c ../Utilities/CueSheetScanner.c
+//   ./fuzz_cue_sheet corpus/
+// Without it the built-in driver runs each file given, or random mutations of a sample cue sheet:
+//   cc -g -O1 -DCUE_SHEET_FUZZ_STANDALONE -fsanitize=address,undefined -o fuzz_cue_sheet fuzz_cue_sheet.c ../Utilities/CueSheetScanner.c
+//   ./fuzz_cue_sheet [-n iterations] [file ...]
+// ========================================
+
+#include "../Utilities/CueSheetScanner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(condition)																	\
+	do {																					\
+		if(!(condition)) {																	\
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);	\
+			abort();																		\
+		}																					\
+	} while(0)
+
+static void
+checkRange(const uint8_t *pointer, size_t length, const uint8_t *lineStart, const uint8_t *lineEnd)
+{
+	CHECK(pointer >= lineStart);
+	CHECK(pointer + length <= lineEnd);
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	size_t				byteOrderMarkLength		= 0;
+	CueSheetEncoding	encoding				= cueSheetDetectEncoding(data, size, &byteOrderMarkLength);
+	
+	CHECK(byteOrderMarkLength <= size);
+	
+	// CueSheetParser converts UTF-16 to UTF-8 before scanning, so scan the bytes
+	// as-is; the scanner must cope with anything
+	(void)encoding;
+	
+	const uint8_t		*p						= data + byteOrderMarkLength;
+	const uint8_t		*end					= data + size;
+	const uint8_t		*lineStart				= NULL;
+	const uint8_t		*lineEnd				= NULL;
+	CueSheetCommand		command;
+	
+	while(cueSheetNextLine(&p, end, &lineStart, &lineEnd)) {
+		CHECK(lineStart <= lineEnd);
+		CHECK(lineEnd <= p);
+		CHECK(p <= end);
+		
+		cueSheetScanCommand(lineStart, lineEnd, &command);
+		
+		if(kCueSheetCommandNone == command.type) {
+			CHECK(0 == command.keywordLength);
+			continue;
+		}
+		
+		checkRange(command.keyword, command.keywordLength, lineStart, lineEnd);
+		if(NULL != command.argument)
+			checkRange(command.argument, command.argumentLength, lineStart, lineEnd);
+		
+		// INDEX has no string argument
+		if(kCueSheetCommandIndex == command.type && command.valid)
+			CHECK(NULL == command.argument);
+	}
+	
+	return 0;
+}
+
+#ifdef CUE_SHEET_FUZZ_STANDALONE
+
+static const char sSampleCueSheet [] = 
+	"\xEF\xBB\xBF"
+	"REM GENRE Rock\r\n"
+	"CATALOG 0000000000000\r\n"
+	"PERFORMER \"Some Artist\"\r\n"
+	"TITLE \"Some Album\"\r\n"
+	"FILE \"Some Album.flac\" WAVE\r\n"
+	"  TRACK 01 AUDIO\r\n"
+	"    TITLE \"First\"\r\n"
+	"    ISRC USXXX0000001\r\n"
+	"    INDEX 01 00:00:00\r\n"
+	"  TRACK 02 AUDIO\r\n"
+	"    TITLE \"Second \x83\x65\x83\x58\x83\x67\"\r\n"
+	"    SONGWRITER Someone\r\n"
+	"    INDEX 00 04:58:70\r\n"
+	"    INDEX 01 05:01:12\n"
+	"  TRACK 3 MODE1/2352\n"
+	"    INDEX 1 99999999999:00:00\n";
+
+static void
+runFile(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if(NULL == file) {
+		perror(path);
+		return;
+	}
+	
+	uint8_t		*data		= NULL;
+	size_t		size		= 0;
+	size_t		capacity	= 0;
+	
+	for(;;) {
+		if(size == capacity) {
+			capacity = (0 == capacity ? 4096 : 2 * capacity);
+			data = realloc(data, capacity);
+			if(NULL == data)
+				abort();
+		}
+		
+		size_t bytesRead = fread(data + size, 1, capacity - size, file);
+		if(0 == bytesRead)
+			break;
+		size += bytesRead;
+	}
+	
+	fclose(file);
+	
+	// Copy into an exactly-sized buffer so reads past the end are caught
+	uint8_t *input = malloc(size ? size : 1);
+	memcpy(input, data, size);
+	LLVMFuzzerTestOneInput(input, size);
+	
+	free(input);
+	free(data);
+}
+
+// Flips, inserts, deletes and duplicates bytes; interesting bytes are favored
+static size_t
+mutate(uint8_t *data, size_t size, size_t capacity)
+{
+	static const uint8_t sInterestingBytes [] = { '"', ':', ' ', '\t', '\r', '\n', '0', '9', 0x00, 0x80, 0xFF, 0xFE, 0xEF };
+	
+	unsigned mutations = 1 + (unsigned)(rand() % 8);
+	while(mutations--) {
+		size_t	position	= (0 == size ? 0 : (size_t)rand() % size);
+		uint8_t	byte		= (rand() & 1) ? (uint8_t)rand() : sInterestingBytes[(size_t)rand() % sizeof(sInterestingBytes)];
+		
+		switch(rand() % 4) {
+			case 0:
+				if(0 != size)
+					data[position] = byte;
+				break;
+				
+			case 1:
+				if(size < capacity) {
+					memmove(data + position + 1, data + position, size - position);
+					data[position] = byte;
+					++size;
+				}
+				break;
+				
+			case 2:
+				if(0 != size) {
+					memmove(data + position, data + position + 1, size - position - 1);
+					--size;
+				}
+				break;
+				
+			case 3:
+			{
+				size_t length = (size_t)rand() % 32;
+				if(position + length <= size && size + length <= capacity) {
+					// Duplicates the run of bytes at position
+					memmove(data + position + length, data + position, size - position);
+					size += length;
+				}
+				break;
+			}
+		}
+	}
+	
+	return size;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long	iterations	= 100000;
+	int				i			= 1;
+	
+	if(3 <= argc && 0 == strcmp("-n", argv[1])) {
+		iterations = strtoul(argv[2], NULL, 10);
+		i = 3;
+	}
+	
+	if(i < argc) {
+		for(; i < argc; ++i)
+			runFile(argv[i]);
+		return EXIT_SUCCESS;
+	}
+	
+	size_t	capacity	= 4 * sizeof(sSampleCueSheet);
+	uint8_t	*buffer		= malloc(capacity);
+	
+	srand(1);
+	
+	unsigned long iteration;
+	for(iteration = 0; iteration < iterations; ++iteration) {
+		size_t size = sizeof(sSampleCueSheet) - 1;
+		memcpy(buffer, sSampleCueSheet, size);
+		size = mutate(buffer, size, capacity);
+		
+		uint8_t *input = malloc(size ? size : 1);
+		memcpy(input, buffer, size);
+		LLVMFuzzerTestOneInput(input, size);
+		free(input);
+	}
+	
+	free(buffer);
+	
+	printf("%lu inputs\n", iterations);
+	
+	return EXIT_SUCCESS;
+}
+
+#endif /* CUE_SHEET_FUZZ_STANDALONE */
@@ -0,0 +1,281 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// ========================================
+// A stand-in for the MusicDNS lookup service, for exercising PUID lookups
+// Answers each fingerprint lookup with a PUID derived from the fingerprint,
+// so repeated lookups of a print get the same answer
+//   cc -O2 -o musicdns_stub_server musicdns_stub_server.c
+//   ./musicdns_stub_server [-p port] [-u percent] [-e requests]
+//   defaults write <bundle identifier> musicDNSServiceURL http://localhost:8080/ofa/1/track
+// -u answers the given percentage of prints as unknown
+// -e fails every given number of requests with 503 Service Unavailable
+// Each request is printed with the time since the previous one, so the
+// lookup rate limit and the PUID cache can be observed
+// ========================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define REQUEST_BUFFER_SIZE		(64 * 1024)
+
+static volatile sig_atomic_t	sKeepRunning		= 1;
+
+static void
+handleSignal(int signal)
+{
+	(void)signal;
+	sKeepRunning = 0;
+}
+
+static double
+currentTime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + ((double)now.tv_nsec / 1000000000.0);
+}
+
+static int
+writeAll(int fd, const char *buffer, size_t length)
+{
+	while(0 < length) {
+		ssize_t bytesWritten = write(fd, buffer, length);
+		if(-1 == bytesWritten) {
+			if(EINTR == errno)
+				continue;
+			return -1;
+		}
+		
+		buffer += bytesWritten;
+		length -= (size_t)bytesWritten;
+	}
+	
+	return 0;
+}
+
+// FNV-1a, used to derive a stable PUID from a fingerprint
+static uint64_t
+hashBytes(const char *bytes, size_t length, uint64_t hash)
+{
+	size_t i;
+	for(i = 0; i < length; ++i) {
+		hash ^= (uint8_t)bytes[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+// Finds the value of a field in a form-encoded body; the value is not decoded
+static const char *
+findField(const char *body, const char *name, size_t *length)
+{
+	size_t		nameLength	= strlen(name);
+	const char	*field		= body;
+	
+	while(NULL != field && '\0' != *field) {
+		if(0 == strncmp(field, name, nameLength) && '=' == field[nameLength]) {
+			const char *value = field + nameLength + 1;
+			*length = strcspn(value, "&");
+			return value;
+		}
+		
+		field = strchr(field, '&');
+		if(NULL != field)
+			++field;
+	}
+	
+	return NULL;
+}
+
+// Reads the request headers and body into buffer; returns the body or NULL
+static char *
+readRequest(int fd, char *buffer, size_t capacity)
+{
+	size_t		used			= 0;
+	char		*body			= NULL;
+	size_t		contentLength	= 0;
+	
+	while(used < capacity - 1) {
+		ssize_t bytesRead = read(fd, buffer + used, capacity - 1 - used);
+		if(-1 == bytesRead && EINTR == errno)
+			continue;
+		if(0 >= bytesRead)
+			return NULL;
+		
+		used += (size_t)bytesRead;
+		buffer[used] = '\0';
+		
+		if(NULL == body) {
+			char *headersEnd = strstr(buffer, "\r\n\r\n");
+			if(NULL == headersEnd)
+				continue;
+			
+			body = headersEnd + 4;
+			
+			const char *header = buffer;
+			while(NULL != (header = strchr(header, '\n'))) {
+				++header;
+				if(0 == strncasecmp(header, "Content-Length:", 15))
+					contentLength = strtoul(header + 15, NULL, 10);
+			}
+		}
+		
+		if((size_t)(buffer + used - body) >= contentLength)
+			return body;
+	}
+	
+	return NULL;
+}
+
+static void
+serveConnection(int fd, unsigned unknownPercent, unsigned long failureInterval)
+{
+	static unsigned long	sRequestCount		= 0;
+	static double			sPreviousRequest	= 0;
+	
+	char		*buffer		= malloc(REQUEST_BUFFER_SIZE);
+	char		response	[ 2048 ];
+	char		document	[ 1024 ];
+	
+	if(NULL == buffer)
+		return;
+	
+	char *body = readRequest(fd, buffer, REQUEST_BUFFER_SIZE);
+	if(NULL == body) {
+		free(buffer);
+		return;
+	}
+	
+	double now = currentTime();
+	++sRequestCount;
+	
+	size_t		printLength		= 0;
+	const char	*print			= findField(body, "fpt", &printLength);
+	
+	printf("%lu +%.3fs fpt=%.*s%s\n", sRequestCount, (0 == sPreviousRequest ? 0 : now - sPreviousRequest), 
+		   (NULL == print ? 6 : (int)(16 < printLength ? 16 : printLength)), (NULL == print ? "(none)" : print), (16 < printLength ? "..." : ""));
+	fflush(stdout);
+	sPreviousRequest = now;
+	
+	if(0 != failureInterval && 0 == sRequestCount % failureInterval) {
+		const char *unavailable = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		writeAll(fd, unavailable, strlen(unavailable));
+		free(buffer);
+		return;
+	}
+	
+	uint64_t hash = hashBytes(NULL == print ? "" : print, printLength, 0xCBF29CE484222325ULL);
+	
+	if(NULL == print || hash % 100 < unknownPercent)
+		snprintf(document, sizeof(document), 
+				 "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				 "<metadata xmlns=\"http://musicbrainz.org/ns/mmd-1.0#\"><track></track></metadata>\n");
+	else {
+		uint64_t other = hashBytes(NULL == print ? "" : print, printLength, hash);
+		snprintf(document, sizeof(document), 
+				 "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				 "<metadata xmlns=\"http://musicbrainz.org/ns/mmd-1.0#\"><track><title>Stub Title</title><artist><name>Stub Artist</name></artist>"
+				 "<puid-list><puid id=\"%08x-%04x-%04x-%04x-%012llx\"/></puid-list></track></metadata>\n", 
+				 (unsigned)(hash >> 32), (unsigned)(hash >> 16) & 0xFFFF, (unsigned)hash & 0xFFFF, 
+				 (unsigned)(other >> 48), (unsigned long long)(other & 0xFFFFFFFFFFFFULL));
+	}
+	
+	int length = snprintf(response, sizeof(response), 
+						  "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n%s", 
+						  strlen(document), document);
+	
+	writeAll(fd, response, (size_t)length);
+	free(buffer);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned short		port				= 8080;
+	unsigned			unknownPercent		= 0;
+	unsigned long		failureInterval		= 0;
+	int					option;
+	
+	while(-1 != (option = getopt(argc, argv, "p:u:e:"))) {
+		switch(option) {
+			case 'p':	port				= (unsigned short)strtoul(optarg, NULL, 10);	break;
+			case 'u':	unknownPercent		= (unsigned)strtoul(optarg, NULL, 10);			break;
+			case 'e':	failureInterval		= strtoul(optarg, NULL, 10);					break;
+			default:
+				fprintf(stderr, "Usage: %s [-p port] [-u percent] [-e requests]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handleSignal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	if(-1 == listener) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+	
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family		= AF_INET;
+	address.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+	address.sin_port		= htons(port);
+	
+	if(-1 == bind(listener, (const struct sockaddr *)&address, sizeof(address)) || -1 == listen(listener, 8)) {
+		perror("bind");
+		close(listener);
+		return EXIT_FAILURE;
+	}
+	
+	printf("-- listening on port %u\n", port);
+	fflush(stdout);
+	
+	while(sKeepRunning) {
+		int connection = accept(listener, NULL, NULL);
+		if(-1 == connection)
+			continue;
+		
+		serveConnection(connection, unknownPercent, failureInterval);
+		close(connection);
+	}
+	
+	close(listener);
+	
+	return EXIT_SUCCESS;
+}
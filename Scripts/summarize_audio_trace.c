@@ -0,0 +1,231 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// ========================================
+// Summarizes a dump written by audioTraceWriteToFile()
+// Builds anywhere with a C99 compiler, so dumps can be examined off the Mac:
+//   cc -O2 -o summarize_audio_trace summarize_audio_trace.c -lm
+//   ./summarize_audio_trace play.trace
+// ========================================
+
+#define AUDIO_TRACE_FORMAT_ONLY
+#include "../Audio/AudioPipelineTrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#define HISTOGRAM_BUCKETS		24		// Powers of two, in microseconds
+
+static const char * const sCounterNames [AudioTraceCounterCount] = {
+	"slices scheduled",
+	"slices completed",
+	"late renders",
+	"frames decoded",
+	"decoder ticks",
+	"regions started",
+	"regions finished",
+	"seeks"
+};
+
+typedef struct {
+	uint64_t	buckets			[HISTOGRAM_BUCKETS];
+	uint64_t	count;
+	double		maximum;
+} Histogram;
+
+static void
+addToHistogram(Histogram *histogram, double microseconds)
+{
+	unsigned bucket = 0;
+	while(bucket < HISTOGRAM_BUCKETS - 1 && (double)(1 << (bucket + 1)) <= microseconds)
+		++bucket;
+	
+	++histogram->buckets[bucket];
+	++histogram->count;
+	
+	if(microseconds > histogram->maximum)
+		histogram->maximum = microseconds;
+}
+
+static void
+printHistogram(const char *title, const Histogram *histogram)
+{
+	uint64_t largest = 0;
+	
+	printf("\n%s (%" PRIu64 " samples, max %.1f us)\n", title, histogram->count, histogram->maximum);
+	if(0 == histogram->count)
+		return;
+	
+	for(unsigned i = 0; i < HISTOGRAM_BUCKETS; ++i)
+		if(histogram->buckets[i] > largest)
+			largest = histogram->buckets[i];
+	
+	for(unsigned i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+		if(0 == histogram->buckets[i])
+			continue;
+		
+		int width = (int)((50 * histogram->buckets[i] + largest - 1) / largest);
+		printf("  %9u - %9u us %10" PRIu64 " %.*s\n", (0 == i ? 0 : 1u << i), 1u << (i + 1), histogram->buckets[i], width, "##################################################");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	AudioTraceFileHeader	header;
+	
+	if(2 != argc) {
+		fprintf(stderr, "Usage: %s trace-file\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	
+	FILE *file = fopen(argv[1], "rb");
+	if(NULL == file) {
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+	
+	if(1 != fread(&header, sizeof(header), 1, file) || 0 != memcmp(header.magic, AUDIO_TRACE_FILE_MAGIC, sizeof(header.magic))) {
+		fprintf(stderr, "%s: Not an audio pipeline trace\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	
+	if(AUDIO_TRACE_FILE_VERSION != header.version || sizeof(AudioTraceEvent) != header.eventSize || 0 == header.timebaseDenom) {
+		fprintf(stderr, "%s: Unsupported trace version or byte order\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	
+	AudioTraceEvent *events = calloc((size_t)header.eventCount + 1, sizeof(AudioTraceEvent));
+	if(NULL == events || header.eventCount != fread(events, sizeof(AudioTraceEvent), (size_t)header.eventCount, file)) {
+		fprintf(stderr, "%s: Truncated trace\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	
+	fclose(file);
+	
+	double ticksToMicroseconds = (double)header.timebaseNumer / header.timebaseDenom / 1000.0;
+	
+	// Counters cover the whole session, events only the most recent part of it
+	printf("Counters\n");
+	for(unsigned i = 0; i < AudioTraceCounterCount; ++i)
+		printf("  %-18s %" PRIu64 "\n", sCounterNames[i], header.counters[i]);
+	
+	if(0 != header.counters[AudioTraceCounterFramesDecoded])
+		printf("  %-18s %.3f us\n", "decode per frame", header.counters[AudioTraceCounterDecoderTicks] * ticksToMicroseconds / header.counters[AudioTraceCounterFramesDecoded]);
+	
+	printf("\n%" PRIu64 " events, %" PRIu64 " dropped\n", header.eventCount, header.eventsDropped);
+	if(0 == header.eventCount)
+		return EXIT_SUCCESS;
+	
+	Histogram	decoderReads;
+	Histogram	completionIntervals;
+	uint64_t	firstTimestamp			= events[0].timestamp;
+	uint64_t	lastCompletion			= 0;
+	uint64_t	latestTimestamp			= firstTimestamp;
+	int64_t		slicesInFlight			= 0;
+	int64_t		minimumInFlight			= INT64_MAX;
+	int64_t		currentSecond			= 0;
+	uint64_t	lateThisSecond			= 0;
+	double		cpuLoadThisSecond		= -1;
+	
+	memset(&decoderReads, 0, sizeof(decoderReads));
+	memset(&completionIntervals, 0, sizeof(completionIntervals));
+	
+	// The in-flight depth is relative to the start of the dump, since slices may already be in flight
+	printf("\nTimeline (per second: minimum slices in flight relative to the start, late renders, CPU load)\n");
+	
+	for(uint64_t i = 0; i <= header.eventCount; ++i) {
+		const AudioTraceEvent	*event		= &events[i];
+		
+		// Threads can record events slightly out of timestamp order, so time never runs backwards here
+		if(i < header.eventCount && event->timestamp > latestTimestamp)
+			latestTimestamp = event->timestamp;
+		
+		uint64_t				timestamp	= latestTimestamp;
+		int64_t					second		= (i < header.eventCount ? (int64_t)((timestamp - firstTimestamp) * ticksToMicroseconds / 1000000.0) : INT64_MAX);
+		
+		if(second != currentSecond) {
+			if(0 != lateThisSecond || INT64_MAX != minimumInFlight) {
+				printf("  %10" PRId64 " s  in flight %+4" PRId64 "  late %4" PRIu64, currentSecond, (INT64_MAX == minimumInFlight ? slicesInFlight : minimumInFlight), lateThisSecond);
+				if(0 <= cpuLoadThisSecond)
+					printf("  cpu %5.1f%%", 100 * cpuLoadThisSecond);
+				printf("%s\n", (0 != lateThisSecond ? "  UNDERRUN" : ""));
+			}
+			
+			if(i == header.eventCount)
+				break;
+			
+			currentSecond		= second;
+			minimumInFlight		= INT64_MAX;
+			lateThisSecond		= 0;
+			cpuLoadThisSecond	= -1;
+		}
+		
+		switch(event->type) {
+			case AudioTraceEventSliceScheduled:
+				++slicesInFlight;
+				break;
+				
+			case AudioTraceEventSliceCompleted:
+				--slicesInFlight;
+				if(slicesInFlight < minimumInFlight)
+					minimumInFlight = slicesInFlight;
+				if(0 != lastCompletion)
+					addToHistogram(&completionIntervals, (timestamp - lastCompletion) * ticksToMicroseconds);
+				lastCompletion = timestamp;
+				break;
+				
+			case AudioTraceEventLateRender:
+				++lateThisSecond;
+				printf("  %10.3f s  late render of slice %" PRIu32 " at sample %" PRId64 "\n", (timestamp - firstTimestamp) * ticksToMicroseconds / 1000000.0, event->detail, event->value);
+				break;
+				
+			case AudioTraceEventDecoderRead:
+				addToHistogram(&decoderReads, event->value * ticksToMicroseconds);
+				break;
+				
+			case AudioTraceEventRegionStarted:
+				printf("  %10.3f s  region started at frame %" PRId64 "\n", (timestamp - firstTimestamp) * ticksToMicroseconds / 1000000.0, event->value);
+				break;
+				
+			case AudioTraceEventRegionFinished:
+				printf("  %10.3f s  region finished after %" PRId64 " frames\n", (timestamp - firstTimestamp) * ticksToMicroseconds / 1000000.0, event->value);
+				break;
+				
+			case AudioTraceEventSeek:
+				printf("  %10.3f s  seek to frame %" PRId64 "\n", (timestamp - firstTimestamp) * ticksToMicroseconds / 1000000.0, event->value);
+				break;
+				
+			case AudioTraceEventCPULoad:
+				cpuLoadThisSecond = fmax(cpuLoadThisSecond, event->value / 1000000.0);
+				break;
+		}
+	}
+	
+	printHistogram("Decoder read latency", &decoderReads);
+	printHistogram("Slice completion interval", &completionIntervals);
+	
+	free(events);
+	
+	return EXIT_SUCCESS;
+}
@@ -19,7 +19,7 @@ using namespace std;
 
 #include "protocol.h"
 
-const char *url = "http://ofa.musicdns.org/ofa/1/track"; 
+string url = "http://ofa.musicdns.org/ofa/1/track"; 
 const char *userAgent = "libofa_example";
 const char *unknown = "unknown";
 
@@ -181,6 +181,12 @@ bool parse_xml(const string &doc, TrackInformation *info, string &err)
 // Retrieve metadata for fingerprint
 // --------------------------------------------------------------------
 
+// Allows requests to be sent to a stand-in for the service
+void set_service_url(string service_url)
+{
+    url = service_url;
+}
+
 // Returns true on success
 bool retrieve_metadata(string client_key, string client_version,
 	TrackInformation *info, bool getMetadata) 
@@ -64,6 +64,7 @@ public:
 // Get your unique key at http://www.musicdns.org
 bool retrieve_metadata(string client_key, string client_verstion,
 	TrackInformation *info, bool getMetadata);
+void set_service_url(string service_url);
 
 class AudioData {
 private:
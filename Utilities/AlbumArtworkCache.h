@@ -0,0 +1,89 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+// ========================================
+// Notification posted (on the main thread) when artwork for a file has been cached
+// The userInfo dictionary contains the file's URL for the key StreamURLKey
+// ========================================
+extern NSString * const		AlbumArtworkCacheDidCacheArtworkNotification;
+
+// ========================================
+// Thumbnail sizes, in pixels along the longest edge
+// ========================================
+enum {
+	AlbumArtworkSmallSize				= 32,
+	AlbumArtworkMediumSize				= 64,
+	AlbumArtworkLargeSize				= 128,
+	AlbumArtworkExtraLargeSize			= 256
+};
+
+// ========================================
+// A persistent, content-addressed cache of embedded album artwork
+// Artwork is extracted from files in the background and stored only as
+// pre-scaled PNG thumbnails in a single pack file, which is memory mapped
+// for reading.  Identical images (for example, the same cover embedded in
+// every track of an album) are stored once, keyed by their SHA-1 digest
+// Decoded thumbnails are kept in memory, and the pack is compacted when
+// the index is saved if much of it is no longer referenced
+// ========================================
+@class AudioStream;
+
+@interface AlbumArtworkCache : NSObject
+{
+	@private
+	NSString				*_packPath;			// Concatenated PNG thumbnails
+	NSString				*_indexPath;		// Property list mapping files and digests to ranges in the pack
+	
+	NSMutableDictionary		*_images;			// SHA-1 digest -> (thumbnail size -> range in the pack)
+	NSMutableDictionary		*_files;			// File URL -> SHA-1 digest (empty if the file has no artwork) and file stamp
+	NSData					*_pack;				// The memory mapped pack file, or nil if not mapped
+	NSCache					*_thumbnails;		// Decoded thumbnails (or NSNull) keyed by size and URL, with the file stamp they are for
+	NSLock					*_packLock;			// Serializes changes to the pack and index; readers only take the object's lock
+	
+	NSOperationQueue		*_queue;			// Extraction and scaling happen here
+	NSMutableSet			*_pendingURLs;		// Files queued for extraction
+}
+
+// ========================================
+// The shared instance
++ (AlbumArtworkCache *) sharedCache;
+
+// ========================================
+// Queue the artwork in a file for caching, if it isn't cached already
+- (void) cacheArtworkForURL:(NSURL *)url;
+
+// ========================================
+// Returns nil if the file has no artwork, or if it hasn't been cached yet
+// (in which case it is queued for caching and a notification is posted when complete)
+// Entries are stamped with the file's size and modification date, and a file
+// that has changed since it was cached is treated as not cached
+- (NSImage *) artworkForURL:(NSURL *)url size:(NSUInteger)size;
+
+// As above, but the file stamp stored with the stream is trusted, so a thumbnail
+// already in memory is returned without touching the disk (for drawing table cells)
+- (NSImage *) artworkForStream:(AudioStream *)stream size:(NSUInteger)size;
+
+// ========================================
+// Discard all cached artwork
+- (void) removeAllArtwork;
+
+@end
@@ -0,0 +1,603 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AlbumArtworkCache.h"
+#import "AudioStream.h"
+#import "UtilityFunctions.h"
+
+#include <CommonCrypto/CommonDigest.h>
+#include <ApplicationServices/ApplicationServices.h>
+#include <stdio.h>
+
+#include <FLAC/metadata.h>
+
+#include <taglib/mpegfile.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/attachedpictureframe.h>
+
+NSString * const	AlbumArtworkCacheDidCacheArtworkNotification	= @"org.sbooth.Play.AlbumArtworkCache.DidCacheArtworkNotification";
+
+static NSString * const		AlbumArtworkImagesKey	= @"images";
+static NSString * const		AlbumArtworkFilesKey	= @"files";
+static NSString * const		AlbumArtworkDigestKey	= @"digest";
+static NSString * const		AlbumArtworkImageKey	= @"image";
+
+// Decoded thumbnails kept in memory, enough for a few screens of the library in every size
+#define THUMBNAIL_CACHE_COUNT_LIMIT		2048
+
+// The pack is rewritten once this fraction of it holds images no file refers to any more
+#define PACK_COMPACTION_THRESHOLD		0.25
+#define PACK_COMPACTION_MINIMUM_BYTES	(1024 * 1024)
+
+// The thumbnail sizes stored for each image, smallest first
+static const NSUInteger		sThumbnailSizes []		= { AlbumArtworkSmallSize, AlbumArtworkMediumSize, AlbumArtworkLargeSize, AlbumArtworkExtraLargeSize };
+#define THUMBNAIL_SIZE_COUNT	(sizeof(sThumbnailSizes) / sizeof(sThumbnailSizes[0]))
+
+// ========================================
+// Returns the raw image data embedded in the file, preferring the front cover
+static NSData *
+copyEmbeddedArtwork(NSURL *url)
+{
+	NSString	*path				= [url path];
+	NSString	*pathExtension		= [[path pathExtension] lowercaseString];
+	NSData		*artwork			= nil;
+	
+	if([pathExtension isEqualToString:@"flac"]) {
+		FLAC__StreamMetadata *picture = NULL;
+		
+		// Any picture type, with no limits on the dimensions
+		if(FLAC__metadata_get_picture([path fileSystemRepresentation], &picture, (FLAC__StreamMetadata_Picture_Type)(-1), NULL, NULL, (unsigned)(-1), (unsigned)(-1), (unsigned)(-1), (unsigned)(-1))) {
+			artwork = [NSData dataWithBytes:picture->data.picture.data length:picture->data.picture.data_length];
+			FLAC__metadata_object_delete(picture);
+		}
+	}
+	else if([pathExtension isEqualToString:@"mp3"]) {
+		TagLib::MPEG::File f([path fileSystemRepresentation], false);
+		
+		if(f.isValid() && NULL != f.ID3v2Tag()) {
+			TagLib::ID3v2::FrameList						frameList		= f.ID3v2Tag()->frameListMap()["APIC"];
+			TagLib::ID3v2::AttachedPictureFrame				*picture		= NULL;
+			TagLib::ID3v2::FrameList::Iterator				frameIterator;
+			
+			for(frameIterator = frameList.begin(); frameIterator != frameList.end(); ++frameIterator) {
+				TagLib::ID3v2::AttachedPictureFrame *frame = dynamic_cast<TagLib::ID3v2::AttachedPictureFrame *>(*frameIterator);
+				if(NULL == frame)
+					continue;
+				
+				if(NULL == picture || TagLib::ID3v2::AttachedPictureFrame::FrontCover == frame->type())
+					picture = frame;
+			}
+			
+			if(NULL != picture) {
+				TagLib::ByteVector bv = picture->picture();
+				artwork = [NSData dataWithBytes:bv.data() length:bv.size()];
+			}
+		}
+	}
+	
+	return artwork;
+}
+
+// ========================================
+// The hex-encoded SHA-1 digest of data
+static NSString *
+digestForData(NSData *data)
+{
+	unsigned char	digest [CC_SHA1_DIGEST_LENGTH];
+	NSMutableString	*result		= [NSMutableString stringWithCapacity:2 * CC_SHA1_DIGEST_LENGTH];
+	
+	CC_SHA1([data bytes], (CC_LONG)[data length], digest);
+	
+	unsigned i;
+	for(i = 0; i < CC_SHA1_DIGEST_LENGTH; ++i)
+		[result appendFormat:@"%02x", digest[i]];
+	
+	return result;
+}
+
+// ========================================
+// Scales the image to fit in a size x size square and encodes it as PNG
+static NSData *
+createThumbnail(CGImageSourceRef source, NSUInteger size)
+{
+	NSDictionary *options = [NSDictionary dictionaryWithObjectsAndKeys:
+		(id)kCFBooleanTrue, (id)kCGImageSourceCreateThumbnailFromImageAlways,
+		(id)kCFBooleanTrue, (id)kCGImageSourceCreateThumbnailWithTransform,
+		[NSNumber numberWithUnsignedInteger:size], (id)kCGImageSourceThumbnailMaxPixelSize,
+		nil];
+	
+	CGImageRef thumbnail = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)options);
+	if(NULL == thumbnail)
+		return nil;
+	
+	NSMutableData			*pngData		= [NSMutableData data];
+	CGImageDestinationRef	destination		= CGImageDestinationCreateWithData((__bridge CFMutableDataRef)pngData, CFSTR("public.png"), 1, NULL);
+	
+	if(NULL == destination) {
+		CGImageRelease(thumbnail);
+		return nil;
+	}
+	
+	CGImageDestinationAddImage(destination, thumbnail, NULL);
+	bool success = CGImageDestinationFinalize(destination);
+	
+	CFRelease(destination);
+	CGImageRelease(thumbnail);
+	
+	return (success ? pngData : nil);
+}
+
+// ========================================
+// Returns YES if the file hasn't changed since its entry was made
+static BOOL
+fileEntryIsCurrent(NSDictionary *entry, NSDictionary *fileStamp)
+{
+	if(NO == [entry isKindOfClass:[NSDictionary class]] || nil == fileStamp)
+		return NO;
+	
+	NSNumber	*size		= [entry objectForKey:FileSizeKey];
+	NSDate		*date		= [entry objectForKey:FileModificationDateKey];
+	
+	if(nil == size || nil == date)
+		return NO;
+	
+	return ([size isEqualToNumber:[fileStamp objectForKey:FileSizeKey]]
+			&& 0.000001 > fabs([date timeIntervalSinceDate:[fileStamp objectForKey:FileModificationDateKey]]));
+}
+
+@interface AlbumArtworkCache (Private)
+- (NSString *) digestForURL:(NSURL *)url;
+- (NSImage *) artworkForURL:(NSURL *)url fileStamp:(NSDictionary *)fileStamp size:(NSUInteger)size;
+- (void) extractArtworkForURL:(NSURL *)url;
+- (NSDictionary *) appendThumbnailsToPack:(NSArray *)thumbnails;
+- (void) saveIndex;
+- (void) compactPackIfNeeded;
+- (void) postDidCacheArtworkNotificationForURL:(NSURL *)url;
+@end
+
+// ========================================
+// The singleton instance
+// ========================================
+static AlbumArtworkCache *sharedCacheInstance = nil;
+
+@implementation AlbumArtworkCache
+
++ (AlbumArtworkCache *) sharedCache
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedCacheInstance = [[self alloc] init];
+    });
+    return sharedCacheInstance;
+}
+
+- (id) init
+{
+	if((self = [super init])) {
+		NSArray *paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+		NSAssert(nil != paths && 0 != [paths count], @"Unable to locate the \"Caches\" folder.");
+		
+		NSString *applicationName	= [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleName"];
+		NSString *cacheFolder		= [[paths objectAtIndex:0] stringByAppendingPathComponent:applicationName];
+		
+		if(NO == [[NSFileManager defaultManager] fileExistsAtPath:cacheFolder]) {
+			BOOL success = [[NSFileManager defaultManager] createDirectoryAtPath:cacheFolder withIntermediateDirectories:YES attributes:nil error:nil];
+			NSAssert(YES == success, @"Unable to create the \"Caches\" folder.");
+		}
+		
+		_packPath		= [cacheFolder stringByAppendingPathComponent:@"Artwork.pack"];
+		_indexPath		= [cacheFolder stringByAppendingPathComponent:@"Artwork.plist"];
+		
+		// An index without its pack (or vice versa) is useless
+		NSDictionary *index = nil;
+		if([[NSFileManager defaultManager] fileExistsAtPath:_packPath])
+			index = [NSDictionary dictionaryWithContentsOfFile:_indexPath];
+		
+		_images			= [[NSMutableDictionary alloc] initWithDictionary:[index objectForKey:AlbumArtworkImagesKey]];
+		_files			= [[NSMutableDictionary alloc] init];
+		
+		// Entries from before files were stamped are dropped, so the files are examined again
+		NSDictionary *files = [index objectForKey:AlbumArtworkFilesKey];
+		for(NSString *key in files) {
+			if([[files objectForKey:key] isKindOfClass:[NSDictionary class]])
+				[_files setObject:[files objectForKey:key] forKey:key];
+		}
+		
+		_pendingURLs	= [[NSMutableSet alloc] init];
+		_packLock		= [[NSLock alloc] init];
+		
+		_thumbnails		= [[NSCache alloc] init];
+		[_thumbnails setCountLimit:THUMBNAIL_CACHE_COUNT_LIMIT];
+		
+		_queue			= [[NSOperationQueue alloc] init];
+		[_queue setMaxConcurrentOperationCount:[[NSProcessInfo processInfo] activeProcessorCount]];
+		
+		if(nil == index)
+			[[NSFileManager defaultManager] removeItemAtPath:_packPath error:nil];
+	}
+	return self;
+}
+
+- (void) cacheArtworkForURL:(NSURL *)url
+{
+	NSParameterAssert(nil != url);
+	
+	@synchronized(self) {
+		if(nil != [self digestForURL:url] || [_pendingURLs containsObject:url])
+			return;
+		
+		[_pendingURLs addObject:url];
+	}
+	
+	[_queue addOperationWithBlock:^{
+		[self extractArtworkForURL:url];
+	}];
+}
+
+- (NSImage *) artworkForURL:(NSURL *)url size:(NSUInteger)size
+{
+	NSParameterAssert(nil != url);
+	
+	return [self artworkForURL:url fileStamp:getFileStampForURL(url) size:size];
+}
+
+- (NSImage *) artworkForStream:(AudioStream *)stream size:(NSUInteger)size
+{
+	NSParameterAssert(nil != stream);
+	
+	NSURL			*url			= [stream valueForKey:StreamURLKey];
+	NSDictionary	*fileStamp		= nil;
+	
+	// Streams added before files were stamped have to be checked on disk
+	if(nil != [stream valueForKey:FileSizeKey] && nil != [stream valueForKey:FileModificationDateKey])
+		fileStamp = [NSDictionary dictionaryWithObjectsAndKeys:
+			[stream valueForKey:FileSizeKey], FileSizeKey,
+			[stream valueForKey:FileModificationDateKey], FileModificationDateKey,
+			nil];
+	else
+		fileStamp = getFileStampForURL(url);
+	
+	return [self artworkForURL:url fileStamp:fileStamp size:size];
+}
+
+- (void) removeAllArtwork
+{
+	[_queue cancelAllOperations];
+	
+	[_packLock lock];
+	
+	@synchronized(self) {
+		[_images removeAllObjects];
+		[_files removeAllObjects];
+		[_pendingURLs removeAllObjects];
+		[_thumbnails removeAllObjects];
+		_pack = nil;
+		
+		[[NSFileManager defaultManager] removeItemAtPath:_packPath error:nil];
+		[[NSFileManager defaultManager] removeItemAtPath:_indexPath error:nil];
+	}
+	
+	[_packLock unlock];
+}
+
+@end
+
+@implementation AlbumArtworkCache (Private)
+
+// Returns nil if the file hasn't been cached, or has changed since it was
+// Must be called with the lock held
+- (NSString *) digestForURL:(NSURL *)url
+{
+	NSDictionary *entry = [_files objectForKey:[url absoluteString]];
+	if(nil == entry)
+		return nil;
+	
+	// Tag edits can add, remove or replace the artwork, and "no artwork" is worth checking again too
+	if(NO == fileEntryIsCurrent(entry, getFileStampForURL(url))) {
+		[_files removeObjectForKey:[url absoluteString]];
+		return nil;
+	}
+	
+	return [entry objectForKey:AlbumArtworkDigestKey];
+}
+
+// Thumbnails are decoded once and kept with the stamp of the file they came from,
+// so drawing a cell that was drawn before costs a dictionary lookup
+- (NSImage *) artworkForURL:(NSURL *)url fileStamp:(NSDictionary *)fileStamp size:(NSUInteger)size
+{
+	NSString		*cacheKey	= [NSString stringWithFormat:@"%lu %@", (unsigned long)size, [url absoluteString]];
+	NSDictionary	*cached		= [_thumbnails objectForKey:cacheKey];
+	
+	if(fileEntryIsCurrent(cached, fileStamp)) {
+		id image = [cached objectForKey:AlbumArtworkImageKey];
+		return ([image isKindOfClass:[NSImage class]] ? image : nil);
+	}
+	
+	NSData *thumbnail = nil;
+	
+	@synchronized(self) {
+		// The stamp given is usually the one the entry was made with, which saves a stat()
+		NSDictionary	*entry		= [_files objectForKey:[url absoluteString]];
+		NSString		*digest		= (fileEntryIsCurrent(entry, fileStamp) ? [entry objectForKey:AlbumArtworkDigestKey] : [self digestForURL:url]);
+		
+		if(nil == digest) {
+			[self cacheArtworkForURL:url];
+			return nil;
+		}
+		
+		// Use the smallest thumbnail at least as large as the requested size
+		// Files without artwork are recorded with an empty digest
+		if(0 != [digest length]) {
+			NSUInteger i;
+			for(i = 0; i < THUMBNAIL_SIZE_COUNT - 1 && sThumbnailSizes[i] < size; ++i)
+				;
+			
+			NSString *rangeString = [[_images objectForKey:digest] objectForKey:[NSString stringWithFormat:@"%lu", (unsigned long)sThumbnailSizes[i]]];
+			if(nil == rangeString)
+				return nil;
+			
+			if(nil == _pack)
+				_pack = [NSData dataWithContentsOfFile:_packPath options:NSDataReadingMappedIfSafe error:nil];
+			
+			NSRange range = NSRangeFromString(rangeString);
+			if(NSMaxRange(range) > [_pack length])
+				return nil;
+			
+			thumbnail = [_pack subdataWithRange:range];
+		}
+	}
+	
+	// Decoding happens outside the lock so extraction isn't held up by drawing
+	NSImage *image = (nil != thumbnail ? [[NSImage alloc] initWithData:thumbnail] : nil);
+	
+	if(nil != fileStamp)
+		[_thumbnails setObject:[NSDictionary dictionaryWithObjectsAndKeys:
+			(nil != image ? (id)image : (id)[NSNull null]), AlbumArtworkImageKey,
+			[fileStamp objectForKey:FileSizeKey], FileSizeKey,
+			[fileStamp objectForKey:FileModificationDateKey], FileModificationDateKey,
+			nil] forKey:cacheKey];
+	
+	return image;
+}
+
+// Called on a worker thread
+- (void) extractArtworkForURL:(NSURL *)url
+{
+	// Stamp the entry before reading, so a change made during extraction is seen next time
+	NSDictionary	*fileStamp		= getFileStampForURL(url);
+	NSData			*artwork		= copyEmbeddedArtwork(url);
+	NSString		*digest			= (nil == artwork ? @"" : digestForData(artwork));
+	NSMutableArray	*thumbnails		= nil;
+	BOOL			known			= NO;
+	
+	@synchronized(self) {
+		known = (0 == [digest length] || nil != [_images objectForKey:digest]);
+	}
+	
+	// Only scale images that aren't already in the pack
+	if(NO == known) {
+		CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)artwork, NULL);
+		
+		if(NULL != source) {
+			thumbnails = [NSMutableArray array];
+			
+			NSUInteger i;
+			for(i = 0; i < THUMBNAIL_SIZE_COUNT; ++i) {
+				NSData *thumbnail = createThumbnail(source, sThumbnailSizes[i]);
+				if(nil == thumbnail) {
+					thumbnails = nil;
+					break;
+				}
+				
+				[thumbnails addObject:thumbnail];
+			}
+			
+			CFRelease(source);
+		}
+		
+		// Undecodable images are treated as missing
+		if(nil == thumbnails)
+			digest = @"";
+	}
+	
+	// The pack is written holding only the pack lock, so drawing isn't held up by the disk
+	[_packLock lock];
+	
+	NSDictionary	*ranges			= nil;
+	BOOL			queueDrained	= NO;
+	
+	// Another file with the same artwork may have been processed in the meantime
+	if(nil != thumbnails) {
+		@synchronized(self) {
+			known = (nil != [_images objectForKey:digest]);
+		}
+		
+		if(NO == known && nil == (ranges = [self appendThumbnailsToPack:thumbnails]))
+			digest = @"";
+	}
+	
+	@synchronized(self) {
+		if(nil != ranges) {
+			[_images setObject:ranges forKey:digest];
+			
+			// Remap the pack on the next read
+			_pack = nil;
+		}
+		
+		// Missing files aren't recorded
+		if(nil != fileStamp)
+			[_files setObject:[NSDictionary dictionaryWithObjectsAndKeys:
+				digest, AlbumArtworkDigestKey,
+				[fileStamp objectForKey:FileSizeKey], FileSizeKey,
+				[fileStamp objectForKey:FileModificationDateKey], FileModificationDateKey,
+				nil] forKey:[url absoluteString]];
+		
+		[_pendingURLs removeObject:url];
+		queueDrained = (0 == [_pendingURLs count]);
+	}
+	
+	// Write the index once the queue drains rather than after every file
+	if(queueDrained) {
+		[self compactPackIfNeeded];
+		[self saveIndex];
+	}
+	
+	[_packLock unlock];
+	
+	if(0 != [digest length])
+		[self performSelectorOnMainThread:@selector(postDidCacheArtworkNotificationForURL:) withObject:url waitUntilDone:NO];
+}
+
+// Must be called with the pack lock held
+- (NSDictionary *) appendThumbnailsToPack:(NSArray *)thumbnails
+{
+	FILE *file = fopen([_packPath fileSystemRepresentation], "ab");
+	if(NULL == file)
+		return nil;
+	
+	if(-1 == fseeko(file, 0, SEEK_END)) {
+		fclose(file);
+		return nil;
+	}
+	
+	NSMutableDictionary		*ranges		= [NSMutableDictionary dictionary];
+	off_t					offset		= ftello(file);
+	NSUInteger				i;
+	
+	for(i = 0; i < [thumbnails count]; ++i) {
+		NSData *thumbnail = [thumbnails objectAtIndex:i];
+		
+		if(1 != fwrite([thumbnail bytes], [thumbnail length], 1, file)) {
+			fclose(file);
+			return nil;
+		}
+		
+		[ranges setObject:NSStringFromRange(NSMakeRange((NSUInteger)offset, [thumbnail length])) forKey:[NSString stringWithFormat:@"%lu", (unsigned long)sThumbnailSizes[i]]];
+		offset += [thumbnail length];
+	}
+	
+	if(0 != fclose(file))
+		return nil;
+	
+	return ranges;
+}
+
+// Must be called with the pack lock held
+- (void) saveIndex
+{
+	NSDictionary *index = nil;
+	
+	@synchronized(self) {
+		index = [NSDictionary dictionaryWithObjectsAndKeys:
+			[_images copy], AlbumArtworkImagesKey,
+			[_files copy], AlbumArtworkFilesKey,
+			nil];
+	}
+	
+	if(NO == [index writeToFile:_indexPath atomically:YES])
+		NSLog(@"Unable to save the album artwork index to %@", _indexPath);
+}
+
+// Images stay in the pack after the files using them change or go away; once enough of
+// the pack is unreferenced it is rewritten with only the live thumbnails
+// Must be called with the pack lock held
+- (void) compactPackIfNeeded
+{
+	NSDictionary		*images			= nil;
+	NSMutableSet		*liveDigests	= [NSMutableSet set];
+	NSData				*pack			= nil;
+	unsigned long long	liveBytes		= 0;
+	
+	@synchronized(self) {
+		for(NSDictionary *entry in [_files allValues])
+			[liveDigests addObject:[entry objectForKey:AlbumArtworkDigestKey]];
+		
+		images	= [_images copy];
+		pack	= [NSData dataWithContentsOfFile:_packPath options:NSDataReadingMappedIfSafe error:nil];
+	}
+	
+	for(NSString *digest in liveDigests) {
+		for(NSString *rangeString in [[images objectForKey:digest] allValues])
+			liveBytes += NSRangeFromString(rangeString).length;
+	}
+	
+	unsigned long long deadBytes = [pack length] - MIN(liveBytes, (unsigned long long)[pack length]);
+	if(deadBytes < PACK_COMPACTION_MINIMUM_BYTES || deadBytes < PACK_COMPACTION_THRESHOLD * [pack length])
+		return;
+	
+	NSString			*compactedPath		= [_packPath stringByAppendingPathExtension:@"compacting"];
+	NSMutableDictionary	*compactedImages	= [NSMutableDictionary dictionary];
+	NSMutableData		*compactedPack		= [NSMutableData dataWithCapacity:(NSUInteger)liveBytes];
+	
+	for(NSString *digest in liveDigests) {
+		NSDictionary *ranges = [images objectForKey:digest];
+		if(nil == ranges)
+			continue;
+		
+		NSMutableDictionary *compactedRanges = [NSMutableDictionary dictionaryWithCapacity:[ranges count]];
+		
+		for(NSString *size in ranges) {
+			NSRange range = NSRangeFromString([ranges objectForKey:size]);
+			if(NSMaxRange(range) > [pack length])
+				break;
+			
+			[compactedRanges setObject:NSStringFromRange(NSMakeRange([compactedPack length], range.length)) forKey:size];
+			[compactedPack appendData:[pack subdataWithRange:range]];
+		}
+		
+		// An image with a damaged range is dropped, and extracted again when next needed
+		if([compactedRanges count] == [ranges count])
+			[compactedImages setObject:compactedRanges forKey:digest];
+	}
+	
+	if(NO == [compactedPack writeToFile:compactedPath atomically:NO]) {
+		[[NSFileManager defaultManager] removeItemAtPath:compactedPath error:nil];
+		return;
+	}
+	
+	// Readers map the pack under this lock, so they never pair the new file with the old ranges
+	@synchronized(self) {
+		if(0 != rename([compactedPath fileSystemRepresentation], [_packPath fileSystemRepresentation])) {
+			[[NSFileManager defaultManager] removeItemAtPath:compactedPath error:nil];
+			return;
+		}
+		
+		[_images setDictionary:compactedImages];
+		_pack = nil;
+		
+		// Entries whose image was dropped are examined again
+		for(NSString *key in [_files allKeys]) {
+			NSString *digest = [[_files objectForKey:key] objectForKey:AlbumArtworkDigestKey];
+			if(0 != [digest length] && nil == [_images objectForKey:digest])
+				[_files removeObjectForKey:key];
+		}
+	}
+	
+	NSLog(@"Compacted the album artwork pack from %lu to %lu bytes", (unsigned long)[pack length], (unsigned long)[compactedPack length]);
+}
+
+- (void) postDidCacheArtworkNotificationForURL:(NSURL *)url
+{
+	[[NSNotificationCenter defaultCenter] postNotificationName:AlbumArtworkCacheDidCacheArtworkNotification 
+														object:self 
+													  userInfo:[NSDictionary dictionaryWithObject:url forKey:StreamURLKey]];
+}
+
+@end
@@ -0,0 +1,583 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioFingerprintUtilities.h"
+#import "PUIDUtilities.h"
+#import "CollectionManager.h"
+#import "AudioStreamManager.h"
+#import "AudioStream.h"
+
+#include <Accelerate/Accelerate.h>
+
+#include <vector>
+#include <algorithm>
+
+// ========================================
+// The fingerprint is a sequence of 32-bit words, one per hop, where each bit is
+// the sign of the change in energy difference between adjacent frequency bands
+// The first FINGERPRINT_SECONDS of each stream are resampled to roughly 5.5 kHz
+// ========================================
+#define FINGERPRINT_SECONDS				30
+#define FINGERPRINT_SAMPLE_RATE			5512.5
+#define FINGERPRINT_FRAME_SIZE_LOG2		11
+#define FINGERPRINT_FRAME_SIZE			(1 << FINGERPRINT_FRAME_SIZE_LOG2)
+#define FINGERPRINT_HOP_SIZE			512
+#define FINGERPRINT_BANDS				33
+#define FINGERPRINT_MINIMUM_FREQUENCY	300.0
+#define FINGERPRINT_MAXIMUM_FREQUENCY	2000.0
+
+// Band energies this far below the loudest band are treated as silence
+#define SILENCE_THRESHOLD				1e-6f
+
+// ========================================
+// The signature is a SimHash of the stream's coarse spectrogram (SIGNATURE_SEGMENTS
+// time segments by SIGNATURE_BAND_GROUPS groups of bands) that is robust to noise,
+// level changes and small misalignments
+// The SIGNATURE_LENGTH bytes of the signature are split into SIGNATURE_BANDS 16-bit
+// locality-sensitive hashing bands; streams sharing at least MINIMUM_BAND_MATCHES
+// bands are compared using their complete fingerprints
+// With 65,536 values per band a library of 500,000 streams averages fewer than
+// 8 streams per bucket, so only unusually crowded buckets reach the cap
+// ========================================
+#define SIGNATURE_SEGMENTS				16
+#define SIGNATURE_BAND_GROUPS			16
+#define SIGNATURE_LENGTH				16
+#define SIGNATURE_BANDS					(SIGNATURE_LENGTH / sizeof(uint16_t))
+#define MINIMUM_BAND_MATCHES			2
+#define MAXIMUM_BUCKET_SIZE				256
+
+// Fingerprints match when their bit error rate at the best alignment is low enough
+#define MAXIMUM_ALIGNMENT_OFFSET		8
+#define MINIMUM_OVERLAP					64
+#define MAXIMUM_BIT_ERROR_RATE			0.30
+
+#define BUFFER_LENGTH					4096
+
+// The number of decoders opened for each fingerprinting worker
+#define STREAMS_IN_FLIGHT_PER_WORKER	2
+
+static inline uint32_t
+hashWord(uint32_t word, unsigned seed)
+{
+	uint32_t h = word ^ (0x9E3779B9u * (seed + 1));
+	
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	h *= 0x846CA68Bu;
+	h ^= h >> 16;
+	
+	return h;
+}
+
+// ========================================
+// Downmixes and resamples decoded audio to FINGERPRINT_SAMPLE_RATE, so hops span the
+// same time for every stream
+// Audio is appended a buffer at a time, so the memory each worker uses doesn't depend
+// on the stream's sample rate
+// The input is smoothed with a moving average of the resampling step to keep the
+// worst of the aliasing out
+// ========================================
+class FingerprintResampler
+{
+public:
+	FingerprintResampler(UInt32 channels, Float64 sampleRate)
+		: mChannels(channels), mStep(sampleRate / FINGERPRINT_SAMPLE_RATE), mWidth(std::max<UInt32>(1, (UInt32)mStep)), 
+		  mScale(1.f / (mWidth * channels * 32768.f)), mHistory(mWidth), mSum(0), mFrame(0), mNextSample(0), mPrevious(0)
+	{
+		mSamples.reserve((size_t)(FINGERPRINT_SECONDS * FINGERPRINT_SAMPLE_RATE) + 1);
+	}
+	
+	void Append(const int16_t *samples, UInt32 frameCount)
+	{
+		for(UInt32 i = 0; i < frameCount; ++i) {
+			int32_t frameSum = 0;
+			for(UInt32 channel = 0; channel < mChannels; ++channel)
+				frameSum += samples[i * mChannels + channel];
+			
+			int32_t &slot = mHistory[mFrame % mWidth];
+			if(mFrame >= mWidth)
+				mSum -= slot;
+			slot	= frameSum;
+			mSum	+= frameSum;
+			
+			// Interpolate each output sample that falls between the previous frame and this one
+			float mono = mSum * mScale;
+			if(0 != mFrame) {
+				for(;;) {
+					double		position	= mNextSample * mStep;
+					uint64_t	index		= (uint64_t)position;
+					if(index >= mFrame)
+						break;
+					
+					mSamples.push_back(mPrevious + (float)(position - index) * (mono - mPrevious));
+					++mNextSample;
+				}
+			}
+			
+			mPrevious = mono;
+			++mFrame;
+		}
+	}
+	
+	const std::vector<float>& Samples() const		{ return mSamples; }
+	
+private:
+	UInt32					mChannels;
+	double					mStep;
+	UInt32					mWidth;
+	float					mScale;
+	std::vector<int32_t>	mHistory;			// The last mWidth downmixed frames
+	int64_t					mSum;
+	uint64_t				mFrame;
+	uint64_t				mNextSample;
+	float					mPrevious;
+	std::vector<float>		mSamples;
+};
+
+static bool
+calculateFingerprint(const std::vector<float>& resampled, std::vector<uint32_t>& words, std::vector<uint8_t>& signature)
+{
+	size_t sampleCount = resampled.size();
+	
+	if(sampleCount < FINGERPRINT_FRAME_SIZE + 2 * FINGERPRINT_HOP_SIZE)
+		return false;
+	
+	// Logarithmically spaced bands, as FFT bin indexes
+	unsigned edges [ FINGERPRINT_BANDS + 1 ];
+	for(unsigned band = 0; band <= FINGERPRINT_BANDS; ++band) {
+		double frequency = FINGERPRINT_MINIMUM_FREQUENCY * pow(FINGERPRINT_MAXIMUM_FREQUENCY / FINGERPRINT_MINIMUM_FREQUENCY, (double)band / FINGERPRINT_BANDS);
+		edges[band] = (unsigned)lround(frequency * FINGERPRINT_FRAME_SIZE / FINGERPRINT_SAMPLE_RATE);
+		if(0 != band && edges[band] <= edges[band - 1])
+			edges[band] = edges[band - 1] + 1;
+	}
+	
+	size_t				frames			= 1 + (sampleCount - FINGERPRINT_FRAME_SIZE) / FINGERPRINT_HOP_SIZE;
+	std::vector<float>	energies		(frames * FINGERPRINT_BANDS);
+	std::vector<float>	window			(FINGERPRINT_FRAME_SIZE);
+	std::vector<float>	windowed		(FINGERPRINT_FRAME_SIZE);
+	std::vector<float>	real			(FINGERPRINT_FRAME_SIZE / 2);
+	std::vector<float>	imaginary		(FINGERPRINT_FRAME_SIZE / 2);
+	std::vector<float>	power			(FINGERPRINT_FRAME_SIZE / 2);
+	DSPSplitComplex		split			= { &real[0], &imaginary[0] };
+	FFTSetup			setup			= vDSP_create_fftsetup(FINGERPRINT_FRAME_SIZE_LOG2, kFFTRadix2);
+	float				loudest			= 0;
+	
+	if(NULL == setup)
+		return false;
+	
+	vDSP_hann_window(&window[0], FINGERPRINT_FRAME_SIZE, vDSP_HANN_NORM);
+	
+	for(size_t frame = 0; frame < frames; ++frame) {
+		vDSP_vmul(&resampled[frame * FINGERPRINT_HOP_SIZE], 1, &window[0], 1, &windowed[0], 1, FINGERPRINT_FRAME_SIZE);
+		vDSP_ctoz((const DSPComplex *)&windowed[0], 2, &split, 1, FINGERPRINT_FRAME_SIZE / 2);
+		vDSP_fft_zrip(setup, &split, 1, FINGERPRINT_FRAME_SIZE_LOG2, FFT_FORWARD);
+		vDSP_zvmags(&split, 1, &power[0], 1, FINGERPRINT_FRAME_SIZE / 2);
+		
+		float *bands = &energies[frame * FINGERPRINT_BANDS];
+		for(unsigned band = 0; band < FINGERPRINT_BANDS; ++band) {
+			float energy = 0;
+			for(unsigned bin = edges[band]; bin < edges[band + 1] && bin < FINGERPRINT_FRAME_SIZE / 2; ++bin)
+				energy += power[bin];
+			bands[band]	= energy;
+			loudest		= std::max(loudest, energy);
+		}
+	}
+	
+	vDSP_destroy_fftsetup(setup);
+	
+	words.assign(frames - 1, 0);
+	for(size_t frame = 1; frame < frames; ++frame) {
+		const float		*current	= &energies[frame * FINGERPRINT_BANDS];
+		const float		*previous	= &energies[(frame - 1) * FINGERPRINT_BANDS];
+		uint32_t		word		= 0;
+		
+		for(unsigned bit = 0; bit < 32; ++bit) {
+			if(0 < (current[bit] - current[bit + 1]) - (previous[bit] - previous[bit + 1]))
+				word |= (1u << bit);
+		}
+		
+		words[frame - 1] = word;
+	}
+	
+	// A stream that is entirely silent can't be matched
+	signature.clear();
+	if(0 == loudest)
+		return true;
+	
+	// Average the log energies into a coarse spectrogram, floored so quiet passages don't dominate
+	float	floor							= loudest * SILENCE_THRESHOLD;
+	float	coarse	[ SIGNATURE_SEGMENTS ][ SIGNATURE_BAND_GROUPS ];
+	
+	for(unsigned segment = 0; segment < SIGNATURE_SEGMENTS; ++segment) {
+		size_t first	= frames * segment / SIGNATURE_SEGMENTS;
+		size_t last		= std::max(first + 1, frames * (segment + 1) / SIGNATURE_SEGMENTS);
+		
+		for(unsigned group = 0; group < SIGNATURE_BAND_GROUPS; ++group) {
+			unsigned	firstBand	= FINGERPRINT_BANDS * group / SIGNATURE_BAND_GROUPS;
+			unsigned	lastBand	= FINGERPRINT_BANDS * (group + 1) / SIGNATURE_BAND_GROUPS;
+			float		total		= 0;
+			
+			for(size_t frame = first; frame < last; ++frame) {
+				for(unsigned band = firstBand; band < lastBand; ++band)
+					total += logf(std::max(energies[frame * FINGERPRINT_BANDS + band], floor));
+			}
+			
+			coarse[segment][group] = total / ((last - first) * (lastBand - firstBand));
+		}
+	}
+	
+	// Only the change over time in each group is kept, which removes both the
+	// overall level and the spectral tilt that all music shares
+	for(unsigned group = 0; group < SIGNATURE_BAND_GROUPS; ++group) {
+		float mean = 0;
+		for(unsigned segment = 0; segment < SIGNATURE_SEGMENTS; ++segment)
+			mean += coarse[segment][group];
+		mean /= SIGNATURE_SEGMENTS;
+		
+		for(unsigned segment = 0; segment < SIGNATURE_SEGMENTS; ++segment)
+			coarse[segment][group] -= mean;
+	}
+	
+	// Project onto pseudo-random hyperplanes; each bit is the side the spectrogram falls on
+	signature.assign(SIGNATURE_LENGTH, 0);
+	for(unsigned bit = 0; bit < 8 * SIGNATURE_LENGTH; ++bit) {
+		float projection = 0;
+		for(unsigned segment = 0; segment < SIGNATURE_SEGMENTS; ++segment) {
+			for(unsigned group = 0; group < SIGNATURE_BAND_GROUPS; ++group) {
+				if(1 & hashWord(segment * SIGNATURE_BAND_GROUPS + group, bit))
+					projection += coarse[segment][group];
+				else
+					projection -= coarse[segment][group];
+			}
+		}
+		
+		if(0 < projection)
+			signature[bit / 8] |= (uint8_t)(1 << (bit % 8));
+	}
+	
+	return true;
+}
+
+static double
+bitErrorRate(const uint32_t *a, size_t aCount, const uint32_t *b, size_t bCount)
+{
+	double best = 1;
+	
+	// Allow for a little misalignment, such as from encoder delay
+	for(int offset = -MAXIMUM_ALIGNMENT_OFFSET; offset <= MAXIMUM_ALIGNMENT_OFFSET; ++offset) {
+		size_t aStart = (0 < offset ? (size_t)offset : 0);
+		size_t bStart = (0 > offset ? (size_t)-offset : 0);
+		
+		if(aStart >= aCount || bStart >= bCount)
+			continue;
+		
+		size_t overlap = std::min(aCount - aStart, bCount - bStart);
+		if(MINIMUM_OVERLAP > overlap)
+			continue;
+		
+		unsigned long errors = 0;
+		for(size_t i = 0; i < overlap; ++i)
+			errors += __builtin_popcount(a[aStart + i] ^ b[bStart + i]);
+		
+		best = std::min(best, errors / (32.0 * overlap));
+	}
+	
+	return best;
+}
+
+static size_t
+findRoot(std::vector<size_t>& parents, size_t i)
+{
+	while(parents[i] != i)
+		i = parents[i] = parents[parents[i]];
+	return i;
+}
+
+static BOOL
+fingerprintDecoder(id <AudioDecoderMethods> decoder, volatile BOOL *cancel, NSData **fingerprint, NSData **signature)
+{
+	AudioStreamBasicDescription		asbd			= [decoder format];
+	UInt32							frameCount		= FINGERPRINT_SECONDS * asbd.mSampleRate;
+	std::vector<int16_t>			samples			(asbd.mChannelsPerFrame * BUFFER_LENGTH);
+	std::vector<float>				left			(BUFFER_LENGTH);
+	std::vector<float>				right			(BUFFER_LENGTH);
+	FingerprintResampler			resampler		(asbd.mChannelsPerFrame, asbd.mSampleRate);
+	UInt32							framesRead		= 0;
+	
+	// Allocate the AudioBufferList for the decoder to use (2 channels regardless of channels in file)
+	AudioBufferList *bufferList = (AudioBufferList *)calloc(sizeof(AudioBufferList) + sizeof(AudioBuffer), 1);
+	if(NULL == bufferList)
+		return NO;
+	
+	bufferList->mNumberBuffers = 2;
+	bufferList->mBuffers[0].mData = &left[0];
+	bufferList->mBuffers[1].mData = &right[0];
+	
+	for(unsigned i = 0; i < bufferList->mNumberBuffers; ++i) {
+		bufferList->mBuffers[i].mDataByteSize = BUFFER_LENGTH * sizeof(float);
+		bufferList->mBuffers[i].mNumberChannels = 1;
+	}
+	
+	// Decode a buffer at a time, continuing from where the previous read stopped
+	while(framesRead < frameCount && NO == *cancel) {
+		UInt32 framesDecoded = readFingerprintSamples(decoder, bufferList, &samples[0], framesRead, std::min<UInt32>(BUFFER_LENGTH, frameCount - framesRead), cancel);
+		if(0 == framesDecoded)
+			break;
+		
+		resampler.Append(&samples[0], framesDecoded);
+		framesRead += framesDecoded;
+	}
+	
+	free(bufferList);
+	
+	if(*cancel)
+		return NO;
+	
+	std::vector<uint32_t>	words;
+	std::vector<uint8_t>	hash;
+	if(false == calculateFingerprint(resampler.Samples(), words, hash)) {
+		// A stream that ended too soon gets an empty fingerprint, so it isn't decoded again
+		if(framesRead < frameCount) {
+			*fingerprint	= [NSData data];
+			*signature		= [NSData data];
+			return YES;
+		}
+		
+		return NO;
+	}
+	
+	*fingerprint	= [NSData dataWithBytes:&words[0] length:words.size() * sizeof(uint32_t)];
+	*signature		= (hash.empty() ? [NSData data] : [NSData dataWithBytes:&hash[0] length:hash.size()]);
+	
+	return YES;
+}
+
+void
+calculateAudioFingerprints(NSArray *streams, NSModalSession modalSession)
+{
+	NSCParameterAssert(nil != streams);
+	
+	AudioStreamManager		*streamManager		= [[CollectionManager manager] streamManager];
+	NSSet					*missingIDs			= [NSSet setWithArray:[streamManager streamIDsWithoutFingerprints]];
+	NSOperationQueue		*queue				= [[NSOperationQueue alloc] init];
+	NSMutableArray			*results			= [NSMutableArray array];
+	NSUInteger				maximumInFlight		= STREAMS_IN_FLIGHT_PER_WORKER * [[NSProcessInfo processInfo] activeProcessorCount];
+	NSUInteger				nextStream			= 0;
+	NSUInteger				streamsInFlight		= 0;
+	dispatch_semaphore_t	resultAvailable		= dispatch_semaphore_create(0);
+	volatile BOOL			*cancel				= (volatile BOOL *)calloc(1, sizeof(BOOL));
+	
+	NSCAssert(NULL != cancel, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+	
+	[queue setMaxConcurrentOperationCount:[[NSProcessInfo processInfo] activeProcessorCount]];
+	
+#if DEBUG
+	clock_t start = clock();
+#endif
+	
+	for(;;) {
+		@autoreleasepool {
+			// Decoders are created here because the stream URLs must be resolved on the main thread
+			while(NO == *cancel && nextStream < [streams count] && [queue operationCount] < maximumInFlight) {
+				AudioStream *stream = [streams objectAtIndex:nextStream++];
+				if(NO == [missingIDs containsObject:[stream valueForKey:ObjectIDKey]])
+					continue;
+				
+				// Skip this stream if any errors occurred, or if it is not mono or stereo
+				id <AudioDecoderMethods> decoder = [stream decoder:nil];
+				if(nil == decoder || (1 != [decoder format].mChannelsPerFrame && 2 != [decoder format].mChannelsPerFrame))
+					continue;
+				
+				NSNumber *objectID = [stream valueForKey:ObjectIDKey];
+				
+				[queue addOperationWithBlock:^{
+					NSData *fingerprint = nil, *signature = nil;
+					NSArray *result = nil;
+					
+					if(fingerprintDecoder(decoder, cancel, &fingerprint, &signature))
+						result = [NSArray arrayWithObjects:objectID, fingerprint, signature, nil];
+					else
+						result = [NSArray arrayWithObject:objectID];
+					
+					@synchronized(results) {
+						[results addObject:result];
+					}
+					dispatch_semaphore_signal(resultAvailable);
+				}];
+				
+				++streamsInFlight;
+			}
+			
+			// Store any results; the database is only used from the main thread
+			NSArray *completed = nil;
+			@synchronized(results) {
+				completed = [results copy];
+				[results removeAllObjects];
+			}
+			
+			for(NSArray *result in completed) {
+				if(3 == [result count])
+					[streamManager setFingerprint:[result objectAtIndex:1] signature:[result objectAtIndex:2] forStreamID:[result objectAtIndex:0]];
+				--streamsInFlight;
+			}
+			
+			if(0 == streamsInFlight && (*cancel || nextStream == [streams count]))
+				break;
+			
+			// Allow user cancellation
+			if(NO == *cancel && NULL != modalSession && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession]) {
+				*cancel = YES;
+				[queue cancelAllOperations];
+			}
+			
+			dispatch_semaphore_wait(resultAvailable, dispatch_time(DISPATCH_TIME_NOW, 50 * NSEC_PER_MSEC));
+			
+			// Operations cancelled before they started never report
+			if(*cancel && 0 == [queue operationCount])
+				break;
+		}
+	}
+	
+	[queue waitUntilAllOperationsAreFinished];
+	free((void *)cancel);
+	
+#if DEBUG
+	clock_t end = clock();
+	NSLog(@"Calculated fingerprints for %ld streams in %f seconds", (long)nextStream, (end - start) / (double)CLOCKS_PER_SEC);
+#endif
+}
+
+NSArray *
+findDuplicateStreams()
+{
+	AudioStreamManager							*streamManager		= [[CollectionManager manager] streamManager];
+	std::vector<NSInteger>						streamIDs;
+	std::vector<std::pair<uint64_t, uint32_t> >	buckets;
+	std::vector<NSInteger>						*streamIDsAlias		= &streamIDs;
+	std::vector<std::pair<uint64_t, uint32_t> >	*bucketsAlias		= &buckets;
+	
+#if DEBUG
+	clock_t start = clock();
+#endif
+	
+	// Each 16-bit band of the signature, tagged with its position, is a bucket key
+	// Streams that were silent or too short have empty signatures and are skipped
+	[streamManager enumerateFingerprintSignaturesUsingBlock:^(NSInteger streamID, const void *signature, NSUInteger length) {
+		if(SIGNATURE_LENGTH != length)
+			return;
+		
+		uint32_t		index		= (uint32_t)streamIDsAlias->size();
+		const uint8_t	*hash		= (const uint8_t *)signature;
+		
+		streamIDsAlias->push_back(streamID);
+		for(unsigned i = 0; i < SIGNATURE_BANDS; ++i) {
+			uint32_t band = ((uint32_t)hash[2 * i] << 8) | hash[2 * i + 1];
+			bucketsAlias->push_back(std::make_pair(((uint64_t)i << 32) | band, index));
+		}
+	}];
+	
+	std::sort(buckets.begin(), buckets.end());
+	
+	// Collect the pairs of streams that share a bucket
+	std::vector<uint64_t> candidates;
+	for(size_t first = 0, last = 0; first < buckets.size(); first = last) {
+		for(last = first + 1; last < buckets.size() && buckets[last].first == buckets[first].first; ++last)
+			;
+		
+		// Very large buckets are uninformative and would make this quadratic
+		if(2 > last - first || MAXIMUM_BUCKET_SIZE < last - first)
+			continue;
+		
+		for(size_t i = first; i < last; ++i) {
+			for(size_t j = i + 1; j < last; ++j)
+				candidates.push_back(((uint64_t)std::min(buckets[i].second, buckets[j].second) << 32) | std::max(buckets[i].second, buckets[j].second));
+		}
+	}
+	
+	std::sort(candidates.begin(), candidates.end());
+	
+	// Verify the candidates that share enough bands against their complete fingerprints
+	std::vector<size_t>		parents			(streamIDs.size());
+	NSMutableDictionary		*fingerprints	= [NSMutableDictionary dictionary];
+	
+	for(size_t i = 0; i < parents.size(); ++i)
+		parents[i] = i;
+	
+	for(size_t first = 0, last = 0; first < candidates.size(); first = last) {
+		for(last = first + 1; last < candidates.size() && candidates[last] == candidates[first]; ++last)
+			;
+		
+		if(MINIMUM_BAND_MATCHES > last - first)
+			continue;
+		
+		size_t a = (size_t)(candidates[first] >> 32);
+		size_t b = (size_t)(candidates[first] & UINT32_MAX);
+		
+		if(findRoot(parents, a) == findRoot(parents, b))
+			continue;
+		
+		NSData *prints [ 2 ];
+		size_t indexes [ 2 ] = { a, b };
+		for(unsigned i = 0; i < 2; ++i) {
+			NSNumber *objectID = @(streamIDs[indexes[i]]);
+			prints[i] = [fingerprints objectForKey:objectID];
+			if(nil == prints[i]) {
+				prints[i] = [streamManager fingerprintForStreamID:objectID];
+				if(nil == prints[i])
+					prints[i] = [NSData data];
+				[fingerprints setObject:prints[i] forKey:objectID];
+			}
+		}
+		
+		double errorRate = bitErrorRate((const uint32_t *)[prints[0] bytes], [prints[0] length] / sizeof(uint32_t), 
+										(const uint32_t *)[prints[1] bytes], [prints[1] length] / sizeof(uint32_t));
+		
+		if(MAXIMUM_BIT_ERROR_RATE >= errorRate)
+			parents[findRoot(parents, a)] = findRoot(parents, b);
+	}
+	
+	// Gather the clusters
+	NSMutableDictionary *clusters = [NSMutableDictionary dictionary];
+	for(size_t i = 0; i < parents.size(); ++i) {
+		NSNumber		*key		= @(findRoot(parents, i));
+		NSMutableArray	*cluster	= [clusters objectForKey:key];
+		
+		if(nil == cluster) {
+			cluster = [NSMutableArray array];
+			[clusters setObject:cluster forKey:key];
+		}
+		
+		[cluster addObject:@(streamIDs[i])];
+	}
+	
+	NSMutableArray *duplicates = [NSMutableArray array];
+	for(NSArray *cluster in [clusters allValues]) {
+		if(1 < [cluster count])
+			[duplicates addObject:cluster];
+	}
+	
+#if DEBUG
+	clock_t end = clock();
+	NSLog(@"Found %ld groups of duplicates among %ld streams (%ld candidate pairs) in %f seconds", (long)[duplicates count], (long)streamIDs.size(), (long)candidates.size(), (end - start) / (double)CLOCKS_PER_SEC);
+#endif
+	
+	return duplicates;
+}
@@ -0,0 +1,35 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// Decodes each stream through a ScheduledAudioRegion's slice buffer as fast as possible, without an output device
+	// Slices are handed to a null sink that completes them immediately, so only decoding and slice filling are measured
+	// Results are logged per source format: decoded frames per second, refill latency percentiles,
+	// refill jitter and the number of heap allocations made on the benchmark thread per slice
+	void benchmarkAudioPipeline(NSArray *streams, NSModalSession modalSession);
+
+#ifdef __cplusplus
+}
+#endif
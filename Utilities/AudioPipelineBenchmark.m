@@ -0,0 +1,247 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "AudioPipelineBenchmark.h"
+#import "AudioStream.h"
+#import "AudioDecoderMethods.h"
+#import "ScheduledAudioRegion.h"
+
+#include <mach/mach_time.h>
+#include <pthread.h>
+
+// ========================================
+// libmalloc calls malloc_logger (if set) for every allocation and deallocation in every zone
+// It isn't in a public header, so the declarations from libmalloc are repeated here
+// ========================================
+typedef void (malloc_logger_t)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t num_hot_frames_to_skip);
+extern malloc_logger_t *malloc_logger;
+
+#define MALLOC_LOG_TYPE_ALLOCATE		2
+
+// Only allocations made on the measuring thread, while a slice is being filled, are counted
+// The thread is compared by ID because the first access to a __thread variable may itself
+// allocate, which would re-enter the logger
+static pthread_t			sMeasuringThread;
+static volatile BOOL		sCountingAllocations		= NO;
+static uint64_t				sAllocationCount			= 0;
+static malloc_logger_t		*sPreviousMallocLogger		= NULL;
+
+// ========================================
+// Accumulated measurements for one source format
+// ========================================
+@interface AudioPipelineBenchmarkResult : NSObject
+{
+	@public
+	NSUInteger			_streamCount;
+	SInt64				_framesDecoded;
+	uint64_t			_elapsedTime;		// Nanoseconds spent filling slices
+	NSMutableData		*_latencies;		// uint64_t nanoseconds per slice refill
+	uint64_t			_allocations;		// Heap allocations made while filling slices
+}
+@end
+
+@implementation AudioPipelineBenchmarkResult
+
+- (id) init
+{
+	if((self = [super init]))
+		_latencies = [[NSMutableData alloc] init];
+	return self;
+}
+
+@end
+
+// ========================================
+// Helper functions
+// ========================================
+static int
+compareLatencies(const void *a, const void *b)
+{
+	uint64_t lhs = *(const uint64_t *)a;
+	uint64_t rhs = *(const uint64_t *)b;
+	return (lhs < rhs ? -1 : (lhs > rhs ? 1 : 0));
+}
+
+static double
+latencyPercentile(const uint64_t *sortedLatencies, NSUInteger count, double percentile)
+{
+	NSUInteger index = (NSUInteger)ceil(percentile * count);
+	return sortedLatencies[(0 < index ? index - 1 : 0)] / (double)NSEC_PER_USEC;
+}
+
+static void
+countAllocations(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t num_hot_frames_to_skip)
+{
+	// realloc is logged as an allocation and a deallocation, and counts as an allocation
+	if(sCountingAllocations && (MALLOC_LOG_TYPE_ALLOCATE & type) && pthread_equal(pthread_self(), sMeasuringThread))
+		++sAllocationCount;
+	
+	if(NULL != sPreviousMallocLogger)
+		sPreviousMallocLogger(type, arg1, arg2, arg3, result, num_hot_frames_to_skip + 1);
+}
+
+// Mirrors the slice loop in -[AudioScheduler processSlicesInThread], with every slice rendered as soon as it is scheduled
+// Scripts/benchmark_audio_pipeline.c is a portable port of this loop for measuring off the Mac
+static BOOL
+benchmarkStream(id <AudioDecoderMethods> decoder, NSUInteger sliceCount, NSUInteger framesPerSlice, AudioPipelineBenchmarkResult *result, NSModalSession modalSession)
+{
+	ScheduledAudioRegion			*region		= [ScheduledAudioRegion scheduledAudioRegionWithDecoder:decoder];
+	mach_timebase_info_data_t		timebase;
+	
+	mach_timebase_info(&timebase);
+	
+	[region allocateBuffersWithSliceCount:sliceCount frameCount:framesPerSlice];
+	
+	// Reserve room for every measurement up front so recording them doesn't allocate
+	SInt64		totalFrames		= [decoder totalFrames];
+	NSUInteger	capacity		= (0 < totalFrames ? (NSUInteger)(totalFrames / framesPerSlice) + 2 : 1024);
+	uint64_t	*latencies		= calloc(capacity, sizeof(uint64_t));
+	NSUInteger	count			= 0;
+	uint64_t	elapsed			= 0;
+	SInt64		frames			= 0;
+	uint64_t	allocations		= 0;
+	NSUInteger	i				= 0;
+	
+	if(NULL == latencies)
+		return NO;
+	
+	for(;;) {
+		ScheduledAudioSlice *slice = [region sliceAtIndex:i];
+		
+		sAllocationCount		= 0;
+		sCountingAllocations	= YES;
+		
+		uint64_t start = mach_absolute_time();
+		
+		[region lockSlice:i];
+		[region clearSlice:i];
+		UInt32 frameCount = [region readAudioInSlice:i];
+		
+		// The null sink: the slice is complete as soon as it is filled
+		slice->mNumberFrames	= frameCount;
+		slice->mFlags			= kScheduledAudioSliceFlag_Complete;
+		[region unlockSlice:i];
+		
+		uint64_t latency = ((mach_absolute_time() - start) * timebase.numer) / timebase.denom;
+		
+		sCountingAllocations	= NO;
+		
+		if(0 == frameCount)
+			break;
+		
+		if(count == capacity) {
+			uint64_t *grown = realloc(latencies, 2 * capacity * sizeof(uint64_t));
+			if(NULL == grown)
+				break;
+			latencies	= grown;
+			capacity	*= 2;
+		}
+		
+		latencies[count++]	= latency;
+		elapsed				+= latency;
+		allocations			+= sAllocationCount;
+		frames				+= frameCount;
+		i					= (i + 1) % sliceCount;
+		
+		// Allow user cancellation
+		if(NULL != modalSession && 0 == count % 64 && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession]) {
+			free(latencies);
+			return NO;
+		}
+	}
+	
+	result->_streamCount		+= 1;
+	result->_framesDecoded		+= frames;
+	result->_elapsedTime		+= elapsed;
+	result->_allocations		+= allocations;
+	[result->_latencies appendBytes:latencies length:count * sizeof(uint64_t)];
+	
+	free(latencies);
+	
+	return YES;
+}
+
+static void
+logBenchmarkResult(NSString *format, AudioPipelineBenchmarkResult *result)
+{
+	NSUInteger count = [result->_latencies length] / sizeof(uint64_t);
+	if(0 == count || 0 == result->_elapsedTime) {
+		NSLog(@"%@: no audio decoded", format);
+		return;
+	}
+	
+	uint64_t *latencies = [result->_latencies mutableBytes];
+	qsort(latencies, count, sizeof(uint64_t), compareLatencies);
+	
+	// Jitter is the standard deviation of the refill latency
+	double mean = (result->_elapsedTime / (double)count) / NSEC_PER_USEC;
+	double variance = 0;
+	for(NSUInteger i = 0; i < count; ++i) {
+		double deviation = (latencies[i] / (double)NSEC_PER_USEC) - mean;
+		variance += deviation * deviation;
+	}
+	variance /= count;
+	
+	NSLog(@"%@: %lu streams, %lld frames, %.0f frames/sec", format, (unsigned long)result->_streamCount, result->_framesDecoded, result->_framesDecoded / (result->_elapsedTime / (double)NSEC_PER_SEC));
+	NSLog(@"%@: refill latency p50 %.1f µs, p99 %.1f µs, p99.9 %.1f µs, max %.1f µs, jitter %.1f µs", format,
+		  latencyPercentile(latencies, count, 0.5), latencyPercentile(latencies, count, 0.99), latencyPercentile(latencies, count, 0.999),
+		  latencies[count - 1] / (double)NSEC_PER_USEC, sqrt(variance));
+	NSLog(@"%@: %.3f heap allocations per slice", format, result->_allocations / (double)count);
+}
+
+void
+benchmarkAudioPipeline(NSArray *streams, NSModalSession modalSession)
+{
+	NSCParameterAssert(nil != streams);
+	
+	NSUInteger				sliceCount		= [[NSUserDefaults standardUserDefaults] integerForKey:@"numberOfAudioSlicesInBuffer"];
+	NSUInteger				framesPerSlice	= [[NSUserDefaults standardUserDefaults] integerForKey:@"numberOfAudioFramesPerSlice"];
+	NSMutableDictionary		*results		= [NSMutableDictionary dictionary];
+	
+	sMeasuringThread		= pthread_self();
+	sPreviousMallocLogger	= malloc_logger;
+	malloc_logger			= countAllocations;
+	
+	for(AudioStream *stream in streams) {
+		@autoreleasepool {
+			id <AudioDecoderMethods> decoder = [stream decoder:nil];
+			if(nil == decoder)
+				continue;
+			
+			NSString						*format		= [decoder sourceFormatDescription];
+			AudioPipelineBenchmarkResult	*result		= [results objectForKey:format];
+			
+			if(nil == result) {
+				result = [[AudioPipelineBenchmarkResult alloc] init];
+				[results setObject:result forKey:format];
+			}
+			
+			if(NO == benchmarkStream(decoder, sliceCount, framesPerSlice, result, modalSession))
+				break;
+		}
+	}
+	
+	malloc_logger			= sPreviousMallocLogger;
+	sPreviousMallocLogger	= NULL;
+	
+	NSLog(@"Audio pipeline benchmark (%lu slices of %lu frames)", (unsigned long)sliceCount, (unsigned long)framesPerSlice);
+	for(NSString *format in [[results allKeys] sortedArrayUsingSelector:@selector(compare:)])
+		logBenchmarkResult(format, [results objectForKey:format]);
+}
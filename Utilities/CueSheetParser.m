@@ -22,84 +22,53 @@
 
 #import "AudioStream.h"
 #import "AudioPropertiesReader.h"
-#import "AudioMetadataReader.h"
+#import "AudioFileProbe.h"
 
-BOOL 
-scanPossiblyQuotedString(NSScanner		*scanner, 
-						 NSString		**string);
+#include "CueSheetScanner.h"
 
-BOOL 
-scanMSF(NSScanner		*scanner, 
-		NSInteger				*minute,
-		NSInteger				*second,
-		NSInteger				*frame);
-
-
-BOOL 
-scanPossiblyQuotedString(NSScanner		*scanner, 
-						 NSString		**string)
+// Converts the cue sheet to bytes containing ASCII-compatible text, and returns the encoding of those bytes
+static NSData *
+normalizeCueSheetData(NSData *data, NSStringEncoding *encoding)
 {
-	NSCParameterAssert(nil != scanner);
-
-	// Consume leading whitespace (manually)
-	NSCharacterSet *whitespaceCharacterSet = [NSCharacterSet whitespaceCharacterSet];
-	while([[scanner string] length] > [scanner scanLocation] && [whitespaceCharacterSet characterIsMember:[[scanner string] characterAtIndex:[scanner scanLocation]]])
-		[scanner setScanLocation:(1 + [scanner scanLocation])];
-
-	if([[scanner string] length] == [scanner scanLocation])
-		return NO;
+	NSCParameterAssert(NULL != encoding);
 	
-	// Handle quoted strings
-	BOOL quotedString = (0x0022 == [[scanner string] characterAtIndex:[scanner scanLocation]]);
+	size_t				byteOrderMarkLength		= 0;
+	CueSheetEncoding	cueSheetEncoding		= cueSheetDetectEncoding((const uint8_t *)[data bytes], [data length], &byteOrderMarkLength);
 	
-	if(quotedString) {
-		[scanner setScanLocation:(1 + [scanner scanLocation])];
-
-		if(NO == [scanner scanUpToString:@"\"" intoString:string])
-			return NO;
-		
-		// Ensure string is terminated
-		if([[scanner string] length] > [scanner scanLocation] && 0x0022 == [[scanner string] characterAtIndex:[scanner scanLocation]])
-			[scanner setScanLocation:(1 + [scanner scanLocation])];
-		else {
-			*string = NULL;
-			return NO;
+	switch(cueSheetEncoding) {
+		case kCueSheetEncodingUTF16LittleEndian:
+		case kCueSheetEncodingUTF16BigEndian:
+		{
+			// UTF-16 is not ASCII-compatible, so convert it to UTF-8 first
+			NSString *string = [[NSString alloc] initWithData:data encoding:NSUnicodeStringEncoding];
+			
+			*encoding = NSUTF8StringEncoding;
+			return [string dataUsingEncoding:NSUTF8StringEncoding];
 		}
+			
+		case kCueSheetEncodingShiftJIS:			*encoding = NSShiftJISStringEncoding;			break;
+		case kCueSheetEncodingWindowsCP1252:	*encoding = NSWindowsCP1252StringEncoding;		break;
+		default:								*encoding = NSUTF8StringEncoding;				break;
 	}
-	else if(NO == [scanner scanUpToCharactersFromSet:[NSCharacterSet whitespaceCharacterSet] intoString:string])
-		return NO;
-
-	return YES;
+	
+	if(0 != byteOrderMarkLength)
+		return [data subdataWithRange:NSMakeRange(byteOrderMarkLength, [data length] - byteOrderMarkLength)];
+	
+	return data;
 }
 
-BOOL 
-scanMSF(NSScanner		*scanner, 
-		NSInteger				*minute,
-		NSInteger				*second,
-		NSInteger				*frame)
+static NSError *
+cueSheetError(NSURL *URL, NSString *failureReason, NSString *recoverySuggestion)
 {
-	NSCParameterAssert(nil != scanner);
+	NSMutableDictionary *errorDictionary = [NSMutableDictionary dictionary];
 	
-	if(NO == [scanner scanInteger:minute])
-		return NO;
-		
-	if([[scanner string] length] > [scanner scanLocation] && 0x003A == [[scanner string] characterAtIndex:[scanner scanLocation]])
-		[scanner setScanLocation:(1 + [scanner scanLocation])];
-	else
-		return NO;
-
-	if(NO == [scanner scanInteger:second])
-		return NO;
-
-	if([[scanner string] length] > [scanner scanLocation] && 0x003A == [[scanner string] characterAtIndex:[scanner scanLocation]])
-		[scanner setScanLocation:(1 + [scanner scanLocation])];
-	else
-		return NO;
+	[errorDictionary setObject:[NSString stringWithFormat:NSLocalizedStringFromTable(@"The cue sheet \"%@\" could not be read.", @"Errors", @""), [[NSFileManager defaultManager] displayNameAtPath:[URL path]]] forKey:NSLocalizedDescriptionKey];
+	[errorDictionary setObject:failureReason forKey:NSLocalizedFailureReasonErrorKey];
+	[errorDictionary setObject:recoverySuggestion forKey:NSLocalizedRecoverySuggestionErrorKey];
 	
-	if(NO == [scanner scanInteger:frame])
-		return NO;
-	
-	return YES;
+	return [NSError errorWithDomain:NSCocoaErrorDomain 
+							   code:NSFileReadCorruptFileError 
+						   userInfo:errorDictionary];
 }
 
 @interface CueSheetParser (Private)
@@ -139,15 +108,23 @@ scanMSF(NSScanner		*scanner,
 
 @implementation CueSheetParser (Private)
 
-// Since cue sheets are simple, just use NSScanner in lieu of a full-blown lemon parser
 // This is a bare-bones implementation that ignores many commands we're not interested in
 // This is also an extremely lenient parser, ignoring most "rules" from http://digitalx.org/cuesheetsyntax.php
 - (BOOL) parse:(NSError **)error
 {
-	// Attempt to read the cue sheet as a string for parsing
-	NSString *fileContents = [NSString stringWithContentsOfURL:_URL encoding:NSUTF8StringEncoding error:error];
-	if(nil == fileContents)
-		return NO;		
+	NSData *fileData = [NSData dataWithContentsOfURL:_URL options:NSDataReadingMappedIfSafe error:error];
+	if(nil == fileData)
+		return NO;
+	
+	NSStringEncoding	encoding			= NSUTF8StringEncoding;
+	NSData				*cueSheetData		= normalizeCueSheetData(fileData, &encoding);
+	if(nil == cueSheetData) {
+		if(nil != error)
+			*error = cueSheetError(_URL, 
+								   NSLocalizedStringFromTable(@"Invalid UTF-16 text", @"Errors", @""), 
+								   NSLocalizedStringFromTable(@"The file's byte order mark may not match its contents.", @"Errors", @""));
+		return NO;
+	}
 	
 	NSMutableDictionary		*cueSheet			= [NSMutableDictionary dictionary];
 	NSMutableArray			*cueSheetTracks		= [NSMutableArray array];
@@ -155,169 +132,145 @@ scanMSF(NSScanner		*scanner,
 
 	// The current file
 	NSURL					*fileURL			= nil;
-	AudioPropertiesReader	*propertiesReader	= nil;
-	AudioMetadataReader		*metadataReader		= nil;
+	AudioFileProbe			*probe				= nil;
+	long long				sampleRate			= 0;
+	long long				totalFrames			= 0;
 	
-	// Create a newline character set
-	unichar			rawNewlineCharacters []		= { 0x000D, 0x000A, 0x0085 };
-	NSString		*newlineCharacters			= [NSString stringWithCharacters:rawNewlineCharacters length:3];
-	NSCharacterSet	*newlineCharacterSet		= [NSCharacterSet characterSetWithCharactersInString:newlineCharacters];
+	const uint8_t			*p					= (const uint8_t *)[cueSheetData bytes];
+	const uint8_t			*end				= p + [cueSheetData length];
+	
+	const uint8_t			*lineStart			= NULL;
+	const uint8_t			*lineEnd			= NULL;
+	CueSheetCommand			command;
 	
 	// Parse the cue sheet one line at a time
-	NSScanner	*fileScanner	= [NSScanner scannerWithString:fileContents];
-	NSString	*line			= nil;
-
-	while(NO == [fileScanner isAtEnd] && [fileScanner scanUpToCharactersFromSet:newlineCharacterSet intoString:&line]) {
-		// Parse the line
-		NSScanner	*lineScanner	= [NSScanner scannerWithString:line];
-		NSString	*command		= nil;
-		
-		// Grab the cue sheet command
-		if(NO == [lineScanner scanUpToCharactersFromSet:[NSCharacterSet whitespaceCharacterSet] intoString:&command])
-			continue;
+	while(cueSheetNextLine(&p, end, &lineStart, &lineEnd)) {
+		cueSheetScanCommand(lineStart, lineEnd, &command);
 		
 		// Handle each cue sheet command
-		if([command isEqualToString:@"CATALOG"]) {
-			NSString *mcn = nil;
-			if([lineScanner scanUpToCharactersFromSet:[NSCharacterSet whitespaceCharacterSet] intoString:&mcn])
-				[cueSheet setValue:mcn forKey:MetadataMCNKey];
-		}
-		else if([command isEqualToString:@"CDTEXTFILE"])
-			;
-		else if([command isEqualToString:@"FILE"]) {
-			NSString *filename = nil;
-			
-			if(scanPossiblyQuotedString(lineScanner, &filename)) {
+		switch(command.type) {
+			case kCueSheetCommandNone:
+			case kCueSheetCommandIgnored:
+				break;
+				
+			case kCueSheetCommandCatalog:
+				if(command.valid)
+					[cueSheet setValue:[[NSString alloc] initWithBytes:command.argument length:command.argumentLength encoding:NSASCIIStringEncoding] forKey:MetadataMCNKey];
+				break;
+				
+			case kCueSheetCommandFile:
+			{
+				NSString *filename = nil;
+				if(command.valid)
+					filename = [[NSString alloc] initWithBytes:command.argument length:command.argumentLength encoding:encoding];
+				
+				if(nil == filename) {
+					if(nil != error)
+						*error = cueSheetError(_URL, 
+											   NSLocalizedStringFromTable(@"Invalid FILE command", @"Errors", @""), 
+											   NSLocalizedStringFromTable(@"The file may be damaged or may not be a cue sheet.", @"Errors", @""));
+					return NO;
+				}
+				
 				// If the file doesn't exist as an absolute path attempt to resolve it
 				if(NO == [[NSFileManager defaultManager] fileExistsAtPath:filename]) {
 					NSString	*cueSheetPath	= [[_URL path] stringByDeletingLastPathComponent];
 					NSString	*filenamePath	= [cueSheetPath stringByAppendingPathComponent:filename];
 
-					if(NO == [[NSFileManager defaultManager] fileExistsAtPath:filenamePath])
+					if(NO == [[NSFileManager defaultManager] fileExistsAtPath:filenamePath]) {
+						if(nil != error)
+							*error = cueSheetError(_URL, 
+												   [NSString stringWithFormat:NSLocalizedStringFromTable(@"The file \"%@\" could not be found.", @"Errors", @""), filename], 
+												   NSLocalizedStringFromTable(@"The file may have been renamed or deleted, or exist on removable media.", @"Errors", @""));
 						return NO;
+					}
 					else
 						filename = filenamePath;
 				}
 				
 				fileURL = [NSURL fileURLWithPath:filename];
 				
-				// Read the properties for the file
-				propertiesReader = [AudioPropertiesReader propertiesReaderForURL:fileURL error:error];
-				if(nil == propertiesReader)
+				// Read the properties and metadata for the file
+				probe = [AudioFileProbe probeForURL:fileURL error:error];
+				if(nil == probe)
 					return NO;
 				
-				if(NO == [propertiesReader readProperties:error])
+				if(NO == [probe probeFile:error])
 					return NO;
 				
-				metadataReader = [AudioMetadataReader metadataReaderForURL:fileURL error:error];
-				if(nil == metadataReader)
-					return NO;
+				sampleRate		= llround([[[probe properties] valueForKey:PropertiesSampleRateKey] doubleValue]);
+				totalFrames		= [[[probe properties] valueForKey:PropertiesTotalFramesKey] longLongValue];
 				
-				if(NO == [metadataReader readMetadata:error])
-					return NO;
+				// Ignore anything after the filename; we don't care what type it is or the format
+				break;
 			}
-			else
-				return NO;
-			
-			// Ignore anything after the filename; we don't care what type it is or the format
-		}
-		else if([command isEqualToString:@"FLAGS"])
-			;
-		else if([command isEqualToString:@"INDEX"]) {
-			if(nil == currentTrack)
-				continue;
-			
-			NSInteger indexNumber = 0;
-			if(NO == [lineScanner scanInteger:&indexNumber])
-				continue;
-			
-			// Index 0 is pregap (ignored)
-			if(1 == indexNumber) {
-				NSInteger minute = 0, second = 0, frame = 0;
-				if(NO == scanMSF(lineScanner, &minute, &second, &frame))
-					continue;
 				
-				NSUInteger	framesPerSector		= (NSUInteger)[[[propertiesReader properties] valueForKey:PropertiesSampleRateKey] doubleValue] / 75;
-				NSUInteger	startingSector		= (((60 * minute) + second) * 75) + frame;
-				long long	startingFrame		= startingSector * framesPerSector;
-				long long	totalFrames			= [[[propertiesReader properties] valueForKey:PropertiesTotalFramesKey] longLongValue];
+			case kCueSheetCommandIndex:
+				// Index 0 is pregap (ignored)
+				if(nil != currentTrack && command.valid && 1 == command.number) {
+					// A sector is 1/75 s; multiplying first keeps rates that aren't a multiple of 75 from drifting
+					long long startingFrame = ((long long)command.sector * sampleRate) / 75;
+					
+					// Sanity check
+					if(startingFrame < totalFrames)
+						[currentTrack setValue:[NSNumber numberWithLongLong:startingFrame] forKey:StreamStartingFrameKey];
+				}
+				break;
 				
-				// Sanity check
-				if(startingFrame >= totalFrames)
-					continue;
+			case kCueSheetCommandISRC:
+				if(nil != currentTrack && command.valid)
+					[currentTrack setValue:[[NSString alloc] initWithBytes:command.argument length:command.argumentLength encoding:NSASCIIStringEncoding] forKey:MetadataISRCKey];
+				break;
 				
-				[currentTrack setValue:[NSNumber numberWithInteger:startingFrame] forKey:StreamStartingFrameKey];
-			}
-		}
-		else if([command isEqualToString:@"ISRC"]) {
-			if(nil == currentTrack)
-				continue;
-
-			NSString *isrc = nil;
-			if([lineScanner scanUpToCharactersFromSet:[NSCharacterSet whitespaceCharacterSet] intoString:&isrc])
-				[currentTrack setValue:isrc forKey:MetadataISRCKey];
-		}
-		else if([command isEqualToString:@"PERFORMER"]) {
-			NSString *performer = nil;
-			if(scanPossiblyQuotedString(lineScanner, &performer)) {
-				if(nil == currentTrack)
-					[cueSheet setValue:performer forKey:MetadataArtistKey];
-				else
-					[currentTrack setValue:performer forKey:MetadataArtistKey];
-			}
-		}
-		else if([command isEqualToString:@"POSTGAP"])
-			;
-		else if([command isEqualToString:@"PREGAP"])
-			;
-		else if([command isEqualToString:@"REM"])
-			;
-		else if([command isEqualToString:@"SONGWRITER"]) {
-			NSString *songwriter = nil;
-			if(scanPossiblyQuotedString(lineScanner, &songwriter)) {
-				if(nil == currentTrack)
-					[cueSheet setValue:songwriter forKey:MetadataComposerKey];
-				else
-					[currentTrack setValue:songwriter forKey:MetadataComposerKey];
-			}
-		}
-		else if([command isEqualToString:@"TITLE"]) {
-			NSString *title = nil;
-			
-			if(scanPossiblyQuotedString(lineScanner, &title)) {
-				if(nil == currentTrack)
-					[cueSheet setValue:title forKey:MetadataAlbumTitleKey];
-				else
-					[currentTrack setValue:title forKey:MetadataTitleKey];
-			}
-		}
-		else if([command isEqualToString:@"TRACK"]) {
-			currentTrack = nil;
-			
-			if(nil == fileURL)
-				continue;
-			
-			NSInteger trackNumber = 0;
-			if(NO == [lineScanner scanInteger:&trackNumber])
-				continue;
-
-			NSString *trackType = nil;			
-			if(NO == scanPossiblyQuotedString(lineScanner, &trackType) || NO == [trackType isEqualToString:@"AUDIO"])
-				continue;
+			case kCueSheetCommandPerformer:
+				if(command.valid) {
+					NSString *performer = [[NSString alloc] initWithBytes:command.argument length:command.argumentLength encoding:encoding];
+					if(nil == currentTrack)
+						[cueSheet setValue:performer forKey:MetadataArtistKey];
+					else
+						[currentTrack setValue:performer forKey:MetadataArtistKey];
+				}
+				break;
+				
+			case kCueSheetCommandSongwriter:
+				if(command.valid) {
+					NSString *songwriter = [[NSString alloc] initWithBytes:command.argument length:command.argumentLength encoding:encoding];
+					if(nil == currentTrack)
+						[cueSheet setValue:songwriter forKey:MetadataComposerKey];
+					else
+						[currentTrack setValue:songwriter forKey:MetadataComposerKey];
+				}
+				break;
 				
-			currentTrack = [NSMutableDictionary dictionaryWithObject:fileURL forKey:StreamURLKey];
+			case kCueSheetCommandTitle:
+				if(command.valid) {
+					NSString *title = [[NSString alloc] initWithBytes:command.argument length:command.argumentLength encoding:encoding];
+					if(nil == currentTrack)
+						[cueSheet setValue:title forKey:MetadataAlbumTitleKey];
+					else
+						[currentTrack setValue:title forKey:MetadataTitleKey];
+				}
+				break;
+				
+			case kCueSheetCommandTrack:
+				currentTrack = nil;
+				
+				if(nil == fileURL || NO == command.valid || NO == cueSheetTokenIsKeyword(command.argument, command.argumentLength, "AUDIO"))
+					break;
+				
+				currentTrack = [NSMutableDictionary dictionaryWithObject:fileURL forKey:StreamURLKey];
 
-			[currentTrack setValue:[NSNumber numberWithInteger:trackNumber] forKey:MetadataTrackNumberKey];
-			[currentTrack addEntriesFromDictionary:[propertiesReader properties]];
-			[currentTrack addEntriesFromDictionary:[metadataReader metadata]];
-			
-			[cueSheetTracks addObject:currentTrack];
+				[currentTrack setValue:[NSNumber numberWithUnsignedInt:command.number] forKey:MetadataTrackNumberKey];
+				[currentTrack addEntriesFromDictionary:[probe properties]];
+				[currentTrack addEntriesFromDictionary:[probe metadata]];
+				
+				[cueSheetTracks addObject:currentTrack];
+				break;
+				
+			default:
+				NSLog(@"Unknown cue sheet command: \"%@\"", [[NSString alloc] initWithBytes:command.keyword length:command.keywordLength encoding:encoding]);
+				break;
 		}
-		else
-			NSLog(@"Unknown cue sheet command: \"%@\"", command);
-		
-		// Consume any newlines in preparation for scanning the next line
-		[fileScanner scanCharactersFromSet:newlineCharacterSet intoString:NULL];
 	}
 	
 	// Iterate through the tracks and update the frame counts
@@ -333,16 +286,16 @@ scanMSF(NSScanner		*scanner,
 
 		// Fill in frame counts
 		if(nil != previousTrack && [[previousTrack valueForKey:StreamURLKey] isEqual:[thisTrack valueForKey:StreamURLKey]]) {
-			NSUInteger frameCount = ([[thisTrack valueForKey:StreamStartingFrameKey] unsignedIntegerValue] - 1) - [[previousTrack valueForKey:StreamStartingFrameKey] unsignedIntegerValue];
+			long long frameCount = ([[thisTrack valueForKey:StreamStartingFrameKey] longLongValue] - 1) - [[previousTrack valueForKey:StreamStartingFrameKey] longLongValue];
 			
-			[previousTrack setValue:[NSNumber numberWithUnsignedInteger:frameCount] forKey:StreamFrameCountKey];
+			[previousTrack setValue:[NSNumber numberWithLongLong:frameCount] forKey:StreamFrameCountKey];
 		}
 		
 		// Special handling for last tracks
 		if(nil == [thisTrack valueForKey:StreamFrameCountKey]) {
-			NSUInteger frameCount = (NSUInteger)([[thisTrack valueForKey:PropertiesTotalFramesKey] longLongValue] - [[thisTrack valueForKey:StreamStartingFrameKey] longLongValue] + 1);
+			long long frameCount = [[thisTrack valueForKey:PropertiesTotalFramesKey] longLongValue] - [[thisTrack valueForKey:StreamStartingFrameKey] longLongValue] + 1;
 			
-			[thisTrack setValue:[NSNumber numberWithUnsignedInteger:frameCount] forKey:StreamFrameCountKey];
+			[thisTrack setValue:[NSNumber numberWithLongLong:frameCount] forKey:StreamFrameCountKey];
 		}
 	}
 	
@@ -0,0 +1,339 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "CueSheetScanner.h"
+
+#include <string.h>
+#include <strings.h>
+
+// Larger values can't be meaningful in a cue sheet, and rejecting them keeps the arithmetic in range
+#define MAXIMUM_NUMBER_VALUE		UINT32_MAX
+
+static inline bool
+isCueSheetWhitespace(uint8_t c)
+{
+	return (' ' == c || '\t' == c);
+}
+
+static inline bool
+isCueSheetNewline(uint8_t c)
+{
+	return ('\n' == c || '\r' == c);
+}
+
+static const uint8_t *
+skipWhitespace(const uint8_t *p, const uint8_t *end)
+{
+	while(p < end && isCueSheetWhitespace(*p))
+		++p;
+	return p;
+}
+
+// Scans a whitespace-delimited or double-quoted token
+static bool
+scanPossiblyQuotedToken(const uint8_t		**p, 
+						const uint8_t		*end, 
+						const uint8_t		**token, 
+						size_t				*tokenLength)
+{
+	const uint8_t *current = skipWhitespace(*p, end);
+	if(current == end)
+		return false;
+	
+	// Handle quoted strings
+	if('"' == *current) {
+		const uint8_t *closingQuote = (const uint8_t *)memchr(current + 1, '"', (size_t)(end - current - 1));
+		
+		// Ensure string is terminated
+		if(NULL == closingQuote)
+			return false;
+		
+		*token			= current + 1;
+		*tokenLength	= (size_t)(closingQuote - current - 1);
+		*p				= closingQuote + 1;
+	}
+	else {
+		const uint8_t *tokenEnd = current;
+		while(tokenEnd < end && false == isCueSheetWhitespace(*tokenEnd))
+			++tokenEnd;
+		
+		*token			= current;
+		*tokenLength	= (size_t)(tokenEnd - current);
+		*p				= tokenEnd;
+	}
+	
+	return true;
+}
+
+static bool
+scanUnsignedInteger(const uint8_t		**p, 
+					const uint8_t		*end, 
+					uint32_t			*value)
+{
+	const uint8_t	*current	= skipWhitespace(*p, end);
+	uint64_t		result		= 0;
+	
+	if(current == end || '0' > *current || '9' < *current)
+		return false;
+	
+	while(current < end && '0' <= *current && '9' >= *current) {
+		result = (10 * result) + (uint64_t)(*current - '0');
+		if(MAXIMUM_NUMBER_VALUE < result)
+			return false;
+		++current;
+	}
+	
+	*value	= (uint32_t)result;
+	*p		= current;
+	
+	return true;
+}
+
+// Scans an mm:ss:ff time and returns the equivalent number of CD sectors (1/75 second)
+static bool
+scanMSF(const uint8_t		**p, 
+		const uint8_t		*end, 
+		uint32_t			*sector)
+{
+	const uint8_t	*current	= *p;
+	uint32_t		minute		= 0, second = 0, frame = 0;
+	
+	if(false == scanUnsignedInteger(&current, end, &minute) || current == end || ':' != *current++)
+		return false;
+	
+	if(false == scanUnsignedInteger(&current, end, &second) || current == end || ':' != *current++)
+		return false;
+	
+	if(false == scanUnsignedInteger(&current, end, &frame))
+		return false;
+	
+	if(60 <= second || 75 <= frame)
+		return false;
+	
+	uint64_t result = (((60 * (uint64_t)minute) + second) * 75) + frame;
+	if(MAXIMUM_NUMBER_VALUE < result)
+		return false;
+	
+	*sector		= (uint32_t)result;
+	*p			= current;
+	
+	return true;
+}
+
+bool
+cueSheetTokenIsKeyword(const uint8_t *token, size_t tokenLength, const char *keyword)
+{
+	return (strlen(keyword) == tokenLength && 0 == strncasecmp((const char *)token, keyword, tokenLength));
+}
+
+// ========================================
+// Encoding detection
+// ========================================
+bool
+cueSheetIsValidUTF8(const uint8_t *bytes, size_t length)
+{
+	const uint8_t	*p			= bytes;
+	const uint8_t	*end		= bytes + length;
+	
+	while(p < end) {
+		if(0x80 > *p) {
+			++p;
+			continue;
+		}
+		
+		unsigned continuationBytes;
+		if(0xC2 <= *p && 0xDF >= *p)
+			continuationBytes = 1;
+		else if(0xE0 <= *p && 0xEF >= *p)
+			continuationBytes = 2;
+		else if(0xF0 <= *p && 0xF4 >= *p)
+			continuationBytes = 3;
+		else
+			return false;
+		
+		if((size_t)(end - p) <= continuationBytes)
+			return false;
+		
+		unsigned i;
+		for(i = 1; i <= continuationBytes; ++i) {
+			if(0x80 != (p[i] & 0xC0))
+				return false;
+		}
+		
+		p += 1 + continuationBytes;
+	}
+	
+	return true;
+}
+
+// Shift-JIS is assumed if every high byte forms a valid double-byte sequence
+// and at least one double-byte sequence is present
+bool
+cueSheetLooksLikeShiftJIS(const uint8_t *bytes, size_t length)
+{
+	const uint8_t	*p					= bytes;
+	const uint8_t	*end				= bytes + length;
+	size_t			doubleByteCount		= 0;
+	
+	while(p < end) {
+		// ASCII and half-width katakana
+		if(0x80 > *p || (0xA1 <= *p && 0xDF >= *p)) {
+			++p;
+			continue;
+		}
+		
+		if(false == ((0x81 <= *p && 0x9F >= *p) || (0xE0 <= *p && 0xFC >= *p)) || p + 1 == end)
+			return false;
+		
+		if(false == ((0x40 <= p[1] && 0x7E >= p[1]) || (0x80 <= p[1] && 0xFC >= p[1])))
+			return false;
+		
+		++doubleByteCount;
+		p += 2;
+	}
+	
+	return (0 != doubleByteCount);
+}
+
+CueSheetEncoding
+cueSheetDetectEncoding(const uint8_t *bytes, size_t length, size_t *byteOrderMarkLength)
+{
+	*byteOrderMarkLength = 0;
+	
+	if(3 <= length && 0xEF == bytes[0] && 0xBB == bytes[1] && 0xBF == bytes[2]) {
+		*byteOrderMarkLength = 3;
+		return kCueSheetEncodingUTF8;
+	}
+	
+	if(2 <= length && 0xFF == bytes[0] && 0xFE == bytes[1]) {
+		*byteOrderMarkLength = 2;
+		return kCueSheetEncodingUTF16LittleEndian;
+	}
+	
+	if(2 <= length && 0xFE == bytes[0] && 0xFF == bytes[1]) {
+		*byteOrderMarkLength = 2;
+		return kCueSheetEncodingUTF16BigEndian;
+	}
+	
+	if(cueSheetIsValidUTF8(bytes, length))
+		return kCueSheetEncodingUTF8;
+	else if(cueSheetLooksLikeShiftJIS(bytes, length))
+		return kCueSheetEncodingShiftJIS;
+	else
+		return kCueSheetEncodingWindowsCP1252;
+}
+
+// ========================================
+// Commands
+// ========================================
+bool
+cueSheetNextLine(const uint8_t **p, const uint8_t *end, const uint8_t **lineStart, const uint8_t **lineEnd)
+{
+	if(*p >= end)
+		return false;
+	
+	const uint8_t *current = *p;
+	while(current < end && false == isCueSheetNewline(*current))
+		++current;
+	
+	*lineStart	= *p;
+	*lineEnd	= current;
+	
+	// Consume any newlines in preparation for scanning the next line
+	while(current < end && isCueSheetNewline(*current))
+		++current;
+	
+	*p = current;
+	
+	return true;
+}
+
+void
+cueSheetScanCommand(const uint8_t *line, const uint8_t *lineEnd, CueSheetCommand *command)
+{
+	memset(command, 0, sizeof(CueSheetCommand));
+	
+	// Grab the cue sheet command
+	const uint8_t *current = skipWhitespace(line, lineEnd);
+	
+	command->keyword = current;
+	while(current < lineEnd && false == isCueSheetWhitespace(*current))
+		++current;
+	command->keywordLength = (size_t)(current - command->keyword);
+	
+	if(0 == command->keywordLength) {
+		command->type = kCueSheetCommandNone;
+		return;
+	}
+	
+	const uint8_t	*keyword		= command->keyword;
+	size_t			keywordLength	= command->keywordLength;
+	
+	if(cueSheetTokenIsKeyword(keyword, keywordLength, "CATALOG"))
+		command->type = kCueSheetCommandCatalog;
+	else if(cueSheetTokenIsKeyword(keyword, keywordLength, "FILE"))
+		command->type = kCueSheetCommandFile;
+	else if(cueSheetTokenIsKeyword(keyword, keywordLength, "INDEX"))
+		command->type = kCueSheetCommandIndex;
+	else if(cueSheetTokenIsKeyword(keyword, keywordLength, "ISRC"))
+		command->type = kCueSheetCommandISRC;
+	else if(cueSheetTokenIsKeyword(keyword, keywordLength, "PERFORMER"))
+		command->type = kCueSheetCommandPerformer;
+	else if(cueSheetTokenIsKeyword(keyword, keywordLength, "SONGWRITER"))
+		command->type = kCueSheetCommandSongwriter;
+	else if(cueSheetTokenIsKeyword(keyword, keywordLength, "TITLE"))
+		command->type = kCueSheetCommandTitle;
+	else if(cueSheetTokenIsKeyword(keyword, keywordLength, "TRACK"))
+		command->type = kCueSheetCommandTrack;
+	else if(cueSheetTokenIsKeyword(keyword, keywordLength, "CDTEXTFILE") 
+			|| cueSheetTokenIsKeyword(keyword, keywordLength, "FLAGS") 
+			|| cueSheetTokenIsKeyword(keyword, keywordLength, "POSTGAP") 
+			|| cueSheetTokenIsKeyword(keyword, keywordLength, "PREGAP") 
+			|| cueSheetTokenIsKeyword(keyword, keywordLength, "REM"))
+		command->type = kCueSheetCommandIgnored;
+	else
+		command->type = kCueSheetCommandUnknown;
+	
+	switch(command->type) {
+		case kCueSheetCommandCatalog:
+		case kCueSheetCommandFile:
+		case kCueSheetCommandISRC:
+		case kCueSheetCommandPerformer:
+		case kCueSheetCommandSongwriter:
+		case kCueSheetCommandTitle:
+			// Anything after the argument (such as the type of a FILE) is ignored
+			command->valid = scanPossiblyQuotedToken(&current, lineEnd, &command->argument, &command->argumentLength);
+			break;
+			
+		case kCueSheetCommandIndex:
+			command->valid = (scanUnsignedInteger(&current, lineEnd, &command->number) 
+							  && scanMSF(&current, lineEnd, &command->sector));
+			break;
+			
+		case kCueSheetCommandTrack:
+			command->valid = (scanUnsignedInteger(&current, lineEnd, &command->number) 
+							  && scanPossiblyQuotedToken(&current, lineEnd, &command->argument, &command->argumentLength));
+			break;
+			
+		default:
+			command->valid = true;
+			break;
+	}
+}
@@ -0,0 +1,103 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CUE_SHEET_SCANNER_H
+#define CUE_SHEET_SCANNER_H
+
+// ========================================
+// The byte-level half of CueSheetParser
+// All keywords in a cue sheet are ASCII, so the file is scanned as raw bytes
+// and only the string arguments are converted using the detected encoding
+// This is plain C with no dependencies so it can be fuzzed and benchmarked
+// anywhere (see Scripts/fuzz_cue_sheet.c and Scripts/benchmark_cue_sheet.c)
+// ========================================
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================
+// Encoding detection
+// ========================================
+typedef enum {
+	kCueSheetEncodingUTF8					= 0,
+	kCueSheetEncodingUTF16LittleEndian		= 1,		// Not ASCII-compatible; must be converted before scanning
+	kCueSheetEncodingUTF16BigEndian			= 2,		// Not ASCII-compatible; must be converted before scanning
+	kCueSheetEncodingShiftJIS				= 3,
+	kCueSheetEncodingWindowsCP1252			= 4
+} CueSheetEncoding;
+
+// A byte order mark selects UTF-8 or UTF-16, otherwise the bytes are validated
+// as UTF-8, then checked as Shift-JIS, and Windows-1252 is the fallback
+// byteOrderMarkLength is set to the number of bytes to skip
+CueSheetEncoding	cueSheetDetectEncoding(const uint8_t *bytes, size_t length, size_t *byteOrderMarkLength);
+
+bool				cueSheetIsValidUTF8(const uint8_t *bytes, size_t length);
+bool				cueSheetLooksLikeShiftJIS(const uint8_t *bytes, size_t length);
+
+// ========================================
+// Commands
+// ========================================
+typedef enum {
+	kCueSheetCommandNone					= 0,		// Blank line
+	kCueSheetCommandCatalog,							// argument: media catalog number
+	kCueSheetCommandFile,								// argument: file name
+	kCueSheetCommandIndex,								// number: index number, sector: start time in 1/75 second
+	kCueSheetCommandISRC,								// argument: ISRC
+	kCueSheetCommandPerformer,							// argument: performer
+	kCueSheetCommandSongwriter,							// argument: songwriter
+	kCueSheetCommandTitle,								// argument: title
+	kCueSheetCommandTrack,								// number: track number, argument: data type
+	kCueSheetCommandIgnored,							// CDTEXTFILE, FLAGS, POSTGAP, PREGAP and REM
+	kCueSheetCommandUnknown
+} CueSheetCommandType;
+
+typedef struct {
+	CueSheetCommandType		type;
+	bool					valid;				// All of the command's arguments were scanned
+	
+	const uint8_t			*keyword;			// The command as it appears in the line
+	size_t					keywordLength;
+	
+	const uint8_t			*argument;			// Points into the line; quotes are removed
+	size_t					argumentLength;
+	
+	uint32_t				number;
+	uint32_t				sector;
+} CueSheetCommand;
+
+// Splits off the next line, skipping the line break; returns false at the end of the data
+bool				cueSheetNextLine(const uint8_t **p, const uint8_t *end, const uint8_t **lineStart, const uint8_t **lineEnd);
+
+// Scans the command on a single line
+void				cueSheetScanCommand(const uint8_t *line, const uint8_t *lineEnd, CueSheetCommand *command);
+
+// Case-insensitive comparison of a token with an ASCII keyword
+bool				cueSheetTokenIsKeyword(const uint8_t *token, size_t tokenLength, const char *keyword);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CUE_SHEET_SCANNER_H */
@@ -0,0 +1,45 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// Measures main-thread read latency in a scratch database while a second connection imports 50,000 rows
+	// Runs once with SQLite's default settings and once with the connection profile from the user defaults
+	// (journal mode, synchronous, cache size, mmap size and busy timeout) and logs both
+	void benchmarkDatabaseConcurrency(NSModalSession modalSession);
+
+	// Builds a scratch library of 500,000 streams with the real schema and compares how long it takes to open it
+	// and scan every row directly against loading it into memory with the backup API first, as the hybrid
+	// in-memory mode does, then how long flushing 1,000 plays and 100 additions and removals takes by copying
+	// only the changed rows against copying the whole database
+	void benchmarkDatabaseLoading(NSModalSession modalSession);
+
+	// Adds 5,000 streams for files that don't exist to the library through the same calls as
+	// -[AudioLibrary addFiles:] and logs how long the main thread was held up and how long it
+	// took until the streams were written and in the library; the streams are removed afterwards
+	void benchmarkLibraryImport(NSModalSession modalSession);
+
+#ifdef __cplusplus
+}
+#endif
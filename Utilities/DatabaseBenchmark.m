@@ -0,0 +1,592 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "DatabaseBenchmark.h"
+#import "CollectionManager.h"
+#import "AudioStreamManager.h"
+#import "AudioStream.h"
+#import "SQLiteUtilityFunctions.h"
+
+#include "sqlite3.h"
+#include <mach/mach_time.h>
+
+#define BENCHMARK_SEED_ROWS			10000
+#define BENCHMARK_IMPORT_ROWS		50000
+#define BENCHMARK_IMPORT_BATCH		500
+#define BENCHMARK_ARTIST_COUNT		1000
+#define BENCHMARK_LIBRARY_ROWS		500000
+#define BENCHMARK_LIBRARY_IMPORTS	5000
+#define BENCHMARK_FLUSH_CHANGES		1000
+
+// ========================================
+// Helper functions
+// ========================================
+static int
+compareLatencies(const void *a, const void *b)
+{
+	uint64_t lhs = *(const uint64_t *)a;
+	uint64_t rhs = *(const uint64_t *)b;
+	return (lhs < rhs ? -1 : (lhs > rhs ? 1 : 0));
+}
+
+static double
+latencyPercentile(const uint64_t *sortedLatencies, NSUInteger count, double percentile)
+{
+	NSUInteger index = (NSUInteger)ceil(percentile * count);
+	return sortedLatencies[(0 < index ? index - 1 : 0)] / (double)NSEC_PER_USEC;
+}
+
+// Opens a connection to path using either SQLite's defaults or the profile CollectionManager uses
+static sqlite3 *
+openBenchmarkDatabase(NSString *path, BOOL tuned)
+{
+	NSUserDefaults	*defaults	= [NSUserDefaults standardUserDefaults];
+	sqlite3			*db			= NULL;
+	
+	if(SQLITE_OK != sqlite3_open([path fileSystemRepresentation], &db)) {
+		NSLog(@"Database benchmark: Unable to open %@ (%@)", path, [NSString stringWithUTF8String:sqlite3_errmsg(db)]);
+		sqlite3_close(db);
+		return NULL;
+	}
+	
+	// Both profiles wait for locks, so the blocking shows up as latency instead of errors
+	sqlite3_busy_timeout(db, (int)[defaults integerForKey:@"databaseBusyTimeout"]);
+	
+	if(tuned) {
+		NSString *pragmas = [NSString stringWithFormat:@"PRAGMA journal_mode = %@; PRAGMA synchronous = %@; PRAGMA cache_size = %ld; PRAGMA mmap_size = %lld;",
+							 [defaults stringForKey:@"databaseJournalMode"], [defaults stringForKey:@"databaseSynchronous"],
+							 (long)[defaults integerForKey:@"databaseCacheSize"], [[defaults objectForKey:@"databaseMmapSize"] longLongValue]];
+		
+		if(SQLITE_OK != sqlite3_exec(db, [pragmas UTF8String], NULL, NULL, NULL))
+			NSLog(@"Database benchmark: Unable to apply the connection profile (%@)", [NSString stringWithUTF8String:sqlite3_errmsg(db)]);
+	}
+	
+	return db;
+}
+
+// Inserts count rows shaped like library entries, in transactions of batchSize rows
+static BOOL
+insertRows(sqlite3 *db, NSUInteger firstRow, NSUInteger count, NSUInteger batchSize)
+{
+	sqlite3_stmt *statement = NULL;
+	
+	if(SQLITE_OK != sqlite3_prepare_v2(db, "INSERT INTO benchmark_streams (id, url, title, artist, album_title, play_count) VALUES (?, ?, ?, ?, ?, 0)", -1, &statement, NULL))
+		return NO;
+	
+	BOOL success = YES;
+	
+	for(NSUInteger row = firstRow; success && row < firstRow + count; ) {
+		if(SQLITE_OK != sqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION", NULL, NULL, NULL)) {
+			success = NO;
+			break;
+		}
+		
+		for(NSUInteger i = 0; i < batchSize && row < firstRow + count; ++i, ++row) {
+			char url [128], title [64], artist [64], album [64];
+			
+			snprintf(url, sizeof(url), "file:///Users/Shared/Music/Artist%%20%lu/Album/Track%%20%lu.flac", (unsigned long)(row % BENCHMARK_ARTIST_COUNT), (unsigned long)row);
+			snprintf(title, sizeof(title), "Track %lu", (unsigned long)row);
+			snprintf(artist, sizeof(artist), "Artist %lu", (unsigned long)(row % BENCHMARK_ARTIST_COUNT));
+			snprintf(album, sizeof(album), "Album %lu", (unsigned long)(row / 12));
+			
+			sqlite3_bind_int64(statement, 1, (sqlite3_int64)row + 1);
+			sqlite3_bind_text(statement, 2, url, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(statement, 3, title, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(statement, 4, artist, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(statement, 5, album, -1, SQLITE_TRANSIENT);
+			
+			if(SQLITE_DONE != sqlite3_step(statement))
+				success = NO;
+			
+			sqlite3_reset(statement);
+		}
+		
+		if(SQLITE_OK != sqlite3_exec(db, (success ? "COMMIT TRANSACTION" : "ROLLBACK TRANSACTION"), NULL, NULL, NULL))
+			success = NO;
+	}
+	
+	sqlite3_finalize(statement);
+	
+	return success;
+}
+
+// Returns NO if the user canceled
+static BOOL
+benchmarkProfile(NSString *path, BOOL tuned, NSModalSession modalSession)
+{
+	NSString					*profileName	= (tuned ? @"Tuned profile" : @"SQLite defaults");
+	mach_timebase_info_data_t	timebase;
+	
+	mach_timebase_info(&timebase);
+	
+	for(NSString *suffix in [NSArray arrayWithObjects:@"", @"-wal", @"-shm", @"-journal", nil])
+		[[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:suffix] error:nil];
+	
+	// Set up a table with some rows already in it, as the reader's working set
+	sqlite3 *reader = openBenchmarkDatabase(path, tuned);
+	if(NULL == reader)
+		return YES;
+	
+	if(SQLITE_OK != sqlite3_exec(reader, "CREATE TABLE benchmark_streams (id INTEGER PRIMARY KEY, url TEXT, title TEXT, artist TEXT, album_title TEXT, play_count INTEGER); CREATE INDEX benchmark_streams_by_artist ON benchmark_streams (artist);", NULL, NULL, NULL) 
+	   || NO == insertRows(reader, 0, BENCHMARK_SEED_ROWS, BENCHMARK_SEED_ROWS)) {
+		NSLog(@"Database benchmark: Unable to create the scratch table (%@)", [NSString stringWithUTF8String:sqlite3_errmsg(reader)]);
+		sqlite3_close(reader);
+		return YES;
+	}
+	
+	sqlite3_stmt *lookup = NULL, *artistQuery = NULL;
+	sqlite3_prepare_v2(reader, "SELECT id, title, artist FROM benchmark_streams WHERE id = ?", -1, &lookup, NULL);
+	sqlite3_prepare_v2(reader, "SELECT id, title FROM benchmark_streams WHERE artist = ? ORDER BY title LIMIT 50", -1, &artistQuery, NULL);
+	
+	// The import runs on its own connection and thread, like CollectionManager's background writer
+	sqlite3				*writer			= openBenchmarkDatabase(path, tuned);
+	dispatch_group_t	importGroup		= dispatch_group_create();
+	__block BOOL		importSucceeded	= NO;
+	__block uint64_t	importTime		= 0;
+	
+	if(NULL == writer || NULL == lookup || NULL == artistQuery) {
+		sqlite3_finalize(lookup);
+		sqlite3_finalize(artistQuery);
+		sqlite3_close(writer);
+		sqlite3_close(reader);
+		return YES;
+	}
+	
+	dispatch_group_async(importGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		uint64_t start		= mach_absolute_time();
+		importSucceeded		= insertRows(writer, BENCHMARK_SEED_ROWS, BENCHMARK_IMPORT_ROWS, BENCHMARK_IMPORT_BATCH);
+		importTime			= ((mach_absolute_time() - start) * timebase.numer) / timebase.denom;
+	});
+	
+	NSMutableData	*latencies		= [NSMutableData data];
+	NSUInteger		failedReads		= 0;
+	BOOL			canceled		= NO;
+	
+	// Read the way the UI does while the import is running
+	while(0 != dispatch_group_wait(importGroup, DISPATCH_TIME_NOW)) {
+		NSUInteger		readCount		= [latencies length] / sizeof(uint64_t);
+		sqlite3_stmt	*statement		= (0 == readCount % 4 ? artistQuery : lookup);
+		char			artist [64];
+		int				result			= SQLITE_OK;
+		
+		if(artistQuery == statement) {
+			snprintf(artist, sizeof(artist), "Artist %u", arc4random_uniform(BENCHMARK_ARTIST_COUNT));
+			sqlite3_bind_text(statement, 1, artist, -1, SQLITE_TRANSIENT);
+		}
+		else
+			sqlite3_bind_int64(statement, 1, 1 + arc4random_uniform(BENCHMARK_SEED_ROWS));
+		
+		uint64_t start = mach_absolute_time();
+		
+		while(SQLITE_ROW == (result = sqlite3_step(statement)))
+			;
+		
+		uint64_t latency = ((mach_absolute_time() - start) * timebase.numer) / timebase.denom;
+		
+		sqlite3_reset(statement);
+		
+		if(SQLITE_DONE == result)
+			[latencies appendBytes:&latency length:sizeof(latency)];
+		else
+			++failedReads;
+		
+		// Allow user cancellation
+		if(NULL != modalSession && 0 == readCount % 64 && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession])
+			canceled = YES;
+		
+		if(canceled)
+			break;
+		
+		// Leave a gap between reads, as a user scrolling the track list would
+		usleep(500);
+	}
+	
+	// The writer must finish before its connection is closed
+	dispatch_group_wait(importGroup, DISPATCH_TIME_FOREVER);
+	
+	sqlite3_finalize(lookup);
+	sqlite3_finalize(artistQuery);
+	sqlite3_close(writer);
+	sqlite3_close(reader);
+	
+	NSUInteger count = [latencies length] / sizeof(uint64_t);
+	
+	if(canceled)
+		return NO;
+	
+	if(NO == importSucceeded)
+		NSLog(@"%@: the import failed", profileName);
+	
+	if(0 == count) {
+		NSLog(@"%@: no reads completed (%lu failed)", profileName, (unsigned long)failedReads);
+		return YES;
+	}
+	
+	uint64_t *sortedLatencies = [latencies mutableBytes];
+	qsort(sortedLatencies, count, sizeof(uint64_t), compareLatencies);
+	
+	NSLog(@"%@: imported %d rows in %.2f seconds (%.0f rows/sec)", profileName, BENCHMARK_IMPORT_ROWS, importTime / (double)NSEC_PER_SEC, BENCHMARK_IMPORT_ROWS / (importTime / (double)NSEC_PER_SEC));
+	NSLog(@"%@: %lu reads (%lu failed), latency p50 %.1f µs, p99 %.1f µs, p99.9 %.1f µs, max %.1f µs", profileName, (unsigned long)count, (unsigned long)failedReads,
+		  latencyPercentile(sortedLatencies, count, 0.5), latencyPercentile(sortedLatencies, count, 0.99), latencyPercentile(sortedLatencies, count, 0.999),
+		  sortedLatencies[count - 1] / (double)NSEC_PER_USEC);
+	
+	return YES;
+}
+
+// Creates the library's tables, indexes and triggers from the SQL in the bundle, as CollectionManager does
+static BOOL
+createLibrarySchema(sqlite3 *db)
+{
+	NSArray *filenames = [NSArray arrayWithObjects:@"create_stream_table", @"create_playlist_table", @"create_playlist_entry_table", @"create_smart_playlist_table", 
+						  @"create_watch_folder_table", @"create_stream_search_table", @"create_stream_fingerprint_table", @"create_seek_table_table", 
+						  @"create_stream_silence_table", @"create_play_queue_table", @"delete_playlist_trigger", @"delete_stream_trigger", @"stream_search_triggers", 
+						  @"delete_stream_fingerprint_trigger", @"delete_seek_table_trigger", @"delete_stream_silence_trigger", @"delete_play_queue_trigger", nil];
+	
+	for(NSString *filename in filenames) {
+		NSString *path = [[NSBundle mainBundle] pathForResource:filename ofType:@"sql"];
+		NSString *sql = (nil != path ? [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:nil] : nil);
+		
+		if(nil == sql || SQLITE_OK != sqlite3_exec(db, [sql UTF8String], NULL, NULL, NULL))
+			return NO;
+	}
+	
+	return YES;
+}
+
+// Inserts count streams shaped like library entries, with a silence row for each and every
+// hundredth one in a playlist, so the search index and side tables are the size they would be
+static BOOL
+insertLibraryRows(sqlite3 *db, NSUInteger firstRow, NSUInteger count, NSUInteger batchSize)
+{
+	sqlite3_stmt *streamStatement = NULL, *silenceStatement = NULL, *entryStatement = NULL;
+	
+	if(SQLITE_OK != sqlite3_exec(db, "INSERT OR IGNORE INTO playlists (id, name) VALUES (1, 'Benchmark')", NULL, NULL, NULL)
+	   || SQLITE_OK != sqlite3_prepare_v2(db, "INSERT INTO streams (url, date_added, title, artist, album_title, track_number, file_type, sample_rate, total_frames) VALUES (?, julianday('now'), ?, ?, ?, ?, 'FLAC', 44100, 10584000)", -1, &streamStatement, NULL)
+	   || SQLITE_OK != sqlite3_prepare_v2(db, "INSERT INTO stream_silence (stream_id, leading_silence, trailing_silence) VALUES (?, 0, 0)", -1, &silenceStatement, NULL)
+	   || SQLITE_OK != sqlite3_prepare_v2(db, "INSERT INTO playlist_entries (playlist_id, stream_index, stream_id) VALUES (1, ?, ?)", -1, &entryStatement, NULL)) {
+		sqlite3_finalize(streamStatement);
+		sqlite3_finalize(silenceStatement);
+		sqlite3_finalize(entryStatement);
+		return NO;
+	}
+	
+	BOOL success = YES;
+	
+	for(NSUInteger row = firstRow; success && row < firstRow + count; ) {
+		if(SQLITE_OK != sqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION", NULL, NULL, NULL)) {
+			success = NO;
+			break;
+		}
+		
+		for(NSUInteger i = 0; success && i < batchSize && row < firstRow + count; ++i, ++row) {
+			char url [128], title [64], artist [64], album [64];
+			
+			snprintf(url, sizeof(url), "file:///Users/Shared/Music/Artist%%20%lu/Album/Track%%20%lu.flac", (unsigned long)(row % BENCHMARK_ARTIST_COUNT), (unsigned long)row);
+			snprintf(title, sizeof(title), "Track %lu", (unsigned long)row);
+			snprintf(artist, sizeof(artist), "Artist %lu", (unsigned long)(row % BENCHMARK_ARTIST_COUNT));
+			snprintf(album, sizeof(album), "Album %lu", (unsigned long)(row / 12));
+			
+			sqlite3_bind_text(streamStatement, 1, url, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(streamStatement, 2, title, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(streamStatement, 3, artist, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text(streamStatement, 4, album, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_int(streamStatement, 5, (int)(1 + row % 12));
+			
+			success = (SQLITE_DONE == sqlite3_step(streamStatement));
+			sqlite3_reset(streamStatement);
+			
+			sqlite3_int64 streamID = sqlite3_last_insert_rowid(db);
+			
+			if(success) {
+				sqlite3_bind_int64(silenceStatement, 1, streamID);
+				success = (SQLITE_DONE == sqlite3_step(silenceStatement));
+				sqlite3_reset(silenceStatement);
+			}
+			
+			if(success && 0 == row % 100) {
+				sqlite3_bind_int64(entryStatement, 1, (sqlite3_int64)(row / 100));
+				sqlite3_bind_int64(entryStatement, 2, streamID);
+				success = (SQLITE_DONE == sqlite3_step(entryStatement));
+				sqlite3_reset(entryStatement);
+			}
+		}
+		
+		if(SQLITE_OK != sqlite3_exec(db, (success ? "COMMIT TRANSACTION" : "ROLLBACK TRANSACTION"), NULL, NULL, NULL))
+			success = NO;
+	}
+	
+	sqlite3_finalize(streamStatement);
+	sqlite3_finalize(silenceStatement);
+	sqlite3_finalize(entryStatement);
+	
+	return success;
+}
+
+// Makes the changes a listening session would: count streams played, and a tenth as many added and removed
+static BOOL
+changeLibraryRows(sqlite3 *db, NSUInteger count)
+{
+	unsigned long	interval	= BENCHMARK_LIBRARY_ROWS / count;
+	char			sql [512];
+	
+	snprintf(sql, sizeof(sql), 
+			 "BEGIN IMMEDIATE TRANSACTION;"
+			 "UPDATE streams SET play_count = play_count + 1, last_played_date = julianday('now') WHERE id %% %lu = 7;"
+			 "DELETE FROM streams WHERE id %% %lu = 3 AND id <= %d;"
+			 "INSERT INTO streams (url, title) SELECT url || '?copy', title FROM streams WHERE id %% %lu = 5 AND id <= %d;"
+			 "COMMIT TRANSACTION;",
+			 interval, interval, BENCHMARK_LIBRARY_ROWS / 10, interval, BENCHMARK_LIBRARY_ROWS / 10);
+	
+	return SQLITE_OK == sqlite3_exec(db, sql, NULL, NULL, NULL);
+}
+
+// Returns the number of rows read, or -1 on error
+static sqlite3_int64
+scanAllRows(sqlite3 *db)
+{
+	sqlite3_stmt	*statement	= NULL;
+	sqlite3_int64	rows		= 0;
+	int				result		= SQLITE_OK;
+	
+	if(SQLITE_OK != sqlite3_prepare_v2(db, "SELECT id, url, title, artist, album_title, play_count FROM streams", -1, &statement, NULL))
+		return -1;
+	
+	while(SQLITE_ROW == (result = sqlite3_step(statement))) {
+		sqlite3_column_text(statement, 1);
+		sqlite3_column_text(statement, 2);
+		++rows;
+	}
+	
+	sqlite3_finalize(statement);
+	
+	return (SQLITE_DONE == result ? rows : -1);
+}
+
+void
+benchmarkDatabaseConcurrency(NSModalSession modalSession)
+{
+	NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PlayDatabaseBenchmark.sqlite3"];
+	
+	NSLog(@"Database benchmark (%d seed rows, %d rows imported in batches of %d)", BENCHMARK_SEED_ROWS, BENCHMARK_IMPORT_ROWS, BENCHMARK_IMPORT_BATCH);
+	
+	if(benchmarkProfile(path, NO, modalSession))
+		benchmarkProfile(path, YES, modalSession);
+	
+	for(NSString *suffix in [NSArray arrayWithObjects:@"", @"-wal", @"-shm", @"-journal", nil])
+		[[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:suffix] error:nil];
+}
+
+void
+benchmarkDatabaseLoading(NSModalSession modalSession)
+{
+	NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PlayDatabaseLoadBenchmark.sqlite3"];
+	
+	for(NSString *suffix in [NSArray arrayWithObjects:@"", @"-wal", @"-shm", @"-journal", nil])
+		[[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:suffix] error:nil];
+	
+	NSLog(@"Database load benchmark (%d streams)", BENCHMARK_LIBRARY_ROWS);
+	
+	sqlite3 *db = openBenchmarkDatabase(path, YES);
+	if(NULL == db)
+		return;
+	
+	if(NO == createLibrarySchema(db) || NO == insertLibraryRows(db, 0, BENCHMARK_LIBRARY_ROWS, 10000)) {
+		NSLog(@"Database load benchmark: Unable to build the scratch library (%@)", [NSString stringWithUTF8String:sqlite3_errmsg(db)]);
+		sqlite3_close(db);
+		return;
+	}
+	
+	// Fold the WAL into the file so both runs start from the same state
+	sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE)", NULL, NULL, NULL);
+	sqlite3_close(db);
+	
+	if(NULL != modalSession && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession])
+		goto cleanup;
+	
+	// Open the file and read everything from it, as the default mode does
+	{
+		NSDate			*startTime		= [NSDate date];
+		sqlite3			*fileDB			= openBenchmarkDatabase(path, YES);
+		sqlite3_int64	rows			= (NULL != fileDB ? scanAllRows(fileDB) : -1);
+		
+		NSLog(@"On disk: opened and read %lld rows in %.3f seconds", rows, -[startTime timeIntervalSinceNow]);
+		
+		sqlite3_close(fileDB);
+	}
+	
+	if(NULL != modalSession && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession])
+		goto cleanup;
+	
+	// Copy the file into memory first, as the hybrid mode does
+	{
+		NSDate			*startTime		= [NSDate date];
+		sqlite3			*fileDB			= openBenchmarkDatabase(path, NO);
+		sqlite3			*memoryDB		= NULL;
+		sqlite3_int64	rows			= -1;
+		
+		if(NULL != fileDB && SQLITE_OK == sqlite3_open(":memory:", &memoryDB)) {
+			sqlite3_backup *backup = sqlite3_backup_init(memoryDB, "main", fileDB, "main");
+			if(NULL != backup) {
+				sqlite3_backup_step(backup, -1);
+				sqlite3_backup_finish(backup);
+			}
+			
+			NSTimeInterval loadTime = -[startTime timeIntervalSinceNow];
+			
+			if(SQLITE_OK == sqlite3_errcode(memoryDB))
+				rows = scanAllRows(memoryDB);
+			
+			NSLog(@"In memory: loaded in %.3f seconds, loaded and read %lld rows in %.3f seconds", loadTime, rows, -[startTime timeIntervalSinceNow]);
+			
+			// Scanning a second time shows the steady-state difference once the load is paid for
+			startTime = [NSDate date];
+			rows = scanAllRows(memoryDB);
+			NSLog(@"In memory: read %lld rows again in %.3f seconds", rows, -[startTime timeIntervalSinceNow]);
+			
+			// Write a session's worth of changes back to the file, first as the flush timer does
+			// and then by copying the whole database, as it does when the log can't be used
+			if(startLoggingChanges(memoryDB) && changeLibraryRows(memoryDB, BENCHMARK_FLUSH_CHANGES)) {
+				startTime = [NSDate date];
+				int result = copyLoggedChanges(memoryDB, fileDB);
+				NSLog(@"In memory: flushed %d plays and %d added and removed streams in %.3f seconds (%s)", BENCHMARK_FLUSH_CHANGES, BENCHMARK_FLUSH_CHANGES / 10, 
+					  -[startTime timeIntervalSinceNow], sqlite3_errstr(result));
+				
+				startTime = [NSDate date];
+				sqlite3_backup *flush = sqlite3_backup_init(fileDB, "main", memoryDB, "main");
+				if(NULL != flush) {
+					sqlite3_backup_step(flush, -1);
+					result = sqlite3_backup_finish(flush);
+				}
+				else
+					result = sqlite3_errcode(fileDB);
+				NSLog(@"In memory: copied the whole database to the file in %.3f seconds (%s)", -[startTime timeIntervalSinceNow], sqlite3_errstr(result));
+			}
+			else
+				NSLog(@"Database load benchmark: Unable to change the library in memory (%@)", [NSString stringWithUTF8String:sqlite3_errmsg(memoryDB)]);
+		}
+		
+		sqlite3_close(memoryDB);
+		sqlite3_close(fileDB);
+	}
+	
+cleanup:
+	for(NSString *suffix in [NSArray arrayWithObjects:@"", @"-wal", @"-shm", @"-journal", nil])
+		[[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:suffix] error:nil];
+}
+
+void
+benchmarkLibraryImport(NSModalSession modalSession)
+{
+	CollectionManager			*collectionManager	= [CollectionManager manager];
+	AudioStreamManager			*streamManager		= [collectionManager streamManager];
+	NSString					*directory			= [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]];
+	NSMutableArray				*streams			= [NSMutableArray arrayWithCapacity:BENCHMARK_LIBRARY_IMPORTS];
+	NSMutableData				*batchTimes			= [NSMutableData data];
+	BOOL						canceled			= NO;
+	mach_timebase_info_data_t	timebase;
+	
+	mach_timebase_info(&timebase);
+	
+	NSLog(@"Library import benchmark (%d streams in batches of %d, written %@)", BENCHMARK_LIBRARY_IMPORTS, BENCHMARK_IMPORT_BATCH,
+		  ([collectionManager writesInBackground] ? @"by the background writer" : @"on the main connection"));
+	
+	// The library must be loaded for the streams to be added to it
+	[streamManager streams];
+	
+	uint64_t importStart = mach_absolute_time();
+	
+	for(NSUInteger firstRow = 0; firstRow < BENCHMARK_LIBRARY_IMPORTS && NO == canceled; firstRow += BENCHMARK_IMPORT_BATCH) {
+		uint64_t batchStart = mach_absolute_time();
+		
+		// The calls -[AudioLibrary addFiles:] makes for each file once it has been probed
+		[collectionManager beginUpdate];
+		
+		for(NSUInteger row = firstRow; row < firstRow + BENCHMARK_IMPORT_BATCH && row < BENCHMARK_LIBRARY_IMPORTS; ++row) {
+			NSURL *url = [NSURL fileURLWithPath:[directory stringByAppendingPathComponent:[NSString stringWithFormat:@"Track %lu.flac", (unsigned long)row]]];
+			if(nil != [streamManager streamForURL:url])
+				continue;
+			
+			NSDictionary *values = [NSDictionary dictionaryWithObjectsAndKeys:
+				[NSString stringWithFormat:@"Track %lu", (unsigned long)row], MetadataTitleKey,
+				[NSString stringWithFormat:@"Artist %lu", (unsigned long)(row % BENCHMARK_ARTIST_COUNT)], MetadataArtistKey,
+				[NSString stringWithFormat:@"Album %lu", (unsigned long)(row / 12)], MetadataAlbumTitleKey,
+				[NSNumber numberWithInt:(int)(1 + row % 12)], MetadataTrackNumberKey,
+				[NSNumber numberWithInt:12], MetadataTrackTotalKey,
+				@"FLAC", PropertiesFileTypeKey,
+				[NSNumber numberWithDouble:44100], PropertiesSampleRateKey,
+				[NSNumber numberWithUnsignedInt:2], PropertiesChannelsPerFrameKey,
+				[NSNumber numberWithUnsignedInt:16], PropertiesBitsPerChannelKey,
+				[NSNumber numberWithLongLong:44100 * 240], PropertiesTotalFramesKey,
+				nil];
+			
+			AudioStream *stream = [AudioStream insertStreamForURL:url withInitialValues:values];
+			if(nil != stream)
+				[streams addObject:stream];
+		}
+		
+		[collectionManager finishUpdate];
+		
+		uint64_t batchTime = ((mach_absolute_time() - batchStart) * timebase.numer) / timebase.denom;
+		[batchTimes appendBytes:&batchTime length:sizeof(batchTime)];
+		
+		// Allow user cancellation
+		if(NULL != modalSession && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession])
+			canceled = YES;
+	}
+	
+	uint64_t mainThreadTime = ((mach_absolute_time() - importStart) * timebase.numer) / timebase.denom;
+	
+	// Once this returns the streams are registered and in the library
+	[collectionManager waitForBackgroundWrites];
+	
+	uint64_t importTime = ((mach_absolute_time() - importStart) * timebase.numer) / timebase.denom;
+	
+	NSUInteger	count		= [batchTimes length] / sizeof(uint64_t);
+	uint64_t	*sortedTimes		= [batchTimes mutableBytes];
+	
+	if(0 != count) {
+		qsort(sortedTimes, count, sizeof(uint64_t), compareLatencies);
+		
+		NSLog(@"Imported %lu streams in %.2f seconds (%.0f streams/sec), %.2f seconds of it on the main thread", (unsigned long)[streams count],
+			  importTime / (double)NSEC_PER_SEC, [streams count] / (importTime / (double)NSEC_PER_SEC), mainThreadTime / (double)NSEC_PER_SEC);
+		NSLog(@"Main thread time per batch: p50 %.1f ms, p99 %.1f ms, max %.1f ms",
+			  latencyPercentile(sortedTimes, count, 0.5) / 1000.0, latencyPercentile(sortedTimes, count, 0.99) / 1000.0,
+			  sortedTimes[count - 1] / (double)NSEC_PER_MSEC);
+	}
+	
+	// Remove the streams again; any whose rows weren't written have no ID
+	NSMutableArray *insertedStreams = [NSMutableArray arrayWithCapacity:[streams count]];
+	for(AudioStream *stream in streams) {
+		if(nil != [stream valueForKey:ObjectIDKey])
+			[insertedStreams addObject:stream];
+	}
+	
+	if(0 != [insertedStreams count]) {
+		[collectionManager beginUpdate];
+		
+		for(AudioStream *stream in insertedStreams)
+			[streamManager deleteStream:stream];
+		
+		[collectionManager finishUpdate];
+	}
+	
+	if(canceled)
+		NSLog(@"Library import benchmark canceled");
+}
@@ -19,6 +19,7 @@
  */
 
 #import <Cocoa/Cocoa.h>
+#import "AudioDecoderMethods.h"
 
 @class AudioStream;
 
@@ -28,6 +29,13 @@ extern "C" {
 
 	BOOL canConnectToMusicDNS();
 
+	// Decodes up to frameCount frames beginning at startingFrame as interleaved 16-bit samples
+	// The decoder seeks to startingFrame if it can, otherwise the audio before it is decoded and discarded
+	// bufferList must hold at least as many buffers as the decoder has channels, all the same size
+	// Returns the number of frames decoded; decoding stops early if *cancel becomes YES
+	UInt32 readFingerprintSamples(id <AudioDecoderMethods> decoder, AudioBufferList *bufferList, int16_t *samples, SInt64 startingFrame, UInt32 frameCount, volatile BOOL *cancel);
+
+	// Fingerprints are calculated in parallel, and PUIDs are requested at a limited rate and cached
 	void calculateFingerprintAndRequestPUID(AudioStream *stream, NSModalSession modalSession);
 	void calculateFingerprintsAndRequestPUIDs(NSArray *streams, NSModalSession modalSession);
 	
@@ -20,6 +20,7 @@
 
 #import "PUIDUtilities.h"
 #import "AudioStream.h"
+#import "AudioDecoderMethods.h"
 
 #include <ofa1/ofa.h>
 #include "protocol.h"
@@ -31,12 +32,164 @@
 #define BUFFER_LENGTH			4096
 #define SECONDS_TO_PROCESS		135
 #define PLAY_CLIENT_ID			"79245705acce76cd5e0e2143fce6a8a1"
+#define MUSICDNS_SERVICE_URL	"http://ofa.musicdns.org/ofa/1/track"
+
+// MusicDNS asks clients not to flood the service, so lookups are spaced out
+#define LOOKUP_INTERVAL			0.5
+
+// The number of decoders opened for each fingerprinting worker
+#define STREAMS_IN_FLIGHT_PER_WORKER	2
+
+// libofa needs the whole excerpt in memory at once, so the excerpts held by the workers
+// are limited to about two SECONDS_TO_PROCESS stereo excerpts at 44.1 kHz
+#define SAMPLE_MEMORY_LIMIT				(48 * 1024 * 1024)
+
+// MusicDNS may learn about a print later, so "unknown" answers are only cached for a while
+#define UNKNOWN_PUID_LIFETIME			(30 * 24 * 60 * 60)
+
+// Keys for cached "unknown" answers
+static NSString * const		CachedPUIDKey		= @"PUID";
+static NSString * const		CachedDateKey		= @"date";
+
+// ========================================
+// Buffers reused by the fingerprinting workers
+// ========================================
+@interface PUIDFingerprintBuffers : NSObject
+{
+	@public
+	AudioBufferList		*_bufferList;		// Decoder output, 2 channels regardless of channels in file
+}
+@end
+
+// ========================================
+// A single run of fingerprint calculations and PUID lookups
+// Decoding and fingerprinting run on a pool of workers; lookups are serialized,
+// rate-limited and cached; results are applied on the main thread
+// ========================================
+@interface PUIDCalculation : NSObject
+{
+	@private
+	NSOperationQueue		*_fingerprintQueue;
+	NSOperationQueue		*_lookupQueue;
+	NSMutableArray			*_buffers;			// Idle PUIDFingerprintBuffers
+	NSCondition				*_sampleMemory;		// Guards _sampleBytesInUse
+	size_t					_sampleBytesInUse;
+	NSMutableArray			*_results;			// (stream, PUID or NSNull) pairs not yet applied
+	dispatch_semaphore_t	_resultAvailable;
+	NSDate					*_lastLookup;
+	volatile BOOL			_cancelled;
+}
+- (void) calculateForStreams:(NSArray *)streams modalSession:(NSModalSession)modalSession;
+@end
+
+@interface PUIDCalculation (Private)
+- (PUIDFingerprintBuffers *) dequeueBuffers;
+- (void) enqueueBuffers:(PUIDFingerprintBuffers *)buffers;
+- (int16_t *) allocateSamples:(size_t)sampleCount;
+- (void) freeSamples:(int16_t *)samples count:(size_t)sampleCount;
+- (void) fingerprintStream:(AudioStream *)stream decoder:(id <AudioDecoderMethods>)decoder pathExtension:(NSString *)pathExtension;
+- (void) lookupPrint:(NSString *)print forStream:(AudioStream *)stream format:(NSString *)format milliseconds:(long)milliseconds;
+- (void) finishStream:(AudioStream *)stream PUID:(NSString *)PUID;
+@end
+
+// ========================================
+// PUIDs previously returned by MusicDNS, keyed by fingerprint
+// ========================================
+static NSMutableDictionary	*sCachedPUIDs		= nil;
+static BOOL					sCacheChanged		= NO;
+
+static NSString *
+cachedPUIDsPath()
+{
+	NSArray *paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+	NSCAssert(nil != paths && 0 != [paths count], @"Unable to locate the \"Caches\" folder.");
+	
+	NSString *applicationName	= [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleName"];
+	NSString *cacheFolder		= [[paths objectAtIndex:0] stringByAppendingPathComponent:applicationName];
+	
+	if(NO == [[NSFileManager defaultManager] fileExistsAtPath:cacheFolder])
+		[[NSFileManager defaultManager] createDirectoryAtPath:cacheFolder withIntermediateDirectories:YES attributes:nil error:nil];
+	
+	return [cacheFolder stringByAppendingPathComponent:@"PUIDs.plist"];
+}
+
+// MusicDNS answers an unknown print with an empty or all-zero PUID
+static BOOL
+isKnownPUID(NSString *PUID)
+{
+	return (0 != [PUID length] && NSNotFound != [PUID rangeOfCharacterFromSet:[[NSCharacterSet characterSetWithCharactersInString:@"0-"] invertedSet]].location);
+}
+
+// Known PUIDs are cached as strings, unknown ones as dictionaries recording when they were requested
+// Entries from older versions without a date are treated as expired
+static NSString *
+cachedPUIDForPrint(NSString *print)
+{
+	@synchronized([PUIDCalculation class]) {
+		if(nil == sCachedPUIDs) {
+			sCachedPUIDs = [[NSMutableDictionary alloc] initWithContentsOfFile:cachedPUIDsPath()];
+			if(nil == sCachedPUIDs)
+				sCachedPUIDs = [[NSMutableDictionary alloc] init];
+		}
+		
+		id entry = [sCachedPUIDs objectForKey:print];
+		if([entry isKindOfClass:[NSString class]] && isKnownPUID(entry))
+			return entry;
+		
+		if([entry isKindOfClass:[NSDictionary class]]) {
+			NSDate *date = [entry objectForKey:CachedDateKey];
+			if([date isKindOfClass:[NSDate class]] && UNKNOWN_PUID_LIFETIME > -[date timeIntervalSinceNow])
+				return [entry objectForKey:CachedPUIDKey];
+		}
+		
+		if(nil != entry) {
+			[sCachedPUIDs removeObjectForKey:print];
+			sCacheChanged = YES;
+		}
+		
+		return nil;
+	}
+}
+
+static void
+cachePUIDForPrint(NSString *PUID, NSString *print)
+{
+	@synchronized([PUIDCalculation class]) {
+		if(isKnownPUID(PUID))
+			[sCachedPUIDs setObject:PUID forKey:print];
+		else
+			[sCachedPUIDs setObject:[NSDictionary dictionaryWithObjectsAndKeys:PUID, CachedPUIDKey, [NSDate date], CachedDateKey, nil] forKey:print];
+		sCacheChanged = YES;
+	}
+}
+
+static void
+saveCachedPUIDs()
+{
+	@synchronized([PUIDCalculation class]) {
+		if(sCacheChanged && NO == [sCachedPUIDs writeToFile:cachedPUIDsPath() atomically:YES])
+			NSLog(@"Unable to save the PUID cache");
+		sCacheChanged = NO;
+	}
+}
+
+// The service can be replaced (for example by Scripts/musicdns_stub_server.c) with the musicDNSServiceURL default
+static NSURL *
+musicDNSServiceURL()
+{
+	NSString *serviceURL = [[NSUserDefaults standardUserDefaults] stringForKey:@"musicDNSServiceURL"];
+	return [NSURL URLWithString:(nil == serviceURL ? @MUSICDNS_SERVICE_URL : serviceURL)];
+}
 
 BOOL
 canConnectToMusicDNS()
 {
+	NSString *host = [musicDNSServiceURL() host];
+	if(nil == host)
+		return NO;
+	
 	SCNetworkConnectionFlags flags;
-	if(SCNetworkCheckReachabilityByName("ofa.musicdns.org", &flags)) {
+	if(SCNetworkCheckReachabilityByName([host UTF8String], &flags)) {
 		if(kSCNetworkFlagsReachable & flags && !(kSCNetworkFlagsConnectionRequired & flags))
 			return YES;
 	}
@@ -44,6 +197,84 @@ canConnectToMusicDNS()
 	return NO;
 }
 
+UInt32
+readFingerprintSamples(id <AudioDecoderMethods> decoder, AudioBufferList *bufferList, int16_t *samples, SInt64 startingFrame, UInt32 frameCount, volatile BOOL *cancel)
+{
+	NSCParameterAssert(nil != decoder);
+	NSCParameterAssert(NULL != bufferList);
+	NSCParameterAssert(NULL != samples);
+	
+	float		scale				= (1L << (16 - 1));
+	UInt32		channelsToProcess	= [decoder format].mChannelsPerFrame;
+	UInt32		framesRemaining		= frameCount;
+	UInt32		bufferLength		= bufferList->mBuffers[0].mDataByteSize / sizeof(float);
+	int16_t		*fingerprintAlias	= samples;
+	unsigned	i;
+	
+	NSCParameterAssert(channelsToProcess <= bufferList->mNumberBuffers);
+	
+	// Seek to the requested frame if possible, otherwise decode up to it
+	// The stream may be a region of a larger file, in which case the decoder's frames are relative to the region
+	if(startingFrame != [decoder currentFrame]) {
+		if([decoder supportsSeeking]) {
+			if(startingFrame != [decoder seekToFrame:startingFrame])
+				return 0;
+		}
+		else if(startingFrame < [decoder currentFrame])
+			return 0;
+	}
+	
+	// To avoid parameter errors from the decoders, set the number of buffer to the number of channels
+	UInt32 numberBuffers = bufferList->mNumberBuffers;
+	bufferList->mNumberBuffers = channelsToProcess;
+	
+	while(startingFrame > [decoder currentFrame]) {
+		if(NULL != cancel && *cancel)
+			break;
+		
+		for(i = 0; i < bufferList->mNumberBuffers; ++i)
+			bufferList->mBuffers[i].mDataByteSize = bufferLength * sizeof(float);
+		
+		if(0 == [decoder readAudio:bufferList frameCount:(UInt32)LOCAL_MIN((SInt64)bufferLength, startingFrame - [decoder currentFrame])]) {
+			bufferList->mNumberBuffers = numberBuffers;
+			return 0;
+		}
+	}
+	
+	while(0 != framesRemaining) {
+		
+		// Allow cancellation
+		if(NULL != cancel && *cancel)
+			break;
+		
+		// Reset read parameters
+		for(i = 0; i < bufferList->mNumberBuffers; ++i)
+			bufferList->mBuffers[i].mDataByteSize = bufferLength * sizeof(float);
+		
+		// Read no more audio than is needed
+		UInt32 framesRead = [decoder readAudio:bufferList frameCount:LOCAL_MIN(bufferLength, framesRemaining)];
+		if(0 == framesRead)
+			break;
+		
+		UInt32 framesToProcess = LOCAL_MIN(framesRead, framesRemaining);
+		
+		// Interleave the samples and convert to 16-bit sample size for processing
+		unsigned channel, sample;
+		for(sample = 0; sample < framesToProcess; ++sample) {
+			for(channel = 0; channel < channelsToProcess; ++channel) {
+				float *floatBuffer = (float *)bufferList->mBuffers[channel].mData;
+				*fingerprintAlias++ = floatBuffer[sample] * scale;
+			}
+		}
+		
+		framesRemaining -= framesToProcess;
+	}
+	
+	bufferList->mNumberBuffers = numberBuffers;
+	
+	return (frameCount - framesRemaining);
+}
+
 void 
 calculateFingerprintAndRequestPUID(AudioStream *stream, NSModalSession modalSession)
 {
@@ -57,148 +288,311 @@ calculateFingerprintsAndRequestPUIDs(NSArray *streams, NSModalSession modalSessi
 {
 	NSCParameterAssert(nil != streams);
 	
-	float		scale				= (1L << (16 - 1));
-	int16_t		*fingerprintBuffer	= NULL;
-	
-	// Allocate the AudioBufferList for the decoder to use (2 channels regardless of channels in file)
-	AudioBufferList *bufferList = (AudioBufferList *)calloc(sizeof(AudioBufferList) + sizeof(AudioBuffer), 1);
-	NSCAssert(NULL != bufferList, @"Unable to allocate memory");
-	
-	bufferList->mNumberBuffers = 2;
+	PUIDCalculation *calculation = [[PUIDCalculation alloc] init];
+	[calculation calculateForStreams:streams modalSession:modalSession];
 	
-	unsigned i;
-	for(i = 0; i < bufferList->mNumberBuffers; ++i) {
-		bufferList->mBuffers[i].mData = calloc(BUFFER_LENGTH, sizeof(float));
-		NSCAssert(NULL != bufferList->mBuffers[i].mData, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
-		bufferList->mBuffers[i].mDataByteSize = BUFFER_LENGTH * sizeof(float);
-		bufferList->mBuffers[i].mNumberChannels = 1;
-	}
-	
-	for(AudioStream *stream in streams) {
-		
-#if DEBUG
-		clock_t track_start = clock();
-#endif
-		
-		id <AudioDecoderMethods> decoder = [stream decoder:nil];
-		
-		// Skip this stream if any errors occurred
-		if(nil == decoder)
-			continue;
-		
-		// Also skip this stream if it is not mono or stereo
-		if(1 != [decoder format].mChannelsPerFrame && 2 != [decoder format].mChannelsPerFrame)
-			continue;
+	saveCachedPUIDs();
+}
+
+@implementation PUIDFingerprintBuffers
+
+- (id) init
+{
+	if((self = [super init])) {
+		_bufferList = (AudioBufferList *)calloc(sizeof(AudioBufferList) + sizeof(AudioBuffer), 1);
+		if(NULL == _bufferList)
+			return nil;
 		
-		// To avoid parameter errors from the decoders, set the number of buffer to the number of channels
-		bufferList->mNumberBuffers = [decoder format].mChannelsPerFrame;
+		_bufferList->mNumberBuffers = 2;
 		
-		AudioStreamBasicDescription		asbd				= [decoder format];
-		UInt32							channelsToProcess	= LOCAL_MIN(asbd.mChannelsPerFrame, bufferList->mNumberBuffers);
-		UInt32							framesToRead		= SECONDS_TO_PROCESS * asbd.mSampleRate;
-		UInt32							framesRemaining		= framesToRead;
+		unsigned i;
+		for(i = 0; i < _bufferList->mNumberBuffers; ++i) {
+			_bufferList->mBuffers[i].mData = calloc(BUFFER_LENGTH, sizeof(float));
+			if(NULL == _bufferList->mBuffers[i].mData)
+				return nil;
+			_bufferList->mBuffers[i].mDataByteSize = BUFFER_LENGTH * sizeof(float);
+			_bufferList->mBuffers[i].mNumberChannels = 1;
+		}
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	if(NULL != _bufferList) {
+		unsigned i;
+		for(i = 0; i < _bufferList->mNumberBuffers; ++i)
+			free(_bufferList->mBuffers[i].mData);
+		free(_bufferList), _bufferList = NULL;
+	}
+}
+
+@end
+
+@implementation PUIDCalculation
+
+- (id) init
+{
+	if((self = [super init])) {
+		_fingerprintQueue	= [[NSOperationQueue alloc] init];
+		[_fingerprintQueue setMaxConcurrentOperationCount:[[NSProcessInfo processInfo] activeProcessorCount]];
 		
-		// Allocate the OFA fingerprint buffer
-		fingerprintBuffer = (int16_t *)calloc(channelsToProcess * framesToRead, sizeof(int16_t));
-		NSCAssert(NULL != fingerprintBuffer, NSLocalizedStringFromTable(@"Unable to allocate memory.", @"Errors", @""));
+		_lookupQueue		= [[NSOperationQueue alloc] init];
+		[_lookupQueue setMaxConcurrentOperationCount:1];
 		
-		int16_t *fingerprintAlias = fingerprintBuffer;
+		_buffers			= [[NSMutableArray alloc] init];
+		_sampleMemory		= [[NSCondition alloc] init];
+		_results			= [[NSMutableArray alloc] init];
+		_resultAvailable	= dispatch_semaphore_create(0);
+		_lastLookup			= [NSDate distantPast];
 		
-		// Process the first SECONDS_TO_PROCESS seconds of the file
-		for(;;) {
-			
-			// Reset read parameters
-			for(i = 0; i < bufferList->mNumberBuffers; ++i)
-				bufferList->mBuffers[i].mDataByteSize = BUFFER_LENGTH * sizeof(float);
-			
-			// Read some audio
-			UInt32 framesRead = [decoder readAudio:bufferList frameCount:BUFFER_LENGTH];
-			if(0 == framesRead)
-				break;
-			
-			UInt32 framesToProcess = LOCAL_MIN(framesRead, framesRemaining);
+		set_service_url([[musicDNSServiceURL() absoluteString] UTF8String]);
+	}
+	return self;
+}
+
+- (void) calculateForStreams:(NSArray *)streams modalSession:(NSModalSession)modalSession
+{
+	NSParameterAssert(nil != streams);
+	
+	NSUInteger		nextStream			= 0;
+	NSUInteger		streamsInFlight		= 0;
+	NSUInteger		maximumInFlight		= STREAMS_IN_FLIGHT_PER_WORKER * [[NSProcessInfo processInfo] activeProcessorCount];
+	
+#if DEBUG
+	clock_t start = clock();
+#endif
+	
+	for(;;) {
+		@autoreleasepool {
+			// Keep the workers fed; decoders are created here because the stream URLs must be resolved on the main thread
+			while(NO == _cancelled && nextStream < [streams count] && [_fingerprintQueue operationCount] < maximumInFlight) {
+				AudioStream					*stream		= [streams objectAtIndex:nextStream++];
+				id <AudioDecoderMethods>	decoder		= [stream decoder:nil];
+				
+				// Skip this stream if any errors occurred, or if it is not mono or stereo
+				if(nil == decoder || (1 != [decoder format].mChannelsPerFrame && 2 != [decoder format].mChannelsPerFrame))
+					continue;
+				
+				NSString *pathExtension = [[[stream currentStreamURL] path] pathExtension];
+				
+				[_fingerprintQueue addOperationWithBlock:^{
+					[self fingerprintStream:stream decoder:decoder pathExtension:pathExtension];
+				}];
+				
+				++streamsInFlight;
+			}
 			
-			// Interleave the samples and convert to 16-bit sample size for processing
-			unsigned channel, sample;
-			for(sample = 0; sample < framesToProcess; ++sample) {
-				for(channel = 0; channel < channelsToProcess; ++channel) {
-					float *floatBuffer = (float *)bufferList->mBuffers[channel].mData;
-					*fingerprintAlias++ = floatBuffer[sample] * scale;
-				}
+			// Apply any results
+			NSArray *results = nil;
+			@synchronized(_results) {
+				results = [_results copy];
+				[_results removeAllObjects];
 			}
 			
-			framesRemaining -= framesToProcess;
+			for(NSArray *result in results) {
+				NSString *PUID = [result objectAtIndex:1];
+				if([PUID isKindOfClass:[NSString class]] && isKnownPUID(PUID))
+					[[result objectAtIndex:0] setValue:PUID forKey:MetadataMusicDNSPUIDKey];
+				--streamsInFlight;
+			}
 			
-			// Terminate loop if no frames remain to be read
-			if(0 == framesRemaining)
+			if(0 == streamsInFlight && (_cancelled || nextStream == [streams count]))
 				break;
 			
 			// Allow user cancellation
-			if(NULL != modalSession && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession])
-				goto cleanup;
+			if(NO == _cancelled && NULL != modalSession && NSRunContinuesResponse != [[NSApplication sharedApplication] runModalSession:modalSession]) {
+				_cancelled = YES;
+				[_fingerprintQueue cancelAllOperations];
+				[_lookupQueue cancelAllOperations];
+				
+				// Cancelled operations never report, so stop waiting for them
+				[_fingerprintQueue waitUntilAllOperationsAreFinished];
+				[_lookupQueue waitUntilAllOperationsAreFinished];
+				break;
+			}
+			
+			dispatch_semaphore_wait(_resultAvailable, dispatch_time(DISPATCH_TIME_NOW, 50 * NSEC_PER_MSEC));
 		}
+	}
+	
+#if DEBUG
+	clock_t end = clock();
+	NSLog(@"Calculated PUIDs for %ld streams in %f seconds", (long)nextStream, (end - start) / (double)CLOCKS_PER_SEC);
+#endif
+}
 
-		// Query MusicDNS for the PUID matching this fingerprint
-		AudioData	*trackData		= new AudioData();
-		NSString	*pathExtension	= [[[stream currentStreamURL] path] pathExtension];
-		int			milliseconds	= [decoder totalFrames] / (asbd.mSampleRate / 1000);
-		
+@end
+
+@implementation PUIDCalculation (Private)
+
+- (PUIDFingerprintBuffers *) dequeueBuffers
+{
+	@synchronized(_buffers) {
+		PUIDFingerprintBuffers *buffers = [_buffers lastObject];
+		if(nil != buffers) {
+			[_buffers removeLastObject];
+			return buffers;
+		}
+	}
+	
+	return [[PUIDFingerprintBuffers alloc] init];
+}
+
+- (void) enqueueBuffers:(PUIDFingerprintBuffers *)buffers
+{
+	if(nil == buffers)
+		return;
+	
+	@synchronized(_buffers) {
+		[_buffers addObject:buffers];
+	}
+}
+
+- (int16_t *) allocateSamples:(size_t)sampleCount
+{
+	size_t byteCount = sampleCount * sizeof(int16_t);
+	
+	// Wait for other workers to finish with their excerpts, but never block a worker that would be alone
+	[_sampleMemory lock];
+	while(NO == _cancelled && 0 != _sampleBytesInUse && SAMPLE_MEMORY_LIMIT < _sampleBytesInUse + byteCount)
+		[_sampleMemory waitUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+	
+	int16_t *samples = NULL;
+	if(NO == _cancelled) {
+		samples = (int16_t *)malloc(byteCount);
+		if(NULL != samples)
+			_sampleBytesInUse += byteCount;
+	}
+	[_sampleMemory unlock];
+	
+	return samples;
+}
+
+- (void) freeSamples:(int16_t *)samples count:(size_t)sampleCount
+{
+	if(NULL == samples)
+		return;
+	
+	free(samples);
+	
+	[_sampleMemory lock];
+	_sampleBytesInUse -= sampleCount * sizeof(int16_t);
+	[_sampleMemory broadcast];
+	[_sampleMemory unlock];
+}
+
+- (void) fingerprintStream:(AudioStream *)stream decoder:(id <AudioDecoderMethods>)decoder pathExtension:(NSString *)pathExtension
+{
+	PUIDFingerprintBuffers			*buffers			= [self dequeueBuffers];
+	AudioStreamBasicDescription		asbd				= [decoder format];
+	UInt32							channelsToProcess	= asbd.mChannelsPerFrame;
+	UInt32							framesToRead		= SECONDS_TO_PROCESS * asbd.mSampleRate;
+	NSString						*print				= nil;
+	
+	// Short streams don't need a full excerpt
+	if(0 < [decoder totalFrames])
+		framesToRead = (UInt32)LOCAL_MIN((SInt64)framesToRead, [decoder totalFrames]);
+	
+	size_t		sampleCount		= channelsToProcess * framesToRead;
+	int16_t		*samples		= (nil == buffers ? NULL : [self allocateSamples:sampleCount]);
+	
+	if(NULL == samples) {
+		[self enqueueBuffers:buffers];
+		[self finishStream:stream PUID:nil];
+		return;
+	}
+	
+	// Process the first SECONDS_TO_PROCESS seconds of the stream, a buffer at a time
+	UInt32 framesRead = readFingerprintSamples(decoder, buffers->_bufferList, samples, 0, framesToRead, &_cancelled);
+	
+	[self enqueueBuffers:buffers];
+	
+	if(NO == _cancelled && 0 != framesRead) {
+		// libofa's FFT setup is not guaranteed to be reentrant
+		@synchronized([PUIDCalculation class]) {
+			const char *fingerprint = ofa_create_print((unsigned char *)samples, 
 #if __BIG_ENDIAN__
-/*		const char *fingerprint = ofa_create_print((unsigned char *)fingerprintBuffer, 
-												   OFA_BIG_ENDIAN, 
-												   (channelsToProcess * (framesToRead - framesRemaining)),
-												   asbd.mSampleRate, 
-												   (2 == channelsToProcess));*/
-		trackData->setData((unsigned char *)fingerprintBuffer, 
-						   OFA_BIG_ENDIAN, 
-						   (channelsToProcess * (framesToRead - framesRemaining)), 
-						   asbd.mSampleRate, 
-						   (2 == channelsToProcess), 
-						   milliseconds, 
-						   [pathExtension UTF8String]);
+													   OFA_BIG_ENDIAN, 
 #else
-/*		const char *fingerprint = ofa_create_print((unsigned char *)fingerprintBuffer, 
-												   OFA_LITTLE_ENDIAN, 
-												   (channelsToProcess * (framesToRead - framesRemaining)),
-												   asbd.mSampleRate, 
-												   (2 == channelsToProcess));*/
-		trackData->setData((unsigned char *)fingerprintBuffer, 
-						   OFA_LITTLE_ENDIAN, 
-						   (channelsToProcess * (framesToRead - framesRemaining)), 
-						   asbd.mSampleRate, 
-						   (2 == channelsToProcess), 
-						   milliseconds, 
-						   [pathExtension UTF8String]);
+													   OFA_LITTLE_ENDIAN, 
 #endif
-
-		// Create the audio fingerprint
-		if(false == trackData->createPrint()) {
-			delete trackData;
-			continue;
+													   (channelsToProcess * framesRead),
+													   asbd.mSampleRate, 
+													   (2 == channelsToProcess));
+			if(NULL != fingerprint)
+				print = [NSString stringWithCString:fingerprint encoding:NSASCIIStringEncoding];
 		}
+	}
+	
+	[self freeSamples:samples count:sampleCount];
+	
+	if(nil == print) {
+		[self finishStream:stream PUID:nil];
+		return;
+	}
+	
+	// Query MusicDNS for the PUID matching this fingerprint, unless it is already known
+	NSString *PUID = cachedPUIDForPrint(print);
+	if(nil != PUID) {
+		[self finishStream:stream PUID:PUID];
+		return;
+	}
+	
+	long milliseconds = [decoder totalFrames] / (asbd.mSampleRate / 1000);
+	
+	[_lookupQueue addOperationWithBlock:^{
+		[self lookupPrint:print forStream:stream format:pathExtension milliseconds:milliseconds];
+	}];
+}
 
-		// Get the PUID
-		NSString *bundleVersion = [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleVersion"];
-		TrackInformation *trackInfo = trackData->getMetadata(PLAY_CLIENT_ID, [bundleVersion UTF8String], true);
-		if(NULL != trackInfo) {
-			std::string PUID = trackInfo->getPUID();
-			if(0 < PUID.length())
-				[stream setValue:[NSString stringWithCString:PUID.c_str() encoding:NSASCIIStringEncoding] forKey:MetadataMusicDNSPUIDKey];			
-		}
-		else
-			NSLog(@"Unable to retrieve MusicDNS metadata");
-		
-		delete trackData;
+- (void) lookupPrint:(NSString *)print forStream:(AudioStream *)stream format:(NSString *)format milliseconds:(long)milliseconds
+{
+	if(_cancelled)
+		return;
+	
+	// Another stream may have had the same print
+	NSString *PUID = cachedPUIDForPrint(print);
+	if(nil != PUID) {
+		[self finishStream:stream PUID:PUID];
+		return;
+	}
+	
+	// Rate-limit requests
+	NSTimeInterval wait = LOOKUP_INTERVAL + [_lastLookup timeIntervalSinceNow];
+	if(0 < wait)
+		[NSThread sleepForTimeInterval:wait];
+	
+	TrackInformation	trackInfo;
+	NSString			*bundleVersion		= [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleVersion"];
+	
+	trackInfo.setPrint([print UTF8String]);
+	trackInfo.setFormat([format UTF8String]);
+	trackInfo.setLengthInMS(milliseconds);
+	
+	BOOL success = retrieve_metadata(PLAY_CLIENT_ID, [bundleVersion UTF8String], &trackInfo, true);
+	_lastLookup = [NSDate date];
+	
+	if(NO == success) {
+		NSLog(@"Unable to retrieve MusicDNS metadata");
+		[self finishStream:stream PUID:nil];
+		return;
+	}
+	
+	// Cache the answer even when MusicDNS doesn't know the print, so it isn't requested again
+	PUID = [NSString stringWithCString:trackInfo.getPUID().c_str() encoding:NSASCIIStringEncoding];
+	cachePUIDForPrint(PUID, print);
+	
+	[self finishStream:stream PUID:PUID];
+}
 
-#if DEBUG
-		clock_t track_end = clock();
-		NSLog(@"Calculated PUID for %@ in %f seconds", stream, (track_end - track_start) / (double)CLOCKS_PER_SEC);
-#endif		
+- (void) finishStream:(AudioStream *)stream PUID:(NSString *)PUID
+{
+	@synchronized(_results) {
+		[_results addObject:[NSArray arrayWithObjects:stream, (nil == PUID ? (id)[NSNull null] : PUID), nil]];
 	}
-		
-	// Free allocated memory
-cleanup:
-	for(i = 0; i < bufferList->mNumberBuffers; ++i)
-		free(bufferList->mBuffers[i].mData);
-	free(bufferList);
+	
+	dispatch_semaphore_signal(_resultAvailable);
 }
+
+@end
@@ -65,6 +65,14 @@ extern "C" {
 					   NSString			*key,
 					   eObjectType		objectType);
 
+	// ========================================
+	// Convert a KVC object value to the NSNumber, NSString, NSData or NSNull
+	// that bindParameter would bind for it, so it can be bound later or elsewhere
+	id
+	parameterValue(id				kvcObject,
+				   NSString			*key,
+				   eObjectType		objectType);
+
 	// ========================================
 	// Extract a column entry in a table to DatabaseObject
 	void
@@ -74,6 +82,27 @@ extern "C" {
 				   NSString			*key,
 				   eObjectType		desiredObjectType);
 
+	// ========================================
+	// Record the key of every row inserted, updated or deleted in the tables of db's main database
+	// in temporary tables, so the changes can be copied to a database with the same schema
+	// Virtual tables and their shadow tables are skipped; triggers in the destination keep them current
+	BOOL
+	startLoggingChanges(sqlite3			*db);
+
+	// ========================================
+	// Copy the rows logged by startLoggingChanges from db to destination in a single transaction
+	// and clear the log; the cost is proportional to the number of changed rows
+	// Returns SQLITE_BUSY without doing anything if db is in a transaction; for any other error
+	// the log has been cleared and destination is unchanged, so it must be copied in full
+	int
+	copyLoggedChanges(sqlite3			*db,
+					  sqlite3			*destination);
+
+	// ========================================
+	// Clear the log kept by startLoggingChanges, for when db is copied in full instead
+	void
+	discardLoggedChanges(sqlite3		*db);
+
 #ifdef __cplusplus
 }
 #endif
@@ -180,6 +180,59 @@ bindNamedParameter(sqlite3_stmt		*statement,
 	NSCAssert1(SQLITE_OK == result, @"Unable to bind parameter \"%s\" to sql statement.", parameterName/*, [NSString stringWithUTF8String:sqlite3_errmsg(_db)]*/);
 }
 
+// ========================================
+// Convert a KVC object value to the object bound for it
+id
+parameterValue(id				kvcObject,
+			   NSString			*key,
+			   eObjectType		objectType)
+{
+	NSCParameterAssert(nil != kvcObject);
+	NSCParameterAssert(nil != key);
+	
+	id value = [kvcObject valueForKey:key];
+	
+	if(nil == value || [NSNull null] == value)
+		return [NSNull null];
+	
+	// The integer conversions match the sqlite3_bind_int calls above
+	switch(objectType) {
+		case eObjectTypeURL:	
+			return [value absoluteString];
+		case eObjectTypeString:	
+			return value;
+		case eObjectTypeDate:	
+			return [NSNumber numberWithDouble:[value timeIntervalSinceReferenceDate]];
+		case eObjectTypeBool:	
+			return [NSNumber numberWithInt:[value boolValue]];
+		case eObjectTypeUnsignedShort:
+			return [NSNumber numberWithInt:[value unsignedShortValue]];
+		case eObjectTypeShort:
+			return [NSNumber numberWithInt:[value shortValue]];
+		case eObjectTypeUnsignedInt:	
+			return [NSNumber numberWithInt:(int)[value unsignedIntValue]];
+		case eObjectTypeInt:	
+			return [NSNumber numberWithInt:[value intValue]];
+		case eObjectTypeUnsignedLong:
+			return [NSNumber numberWithInt:(int)[value unsignedLongValue]];
+		case eObjectTypeLong:
+			return [NSNumber numberWithInt:(int)[value longValue]];
+		case eObjectTypeUnsignedLongLong:
+			return [NSNumber numberWithLongLong:(long long)[value unsignedLongLongValue]];
+		case eObjectTypeLongLong:
+			return [NSNumber numberWithLongLong:[value longLongValue]];
+		case eObjectTypeFloat:	
+		case eObjectTypeDouble:	
+			return [NSNumber numberWithDouble:[value doubleValue]];
+		case eObjectTypePredicate:	
+			return [value predicateFormat];
+		case eObjectTypeBlob:	
+			return value;
+		default:
+			return [NSNull null];
+	}
+}
+
 // ========================================
 // Extract a column entry in a table to DatabaseObject
 void
@@ -255,3 +308,439 @@ getColumnValue(sqlite3_stmt		*statement,
 			break;
 	}
 }
+
+// ========================================
+// Change logging helpers
+// ========================================
+static NSString *
+quotedIdentifier(NSString *identifier)
+{
+	return [NSString stringWithFormat:@"\"%@\"", [identifier stringByReplacingOccurrencesOfString:@"\"" withString:@"\"\""]];
+}
+
+// The key "rowid" stands for the implicit key of tables without an INTEGER PRIMARY KEY
+static NSString *
+columnReference(NSString *table, NSString *column)
+{
+	if([column isEqualToString:@"rowid"])
+		return [NSString stringWithFormat:@"%@.rowid", table];
+	else
+		return [NSString stringWithFormat:@"%@.%@", table, quotedIdentifier(column)];
+}
+
+static NSString *
+logTableName(NSDictionary *table)
+{
+	return quotedIdentifier([@"changed_" stringByAppendingString:[table objectForKey:@"name"]]);
+}
+
+// Describes the tables in db's main database whose changes are logged, as dictionaries holding
+// the table's name, the columns that identify a row and every column that must be copied
+static NSArray *
+loggedTables(sqlite3 *db)
+{
+	NSMutableArray	*tables				= [NSMutableArray array];
+	NSMutableArray	*virtualTables		= [NSMutableArray array];
+	NSMutableArray	*candidates			= [NSMutableArray array];
+	sqlite3_stmt	*statement			= NULL;
+	
+	if(SQLITE_OK != sqlite3_prepare_v2(db, "SELECT name, sql FROM main.sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite\\_%' ESCAPE '\\'", -1, &statement, NULL))
+		return nil;
+	
+	while(SQLITE_ROW == sqlite3_step(statement)) {
+		NSString	*name		= [NSString stringWithUTF8String:(const char *)sqlite3_column_text(statement, 0)];
+		NSString	*sql		= (NULL != sqlite3_column_text(statement, 1) ? [NSString stringWithUTF8String:(const char *)sqlite3_column_text(statement, 1)] : @"");
+		
+		if(NSNotFound != [sql rangeOfString:@"CREATE VIRTUAL TABLE" options:(NSCaseInsensitiveSearch | NSAnchoredSearch)].location)
+			[virtualTables addObject:name];
+		else
+			[candidates addObject:[NSArray arrayWithObjects:name, sql, nil]];
+	}
+	
+	if(SQLITE_OK != sqlite3_finalize(statement))
+		return nil;
+	
+	for(NSArray *candidate in candidates) {
+		NSString		*name				= [candidate objectAtIndex:0];
+		NSString		*sql				= [candidate objectAtIndex:1];
+		NSMutableArray	*columns			= [NSMutableArray array];
+		NSMutableArray	*primaryKey			= [NSMutableArray array];
+		BOOL			isShadowTable		= NO;
+		BOOL			hasIntegerKey		= NO;
+		
+		// The shadow tables holding a virtual table's contents are named after it
+		for(NSString *virtualTable in virtualTables) {
+			if([name hasPrefix:[virtualTable stringByAppendingString:@"_"]])
+				isShadowTable = YES;
+		}
+		
+		if(isShadowTable)
+			continue;
+		
+		NSString *pragma = [NSString stringWithFormat:@"PRAGMA main.table_info(%@)", quotedIdentifier(name)];
+		if(SQLITE_OK != sqlite3_prepare_v2(db, [pragma UTF8String], -1, &statement, NULL))
+			return nil;
+		
+		while(SQLITE_ROW == sqlite3_step(statement)) {
+			NSString	*column				= [NSString stringWithUTF8String:(const char *)sqlite3_column_text(statement, 1)];
+			const char	*type				= (const char *)sqlite3_column_text(statement, 2);
+			NSUInteger	primaryKeyIndex		= (NSUInteger)sqlite3_column_int(statement, 5);
+			
+			[columns addObject:column];
+			
+			if(0 < primaryKeyIndex) {
+				while([primaryKey count] < primaryKeyIndex)
+					[primaryKey addObject:[NSNull null]];
+				[primaryKey replaceObjectAtIndex:(primaryKeyIndex - 1) withObject:column];
+				
+				if(NULL != type && 0 == sqlite3_stricmp(type, "INTEGER"))
+					hasIntegerKey = YES;
+			}
+		}
+		
+		if(SQLITE_OK != sqlite3_finalize(statement))
+			return nil;
+		
+		NSArray *keys = primaryKey;
+		
+		// Rows are identified by their rowid unless the table has no rowid or an INTEGER PRIMARY KEY aliases it
+		if(NSNotFound == [sql rangeOfString:@"WITHOUT ROWID" options:NSCaseInsensitiveSearch].location && NO == (1 == [primaryKey count] && hasIntegerKey)) {
+			keys = [NSArray arrayWithObject:@"rowid"];
+			[columns addObject:@"rowid"];
+		}
+		
+		[tables addObject:[NSDictionary dictionaryWithObjectsAndKeys:name, @"name", keys, @"keys", columns, @"columns", nil]];
+	}
+	
+	return tables;
+}
+
+static void
+clearLogTables(sqlite3 *db, NSArray *tables)
+{
+	for(NSDictionary *table in tables) {
+		NSString *sql = [NSString stringWithFormat:@"DELETE FROM temp.%@", logTableName(table)];
+		sqlite3_exec(db, [sql UTF8String], NULL, NULL, NULL);
+	}
+}
+
+static id
+columnObject(sqlite3_stmt *statement, int columnIndex)
+{
+	id value = nil;
+	
+	switch(sqlite3_column_type(statement, columnIndex)) {
+		case SQLITE_INTEGER:
+			value = [NSNumber numberWithLongLong:sqlite3_column_int64(statement, columnIndex)];
+			break;
+		case SQLITE_FLOAT:
+			value = [NSNumber numberWithDouble:sqlite3_column_double(statement, columnIndex)];
+			break;
+		case SQLITE_TEXT:
+			value = [[NSString alloc] initWithBytes:sqlite3_column_text(statement, columnIndex) 
+											 length:(NSUInteger)sqlite3_column_bytes(statement, columnIndex) 
+										   encoding:NSUTF8StringEncoding];
+			break;
+		case SQLITE_BLOB:
+			value = [NSData dataWithBytes:sqlite3_column_blob(statement, columnIndex) 
+								   length:(NSUInteger)sqlite3_column_bytes(statement, columnIndex)];
+			break;
+	}
+	
+	return (nil != value ? value : [NSNull null]);
+}
+
+static int
+bindObject(sqlite3_stmt *statement, int parameterIndex, id value)
+{
+	if([value isKindOfClass:[NSString class]])
+		return sqlite3_bind_text(statement, parameterIndex, [value UTF8String], -1, SQLITE_TRANSIENT);
+	else if([value isKindOfClass:[NSData class]])
+		return (0 == [value length] ? sqlite3_bind_zeroblob(statement, parameterIndex, 0) : sqlite3_bind_blob(statement, parameterIndex, [value bytes], (int)[value length], SQLITE_TRANSIENT));
+	else if([value isKindOfClass:[NSNumber class]] && 0 == strcmp([value objCType], @encode(double)))
+		return sqlite3_bind_double(statement, parameterIndex, [value doubleValue]);
+	else if([value isKindOfClass:[NSNumber class]])
+		return sqlite3_bind_int64(statement, parameterIndex, [value longLongValue]);
+	else
+		return sqlite3_bind_null(statement, parameterIndex);
+}
+
+// Binds values [range.location, NSMaxRange(range)) of row starting at parameter firstParameterIndex
+static int
+bindObjects(sqlite3_stmt *statement, int firstParameterIndex, NSArray *row, NSRange range)
+{
+	int result = SQLITE_OK;
+	
+	for(NSUInteger i = 0; SQLITE_OK == result && i < range.length; ++i)
+		result = bindObject(statement, firstParameterIndex + (int)i, [row objectAtIndex:(range.location + i)]);
+	
+	return result;
+}
+
+// ========================================
+// Log changes to db for copying them elsewhere
+BOOL
+startLoggingChanges(sqlite3			*db)
+{
+	NSCParameterAssert(NULL != db);
+	
+	NSArray *tables = loggedTables(db);
+	if(nil == tables)
+		return NO;
+	
+	for(NSDictionary *table in tables) {
+		NSString		*name			= [table objectForKey:@"name"];
+		NSMutableArray	*logColumns		= [NSMutableArray array];
+		NSMutableArray	*newKeys		= [NSMutableArray array];
+		NSMutableArray	*oldKeys		= [NSMutableArray array];
+		
+		for(NSString *key in [table objectForKey:@"keys"]) {
+			[logColumns addObject:[NSString stringWithFormat:@"key%lu", (unsigned long)[logColumns count]]];
+			[newKeys addObject:columnReference(@"new", key)];
+			[oldKeys addObject:columnReference(@"old", key)];
+		}
+		
+		// An update may change a row's key, so both keys are logged
+		NSString *sql = [NSString stringWithFormat:
+						 @"CREATE TEMP TABLE IF NOT EXISTS %1$@ (%2$@, PRIMARY KEY (%2$@)) WITHOUT ROWID;"
+						 @"CREATE TEMP TRIGGER IF NOT EXISTS %3$@ AFTER INSERT ON main.%4$@ BEGIN INSERT OR IGNORE INTO %1$@ VALUES (%5$@); END;"
+						 @"CREATE TEMP TRIGGER IF NOT EXISTS %6$@ AFTER UPDATE ON main.%4$@ BEGIN INSERT OR IGNORE INTO %1$@ VALUES (%7$@); INSERT OR IGNORE INTO %1$@ VALUES (%5$@); END;"
+						 @"CREATE TEMP TRIGGER IF NOT EXISTS %8$@ AFTER DELETE ON main.%4$@ BEGIN INSERT OR IGNORE INTO %1$@ VALUES (%7$@); END;",
+						 logTableName(table), [logColumns componentsJoinedByString:@", "],
+						 quotedIdentifier([NSString stringWithFormat:@"changed_%@_insert", name]), quotedIdentifier(name), [newKeys componentsJoinedByString:@", "],
+						 quotedIdentifier([NSString stringWithFormat:@"changed_%@_update", name]), [oldKeys componentsJoinedByString:@", "],
+						 quotedIdentifier([NSString stringWithFormat:@"changed_%@_delete", name])];
+		
+		if(SQLITE_OK != sqlite3_exec(db, [sql UTF8String], NULL, NULL, NULL))
+			return NO;
+	}
+	
+	return YES;
+}
+
+// ========================================
+// Copy the logged changes in db to destination
+int
+copyLoggedChanges(sqlite3			*db,
+				  sqlite3			*destination)
+{
+	NSCParameterAssert(NULL != db);
+	NSCParameterAssert(NULL != destination);
+	
+	sqlite3_mutex	*mutex			= sqlite3_db_mutex(db);
+	NSMutableArray	*changes		= [NSMutableArray array];
+	NSMutableArray	*sequences		= [NSMutableArray array];
+	NSUInteger		rowCount		= 0;
+	int				result			= SQLITE_OK;
+	
+	// Read the changed rows while nothing else can use the connection, so they are consistent with each other
+	sqlite3_mutex_enter(mutex);
+	
+	if(0 == sqlite3_get_autocommit(db)) {
+		sqlite3_mutex_leave(mutex);
+		return SQLITE_BUSY;
+	}
+	
+	NSArray *tables = loggedTables(db);
+	if(nil == tables)
+		result = SQLITE_ERROR;
+	
+	for(NSDictionary *table in tables) {
+		NSArray			*keys			= [table objectForKey:@"keys"];
+		NSArray			*columns		= [table objectForKey:@"columns"];
+		NSMutableArray	*selectColumns	= [NSMutableArray array];
+		NSMutableArray	*joinTerms		= [NSMutableArray array];
+		NSMutableArray	*rows			= [NSMutableArray array];
+		sqlite3_stmt	*statement		= NULL;
+		
+		// Each row is whether it still exists, its key and then its values
+		[selectColumns addObject:[NSString stringWithFormat:@"%@ IS NOT NULL", columnReference(@"t", [keys objectAtIndex:0])]];
+		for(NSUInteger i = 0; i < [keys count]; ++i) {
+			[selectColumns addObject:[NSString stringWithFormat:@"l.key%lu", (unsigned long)i]];
+			[joinTerms addObject:[NSString stringWithFormat:@"%@ = l.key%lu", columnReference(@"t", [keys objectAtIndex:i]), (unsigned long)i]];
+		}
+		for(NSString *column in columns)
+			[selectColumns addObject:columnReference(@"t", column)];
+		
+		NSString *sql = [NSString stringWithFormat:@"SELECT %@ FROM temp.%@ AS l LEFT JOIN main.%@ AS t ON %@",
+						 [selectColumns componentsJoinedByString:@", "], logTableName(table), quotedIdentifier([table objectForKey:@"name"]), [joinTerms componentsJoinedByString:@" AND "]];
+		
+		result = sqlite3_prepare_v2(db, [sql UTF8String], -1, &statement, NULL);
+		if(SQLITE_OK != result)
+			break;
+		
+		while(SQLITE_ROW == (result = sqlite3_step(statement))) {
+			NSMutableArray *row = [NSMutableArray arrayWithCapacity:[selectColumns count]];
+			for(int i = 0; i < (int)[selectColumns count]; ++i)
+				[row addObject:columnObject(statement, i)];
+			[rows addObject:row];
+		}
+		
+		sqlite3_finalize(statement);
+		
+		if(SQLITE_DONE != result)
+			break;
+		
+		result = SQLITE_OK;
+		rowCount += [rows count];
+		
+		if([rows count])
+			[changes addObject:[NSArray arrayWithObjects:table, rows, nil]];
+	}
+	
+	// Triggers can't be placed on sqlite_sequence, so the AUTOINCREMENT counters are copied in full
+	// to keep the IDs of deleted rows from being handed out again
+	if(SQLITE_OK == result && 0 != rowCount) {
+		sqlite3_stmt *statement = NULL;
+		
+		if(SQLITE_OK == sqlite3_prepare_v2(db, "SELECT name, seq FROM main.sqlite_sequence", -1, &statement, NULL)) {
+			while(SQLITE_ROW == sqlite3_step(statement))
+				[sequences addObject:[NSArray arrayWithObjects:columnObject(statement, 0), columnObject(statement, 1), nil]];
+			sqlite3_finalize(statement);
+		}
+	}
+	
+	// The rows are in hand (or a full copy is needed), so the log starts over
+	clearLogTables(db, tables);
+	
+	sqlite3_mutex_leave(mutex);
+	
+	if(SQLITE_OK != result || 0 == rowCount)
+		return result;
+	
+	result = sqlite3_exec(destination, "BEGIN IMMEDIATE TRANSACTION", NULL, NULL, NULL);
+	
+	// Deletions go first so a row that took the place of a deleted one can't conflict with it
+	// Rows are written individually so the destination's own triggers keep its virtual tables current,
+	// and with OR REPLACE since INSERT OR REPLACE in db removes conflicting rows without logging them
+	for(NSUInteger pass = 0; SQLITE_OK == result && pass < 2; ++pass) {
+		for(NSArray *change in changes) {
+			NSDictionary	*table				= [change objectAtIndex:0];
+			NSString		*name				= quotedIdentifier([table objectForKey:@"name"]);
+			NSArray			*keys				= [table objectForKey:@"keys"];
+			NSArray			*columns			= [table objectForKey:@"columns"];
+			NSUInteger		keyCount			= [keys count];
+			NSUInteger		columnCount			= [columns count];
+			NSUInteger		valueCount			= ([[columns lastObject] isEqualToString:@"rowid"] ? columnCount - 1 : columnCount);
+			NSMutableArray	*keyTerms			= [NSMutableArray array];
+			NSMutableArray	*assignments		= [NSMutableArray array];
+			NSMutableArray	*placeholders		= [NSMutableArray array];
+			NSMutableArray	*quotedColumns		= [NSMutableArray array];
+			sqlite3_stmt	*deleteStatement	= NULL;
+			sqlite3_stmt	*updateStatement	= NULL;
+			sqlite3_stmt	*insertStatement	= NULL;
+			
+			for(NSUInteger i = 0; i < keyCount; ++i)
+				[keyTerms addObject:[NSString stringWithFormat:@"%@ = ?", columnReference(name, [keys objectAtIndex:i])]];
+			for(NSUInteger i = 0; i < columnCount; ++i) {
+				NSString *column = [columns objectAtIndex:i];
+				if(i < valueCount)
+					[assignments addObject:[NSString stringWithFormat:@"%@ = ?", quotedIdentifier(column)]];
+				[quotedColumns addObject:([column isEqualToString:@"rowid"] ? column : quotedIdentifier(column))];
+				[placeholders addObject:@"?"];
+			}
+			
+			NSString *whereClause = [keyTerms componentsJoinedByString:@" AND "];
+			
+			if(0 == pass)
+				result = sqlite3_prepare_v2(destination, [[NSString stringWithFormat:@"DELETE FROM main.%@ WHERE %@", name, whereClause] UTF8String], -1, &deleteStatement, NULL);
+			else {
+				result = sqlite3_prepare_v2(destination, [[NSString stringWithFormat:@"UPDATE OR REPLACE main.%@ SET %@ WHERE %@", name, [assignments componentsJoinedByString:@", "], whereClause] UTF8String], -1, &updateStatement, NULL);
+				if(SQLITE_OK == result)
+					result = sqlite3_prepare_v2(destination, [[NSString stringWithFormat:@"INSERT OR REPLACE INTO main.%@ (%@) VALUES (%@)", name, [quotedColumns componentsJoinedByString:@", "], [placeholders componentsJoinedByString:@", "]] UTF8String], -1, &insertStatement, NULL);
+			}
+			
+			for(NSArray *row in [change objectAtIndex:1]) {
+				if(SQLITE_OK != result)
+					break;
+				
+				BOOL exists = [[row objectAtIndex:0] boolValue];
+				
+				if(0 == pass && NO == exists) {
+					result = bindObjects(deleteStatement, 1, row, NSMakeRange(1, keyCount));
+					if(SQLITE_OK == result)
+						result = (SQLITE_DONE == sqlite3_step(deleteStatement) ? SQLITE_OK : sqlite3_errcode(destination));
+					sqlite3_reset(deleteStatement);
+				}
+				else if(1 == pass && exists) {
+					// Update the row if the destination has it, otherwise insert it
+					result = bindObjects(updateStatement, 1, row, NSMakeRange(1 + keyCount, valueCount));
+					if(SQLITE_OK == result)
+						result = bindObjects(updateStatement, 1 + (int)valueCount, row, NSMakeRange(1, keyCount));
+					if(SQLITE_OK == result)
+						result = (SQLITE_DONE == sqlite3_step(updateStatement) ? SQLITE_OK : sqlite3_errcode(destination));
+					sqlite3_reset(updateStatement);
+					
+					if(SQLITE_OK == result && 0 == sqlite3_changes(destination)) {
+						result = bindObjects(insertStatement, 1, row, NSMakeRange(1 + keyCount, columnCount));
+						if(SQLITE_OK == result)
+							result = (SQLITE_DONE == sqlite3_step(insertStatement) ? SQLITE_OK : sqlite3_errcode(destination));
+						sqlite3_reset(insertStatement);
+					}
+				}
+			}
+			
+			sqlite3_finalize(deleteStatement);
+			sqlite3_finalize(updateStatement);
+			sqlite3_finalize(insertStatement);
+			
+			if(SQLITE_OK != result)
+				break;
+		}
+	}
+	
+	if(SQLITE_OK == result && 0 != [sequences count]) {
+		sqlite3_stmt	*updateStatement	= NULL;
+		sqlite3_stmt	*insertStatement	= NULL;
+		
+		result = sqlite3_prepare_v2(destination, "UPDATE main.sqlite_sequence SET seq = ?2 WHERE name = ?1", -1, &updateStatement, NULL);
+		if(SQLITE_OK == result)
+			result = sqlite3_prepare_v2(destination, "INSERT INTO main.sqlite_sequence (name, seq) VALUES (?1, ?2)", -1, &insertStatement, NULL);
+		
+		for(NSArray *sequence in sequences) {
+			if(SQLITE_OK != result)
+				break;
+			
+			result = bindObjects(updateStatement, 1, sequence, NSMakeRange(0, 2));
+			if(SQLITE_OK == result)
+				result = (SQLITE_DONE == sqlite3_step(updateStatement) ? SQLITE_OK : sqlite3_errcode(destination));
+			sqlite3_reset(updateStatement);
+			
+			if(SQLITE_OK == result && 0 == sqlite3_changes(destination)) {
+				result = bindObjects(insertStatement, 1, sequence, NSMakeRange(0, 2));
+				if(SQLITE_OK == result)
+					result = (SQLITE_DONE == sqlite3_step(insertStatement) ? SQLITE_OK : sqlite3_errcode(destination));
+				sqlite3_reset(insertStatement);
+			}
+		}
+		
+		sqlite3_finalize(updateStatement);
+		sqlite3_finalize(insertStatement);
+	}
+	
+	if(SQLITE_OK == result)
+		result = sqlite3_exec(destination, "COMMIT TRANSACTION", NULL, NULL, NULL);
+	
+	// A busy destination is still a failure, since the log is gone
+	if(SQLITE_OK != result) {
+		sqlite3_exec(destination, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+		if(SQLITE_BUSY == result)
+			result = SQLITE_ERROR;
+	}
+	
+	return result;
+}
+
+// ========================================
+// Clear the logged changes in db
+void
+discardLoggedChanges(sqlite3		*db)
+{
+	NSCParameterAssert(NULL != db);
+	
+	sqlite3_mutex *mutex = sqlite3_db_mutex(db);
+	
+	sqlite3_mutex_enter(mutex);
+	clearLogTables(db, loggedTables(db));
+	sqlite3_mutex_leave(mutex);
+}
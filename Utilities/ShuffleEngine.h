@@ -0,0 +1,97 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import <Cocoa/Cocoa.h>
+
+// ========================================
+// Random playback order for a list of items, driven by SFMT
+// Every index is drawn once, in random order, before any index repeats,
+// and each draw is O(1).  The order follows insertions into and removals
+// from the list without reshuffling: inserted items join the items not yet
+// drawn and removed items are dropped.
+// ========================================
+@interface ShuffleEngine : NSObject
+{
+	@private
+	NSUInteger		*_order;		// A permutation of the list indexes; [0, _position) have been drawn this pass
+	NSUInteger		*_slots;		// The inverse of _order, mapping list indexes to slots
+	NSUInteger		_count;
+	NSUInteger		_capacity;
+	NSUInteger		_position;
+}
+
+- (id) initWithCount:(NSUInteger)count;
+
+- (NSUInteger) count;
+
+// Marks currentIndex as drawn and draws the next index, starting a new pass if all have been drawn
+// currentIndex (which may be NSNotFound) is only returned again if it is the only index
+- (NSUInteger) nextIndexAfterIndex:(NSUInteger)currentIndex;
+
+// Returns the index drawn just before index in this pass, or NSNotFound
+- (NSUInteger) indexDrawnBeforeIndex:(NSUInteger)index;
+
+// For items chosen directly rather than drawn
+- (void) markIndexAsDrawn:(NSUInteger)index;
+
+// Keeping the order in step with the list
+// Indexes have the same meaning as in NSKeyValueChangeIndexesKey
+- (void) insertIndexes:(NSIndexSet *)indexes;
+- (void) removeIndexes:(NSIndexSet *)indexes;
+- (void) resetWithCount:(NSUInteger)count;
+
+@end
+
+// ========================================
+// Weighted sampling using Vose's alias method, driven by SFMT
+// Setup is O(n) and each sample is O(1)
+// ========================================
+@interface WeightedIndexSampler : NSObject
+{
+	@private
+	double			*_probabilities;
+	NSUInteger		*_aliases;
+	NSUInteger		_count;
+}
+
+// Weights must be non-negative; if they are all zero every index is equally likely
+- (id) initWithWeights:(const double *)weights count:(NSUInteger)count;
+
+- (NSUInteger) nextIndex;
+
+// Returns up to count distinct indexes (as NSNumbers) in the order they were drawn
+- (NSArray *) indexesWithoutReplacement:(NSUInteger)count;
+
+@end
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// Returns an integer uniformly distributed in [0, upperBound), without modulo bias
+	NSUInteger randomIndexLessThan(NSUInteger upperBound);
+	
+	// Returns min(count, upperBound) distinct integers (as NSNumbers) from [0, upperBound) in random order
+	// Runs in O(count) regardless of upperBound
+	NSArray * randomIndexesWithoutReplacement(NSUInteger upperBound, NSUInteger count);
+
+#ifdef __cplusplus
+}
+#endif
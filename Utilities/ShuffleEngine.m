@@ -0,0 +1,360 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "ShuffleEngine.h"
+
+#include "SFMT.h"
+
+// Rejection sampling attempts per requested index before WeightedIndexSampler gives up on the weights
+#define WEIGHTED_SAMPLING_ATTEMPTS		16
+
+NSUInteger
+randomIndexLessThan(NSUInteger upperBound)
+{
+	NSCParameterAssert(0 < upperBound && UINT32_MAX >= upperBound);
+	
+	// Values below threshold would make the low residues more likely
+	uint32_t	bound		= (uint32_t)upperBound;
+	uint32_t	threshold	= (uint32_t)(-bound) % bound;
+	uint32_t	value;
+	
+	do {
+		value = gen_rand32();
+	} while(value < threshold);
+	
+	return value % bound;
+}
+
+NSArray *
+randomIndexesWithoutReplacement(NSUInteger upperBound, NSUInteger count)
+{
+	count = MIN(count, upperBound);
+	
+	NSMutableArray		*indexes	= [NSMutableArray arrayWithCapacity:count];
+	NSMutableDictionary	*swapped	= [NSMutableDictionary dictionary];
+	
+	// A Fisher-Yates shuffle stopped after count steps, storing only the displaced entries
+	for(NSUInteger i = 0; i < count; ++i) {
+		NSNumber	*slot			= [NSNumber numberWithUnsignedInteger:i + randomIndexLessThan(upperBound - i)];
+		NSNumber	*current		= [NSNumber numberWithUnsignedInteger:i];
+		NSNumber	*chosen			= [swapped objectForKey:slot];
+		NSNumber	*displaced		= [swapped objectForKey:current];
+		
+		[indexes addObject:(nil != chosen ? chosen : slot)];
+		[swapped setObject:(nil != displaced ? displaced : current) forKey:slot];
+	}
+	
+	return indexes;
+}
+
+@interface ShuffleEngine (Private)
+- (void) ensureCapacity:(NSUInteger)capacity;
+- (void) exchangeSlot:(NSUInteger)slot withSlot:(NSUInteger)otherSlot;
+- (void) rebuildSlots;
+@end
+
+@implementation ShuffleEngine
+
+- (id) init
+{
+	return [self initWithCount:0];
+}
+
+- (id) initWithCount:(NSUInteger)count
+{
+	if((self = [super init]))
+		[self resetWithCount:count];
+	return self;
+}
+
+- (void) dealloc
+{
+	free(_order);
+	free(_slots);
+}
+
+- (NSUInteger) count
+{
+	return _count;
+}
+
+- (NSUInteger) nextIndexAfterIndex:(NSUInteger)currentIndex
+{
+	if(0 == _count)
+		return NSNotFound;
+	
+	if(currentIndex < _count)
+		[self markIndexAsDrawn:currentIndex];
+	
+	if(_count == _position)
+		_position = 0;
+	
+	NSUInteger remaining	= _count - _position;
+	NSUInteger slot			= _position + randomIndexLessThan(remaining);
+	
+	// This can only happen at the start of a pass; pick uniformly among the other slots instead
+	if(_order[slot] == currentIndex && 1 < remaining)
+		slot = _position + ((slot - _position) + 1 + randomIndexLessThan(remaining - 1)) % remaining;
+	
+	[self exchangeSlot:_position withSlot:slot];
+	
+	return _order[_position++];
+}
+
+- (NSUInteger) indexDrawnBeforeIndex:(NSUInteger)index
+{
+	if(index >= _count)
+		return NSNotFound;
+	
+	NSUInteger slot = _slots[index];
+	return (0 < slot && slot < _position ? _order[slot - 1] : NSNotFound);
+}
+
+- (void) markIndexAsDrawn:(NSUInteger)index
+{
+	if(index >= _count || _slots[index] < _position)
+		return;
+	
+	[self exchangeSlot:_position withSlot:_slots[index]];
+	++_position;
+}
+
+- (void) insertIndexes:(NSIndexSet *)indexes
+{
+	NSParameterAssert(nil != indexes);
+	
+	NSUInteger insertedCount	= [indexes count];
+	NSUInteger newCount			= _count + insertedCount;
+	
+	if(0 == insertedCount)
+		return;
+	
+	[self ensureCapacity:newCount];
+	
+	// Map each existing index to its index after the insertion, using _slots as scratch space
+	NSUInteger oldIndex = 0;
+	for(NSUInteger newIndex = 0; newIndex < newCount; ++newIndex)
+		if(NO == [indexes containsIndex:newIndex])
+			_slots[oldIndex++] = newIndex;
+	
+	for(NSUInteger slot = 0; slot < _count; ++slot)
+		_order[slot] = _slots[_order[slot]];
+	
+	// New items go after everything else, among the items not yet drawn
+	NSUInteger index = [indexes firstIndex];
+	while(NSNotFound != index) {
+		_order[_count++] = index;
+		index = [indexes indexGreaterThanIndex:index];
+	}
+	
+	[self rebuildSlots];
+}
+
+- (void) removeIndexes:(NSIndexSet *)indexes
+{
+	NSParameterAssert(nil != indexes);
+	
+	if(0 == [indexes count])
+		return;
+	
+	// Map each surviving index to its index after the removal, using _slots as scratch space
+	NSUInteger newIndex = 0;
+	for(NSUInteger oldIndex = 0; oldIndex < _count; ++oldIndex)
+		_slots[oldIndex] = ([indexes containsIndex:oldIndex] ? NSNotFound : newIndex++);
+	
+	// Compact the order, keeping the drawn items ahead of the rest
+	NSUInteger newPosition	= 0;
+	NSUInteger newSlot		= 0;
+	for(NSUInteger slot = 0; slot < _count; ++slot) {
+		NSUInteger mappedIndex = _slots[_order[slot]];
+		if(NSNotFound == mappedIndex)
+			continue;
+		
+		if(slot < _position)
+			++newPosition;
+		
+		_order[newSlot++] = mappedIndex;
+	}
+	
+	_count		= newSlot;
+	_position	= newPosition;
+	
+	[self rebuildSlots];
+}
+
+- (void) resetWithCount:(NSUInteger)count
+{
+	[self ensureCapacity:count];
+	
+	for(NSUInteger i = 0; i < count; ++i)
+		_order[i] = _slots[i] = i;
+	
+	_count		= count;
+	_position	= 0;
+}
+
+@end
+
+@implementation ShuffleEngine (Private)
+
+- (void) ensureCapacity:(NSUInteger)capacity
+{
+	if(capacity <= _capacity)
+		return;
+	
+	NSUInteger newCapacity = MAX(capacity, 2 * _capacity);
+	
+	_order		= realloc(_order, newCapacity * sizeof(NSUInteger));
+	_slots		= realloc(_slots, newCapacity * sizeof(NSUInteger));
+	_capacity	= newCapacity;
+	
+	NSAssert(NULL != _order && NULL != _slots, @"Unable to allocate memory");
+}
+
+- (void) exchangeSlot:(NSUInteger)slot withSlot:(NSUInteger)otherSlot
+{
+	NSUInteger index		= _order[slot];
+	NSUInteger otherIndex	= _order[otherSlot];
+	
+	_order[slot]			= otherIndex;
+	_order[otherSlot]		= index;
+	_slots[otherIndex]		= slot;
+	_slots[index]			= otherSlot;
+}
+
+- (void) rebuildSlots
+{
+	for(NSUInteger slot = 0; slot < _count; ++slot)
+		_slots[_order[slot]] = slot;
+}
+
+@end
+
+@implementation WeightedIndexSampler
+
+- (id) initWithWeights:(const double *)weights count:(NSUInteger)count
+{
+	NSParameterAssert(NULL != weights || 0 == count);
+	
+	if((self = [super init])) {
+		_count			= count;
+		_probabilities	= calloc(MAX(count, 1U), sizeof(double));
+		_aliases		= calloc(MAX(count, 1U), sizeof(NSUInteger));
+		
+		NSUInteger	*small			= calloc(MAX(count, 1U), sizeof(NSUInteger));
+		NSUInteger	*large			= calloc(MAX(count, 1U), sizeof(NSUInteger));
+		NSUInteger	smallCount		= 0;
+		NSUInteger	largeCount		= 0;
+		double		total			= 0;
+		
+		if(NULL == _probabilities || NULL == _aliases || NULL == small || NULL == large) {
+			free(small);
+			free(large);
+			return nil;
+		}
+		
+		for(NSUInteger i = 0; i < count; ++i)
+			total += MAX(weights[i], 0.);
+		
+		// Scale the weights so they average to 1, then pair each light entry with a heavy one
+		for(NSUInteger i = 0; i < count; ++i) {
+			_probabilities[i] = (0 < total ? MAX(weights[i], 0.) * count / total : 1);
+			_aliases[i] = i;
+			
+			if(1 > _probabilities[i])
+				small[smallCount++] = i;
+			else
+				large[largeCount++] = i;
+		}
+		
+		while(0 < smallCount && 0 < largeCount) {
+			NSUInteger light	= small[--smallCount];
+			NSUInteger heavy	= large[largeCount - 1];
+			
+			_aliases[light] = heavy;
+			_probabilities[heavy] -= 1 - _probabilities[light];
+			
+			if(1 > _probabilities[heavy]) {
+				--largeCount;
+				small[smallCount++] = heavy;
+			}
+		}
+		
+		// Whatever is left over is 1 up to rounding error
+		while(0 < largeCount)
+			_probabilities[large[--largeCount]] = 1;
+		while(0 < smallCount)
+			_probabilities[small[--smallCount]] = 1;
+		
+		free(small);
+		free(large);
+	}
+	return self;
+}
+
+- (void) dealloc
+{
+	free(_probabilities);
+	free(_aliases);
+}
+
+- (NSUInteger) nextIndex
+{
+	if(0 == _count)
+		return NSNotFound;
+	
+	NSUInteger index = randomIndexLessThan(_count);
+	return (genrand_real2() < _probabilities[index] ? index : _aliases[index]);
+}
+
+- (NSArray *) indexesWithoutReplacement:(NSUInteger)count
+{
+	count = MIN(count, _count);
+	
+	NSMutableArray		*indexes		= [NSMutableArray arrayWithCapacity:count];
+	NSMutableIndexSet	*chosen			= [NSMutableIndexSet indexSet];
+	NSUInteger			attempts		= WEIGHTED_SAMPLING_ATTEMPTS * count;
+	
+	// Repeats are rejected, so the result follows the weights of the items not yet chosen
+	while([indexes count] < count && 0 < attempts--) {
+		NSUInteger index = [self nextIndex];
+		if([chosen containsIndex:index])
+			continue;
+		
+		[chosen addIndex:index];
+		[indexes addObject:[NSNumber numberWithUnsignedInteger:index]];
+	}
+	
+	// If a few heavy items crowd out the rest, fill up uniformly from what's left
+	if([indexes count] < count) {
+		for(NSNumber *index in randomIndexesWithoutReplacement(_count, _count)) {
+			if([chosen containsIndex:[index unsignedIntegerValue]])
+				continue;
+			
+			[indexes addObject:index];
+			if([indexes count] == count)
+				break;
+		}
+	}
+	
+	return indexes;
+}
+
+@end
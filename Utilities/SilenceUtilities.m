@@ -0,0 +1,112 @@
+/*
+ *  $Id$
+ *
+ *  Copyright (C) 2006 - 2007 Stephen F. Booth <me@sbooth.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#import "SilenceUtilities.h"
+
+#include <Accelerate/Accelerate.h>
+
+#define BUFFER_LENGTH			4096
+
+// Samples below -60 dBFS are considered silent
+#define SILENCE_THRESHOLD		0.001f
+
+BOOL
+calculateSilenceBoundaries(id <AudioDecoderMethods> decoder, NSTimeInterval *leadingSilence, NSTimeInterval *trailingSilence)
+{
+	NSCParameterAssert(nil != decoder);
+	NSCParameterAssert(NULL != leadingSilence);
+	NSCParameterAssert(NULL != trailingSilence);
+	
+	AudioStreamBasicDescription		format				= [decoder format];
+	SInt64							firstAudibleFrame	= -1;
+	SInt64							lastAudibleFrame	= -1;
+	SInt64							frame				= 0;
+	UInt32							framesRead			= 0;
+	UInt32							i, j;
+	
+	if(0 == format.mChannelsPerFrame || 0 >= format.mSampleRate)
+		return NO;
+	
+	// Allocate the AudioBufferList for the decoder to use, with one block of memory backing all the channels
+	AudioBufferList		*bufferList		= calloc(sizeof(AudioBufferList) + (sizeof(AudioBuffer) * (format.mChannelsPerFrame - 1)), 1);
+	float				*samples		= calloc(BUFFER_LENGTH * format.mChannelsPerFrame, sizeof(float));
+	if(NULL == bufferList || NULL == samples) {
+		free(bufferList);
+		free(samples);
+		return NO;
+	}
+	
+	bufferList->mNumberBuffers = format.mChannelsPerFrame;
+	
+	for(i = 0; i < bufferList->mNumberBuffers; ++i) {
+		bufferList->mBuffers[i].mData = samples + (i * BUFFER_LENGTH);
+		bufferList->mBuffers[i].mNumberChannels = 1;
+	}
+	
+	for(;;) {
+		for(i = 0; i < bufferList->mNumberBuffers; ++i)
+			bufferList->mBuffers[i].mDataByteSize = BUFFER_LENGTH * sizeof(float);
+		
+		framesRead = [decoder readAudio:bufferList frameCount:BUFFER_LENGTH];
+		if(0 == framesRead)
+			break;
+		
+		for(i = 0; i < bufferList->mNumberBuffers; ++i) {
+			const float		*buffer			= bufferList->mBuffers[i].mData;
+			float			peak			= 0;
+			
+			// Most buffers are entirely audible or entirely silent, so only look closer when necessary
+			vDSP_maxmgv(buffer, 1, &peak, framesRead);
+			if(SILENCE_THRESHOLD > peak)
+				continue;
+			
+			if(-1 == firstAudibleFrame || frame < firstAudibleFrame) {
+				for(j = 0; j < framesRead && SILENCE_THRESHOLD > fabsf(buffer[j]); ++j)
+					;
+				if(-1 == firstAudibleFrame || frame + j < firstAudibleFrame)
+					firstAudibleFrame = frame + j;
+			}
+			
+			for(j = framesRead; 0 < j && SILENCE_THRESHOLD > fabsf(buffer[j - 1]); --j)
+				;
+			if(frame + j - 1 > lastAudibleFrame)
+				lastAudibleFrame = frame + j - 1;
+		}
+		
+		frame += framesRead;
+	}
+	
+	free(samples);
+	free(bufferList);
+	
+	if(0 == frame)
+		return NO;
+	
+	if(-1 == firstAudibleFrame) {
+		*leadingSilence		= 0;
+		*trailingSilence	= 0;
+	}
+	else {
+		*leadingSilence		= firstAudibleFrame / format.mSampleRate;
+		*trailingSilence	= (frame - lastAudibleFrame - 1) / format.mSampleRate;
+	}
+	
+	return YES;
+}
@@ -46,6 +46,9 @@ extern "C" {
 	
 	NSTreeNode * treeNodeForRepresentedObject(NSTreeNode *root, id representedObject);
 
+	// Determine the size, modification date and inode of a file (keyed by FileSizeKey, etc.)
+	NSDictionary * getFileStampForURL(NSURL *url);
+
 #ifdef __cplusplus
 }
 #endif
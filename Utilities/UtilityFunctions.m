@@ -19,9 +19,11 @@
  */
 
 #import "UtilityFunctions.h"
+#import "AudioStream.h"
 
 #include <AudioToolbox/AudioFile.h>
 #include <ogg/ogg.h>
+#include <sys/stat.h>
 
 static NSArray		*sBuiltinExtensions		= nil;
 static NSArray		*sCoreAudioExtensions	= nil;
@@ -244,3 +246,22 @@ treeNodeForRepresentedObject(NSTreeNode *root, id representedObject)
 	
 	return match;
 }
+
+NSDictionary *
+getFileStampForURL(NSURL *url)
+{
+	NSCParameterAssert(nil != url);
+	
+	struct stat		sb;
+	
+	if(NO == [url isFileURL] || -1 == stat([[url path] fileSystemRepresentation], &sb))
+		return nil;
+	
+	NSTimeInterval modificationTime = sb.st_mtimespec.tv_sec + (sb.st_mtimespec.tv_nsec / 1000000000.0);
+	
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+		[NSNumber numberWithLongLong:sb.st_size], FileSizeKey,
+		[NSDate dateWithTimeIntervalSince1970:modificationTime], FileModificationDateKey,
+		[NSNumber numberWithUnsignedLongLong:sb.st_ino], FileInodeKey,
+		nil];
+}